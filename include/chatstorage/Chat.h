@@ -48,11 +48,13 @@ public:
 
 private:
   void setDatabaseId(int64_t database_id);
+  void setName(const std::string &name);
 
   int64_t mRuntimeId;
   int64_t mDatabaseId;
   std::string mName;
   ChatSource mSource;
+  bool mChanged = false;     // a persisted chat with changes that aren't saved
 };
 
 #endif /* CHAT_H_ */
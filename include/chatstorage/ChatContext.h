@@ -17,12 +17,25 @@
 #include <memory>
 #include <vector>
 #include <unordered_map>
+#include <optional>
 
 // forward declarations
 class ChatRepository;
 class UserRepository;
 class MessageRepository;
 class MediaRepository;
+class MessageIndex;
+
+/**
+ * Filter criteria for ChatContext::findMessages(). All set criteria are combined (AND).
+ */
+struct MessageFilter
+{
+  std::optional<int64_t> sender_runtime_id;
+  std::optional<int64_t> from_timestamp; // inclusive
+  std::optional<int64_t> to_timestamp;   // exclusive
+  bool has_media = false;
+};
 
 /**
  * ChatContext ensures a consistent runtime set of Chat, Users and Messages.
@@ -30,8 +43,14 @@ class MediaRepository;
  */
 class ChatContext
 {
+  /**
+   * friend is needed to prepare all lazy state before the context is shared read-only
+   */
+  friend class ChatSnapshot;
+
 public:
-  ChatContext() = default;
+  ChatContext();
+  ~ChatContext();
 
   // Copy constructor is disabled: ChatContext cannot be copied
   ChatContext(const ChatContext&) = delete;
@@ -74,11 +93,102 @@ public:
 
   const Media& getMediaByMediaDatabaseId(int64_t media_database_id) const;
 
-  void persistChat(ChatRepository& chat_repo);
-  void persistUsers(UserRepository& user_repo);
-  void persistMessages(MessageRepository& message_repo);
-  void persistMedia(MediaRepository &media_repo);
+  bool hasUserWithDatabaseId(int64_t user_database_id) const;
+
+  bool hasMediaWithDatabaseId(int64_t media_database_id) const;
+
+  /**
+   * @return the highest database ID of all persisted messages or Message::DB_NO_ID if no message is persisted
+   */
+  int64_t getLastMessageDatabaseId() const;
+
+  /**
+   * The next free runtime IDs to append new objects to the context.
+   */
+  int64_t nextUserRuntimeId() const;
+  int64_t nextMediaRuntimeId() const;
+  int64_t nextMessageRuntimeId() const;
+
+  /**
+   * Changes of the objects in the context. The objects are marked as changed, so the next save() only updates
+   * their rows instead of writing the complete chat.
+   */
+  void setChatName(const std::string &name);
+  void setUserName(int64_t user_runtime_id, const std::string &name);
+  void setMediaType(int64_t media_runtime_id, MediaType type, const std::string &mime_type);
+
+  /**
+   * An edited message doesn't match its export any longer, so it loses its fingerprint.
+   *
+   * @param message_index index into getMessageList()
+   */
+  void setMessageText(size_t message_index, const std::string &text);
+  void setMessageTimestamp(size_t message_index, int64_t timestamp);
+
+  /**
+   * @return true if a save() has to write anything: new objects or changes of persisted objects
+   */
+  bool hasChanges() const;
+
+  /**
+   * The persist functions insert the new objects, update the changed ones and reset the change tracking. The costs
+   * depend on the number of changes and not on the size of the chat.
+   *
+   * @return false if a row couldn't be written (or an updated row doesn't exist any longer); the transaction has to
+   *         be rolled back then
+   */
+  bool persistChat(ChatRepository& chat_repo);
+  bool persistUsers(UserRepository& user_repo);
+  /**
+   * @return the number of new messages with a fingerprint the chat yet has in the database; they aren't inserted again
+   */
+  size_t persistMessages(MessageRepository& message_repo);
+
+  /**
+   * Result of persistMessageBatch()
+   */
+  struct MessageBatch
+  {
+    size_t messages = 0;   // inserted or updated
+    size_t existing = 0;   // see persistMessages()
+    size_t bytes = 0;      // message text
+    int64_t first_inserted_id = Message::DB_NO_ID;
+    bool failed = false;   // a message couldn't be written, the batch ends in front of it
+    bool done = false;     // all new and changed messages are persisted
+  };
 
+  /**
+   * Persists the next max_messages of the new and changed messages, so a big save could be split into several
+   * transactions. Call it until MessageBatch::done.
+   */
+  MessageBatch persistMessageBatch(MessageRepository& message_repo, size_t max_messages);
+
+  /**
+   * The database changes of the last batch were rolled back: its messages and all not yet persisted ones are
+   * staged again, so the next save() writes them.
+   */
+  void rollbackMessageBatch();
+
+  /**
+   * The persist functions run inside a transaction that may be rolled back. beginPersist() remembers the database IDs
+   * and the change tracking in front of them and rollbackPersist() restores it, so the context has all its changes
+   * again and the next save() writes them. commitPersist() moves the restore point to the current state after a part
+   * of the save is committed, endPersist() drops it after the last commit.
+   */
+  void beginPersist();
+  void commitPersist();
+  void rollbackPersist();
+  void endPersist();
+
+  /**
+   * @param out_deduplicated the number of new Media objects that reference a yet stored file with the same content hash
+   * @return see persistChat()
+   */
+  bool persistMedia(MediaRepository &media_repo, size_t &out_deduplicated);
+
+  /**
+   * Appends a message. If the message index was yet built it's updated incrementally.
+   */
   void addMessage(Message message);
 
   void addMedia(Media media_obj);
@@ -92,8 +202,20 @@ public:
 
   const std::vector<Message>& getMessageList() const;
 
+  /**
+   * The mutable access drops the message index as the list may be changed by the caller. The next save() has to
+   * check all messages for new ones then.
+   */
   std::vector<Message>& getMessageList();
 
+  /**
+   * Find all messages matching the filter. The per-sender and media posting lists are built on first use,
+   * so the costs of a query are proportional to the result size and not to the message count.
+   *
+   * @return the indices into getMessageList() in ascending order
+   */
+  std::vector<size_t> findMessages(const MessageFilter &filter) const;
+
   /**
    * Replaces the current media list.
    * The input vector is taken by value and moved into the context.
@@ -103,9 +225,28 @@ public:
 
   std::vector<Media> getMediaList() const;
 
+  /**
+   * The mutable access must not change the order or the IDs of the Media objects.
+   */
+  std::vector<Media>& getMediaList();
+
   void addRuntimeToDatabaseUserMapping(int64_t runtime_id, int64_t database_id);
 
+  /**
+   * Creates an explicit deep copy of the context. The copy constructor stays disabled to prevent unintended copies.
+   */
+  std::unique_ptr<ChatContext> clone() const;
+
+  /**
+   * Estimated heap and object memory of the context in bytes.
+   */
+  size_t getMemoryUsage() const;
+
 private:
+  void ensureMessageIndex() const;
+
+  void stageMessage(size_t message_index);
+
   std::unique_ptr<Chat> mChat;
   std::vector<User> mUserList;
   std::vector<Message> mMessageList;
@@ -115,6 +256,37 @@ private:
   std::unordered_map<int64_t, size_t> mMediaIndexByRuntimeId;
   std::unordered_map<int64_t, size_t> mMediaIndexByDatabaseId;
 
+  // message list indices of the new and changed messages since the last persist (a flag per message would cost
+  // memory for all loaded messages); set by the mutable list access that might add messages without tracking
+  std::vector<size_t> mStagedMessages;
+  bool mMessagesUntracked = false;
+
+  // the sorted staged messages while they are persisted in batches, the position of the next and the current batch
+  std::vector<size_t> mPersistQueue;
+  size_t mPersistPos = 0;
+  size_t mBatchBegin = 0;
+  std::vector<size_t> mBatchInserted;
+
+  // restore point of a running save, see beginPersist()
+  struct PersistState
+  {
+    int64_t chat_id = Chat::DB_NO_ID;
+    bool chat_changed = false;
+    std::vector<std::pair<int64_t /* database_id */, bool /* changed */>> users;
+    std::vector<std::pair<int64_t /* database_id */, bool /* changed */>> media;
+    std::unordered_map<int64_t, size_t> user_index_by_database_id;
+    std::unordered_map<int64_t, size_t> media_index_by_database_id;
+    std::vector<size_t> staged_messages;
+    bool messages_untracked = false;
+    std::vector<size_t> assigned_messages; // got their database ID after the restore point
+  };
+  std::unique_ptr<PersistState> mPersistState;
+
+  void savePersistState();
+
+  // lazy created on first findMessages() call
+  mutable std::unique_ptr<MessageIndex> mMessageIndex;
+
   // this is a specific mapping to allow User Imports with specific existing database IDs
   std::vector<std::pair<int64_t /* User runtime_id */, int64_t /* User database_id */>> mRuntimeToDatabaseUserMapping;
 };
@@ -0,0 +1,69 @@
+/*
+ * ChatSnapshot.h
+ *
+ *      Author: Andreas Volz
+ */
+
+#ifndef CHATSNAPSHOT_H_
+#define CHATSNAPSHOT_H_
+
+// project public API
+#include "chatstorage/ChatContext.h"
+
+// system
+#include <memory>
+#include <vector>
+
+class ChatSnapshot;
+
+using ChatSnapshotPtr = std::shared_ptr<const ChatSnapshot>;
+
+/**
+ * ChatSnapshot is an immutable, reference counted view of a loaded ChatContext.
+ *
+ * It offers only const access and has no internal locking. All lazy state of the context (e.g. the message index)
+ * is built once at creation, so any number of threads may read the same snapshot in parallel without copies.
+ */
+class ChatSnapshot
+{
+public:
+  /**
+   * Takes over the ownership of the context. The context can't be changed anymore afterwards.
+   */
+  static ChatSnapshotPtr create(std::unique_ptr<ChatContext> ctx);
+
+  ~ChatSnapshot() = default;
+
+  ChatSnapshot(const ChatSnapshot&) = delete;
+  ChatSnapshot& operator=(const ChatSnapshot&) = delete;
+
+  const Chat *getChat() const;
+
+  const std::vector<User>& getUserList() const;
+
+  const std::vector<Message>& getMessageList() const;
+
+  const std::vector<Media>& getMediaList() const;
+
+  const User& getUserBySenderRuntimeId(int64_t sender_runtime_id) const;
+
+  const User& getUserBySenderDatabaseId(int64_t sender_database_id) const;
+
+  const Media& getMediaByMediaRuntimeId(int64_t media_runtime_id) const;
+
+  const Media& getMediaByMediaDatabaseId(int64_t media_database_id) const;
+
+  std::vector<size_t> findMessages(const MessageFilter &filter) const;
+
+  /**
+   * Read access to the underlying context for functions that take a const ChatContext&.
+   */
+  const ChatContext& getContext() const;
+
+private:
+  explicit ChatSnapshot(std::unique_ptr<ChatContext> ctx);
+
+  std::unique_ptr<const ChatContext> mContext;
+};
+
+#endif /* CHATSNAPSHOT_H_ */
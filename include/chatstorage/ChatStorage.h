@@ -13,11 +13,20 @@
 
 // project public API
 #include "chatstorage/ChatContext.h"
+#include "chatstorage/ChatStorageImporter.h"
+#include "chatstorage/ChatSnapshot.h"
+#include "chatstorage/MappedChat.h"
+#include "chatstorage/MediaIngest.h"
+#include "chatstorage/MediaHandle.h"
+#include "chatstorage/Executor.h"
 
 // system
+#include <atomic>
+#include <functional>
 #include <memory>
 #include <vector>
 #include <filesystem>
+#include <future>
 
 struct ChatEntry
 {
@@ -25,26 +34,435 @@ struct ChatEntry
   std::string name;
 };
 
+/**
+ * Group commit of ChatStorage::saveAsync()
+ */
+struct AsyncSaveConfig
+{
+  /**
+   * How long the writer thread waits for more saves before it commits a group that isn't full. 0 only groups the
+   * saves that were queued while the previous group was written.
+   */
+  unsigned maxLatencyMs = 2;
+
+  /**
+   * Maximum number of saves in one transaction.
+   */
+  size_t maxGroupSize = 64;
+
+  /**
+   * saveAsync() blocks while this many saves are waiting, so a fast producer can't use up the memory.
+   */
+  size_t maxQueuedSaves = 1024;
+};
+
+/**
+ * Transactions of a save with many messages, e.g. the first import of a huge chat. In one transaction the WAL file
+ * would grow by the size of the chat and the readers would wait for the checkpoint at its end.
+ */
+struct ChunkedSaveConfig
+{
+  /**
+   * A save commits after each chunk of this many messages. 0 saves everything in one transaction.
+   */
+  size_t chunkMessages = 100000;
+
+  /**
+   * A chunk also ends after this many bytes of message text.
+   */
+  size_t chunkBytes = 64 * 1024 * 1024;
+
+  /**
+   * After the first chunk of a save is committed its messages are written in savepoints of this size. If a message
+   * can't be written then only its savepoint is rolled back, the messages in front of it are committed with the
+   * progress marker and the save reports the failure. A save that fails in its first chunk is rolled back completely.
+   */
+  size_t savepointMessages = 1000;
+
+  /**
+   * A PASSIVE WAL checkpoint after each chunk, so the WAL file doesn't grow beyond the size of a chunk.
+   */
+  bool checkpoint = true;
+};
+
+/**
+ * A save in chunks that didn't finish, e.g. as the process was killed (see ChatStorage::getInterruptedSaves())
+ */
+struct InterruptedSave
+{
+  int64_t chat_id = 0;
+  bool new_chat = false;          // the chat was created by the save
+  int64_t first_message_id = 0;   // the messages from this ID on were written by the save
+  int64_t messages_saved = 0;
+  int64_t started_at = 0;         // unix seconds
+};
+
+/**
+ * Transactions of ChatStorage::followFile()
+ */
+struct FollowConfig
+{
+  /**
+   * A complete message is committed at the latest after this time, so it's visible to the readers.
+   */
+  unsigned maxLatencyMs = 250;
+
+  /**
+   * Maximum number of messages in one transaction, e.g. while the existing part of a file is read.
+   */
+  size_t maxBatchMessages = 5000;
+
+  /**
+   * How often the stop flag is checked while no data arrives.
+   */
+  unsigned idleWakeMs = 250;
+};
+
+struct ChatStorageConfig
+{
+  /**
+   * Memory budget of the cache for loaded chats. A value of 0 disables the cache.
+   */
+  size_t cacheBudgetBytes = 64 * 1024 * 1024;
+
+  /**
+   * Directory of the binary snapshot files for openMappedChat(). If empty "<db_path>.snapshots" is used.
+   */
+  std::filesystem::path snapshotDirectory;
+
+  /**
+   * Verify the payload checksum of a snapshot file on open. This reads the complete file once.
+   */
+  bool verifySnapshotChecksum = false;
+
+  /**
+   * Parallelism and fast paths of the media file operations after a save().
+   */
+  MediaIngestConfig mediaIngest;
+
+  /**
+   * Directory layout of the media files for a new storage. An existing storage keeps its layout until
+   * migrateMediaLayout() is called.
+   */
+  MediaLayout mediaLayout = MediaLayout::Sharded;
+
+  /**
+   * Maximum number of read-only database connections for the load functions, so they run in parallel from many
+   * threads. The connections are opened on demand. 0 = one per hardware thread. An in-memory database always reads
+   * through the single writer connection.
+   */
+  size_t readerConnections = 0;
+
+  /**
+   * How long a database access waits for a lock of another connection or process before it fails.
+   */
+  int busyTimeoutMs = 5000;
+
+  AsyncSaveConfig asyncSave;
+
+  ChunkedSaveConfig chunkedSave;
+
+  FollowConfig follow;
+
+  /**
+   * Thread pool of all parallel operations (media file operations, media probe, ...). If empty the storage creates
+   * its own with executorThreads workers; 0 = one per hardware thread.
+   */
+  std::shared_ptr<Executor> executor;
+  unsigned executorThreads = 0;
+
+  /**
+   * Pin each worker of an own executor to one CPU (Linux only).
+   */
+  bool pinExecutorThreads = false;
+};
+
+struct ChatCacheStats
+{
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t evictions = 0;      // removed to stay in the memory budget
+  uint64_t invalidations = 0;  // removed as the chat was changed
+  size_t entries = 0;
+  size_t bytes = 0;
+  size_t budget_bytes = 0;
+};
+
+/**
+ * Result of ChatStorage::deleteChat()
+ */
+struct ChatDeleteStats
+{
+  bool deleted = false;   // the chat row is removed, false if the chat doesn't exist or a transaction failed
+  size_t messages = 0;
+  size_t media = 0;       // media rows no other chat references
+  size_t users = 0;       // users without messages in other chats
+  size_t batches = 0;
+  MediaIngestStats media_files;
+  std::vector<MediaIngestFailure> media_failures;
+  int64_t pages_freed = 0;
+};
+
+/**
+ * Result of ChatStorage::importFile()
+ */
+struct ImportResult
+{
+  bool committed = false;   // false if the file couldn't be parsed or the save failed
+  bool skipped = false;     // a byte-identical file was yet imported into the chat -> not parsed
+  bool resumed = false;     // only the part of the file behind the last import was parsed
+  int64_t resume_offset = 0;
+  int64_t chat_id = Chat::DB_NO_ID;
+  size_t messages_new = 0;
+  size_t messages_existing = 0; // parsed messages of the file that the chat yet has
+  ImportReport import;
+  SaveReport save;
+};
 
+/**
+ * State of ChatStorage::followFile(), passed to the commit callback and returned at the end
+ */
+struct FollowStats
+{
+  bool ok = false;          // false if the input couldn't be read or parsed, or a save failed
+  int64_t chat_id = Chat::DB_NO_ID;
+  bool resumed = false;     // started behind the messages of an earlier import of the file
+  int64_t resume_offset = 0;
+  size_t restarts = 0;      // read again from the start as the file was truncated, replaced or didn't fit
+  size_t batches = 0;
+  size_t messages_new = 0;
+  size_t messages_existing = 0;
+  int64_t bytes_read = 0;
+  std::vector<std::string> missing_media;
+  std::vector<MediaIngestFailure> media_failures;
+};
+
+/**
+ * All functions could be called from any thread. The load, list and media lookup functions read through a pool of
+ * read-only connections and run in parallel. Functions that change the storage are serialized on a single writer
+ * connection; with WAL they don't block the readers.
+ */
 class ChatStorage
 {
 public:
-  ChatStorage(const std::filesystem::path &db_path, const std::filesystem::path &media_perisitence_path);
+  ChatStorage(const std::filesystem::path &db_path, const std::filesystem::path &media_perisitence_path,
+      const ChatStorageConfig &config = {});
   ~ChatStorage();
 
   std::filesystem::path getMediaPersistencePath();
 
+  /**
+   * The absolute path of the stored file of a media. Always use this function instead of building paths, as the
+   * location depends on the media layout. For a media imported with MediaIngestMode::Reference it's the source file.
+   */
+  std::filesystem::path resolveMediaPath(const Media &media);
+
+  /**
+   * @return empty path if no media with this ID exists, the media is stored in a pack segment or the referenced
+   *         source file was changed
+   */
+  std::filesystem::path resolveMediaPath(int64_t media_database_id);
+
+  /**
+   * Opens the content of a media for reading without copies. Works for all media layouts, pack segments and
+   * referenced source files.
+   *
+   * @return nullptr if no media with this ID exists or its content isn't available
+   */
+  MediaHandlePtr openMedia(int64_t media_database_id);
+
+  /**
+   * Finds media files without media row and media rows without file. Orphaned files are deleted unless
+   * MediaGcConfig::dryRun is set, missing files are only reported. Runs on a reader connection, so saves aren't
+   * blocked in the meantime (except for an in-memory database).
+   */
+  MediaGcStats collectMediaGarbage(const MediaGcConfig &config = {});
+
+  /**
+   * Executes the media file operations that an interrupted save() left in the journal. This is done on each open,
+   * an explicit call is only needed if a save of another process was interrupted while this storage is open.
+   */
+  MediaIngestStats resumeMediaJournal();
+
+  MediaLayout getMediaLayout() const;
+
+  /**
+   * Moves all media files into the target layout in parallel. The storage stays usable during the migration.
+   */
+  MediaLayoutMigrationStats migrateMediaLayout(MediaLayout target_layout);
+
+  /**
+   * Rewrites the media pack segments with at least min_garbage_ratio of deleted media.
+   */
+  MediaPackCompactionStats compactMediaPacks(double min_garbage_ratio = 0.5);
+
+  /**
+   * Runs compactMediaPacks() in a background thread with an own database connection, so this ChatStorage stays
+   * usable in the meantime. Needs a database file.
+   */
+  std::future<MediaPackCompactionStats> compactMediaPacksAsync(double min_garbage_ratio = 0.5);
+
   std::unique_ptr<ChatContext> loadByChatEntry(ChatEntry chat_entry);
 
+  /**
+   * Loads a chat into a new ChatContext that is owned by the caller. If the chat is cached the context is
+   * copied from the cache without any database access.
+   */
   std::unique_ptr<ChatContext> loadByChatId(int64_t chat_id);
 
+  /**
+   * Loads a chat as immutable snapshot that could be shared between threads without copies.
+   * Snapshots are served from the chat cache.
+   */
+  ChatSnapshotPtr loadSnapshotByChatId(int64_t chat_id);
+
+  /**
+   * Appends the messages that were added to the chat of the context since it was loaded or saved (e.g. by a new
+   * import). Only the new rows are read, so long living contexts are updated in O(delta).
+   *
+   * @return the number of new messages
+   */
+  size_t refresh(ChatContext &ctx);
+
+  /**
+   * Opens a chat as read-only memory mapped view. The snapshot file is (re)written if it doesn't exist or the chat
+   * was changed since it was written, otherwise no database access beside the generation check is needed.
+   *
+   * @return nullptr if the chat doesn't exist
+   */
+  MappedChatPtr openMappedChat(int64_t chat_id);
+
+  /**
+   * Writes the binary snapshot file of a chat.
+   *
+   * @return false if the chat doesn't exist or the file couldn't be written
+   */
+  bool writeMappedSnapshot(int64_t chat_id);
+
+  ChatCacheStats getCacheStats() const;
+
+  /**
+   * The thread pool of the storage, the application can run its own tasks on it.
+   */
+  Executor& getExecutor();
+
+  /**
+   * Changes the cache memory budget. Entries are evicted until the cache fits into the new budget.
+   */
+  void setCacheBudget(size_t budget_bytes);
+
+  /**
+   * Stores each media content only once: media files from before content hashing are hashed and duplicates are
+   * merged into the oldest media. Safe to run on a live database; it's only needed once after an upgrade.
+   */
+  MediaDedupStats deduplicateMedia();
+
   std::vector<ChatEntry> getChatEntryList();
 
-  void save(ChatContext& ctx, const std::filesystem::path& import_media_path = {}); // TODO "const ChatContext& ctx", but then a lot of functions must be const...
+  /**
+   * Deletes a chat with its messages and the media and users no other chat references. The messages are deleted in
+   * batches with a short transaction each and the write lock is released between them, so concurrent writers aren't
+   * blocked for long and the WAL stays small. Afterwards the free pages are returned to the file system in steps
+   * (auto_vacuum = INCREMENTAL).
+   *
+   * An interrupted delete leaves a consistent but smaller chat, calling deleteChat() again finishes it.
+   */
+  ChatDeleteStats deleteChat(int64_t chat_id);
+
+  /**
+   * The saves in chunks that were interrupted and not yet finished by a later save of the chat.
+   */
+  std::vector<InterruptedSave> getInterruptedSaves();
+
+  /**
+   * Removes what an interrupted save wrote: the complete chat if the save created it, otherwise its messages and the
+   * media and users only they reference.
+   *
+   * @return the deleted rows; all 0 if the chat has no interrupted save
+   */
+  ChatDeleteStats discardInterruptedSave(int64_t chat_id);
+
+  /**
+   * Saves all new objects of the context in one transaction. After the commit the media files are copied in
+   * parallel into the media persistence path.
+   *
+   * A context with more new or changed messages than ChunkedSaveConfig::chunkMessages is committed in chunks. The
+   * readers see each chunk after its commit. A progress marker is stored with the first chunk and removed with the
+   * last one, so a save that is interrupted in between is found by getInterruptedSaves(). A later complete save of
+   * the chat, e.g. importing the file again, finishes it.
+   *
+   * @return the commit state, the media statistics and every media file operation that failed
+   */
+  SaveReport save(ChatContext& ctx, const std::filesystem::path& import_media_path = {}); // TODO "const ChatContext& ctx", but then a lot of functions must be const...
+
+  /**
+   * Saves many contexts in one transaction, e.g. the import of many small chats. The prepared statements of the
+   * writer connection and the lookups of mapped users are shared by all contexts, and the media files of all
+   * contexts are copied in one parallel pass after the commit. The limits of ChunkedSaveConfig count the messages of
+   * all contexts.
+   *
+   * @param import_media_path as for save(), the same for all contexts
+   *
+   * A context that can't be written is rolled back alone (see saveAsync()), the other contexts are still stored.
+   *
+   * @return a report per context and the result of the media file operations of all contexts
+   */
+  SaveAllReport saveAll(const std::vector<ChatContext*> &contexts, const std::filesystem::path& import_media_path = {});
+
+  /**
+   * Queues the context for a background writer thread and returns at once. The writer saves the queued contexts in
+   * groups of one transaction each (see AsyncSaveConfig), so many small saves share one commit. The saves of the
+   * queue are done in order, but not ordered against save() calls of other threads.
+   *
+   * Pending saves are finished by the destructor.
+   *
+   * @return the report of the save; a context that can't be written is rolled back alone, the other saves of its
+   *         group are committed. A failed commit reports committed = false for each save of the group.
+   */
+  std::future<SaveReport> saveAsync(std::unique_ptr<ChatContext> ctx, const std::filesystem::path& import_media_path = {});
+
+  /**
+   * Imports an export file and merges it into an existing chat, so the monthly re-export of a chat with its complete
+   * history only adds the new messages. Each imported message has a fingerprint (timestamp, sender, text) that is
+   * unique within its chat; the messages the chat yet has are skipped before their media is read, and a concurrent
+   * import of the same messages is ignored by the database. A file with the same content hash as an earlier import
+   * into the chat isn't parsed at all.
+   *
+   * The senders of the file are mapped by name to the users of the chat. Chats imported before fingerprints existed
+   * get them on the first merge.
+   *
+   * The position of the last messages in the file is stored with each import. If the file still has the same lines
+   * in front of that position, the next import of the grown file only parses from there on. Otherwise, or if the
+   * parsed tail doesn't continue with the last known timestamp, the complete file is parsed.
+   *
+   * @param chat_id the chat to merge into. Chat::DB_NO_ID merges into the chat with ImportConfig::chatName and
+   *        ImportConfig::chatSource, a new chat is created if there is none.
+   */
+  ImportResult importFile(const std::filesystem::path &file, const ImportConfig &import_config,
+      int64_t chat_id = Chat::DB_NO_ID);
+
+  /**
+   * Imports a chat export that is still written: a file that is appended to or a pipe ("-" is the standard input).
+   * The parser keeps its state between the reads and the completed messages are committed in small transactions
+   * (see FollowConfig), so they could be read shortly after they were written. A message is complete when the next
+   * line with a timestamp arrives, as a message could be continued by more lines until then.
+   *
+   * A file is merged like with importFile(): a known chat continues behind its last import and the messages the chat
+   * yet has are skipped. After each commit the resume point is stored, so a later importFile() or followFile() of
+   * the same file continues there. A truncated or replaced file is read again from the start.
+   *
+   * Returns when stop is set (checked at least each FollowConfig::idleWakeMs) or the writer of a pipe closes it. The
+   * open last message of a pipe is committed at its end; the one of a file is left for the next import, as the file
+   * could still be continued.
+   *
+   * @param on_commit called after each commit
+   */
+  FollowStats followFile(const std::filesystem::path &file, const ImportConfig &import_config,
+      const std::atomic<bool> &stop, int64_t chat_id = Chat::DB_NO_ID,
+      const std::function<void(const FollowStats&)> &on_commit = {});
 
 private:
   void createChatEntries();
-  std::vector<Chat> listChats();
 
   struct Impl;                    // forward
   std::unique_ptr<Impl> mImpl;    // PIMPL
@@ -9,15 +9,51 @@
 
 // project public API
 #include "chatstorage/ChatContext.h"
+#include "chatstorage/Executor.h"
 
 // system
+#include <filesystem>
 #include <istream>
+#include <memory>
+
+// @formatter:off
+enum class MissingMediaPolicy
+{
+  Keep, // keep the Media, the copy fails later at save time
+  Drop, // import the message without the attachment
+  Fail  // abort the complete import
+};
+// @formatter:on
 
 struct ImportConfig
 {
   std::string chatName = "<no name>";
   ChatSource chatSource = ChatSource::FormatA;
   std::vector<std::pair<std::string, int>> userImportMapping;
+
+  /**
+   * Probe all attachments (size + MIME type by magic number) before the ChatContext is built. Needs mediaDirectory,
+   * importFromFile() uses the directory of the import file if it's empty.
+   */
+  bool probeMedia = true;
+  std::filesystem::path mediaDirectory;
+  unsigned probeWorkers = 8;
+
+  /**
+   * Thread pool of the media probe. ChatStorage::importFile() and followFile() use the executor of the storage if
+   * it's empty, the static functions below start own threads then.
+   */
+  std::shared_ptr<Executor> executor;
+  MissingMediaPolicy missingMedia = MissingMediaPolicy::Keep;
+};
+
+struct ImportReport
+{
+  size_t messages_parsed = 0;
+  size_t messages_known = 0; // skipped by a merge import as the chat yet has them
+  size_t media_probed = 0;
+  size_t media_mime_corrected = 0; // sniffed MIME type differs from the file extension
+  std::vector<std::string> missing_media;
 };
 
 class ChatStorageImporter
@@ -28,8 +64,14 @@ class ChatStorageImporter
 
     static bool importFromStream(std::istream& in_stream, const ImportConfig &import_config, ChatContext& out_ctx);
 
+    static bool importFromStream(std::istream& in_stream, const ImportConfig &import_config, ChatContext& out_ctx,
+        ImportReport &out_report);
+
     static bool importFromFile(const std::string& filename, const ImportConfig &import_config, ChatContext& out_ctx);
 
+    static bool importFromFile(const std::string& filename, const ImportConfig &import_config, ChatContext& out_ctx,
+        ImportReport &out_report);
+
   private:
 
 };
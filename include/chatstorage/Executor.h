@@ -0,0 +1,124 @@
+/*
+ * Executor.h
+ *
+ *      Author: Andreas Volz
+ */
+
+#ifndef EXECUTOR_H_
+#define EXECUTOR_H_
+
+// system
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+/**
+ * Work-stealing thread pool that all parallel operations of the library share, so they don't start their own threads
+ * and oversubscribe the cores.
+ *
+ * Each worker has its own task deque. A task that is started from a worker goes to the back of its deque and the
+ * worker continues with it (good cache locality), an idle worker steals from the front of the other deques. Tasks
+ * from other threads are spread over the deques round robin.
+ *
+ * A ChatStorage creates its own executor, an application can share one executor between several storages and its
+ * own code with ChatStorageConfig::executor.
+ */
+class Executor
+{
+public:
+  /**
+   * @param threads number of worker threads; 0 = one per hardware thread
+   * @param pin_threads pin worker i to CPU i (only on Linux, ignored elsewhere)
+   */
+  explicit Executor(unsigned threads = 0, bool pin_threads = false);
+
+  /**
+   * Runs the queued tasks and joins the workers.
+   */
+  ~Executor();
+
+  Executor(const Executor&) = delete;
+  Executor& operator=(const Executor&) = delete;
+
+  unsigned getThreadCount() const;
+
+  /**
+   * Tasks that are waited for together. The tasks may run tasks of the same or other groups, a wait() from inside a
+   * task doesn't block a worker as it runs queued tasks in the meantime.
+   */
+  class TaskGroup
+  {
+  public:
+    explicit TaskGroup(Executor &executor);
+
+    /**
+     * Waits for the tasks, an exception of a task is dropped.
+     */
+    ~TaskGroup();
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    void run(std::function<void()> task);
+
+    /**
+     * Waits until all tasks of the group are finished. The calling thread runs queued tasks while it waits: a worker
+     * any task, another thread only the tasks of this group.
+     *
+     * @throw the first exception of a task (the group was cancelled by it)
+     */
+    void wait();
+
+    /**
+     * The tasks that aren't started yet are skipped. Running tasks can poll isCancelled() to stop early.
+     */
+    void cancel();
+
+    bool isCancelled() const;
+
+  private:
+    friend class Executor;
+
+    void finishTask(std::exception_ptr error);
+
+    Executor &mExecutor;
+    std::atomic<size_t> mPending { 0 };
+    std::atomic<size_t> mQueued { 0 };  // not started yet
+    std::atomic<bool> mCancelled { false };
+    std::mutex mErrorMutex;
+    std::exception_ptr mError;
+  };
+
+private:
+  struct Impl;
+
+  struct Task
+  {
+    std::function<void()> func;
+    TaskGroup *group = nullptr;
+  };
+
+  void submit(Task task);
+
+  /**
+   * Takes one queued task (the own deque first if called from a worker) and runs it.
+   *
+   * @param only_group only a task of this group is taken
+   * @return false if no task was queued
+   */
+  bool runQueuedTask(const TaskGroup *only_group = nullptr);
+
+  /**
+   * Wakes the threads that wait for tasks or for a group.
+   */
+  void notifyAll();
+
+  static void runTask(Task &task);
+
+  std::unique_ptr<Impl> mImpl;
+};
+
+#endif /* EXECUTOR_H_ */
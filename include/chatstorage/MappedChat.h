@@ -0,0 +1,100 @@
+/*
+ * MappedChat.h
+ *
+ *      Author: Andreas Volz
+ */
+
+#ifndef MAPPEDCHAT_H_
+#define MAPPEDCHAT_H_
+
+// project public API
+#include "chatstorage/ChatContext.h"
+
+// system
+#include <cstdint>
+#include <memory>
+#include <string_view>
+
+// forward declarations
+class MappedFile;
+
+/**
+ * MappedChat is a read-only view of a chat that is memory mapped from a binary snapshot file.
+ *
+ * Opening a snapshot validates only the header, no rows are decoded and no strings are allocated. All accessors
+ * read directly from the mapping, so the costs are bounded by page faults. The runtime IDs are the same as for a
+ * ChatContext loaded with ChatStorage::loadByChatId(): users, media and messages are numbered by their position.
+ */
+class MappedChat
+{
+  /**
+   * friend is needed as only the snapshot file reader is allowed to setup the mapping
+   */
+  friend class ChatSnapshotFile;
+
+public:
+  ~MappedChat();
+
+  MappedChat(const MappedChat&) = delete;
+  MappedChat& operator=(const MappedChat&) = delete;
+
+  int64_t getChatDatabaseId() const;
+
+  /**
+   * The chat generation the snapshot was written for (see ChatStorage).
+   */
+  int64_t getGeneration() const;
+
+  std::string_view getName() const;
+
+  ChatSource getSource() const;
+
+  size_t getUserCount() const;
+  int64_t getUserDatabaseId(size_t user_runtime_id) const;
+  std::string_view getUserName(size_t user_runtime_id) const;
+  bool isSystemUser(size_t user_runtime_id) const;
+
+  size_t getMediaCount() const;
+  int64_t getMediaDatabaseId(size_t media_runtime_id) const;
+  MediaType getMediaType(size_t media_runtime_id) const;
+  int64_t getMediaSize(size_t media_runtime_id) const;
+  std::string_view getMediaMimeType(size_t media_runtime_id) const;
+
+  size_t getMessageCount() const;
+  int64_t getMessageDatabaseId(size_t message_runtime_id) const;
+  int64_t getMessageTimestamp(size_t message_runtime_id) const;
+  int64_t getMessageSenderRuntimeId(size_t message_runtime_id) const;
+  int64_t getMessageMediaRuntimeId(size_t message_runtime_id) const;
+  std::string_view getMessageText(size_t message_runtime_id) const;
+
+  /**
+   * Verifies the checksum of the complete file. This reads every page of the mapping!
+   */
+  bool verifyChecksum() const;
+
+  /**
+   * Decodes the complete snapshot into a new ChatContext.
+   */
+  std::unique_ptr<ChatContext> toChatContext() const;
+
+private:
+  MappedChat(std::unique_ptr<MappedFile> file);
+
+  std::string_view textAt(uint64_t offset, uint64_t length) const;
+
+  std::unique_ptr<MappedFile> mFile;
+  const void *mHeader = nullptr;
+  const uint8_t *mUsers = nullptr;
+  const uint8_t *mMedia = nullptr;
+  const int64_t *mMessageIds = nullptr;
+  const int64_t *mMessageTimestamps = nullptr;
+  const int32_t *mMessageSenders = nullptr;
+  const int32_t *mMessageMedia = nullptr;
+  const uint64_t *mMessageTextOffsets = nullptr;
+  const char *mText = nullptr;
+  uint64_t mTextSize = 0;
+};
+
+using MappedChatPtr = std::shared_ptr<const MappedChat>;
+
+#endif /* MAPPEDCHAT_H_ */
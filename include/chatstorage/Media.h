@@ -61,6 +61,14 @@ public:
 
   std::string getImportName() const;
 
+  /**
+   * The content hash is used to store each media file only once (see MediaRepository::computeContentHash()).
+   */
+  void setContentHash(const std::string &content_hash);
+  std::string getContentHash() const;
+
+  static std::string getExtensionFromMimeType(const std::string &mime_type);
+
   static constexpr int64_t RT_START_ID = 0;
   static constexpr int64_t DB_NO_ID = -1;
 
@@ -71,8 +79,10 @@ private:
   int64_t mDatabaseId;
   MediaType mType;
   std::optional<std::string> mImportName;
+  std::optional<std::string> mContentHash;
   int64_t mMediaSize;        // size information without accessing the file (caching)
   std::string mMimeType;
+  bool mChanged = false;     // a persisted media with changes that aren't saved
 };
 
 #endif /* MEDIA_H_ */
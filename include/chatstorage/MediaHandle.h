@@ -0,0 +1,84 @@
+/*
+ * MediaHandle.h
+ *
+ *      Author: Andreas Volz
+ */
+
+#ifndef MEDIAHANDLE_H_
+#define MEDIAHANDLE_H_
+
+// project public API
+#include "chatstorage/Media.h"
+
+// system
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// forward declarations
+class MappedFile;
+
+/**
+ * Read-only access to the content of a stored media, independent of the storage (own file or pack segment).
+ *
+ * The content is memory mapped, data() points directly into the page cache. For zero-copy transfers the file
+ * descriptor and the byte range inside the file are available (e.g. sendfile(out_fd, getFd(), &offset, length)).
+ * The handle stays valid even if the media is deleted or moved in the meantime.
+ */
+class MediaHandle
+{
+  /**
+   * friend is needed as only ChatStorage is allowed to open media
+   */
+  friend class ChatStorage;
+
+public:
+  ~MediaHandle();
+
+  MediaHandle(const MediaHandle&) = delete;
+  MediaHandle& operator=(const MediaHandle&) = delete;
+
+  int64_t getMediaDatabaseId() const;
+
+  MediaType getType() const;
+
+  const std::string& getMimeType() const;
+
+  /**
+   * Size of the content in bytes
+   */
+  size_t size() const;
+
+  /**
+   * Start of the mapped content. nullptr for empty media.
+   */
+  const uint8_t *data() const;
+
+  /**
+   * File descriptor of the file that contains the content. -1 on platforms without mmap().
+   */
+  int getFd() const;
+
+  /**
+   * Position of the content inside the file of getFd().
+   */
+  int64_t getOffset() const;
+
+  /**
+   * Length of the content inside the file of getFd(), same as size().
+   */
+  int64_t getLength() const;
+
+private:
+  MediaHandle(int64_t media_id, MediaType type, const std::string &mime_type, std::unique_ptr<MappedFile> file);
+
+  int64_t mMediaId;
+  MediaType mType;
+  std::string mMimeType;
+  std::unique_ptr<MappedFile> mFile;
+};
+
+using MediaHandlePtr = std::unique_ptr<MediaHandle>;
+
+#endif /* MEDIAHANDLE_H_ */
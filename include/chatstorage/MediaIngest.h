@@ -0,0 +1,230 @@
+/*
+ * MediaIngest.h
+ *
+ *      Author: Andreas Volz
+ */
+
+#ifndef MEDIAINGEST_H_
+#define MEDIAINGEST_H_
+
+// system
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// @formatter:off
+enum class MediaLayout
+{
+  Flat,    // <media_id>.<ext>
+  Sharded  // <xx>/<yy>/<media_id>.<ext> with xx, yy the lowest two bytes of the media_id as hex
+};
+// @formatter:on
+
+// @formatter:off
+enum class MediaIngestMode
+{
+  Copy,      // the files are stored in the media persistence path
+  Reference  // only the absolute source path is stored, for permanent archive folders
+};
+// @formatter:on
+
+/**
+ * Small media (voice notes, stickers) could be appended to pack segments instead of storing each in an own file.
+ */
+struct MediaPackConfig
+{
+  bool enabled = false;
+
+  /**
+   * Media up to this size are packed, larger ones are stored as standalone files.
+   */
+  uint64_t maxMediaSize = 64 * 1024;
+
+  /**
+   * A new segment is started when the active one reaches this size.
+   */
+  uint64_t segmentSize = 64 * 1024 * 1024;
+};
+
+struct MediaIngestConfig
+{
+  /**
+   * Number of parallel file operations. Media files are small and latency bound, so more workers than CPU
+   * cores are useful. The workers run on the executor of the storage and are limited by its size.
+   */
+  unsigned workers = 8;
+
+  /**
+   * How often a failed file operation is repeated. A missing source file is never retried.
+   */
+  unsigned retries = 2;
+
+  /**
+   * Use a hardlink instead of a copy if source and destination are on the same file system. Only safe if the
+   * import files aren't changed afterwards.
+   */
+  bool allowHardlink = false;
+
+  /**
+   * With Reference the import neither copies nor hashes the media files. The size and mtime of each source are
+   * recorded and checked when the media is read, a changed or removed source makes the media unavailable.
+   */
+  MediaIngestMode mode = MediaIngestMode::Copy;
+
+  MediaPackConfig pack;
+};
+
+struct MediaIngestFailure
+{
+  std::filesystem::path source;
+  std::filesystem::path destination;
+  std::string error;
+  unsigned attempts = 0;
+};
+
+struct MediaIngestStats
+{
+  size_t actions = 0;
+  size_t succeeded = 0;
+  size_t failed = 0;
+  size_t retries = 0;
+  size_t deduplicated = 0;   // content was yet stored, no copy needed
+  size_t packed = 0;         // appended to a pack segment
+  size_t referenced = 0;     // source path recorded (MediaIngestMode::Reference)
+  size_t reflinked = 0;
+  size_t hardlinked = 0;
+  size_t renamed = 0;
+  size_t kernel_copied = 0;  // copy_file_range()
+  size_t copied = 0;         // user space copy
+  size_t deleted = 0;
+  uint64_t bytes = 0;
+  double seconds = 0.0;
+
+  double getBytesPerSecond() const
+  {
+    return seconds > 0.0 ? bytes / seconds : 0.0;
+  }
+};
+
+/**
+ * Result of ChatStorage::deduplicateMedia()
+ */
+struct MediaDedupStats
+{
+  size_t scanned = 0;     // media without content hash
+  size_t hashed = 0;      // unique content, hash stored
+  size_t duplicates = 0;  // rows merged into an existing media
+  size_t missing = 0;     // file not readable, left unchanged
+  uint64_t bytes_freed = 0;
+};
+
+/**
+ * Result of ChatStorage::migrateMediaLayout()
+ */
+struct MediaLayoutMigrationStats
+{
+  size_t files = 0;    // all media of the database
+  size_t moved = 0;
+  size_t missing = 0;  // neither in the old nor in the new layout
+  size_t failed = 0;
+  double seconds = 0.0;
+};
+
+/**
+ * Result of ChatStorage::compactMediaPacks()
+ */
+struct MediaPackCompactionStats
+{
+  size_t segments = 0;    // scanned segments (without the active one)
+  size_t compacted = 0;   // rewritten as they contained too much garbage
+  size_t removed = 0;     // deleted segments
+  uint64_t bytes_moved = 0;
+  uint64_t bytes_freed = 0;
+};
+
+/**
+ * Configuration of ChatStorage::collectMediaGarbage()
+ */
+struct MediaGcConfig
+{
+  /**
+   * Only report the orphans, nothing is deleted.
+   */
+  bool dryRun = true;
+
+  /**
+   * Upper limit of deleted files per second to not saturate the disk of a running system. 0 means no limit.
+   */
+  double maxDeletesPerSecond = 0.0;
+
+  /**
+   * Files modified within this time are never deleted, they may belong to a save that is just running.
+   */
+  int64_t gracePeriodSeconds = 3600;
+
+  /**
+   * Number of media rows read per database query.
+   */
+  size_t windowSize = 10000;
+
+  /**
+   * Maximum number of paths and IDs listed in the stats. The counters include all entries.
+   */
+  size_t maxReportedEntries = 1000;
+};
+
+/**
+ * Result of ChatStorage::collectMediaGarbage()
+ */
+struct MediaGcStats
+{
+  size_t files_scanned = 0;
+  size_t rows_scanned = 0;
+  size_t orphan_files = 0;     // files without media row (including left over temporary files)
+  uint64_t orphan_bytes = 0;
+  size_t recent_files = 0;     // orphans inside the grace period, kept
+  size_t deleted_files = 0;
+  uint64_t bytes_freed = 0;
+  size_t missing_files = 0;    // media rows without file
+  std::vector<std::filesystem::path> orphan_paths;
+  std::vector<int64_t> missing_media_ids;
+  double seconds = 0.0;
+};
+
+/**
+ * Result of ChatStorage::save()
+ */
+struct SaveReport
+{
+  bool committed = false;
+  size_t messages_existing = 0; // imported messages that were skipped as the chat yet has them (same fingerprint)
+  size_t chunks = 0;            // committed transactions, more than one for a save in chunks (see ChunkedSaveConfig)
+  size_t chunk_messages = 0;    // the chunk size of the save; 0 = one transaction
+  MediaIngestStats media;
+  std::vector<MediaIngestFailure> media_failures;
+};
+
+/**
+ * Result of ChatStorage::saveAll(). The media files of all contexts are stored in one pass, so the media statistics
+ * are only available for all of them.
+ */
+struct SaveAllReport
+{
+  std::vector<SaveReport> contexts; // in the order of the call; the media stats only count the deduplicated media
+  size_t chunks = 0;
+  MediaIngestStats media;
+  std::vector<MediaIngestFailure> media_failures;
+
+  size_t getCommittedCount() const
+  {
+    size_t committed = 0;
+    for (const auto &report : contexts)
+    {
+      committed += report.committed ? 1 : 0;
+    }
+    return committed;
+  }
+};
+
+#endif /* MEDIAINGEST_H_ */
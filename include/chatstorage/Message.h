@@ -56,11 +56,20 @@ public:
 
   int64_t getTimestamp() const;
 
-  std::string getText() const;
+  const std::string& getText() const;
+
+  /**
+   * The identity of an imported message within its chat (see ChatStorage::importFile()). Messages that weren't
+   * imported and edited ones have NO_FINGERPRINT.
+   */
+  int64_t getFingerprint() const;
+
+  void setFingerprint(int64_t fingerprint);
 
   static constexpr int64_t RT_START_ID = 0;
   static constexpr int64_t DB_NO_ID = -1;
   static constexpr int64_t MEDIA_NO_ID = -1;
+  static constexpr int64_t NO_FINGERPRINT = 0;
 
 private:
   void setDatabaseId(int64_t database_id);
@@ -78,6 +87,7 @@ private:
   int64_t mMediaDatabaseId;
   int64_t mTimestamp;
   std::string mText;         // text or system messages
+  int64_t mFingerprint = NO_FINGERPRINT;
 };
 
 #endif /* MESSAGE_H_ */
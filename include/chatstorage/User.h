@@ -39,6 +39,9 @@ public:
 
   int64_t getDatabaseId() const;
 
+  /**
+   * Marks the user as changed, so the next save() updates the database row.
+   */
   void setName(const std::string name);
 
   const std::string& getName() const;
@@ -55,6 +58,7 @@ private:
   int64_t mDatabaseId;
   std::string mName; // TODO: this is used until the User handling is well defined to identify a person
   bool mIsSystem;
+  bool mChanged = false;     // a persisted user with changes that aren't saved
 };
 
 #endif /* USER_H_ */
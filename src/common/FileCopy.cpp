@@ -0,0 +1,210 @@
+/*
+ * FileCopy.cpp
+ *
+ *      Author: Andreas Volz
+ */
+
+// project
+#include "FileCopy.h"
+
+// system
+#ifdef __linux__
+#include <cerrno>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace FileCopy
+{
+
+#ifdef __linux__
+  namespace
+  {
+
+    /**
+     * Copies with FICLONE or copy_file_range() between two open file descriptors.
+     */
+    bool copyKernel(int src_fd, int dst_fd, off_t size, Method &out_method, std::error_code &ec)
+    {
+      if (ioctl(dst_fd, FICLONE, src_fd) == 0)
+      {
+        out_method = Method::Reflink;
+        return true;
+      }
+
+      off_t remaining = size;
+      while (remaining > 0)
+      {
+        ssize_t copied = copy_file_range(src_fd, nullptr, dst_fd, nullptr, static_cast<size_t>(remaining), 0);
+        if (copied < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          ec = std::error_code(errno, std::generic_category());
+          return false;
+        }
+        if (copied == 0)
+        {
+          // the source was truncated in the meantime
+          break;
+        }
+        remaining -= copied;
+      }
+
+      out_method = Method::CopyFileRange;
+      return true;
+    }
+
+    bool copyLinux(const fs::path &src, const fs::path &dst, Method &out_method, std::error_code &ec)
+    {
+      int src_fd = ::open(src.c_str(), O_RDONLY | O_CLOEXEC);
+      if (src_fd < 0)
+      {
+        ec = std::error_code(errno, std::generic_category());
+        return false;
+      }
+
+      struct stat st;
+      if (fstat(src_fd, &st) != 0)
+      {
+        ec = std::error_code(errno, std::generic_category());
+        ::close(src_fd);
+        return false;
+      }
+
+      int dst_fd = ::open(dst.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, st.st_mode & 0777);
+      if (dst_fd < 0)
+      {
+        ec = std::error_code(errno, std::generic_category());
+        ::close(src_fd);
+        return false;
+      }
+
+      bool success = copyKernel(src_fd, dst_fd, st.st_size, out_method, ec);
+
+      ::close(src_fd);
+      if (::close(dst_fd) != 0 && success)
+      {
+        ec = std::error_code(errno, std::generic_category());
+        success = false;
+      }
+
+      return success;
+    }
+
+  } // namespace
+#endif
+
+  bool copyFile(const fs::path &src, const fs::path &dst, bool allow_hardlink, Method &out_method,
+      std::error_code &ec)
+  {
+    out_method = Method::None;
+    ec.clear();
+
+    fs::path tmp_dst = dst;
+    tmp_dst += ".tmp";
+
+    if (allow_hardlink)
+    {
+      fs::remove(tmp_dst, ec);
+      fs::create_hard_link(src, tmp_dst, ec);
+      if (!ec)
+      {
+        fs::rename(tmp_dst, dst, ec);
+        if (!ec)
+        {
+          out_method = Method::Hardlink;
+          return true;
+        }
+      }
+      // e.g. different file systems -> try a real copy
+      ec.clear();
+    }
+
+    bool success = false;
+
+#ifdef __linux__
+    success = copyLinux(src, tmp_dst, out_method, ec);
+    if (!success && ec != std::errc::no_such_file_or_directory)
+    {
+      // the kernel fast paths aren't supported by all file systems (e.g. EXDEV, EINVAL, ENOSYS)
+      ec.clear();
+    }
+#endif
+
+    if (!success && !ec)
+    {
+      success = fs::copy_file(src, tmp_dst, fs::copy_options::overwrite_existing, ec);
+      if (success)
+      {
+        out_method = Method::Copy;
+      }
+    }
+
+    if (success)
+    {
+      fs::rename(tmp_dst, dst, ec);
+      success = !ec;
+    }
+
+    if (!success)
+    {
+      std::error_code ignore_ec;
+      fs::remove(tmp_dst, ignore_ec);
+      out_method = Method::None;
+    }
+
+    return success;
+  }
+
+  bool moveFile(const fs::path &src, const fs::path &dst, Method &out_method, std::error_code &ec)
+  {
+    out_method = Method::None;
+    ec.clear();
+
+    fs::rename(src, dst, ec);
+    if (!ec)
+    {
+      out_method = Method::Rename;
+      return true;
+    }
+
+    if (ec != std::errc::cross_device_link)
+    {
+      return false;
+    }
+
+    if (!copyFile(src, dst, false, out_method, ec))
+    {
+      return false;
+    }
+
+    fs::remove(src, ec);
+    return !ec;
+  }
+
+  const char *toString(Method method)
+  {
+    switch (method)
+    {
+      case Method::Reflink:
+        return "reflink";
+      case Method::Hardlink:
+        return "hardlink";
+      case Method::Rename:
+        return "rename";
+      case Method::CopyFileRange:
+        return "copy_file_range";
+      case Method::Copy:
+        return "copy";
+      default:
+        return "none";
+    }
+  }
+
+} // namespace FileCopy
@@ -0,0 +1,54 @@
+/*
+ * FileCopy.h
+ *
+ *      Author: Andreas Volz
+ */
+
+#ifndef FILECOPY_H_
+#define FILECOPY_H_
+
+// project
+#include "platform.h"
+
+// system
+#include <cstdint>
+#include <system_error>
+
+namespace FileCopy
+{
+
+  // @formatter:off
+  enum class Method
+  {
+    None,
+    Reflink,       // FICLONE, shares the blocks copy-on-write (btrfs, xfs, ...)
+    Hardlink,      // a second directory entry for the same inode
+    Rename,        // moved inside the same file system
+    CopyFileRange, // in-kernel copy without user space buffers
+    Copy           // portable std::filesystem::copy_file()
+  };
+  // @formatter:on
+
+  /**
+   * Copies src to dst with the fastest method the file systems support. The destination is written to a temporary
+   * file and renamed at the end, so a crash never leaves a partial file at dst. An existing dst is replaced.
+   *
+   * @param allow_hardlink Hardlinks are only safe if the source isn't modified later, so they must be requested.
+   * @param out_method The method that was successful.
+   * @param ec The error of the last tried method if false is returned.
+   *
+   * @return true on success
+   */
+  bool copyFile(const fs::path &src, const fs::path &dst, bool allow_hardlink, Method &out_method,
+      std::error_code &ec);
+
+  /**
+   * Renames src to dst. Over file system boundaries the file is copied and the source removed.
+   */
+  bool moveFile(const fs::path &src, const fs::path &dst, Method &out_method, std::error_code &ec);
+
+  const char *toString(Method method);
+
+} // namespace FileCopy
+
+#endif /* FILECOPY_H_ */
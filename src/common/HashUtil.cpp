@@ -0,0 +1,204 @@
+/*
+ * HashUtil.cpp
+ *
+ *      Author: Andreas Volz
+ */
+
+// project
+#include "HashUtil.h"
+
+// system
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+namespace HashUtil
+{
+
+  // the XXH64 primes from the reference implementation
+  static constexpr uint64_t PRIME_1 = 11400714785074694791ULL;
+  static constexpr uint64_t PRIME_2 = 14029467366897019727ULL;
+  static constexpr uint64_t PRIME_3 = 1609587929392839161ULL;
+  static constexpr uint64_t PRIME_4 = 9650029242287828579ULL;
+  static constexpr uint64_t PRIME_5 = 2870177450012600261ULL;
+
+  static inline uint64_t rotl(uint64_t x, int r)
+  {
+    return (x << r) | (x >> (64 - r));
+  }
+
+  // the hash is defined on little endian input - all supported platforms are little endian
+  static inline uint64_t read64(const uint8_t *p)
+  {
+    uint64_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+  }
+
+  static inline uint32_t read32(const uint8_t *p)
+  {
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+  }
+
+  static inline uint64_t round(uint64_t acc, uint64_t input)
+  {
+    acc += input * PRIME_2;
+    acc = rotl(acc, 31);
+    return acc * PRIME_1;
+  }
+
+  static inline uint64_t mergeRound(uint64_t acc, uint64_t value)
+  {
+    acc ^= round(0, value);
+    return acc * PRIME_1 + PRIME_4;
+  }
+
+  XXH64::XXH64(uint64_t seed) :
+      mSeed(seed)
+  {
+    mAcc[0] = seed + PRIME_1 + PRIME_2;
+    mAcc[1] = seed + PRIME_2;
+    mAcc[2] = seed;
+    mAcc[3] = seed - PRIME_1;
+  }
+
+  void XXH64::update(const void *data, size_t length)
+  {
+    const uint8_t *p = static_cast<const uint8_t*>(data);
+    const uint8_t *end = p + length;
+    mTotalLength += length;
+
+    // fill up a started stripe first
+    if (mBufferSize > 0)
+    {
+      size_t fill = std::min(length, sizeof(mBuffer) - mBufferSize);
+      std::memcpy(mBuffer + mBufferSize, p, fill);
+      mBufferSize += fill;
+      p += fill;
+
+      if (mBufferSize < sizeof(mBuffer))
+        return;
+
+      for (int lane = 0; lane < 4; lane++)
+      {
+        mAcc[lane] = round(mAcc[lane], read64(mBuffer + lane * 8));
+      }
+      mBufferSize = 0;
+    }
+
+    while (end - p >= 32)
+    {
+      for (int lane = 0; lane < 4; lane++)
+      {
+        mAcc[lane] = round(mAcc[lane], read64(p + lane * 8));
+      }
+      p += 32;
+    }
+
+    if (p < end)
+    {
+      mBufferSize = end - p;
+      std::memcpy(mBuffer, p, mBufferSize);
+    }
+  }
+
+  uint64_t XXH64::digest() const
+  {
+    uint64_t h;
+
+    if (mTotalLength >= 32)
+    {
+      h = rotl(mAcc[0], 1) + rotl(mAcc[1], 7) + rotl(mAcc[2], 12) + rotl(mAcc[3], 18);
+      for (int lane = 0; lane < 4; lane++)
+      {
+        h = mergeRound(h, mAcc[lane]);
+      }
+    }
+    else
+    {
+      h = mSeed + PRIME_5;
+    }
+
+    h += mTotalLength;
+
+    const uint8_t *p = mBuffer;
+    const uint8_t *end = mBuffer + mBufferSize;
+
+    while (end - p >= 8)
+    {
+      h ^= round(0, read64(p));
+      h = rotl(h, 27) * PRIME_1 + PRIME_4;
+      p += 8;
+    }
+
+    if (end - p >= 4)
+    {
+      h ^= static_cast<uint64_t>(read32(p)) * PRIME_1;
+      h = rotl(h, 23) * PRIME_2 + PRIME_3;
+      p += 4;
+    }
+
+    while (p < end)
+    {
+      h ^= static_cast<uint64_t>(*p) * PRIME_5;
+      h = rotl(h, 11) * PRIME_1;
+      p++;
+    }
+
+    // final avalanche
+    h ^= h >> 33;
+    h *= PRIME_2;
+    h ^= h >> 29;
+    h *= PRIME_3;
+    h ^= h >> 32;
+
+    return h;
+  }
+
+  uint64_t xxh64(const void *data, size_t length, uint64_t seed)
+  {
+    XXH64 state(seed);
+    state.update(data, length);
+    return state.digest();
+  }
+
+  bool xxh64File(const fs::path &file, uint64_t &out_hash, uint64_t seed)
+  {
+    std::ifstream in(file, std::ios::binary);
+    if (!in)
+    {
+      return false;
+    }
+
+    XXH64 state(seed);
+    std::vector<char> buffer(256 * 1024);
+    while (in)
+    {
+      in.read(buffer.data(), buffer.size());
+      state.update(buffer.data(), static_cast<size_t>(in.gcount()));
+    }
+
+    if (in.bad())
+    {
+      return false;
+    }
+
+    out_hash = state.digest();
+    return true;
+  }
+
+  std::string toHex(uint64_t value)
+  {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(16, '0');
+    for (int i = 15; i >= 0; i--)
+    {
+      hex[i] = digits[value & 0xF];
+      value >>= 4;
+    }
+    return hex;
+  }
+
+} // namespace HashUtil
@@ -0,0 +1,58 @@
+/*
+ * HashUtil.h
+ *
+ *      Author: Andreas Volz
+ */
+
+#ifndef HASHUTIL_H_
+#define HASHUTIL_H_
+
+// project
+#include "platform.h"
+
+// system
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace HashUtil
+{
+
+  /**
+   * Streaming implementation of the non-cryptographic XXH64 hash (https://xxhash.com).
+   * It's used for checksums and content addressing where a fast hash is needed.
+   */
+  class XXH64
+  {
+  public:
+    XXH64(uint64_t seed = 0);
+
+    void update(const void *data, size_t length);
+
+    uint64_t digest() const;
+
+  private:
+    uint64_t mSeed;
+    uint64_t mAcc[4];
+    uint64_t mTotalLength = 0;
+    uint8_t mBuffer[32];
+    size_t mBufferSize = 0;
+  };
+
+  uint64_t xxh64(const void *data, size_t length, uint64_t seed = 0);
+
+  /**
+   * Hash the complete content of a file.
+   *
+   * @return false if the file couldn't be read
+   */
+  bool xxh64File(const fs::path &file, uint64_t &out_hash, uint64_t seed = 0);
+
+  /**
+   * @return 16 lower case hex digits
+   */
+  std::string toHex(uint64_t value);
+
+} // namespace HashUtil
+
+#endif /* HASHUTIL_H_ */
@@ -0,0 +1,142 @@
+/*
+ * MappedFile.cpp
+ *
+ *      Author: Andreas Volz
+ */
+
+// project
+#include "MappedFile.h"
+
+// system
+#include <algorithm>
+#include <limits>
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+  close();
+}
+
+bool MappedFile::open(const fs::path &path)
+{
+  return open(path, 0, std::numeric_limits<uint64_t>::max());
+}
+
+bool MappedFile::open(const fs::path &path, uint64_t offset, uint64_t length)
+{
+  close();
+
+#ifdef _WIN32
+  std::ifstream in(path, std::ios::binary | std::ios::ate);
+  if (!in)
+  {
+    return false;
+  }
+  uint64_t file_size = static_cast<uint64_t>(in.tellg());
+  if (offset > file_size)
+  {
+    return false;
+  }
+  length = std::min(length, file_size - offset);
+
+  mFallbackBuffer.resize(static_cast<size_t>(length));
+  in.seekg(offset);
+  if (!in.read(reinterpret_cast<char*>(mFallbackBuffer.data()), mFallbackBuffer.size()))
+  {
+    mFallbackBuffer.clear();
+    return false;
+  }
+  mData = mFallbackBuffer.data();
+  mSize = mFallbackBuffer.size();
+#else
+  mFd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (mFd < 0)
+  {
+    return false;
+  }
+
+  struct stat file_stat;
+  if (fstat(mFd, &file_stat) != 0 || offset > static_cast<uint64_t>(file_stat.st_size))
+  {
+    close();
+    return false;
+  }
+
+  length = std::min(length, static_cast<uint64_t>(file_stat.st_size) - offset);
+  mSize = static_cast<size_t>(length);
+  if (mSize > 0)
+  {
+    // mmap() needs a page aligned offset
+    uint64_t page_size = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    uint64_t map_offset = offset - (offset % page_size);
+    mMapSize = static_cast<size_t>(length + (offset - map_offset));
+
+    mMapAddr = mmap(nullptr, mMapSize, PROT_READ, MAP_SHARED, mFd, static_cast<off_t>(map_offset));
+    if (mMapAddr == MAP_FAILED)
+    {
+      mMapAddr = nullptr;
+      close();
+      return false;
+    }
+    mData = static_cast<const uint8_t*>(mMapAddr) + (offset - map_offset);
+  }
+#endif
+
+  mOffset = offset;
+  mOpen = true;
+  return true;
+}
+
+void MappedFile::close()
+{
+#ifndef _WIN32
+  if (mMapAddr)
+  {
+    munmap(mMapAddr, mMapSize);
+  }
+  if (mFd >= 0)
+  {
+    ::close(mFd);
+  }
+#endif
+  mFallbackBuffer.clear();
+  mData = nullptr;
+  mSize = 0;
+  mOffset = 0;
+  mMapAddr = nullptr;
+  mMapSize = 0;
+  mFd = -1;
+  mOpen = false;
+}
+
+bool MappedFile::isOpen() const
+{
+  return mOpen;
+}
+
+const uint8_t* MappedFile::data() const
+{
+  return mData;
+}
+
+size_t MappedFile::size() const
+{
+  return mSize;
+}
+
+uint64_t MappedFile::offset() const
+{
+  return mOffset;
+}
+
+int MappedFile::fd() const
+{
+  return mFd;
+}
@@ -0,0 +1,68 @@
+/*
+ * MappedFile.h
+ *
+ *      Author: Andreas Volz
+ */
+
+#ifndef MAPPEDFILE_H_
+#define MAPPEDFILE_H_
+
+// project
+#include "platform.h"
+
+// system
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Read-only memory mapping of a complete file.
+ *
+ * On platforms without mmap() the file content is read into memory, so the interface works everywhere.
+ */
+class MappedFile
+{
+public:
+  MappedFile() = default;
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  bool open(const fs::path &path);
+
+  /**
+   * Maps only the range [offset, offset + length) of the file, e.g. one entry of a pack file.
+   */
+  bool open(const fs::path &path, uint64_t offset, uint64_t length);
+
+  void close();
+
+  bool isOpen() const;
+
+  const uint8_t *data() const;
+
+  size_t size() const;
+
+  /**
+   * Position of data() in the file.
+   */
+  uint64_t offset() const;
+
+  /**
+   * The file descriptor of the mapped file (e.g. for sendfile()). -1 if not available on this platform.
+   */
+  int fd() const;
+
+private:
+  const uint8_t *mData = nullptr;
+  size_t mSize = 0;
+  uint64_t mOffset = 0;
+  void *mMapAddr = nullptr;   // page aligned start of the mapping
+  size_t mMapSize = 0;
+  int mFd = -1;
+  bool mOpen = false;
+  std::vector<uint8_t> mFallbackBuffer;
+};
+
+#endif /* MAPPEDFILE_H_ */
@@ -0,0 +1,82 @@
+/*
+ * ParallelFor.h
+ *
+ *      Author: Andreas Volz
+ */
+
+#ifndef PARALLELFOR_H_
+#define PARALLELFOR_H_
+
+// project public API
+#include "chatstorage/Executor.h"
+
+// system
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+/**
+ * Calls func(index) for each index in [0, count) on up to 'workers' threads. Each worker fetches the next index
+ * from a shared counter, so long running items don't block the others. The calling thread is one of the workers.
+ * func must not throw.
+ *
+ * The other workers are tasks of the executor, so the number of threads is limited by its size. Without an executor
+ * own threads are started.
+ */
+template<typename Func>
+void parallelFor(Executor *executor, size_t count, unsigned workers, Func func)
+{
+  size_t thread_count = std::min<size_t>(std::max(workers, 1u), count);
+  if (executor)
+  {
+    thread_count = std::min<size_t>(thread_count, executor->getThreadCount() + 1);
+  }
+
+  if (thread_count <= 1)
+  {
+    for (size_t index = 0; index < count; index++)
+    {
+      func(index);
+    }
+    return;
+  }
+
+  std::atomic<size_t> next_index { 0 };
+  auto worker = [&]()
+  {
+    for (size_t index = next_index++; index < count; index = next_index++)
+    {
+      func(index);
+    }
+  };
+
+  if (executor)
+  {
+    // a task that starts after the caller took the last index returns at once
+    Executor::TaskGroup task_group(*executor);
+    for (size_t i = 0; i < thread_count - 1; i++)
+    {
+      task_group.run(worker);
+    }
+    worker();
+    task_group.wait();
+    return;
+  }
+
+  std::vector<std::thread> threads;
+  threads.reserve(thread_count - 1);
+  for (size_t i = 0; i < thread_count - 1; i++)
+  {
+    threads.emplace_back(worker);
+  }
+  worker();
+
+  for (auto &thread : threads)
+  {
+    thread.join();
+  }
+}
+
+#endif /* PARALLELFOR_H_ */
@@ -0,0 +1,277 @@
+/*
+ * TailReader.cpp
+ *
+ *      Author: Andreas Volz
+ */
+
+// project
+#include "TailReader.h"
+
+// system
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+// without inotify the end of a file is checked in this interval
+static constexpr int SIZE_POLL_INTERVAL_MS = 100;
+
+TailReader::~TailReader()
+{
+  close();
+}
+
+bool TailReader::open(const fs::path &path, int64_t offset)
+{
+  close();
+  mPath = path;
+  mOffset = 0;
+
+#ifdef _WIN32
+  mPipe = false;
+  mStream.open(path, std::ios::binary);
+  if (!mStream)
+  {
+    return false;
+  }
+  mStream.seekg(offset);
+  mOffset = offset;
+  return true;
+#else
+  if (path == "-")
+  {
+    mFd = STDIN_FILENO;
+    mOwnFd = false;
+  }
+  else
+  {
+    mFd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    mOwnFd = true;
+  }
+  if (mFd < 0)
+  {
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(mFd, &st) != 0)
+  {
+    close();
+    return false;
+  }
+  mPipe = !S_ISREG(st.st_mode);
+
+  if (!mPipe && offset > 0)
+  {
+    if (lseek(mFd, static_cast<off_t>(offset), SEEK_SET) < 0)
+    {
+      close();
+      return false;
+    }
+    mOffset = offset;
+  }
+
+#ifdef __linux__
+  if (!mPipe)
+  {
+    // without the watch the end of the file is checked in intervals
+    mInotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (mInotifyFd >= 0 && inotify_add_watch(mInotifyFd, path.c_str(),
+        IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_MOVE_SELF | IN_DELETE_SELF) < 0)
+    {
+      ::close(mInotifyFd);
+      mInotifyFd = -1;
+    }
+  }
+#endif
+
+  return true;
+#endif
+}
+
+void TailReader::close()
+{
+#ifdef _WIN32
+  if (mStream.is_open())
+  {
+    mStream.close();
+  }
+#else
+  if (mFd >= 0 && mOwnFd)
+  {
+    ::close(mFd);
+  }
+  mFd = -1;
+  mOwnFd = false;
+
+  if (mInotifyFd >= 0)
+  {
+    ::close(mInotifyFd);
+  }
+  mInotifyFd = -1;
+#endif
+}
+
+bool TailReader::isPipe() const
+{
+  return mPipe;
+}
+
+int64_t TailReader::offset() const
+{
+  return mOffset;
+}
+
+TailReader::Status TailReader::read(std::string &out_data, int timeout_ms)
+{
+#ifdef _WIN32
+  Status status = readAvailable(out_data);
+  if (status != Status::Timeout)
+  {
+    return status;
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(std::min(timeout_ms, SIZE_POLL_INTERVAL_MS)));
+  return readAvailable(out_data);
+#else
+  if (mPipe)
+  {
+    // a pipe delivers its data as soon as it's written
+    struct pollfd poll_fd = { mFd, POLLIN, 0 };
+    int ready = poll(&poll_fd, 1, timeout_ms);
+    if (ready < 0)
+    {
+      return errno == EINTR ? Status::Timeout : Status::Error;
+    }
+    if (ready == 0)
+    {
+      return Status::Timeout;
+    }
+    return readAvailable(out_data);
+  }
+
+  Status status = readAvailable(out_data);
+  if (status != Status::Timeout)
+  {
+    return status;
+  }
+
+  if (wasTruncated())
+  {
+    return Status::Truncated;
+  }
+
+  if (mInotifyFd >= 0)
+  {
+    struct pollfd poll_fd = { mInotifyFd, POLLIN, 0 };
+    int ready = poll(&poll_fd, 1, timeout_ms);
+    if (ready < 0 && errno != EINTR)
+    {
+      return Status::Error;
+    }
+    if (ready > 0)
+    {
+      // only the wake up is of interest, not the events
+      char events[4096];
+      while (::read(mInotifyFd, events, sizeof(events)) > 0)
+      {
+      }
+    }
+  }
+  else
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(std::min(timeout_ms, SIZE_POLL_INTERVAL_MS)));
+  }
+
+  return readAvailable(out_data);
+#endif
+}
+
+TailReader::Status TailReader::readAvailable(std::string &out_data)
+{
+#ifdef _WIN32
+  if (!mStream.is_open())
+  {
+    return Status::Error;
+  }
+  if (static_cast<int64_t>(fs::file_size(mPath)) < mOffset)
+  {
+    return Status::Truncated;
+  }
+
+  // an ifstream that hit the end of the file has to be cleared to see the appended data
+  mStream.clear();
+  char buffer[CHUNK_SIZE];
+  mStream.read(buffer, sizeof(buffer));
+  std::streamsize length = mStream.gcount();
+  if (length <= 0)
+  {
+    return Status::Timeout;
+  }
+  out_data.append(buffer, static_cast<size_t>(length));
+  mOffset += length;
+  return Status::Data;
+#else
+  if (mFd < 0)
+  {
+    return Status::Error;
+  }
+
+  size_t old_size = out_data.size();
+  out_data.resize(old_size + CHUNK_SIZE);
+  ssize_t length;
+  do
+  {
+    length = ::read(mFd, &out_data[old_size], CHUNK_SIZE);
+  } while (length < 0 && errno == EINTR);
+
+  out_data.resize(old_size + static_cast<size_t>(std::max<ssize_t>(length, 0)));
+
+  if (length < 0)
+  {
+    return errno == EAGAIN ? Status::Timeout : Status::Error;
+  }
+  if (length == 0)
+  {
+    // end of a file is the normal case, a pipe without writer ends
+    return mPipe ? Status::End : Status::Timeout;
+  }
+
+  mOffset += length;
+  return Status::Data;
+#endif
+}
+
+bool TailReader::wasTruncated()
+{
+#ifdef _WIN32
+  return false;
+#else
+  struct stat fd_st;
+  struct stat path_st;
+  if (fstat(mFd, &fd_st) != 0)
+  {
+    return true;
+  }
+  if (fd_st.st_size < mOffset)
+  {
+    return true;
+  }
+
+  // a log rotation replaces the file, the read one doesn't grow anymore
+  if (stat(mPath.c_str(), &path_st) == 0 && (path_st.st_ino != fd_st.st_ino || path_st.st_dev != fd_st.st_dev))
+  {
+    return true;
+  }
+
+  return false;
+#endif
+}
@@ -0,0 +1,83 @@
+/*
+ * TailReader.h
+ *
+ *      Author: Andreas Volz
+ */
+
+#ifndef TAILREADER_H_
+#define TAILREADER_H_
+
+// project
+#include "platform.h"
+
+// system
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+/**
+ * Reads a file that is appended to or a pipe as the data arrives. At the end of a file it waits for the next write
+ * with inotify (Linux) or by checking the size in short intervals; a pipe is waited for with poll().
+ *
+ * The path "-" reads the standard input.
+ */
+class TailReader
+{
+public:
+  enum class Status
+  {
+    Data,
+    Timeout,    // nothing new within the timeout (or interrupted by a signal)
+    End,        // the writer of the pipe closed it
+    Truncated,  // the file was truncated or replaced -> open it again and read from the start
+    Error
+  };
+
+  TailReader() = default;
+  ~TailReader();
+
+  TailReader(const TailReader&) = delete;
+  TailReader& operator=(const TailReader&) = delete;
+
+  /**
+   * Opening a named pipe blocks until a writer opens it.
+   *
+   * @param offset where to start reading; ignored for a pipe
+   */
+  bool open(const fs::path &path, int64_t offset = 0);
+
+  void close();
+
+  bool isPipe() const;
+
+  /**
+   * Appends the available data to out_data. Waits at most timeout_ms if there is none.
+   */
+  Status read(std::string &out_data, int timeout_ms);
+
+  /**
+   * Byte offset behind the data read so far
+   */
+  int64_t offset() const;
+
+  static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+private:
+  Status readAvailable(std::string &out_data);
+
+  bool wasTruncated();
+
+  fs::path mPath;
+  bool mPipe = false;
+  int64_t mOffset = 0;
+
+#ifdef _WIN32
+  std::ifstream mStream;
+#else
+  int mFd = -1;
+  bool mOwnFd = false;
+  int mInotifyFd = -1;
+#endif
+};
+
+#endif /* TAILREADER_H_ */
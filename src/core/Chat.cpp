@@ -34,6 +34,12 @@ void Chat::setDatabaseId(int64_t database_id)
   mDatabaseId = database_id;
 }
 
+void Chat::setName(const std::string &name)
+{
+  mName = name;
+  mChanged = true;
+}
+
 /*size_t Chat::getMessageCount() const
 {
   return mMessages.size();
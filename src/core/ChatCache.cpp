@@ -0,0 +1,156 @@
+/*
+ * ChatCache.cpp
+ *
+ *      Author: Andreas Volz
+ */
+
+// project
+#include "ChatCache.h"
+
+ChatSnapshotPtr ChatCache::get(int64_t chat_id)
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  auto map_it = mEntryByChatId.find(chat_id);
+  if (map_it == mEntryByChatId.end())
+  {
+    mStats.misses++;
+    return nullptr;
+  }
+
+  // move the entry to the front of the LRU list
+  mLRUList.splice(mLRUList.begin(), mLRUList, map_it->second);
+  mStats.hits++;
+
+  return map_it->second->snapshot;
+}
+
+void ChatCache::put(int64_t chat_id, int64_t generation, ChatSnapshotPtr snapshot, uint64_t epoch)
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  if (mBudgetBytes == 0 || !snapshot || epoch != mEpoch)
+  {
+    return;
+  }
+
+  auto map_it = mEntryByChatId.find(chat_id);
+  if (map_it != mEntryByChatId.end())
+  {
+    erase(map_it->second);
+  }
+
+  size_t bytes = sizeof(Entry) + snapshot->getContext().getMemoryUsage();
+  if (bytes > mBudgetBytes)
+  {
+    // a single chat bigger than the complete budget would evict everything else without benefit
+    return;
+  }
+
+  mLRUList.push_front(Entry { chat_id, generation, bytes, std::move(snapshot) });
+  mEntryByChatId[chat_id] = mLRUList.begin();
+  mUsedBytes += bytes;
+
+  evictToBudget();
+}
+
+uint64_t ChatCache::getEpoch() const
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mEpoch;
+}
+
+void ChatCache::invalidate(int64_t chat_id)
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  // a loader that started before might still put the old content -> increase the epoch even without an entry
+  mEpoch++;
+
+  auto map_it = mEntryByChatId.find(chat_id);
+  if (map_it != mEntryByChatId.end())
+  {
+    erase(map_it->second);
+    mStats.invalidations++;
+  }
+}
+
+std::vector<int64_t> ChatCache::getChatIds() const
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  std::vector<int64_t> chat_ids;
+  chat_ids.reserve(mLRUList.size());
+  for (const Entry &entry : mLRUList)
+  {
+    chat_ids.push_back(entry.chat_id);
+  }
+  return chat_ids;
+}
+
+void ChatCache::revalidate(const std::unordered_map<int64_t, int64_t> &current_generations)
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  for (const auto &[chat_id, generation] : current_generations)
+  {
+    auto map_it = mEntryByChatId.find(chat_id);
+    if (map_it != mEntryByChatId.end() && map_it->second->generation != generation)
+    {
+      erase(map_it->second);
+      mStats.invalidations++;
+      mEpoch++;
+    }
+  }
+}
+
+void ChatCache::clear()
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  mLRUList.clear();
+  mEntryByChatId.clear();
+  mUsedBytes = 0;
+  mEpoch++;
+}
+
+void ChatCache::setBudget(size_t budget_bytes)
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  mBudgetBytes = budget_bytes;
+  evictToBudget();
+}
+
+bool ChatCache::isEnabled() const
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mBudgetBytes > 0;
+}
+
+ChatCacheStats ChatCache::getStats() const
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  ChatCacheStats stats = mStats;
+  stats.entries = mLRUList.size();
+  stats.bytes = mUsedBytes;
+  stats.budget_bytes = mBudgetBytes;
+  return stats;
+}
+
+void ChatCache::erase(std::list<Entry>::iterator entry_it)
+{
+  mUsedBytes -= entry_it->bytes;
+  mEntryByChatId.erase(entry_it->chat_id);
+  mLRUList.erase(entry_it);
+}
+
+void ChatCache::evictToBudget()
+{
+  while (mUsedBytes > mBudgetBytes && !mLRUList.empty())
+  {
+    erase(std::prev(mLRUList.end()));
+    mStats.evictions++;
+  }
+}
@@ -0,0 +1,103 @@
+/*
+ * ChatCache.h
+ *
+ *      Author: Andreas Volz
+ */
+
+#ifndef CHATCACHE_H_
+#define CHATCACHE_H_
+
+// project public API
+#include "chatstorage/ChatSnapshot.h"
+#include "chatstorage/ChatStorage.h"
+
+// system
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * A byte budgeted LRU cache of loaded chats.
+ *
+ * Each entry remembers the chat generation it was loaded with. Changes of this process are invalidated directly
+ * with invalidate(), changes of other connections are detected by the caller (PRAGMA data_version) and handled with
+ * revalidate().
+ *
+ * All functions are thread safe. A loader that runs in parallel to a save gets the epoch before it reads and passes
+ * it to put(), so a chat that was invalidated in the meantime isn't cached with outdated content.
+ */
+class ChatCache
+{
+public:
+  ChatCache(size_t budget_bytes) :
+      mBudgetBytes(budget_bytes)
+  {
+  }
+
+  ~ChatCache() = default;
+
+  /**
+   * @return the cached snapshot or nullptr on a cache miss
+   */
+  ChatSnapshotPtr get(int64_t chat_id);
+
+  /**
+   * @param epoch the value of getEpoch() before the snapshot was loaded; the snapshot is dropped if any entry was
+   *              invalidated since then
+   */
+  void put(int64_t chat_id, int64_t generation, ChatSnapshotPtr snapshot, uint64_t epoch);
+
+  /**
+   * A counter that is increased by each invalidation.
+   */
+  uint64_t getEpoch() const;
+
+  void invalidate(int64_t chat_id);
+
+  /**
+   * @return the chat ids of all entries, to read their current generations without holding the cache lock
+   */
+  std::vector<int64_t> getChatIds() const;
+
+  /**
+   * Compare the entries with the current generations in the database and drop the outdated entries.
+   *
+   * @param current_generations generation by chat id (-1 for a deleted chat); entries of other chats are kept
+   */
+  void revalidate(const std::unordered_map<int64_t, int64_t> &current_generations);
+
+  void clear();
+
+  void setBudget(size_t budget_bytes);
+
+  bool isEnabled() const;
+
+  ChatCacheStats getStats() const;
+
+private:
+  struct Entry
+  {
+    int64_t chat_id;
+    int64_t generation;
+    size_t bytes;
+    ChatSnapshotPtr snapshot;
+  };
+
+  void erase(std::list<Entry>::iterator entry_it);
+
+  void evictToBudget();
+
+  mutable std::mutex mMutex;
+  uint64_t mEpoch = 0;
+
+  // front = most recently used
+  std::list<Entry> mLRUList;
+  std::unordered_map<int64_t, std::list<Entry>::iterator> mEntryByChatId;
+  size_t mBudgetBytes;
+  size_t mUsedBytes = 0;
+  ChatCacheStats mStats {};
+};
+
+#endif /* CHATCACHE_H_ */
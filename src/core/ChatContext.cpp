@@ -13,14 +13,21 @@
 #include "database/UserRepository.h"
 #include "database/MessageRepository.h"
 #include "database/MediaRepository.h"
+#include "core/MessageIndex.h"
 
 // system
 #include <iostream>
+#include <algorithm>
+#include <limits>
 
 static Logger logger = Logger("ChatStorage.ChatContext");
 
 using namespace std;
 
+ChatContext::ChatContext() = default;
+
+ChatContext::~ChatContext() = default;
+
 void ChatContext::setChat(std::unique_ptr<Chat> chat)
 {
   this->mChat = std::move(chat);
@@ -103,7 +110,123 @@ const Media& ChatContext::getMediaByMediaDatabaseId(int64_t media_database_id) c
   return mMediaList.at(mMediaIndexByDatabaseId.at(media_database_id));
 }
 
-void ChatContext::persistChat(ChatRepository &chat_repo)
+bool ChatContext::hasUserWithDatabaseId(int64_t user_database_id) const
+{
+  return mUserIndexByDatabaseId.find(user_database_id) != mUserIndexByDatabaseId.end();
+}
+
+bool ChatContext::hasMediaWithDatabaseId(int64_t media_database_id) const
+{
+  return mMediaIndexByDatabaseId.find(media_database_id) != mMediaIndexByDatabaseId.end();
+}
+
+int64_t ChatContext::getLastMessageDatabaseId() const
+{
+  // messages are loaded and persisted in message_id order, so search only the not yet persisted tail
+  for (auto message_it = mMessageList.rbegin(); message_it != mMessageList.rend(); message_it++)
+  {
+    if (message_it->getDatabaseId() != Message::DB_NO_ID)
+    {
+      return message_it->getDatabaseId();
+    }
+  }
+  return Message::DB_NO_ID;
+}
+
+int64_t ChatContext::nextUserRuntimeId() const
+{
+  // imported users don't start at 0 if there is no system user -> search the maximum (few users)
+  int64_t next_id = User::RT_START_ID;
+  for (const auto &user : mUserList)
+  {
+    next_id = std::max(next_id, user.getRuntimeId() + 1);
+  }
+  return next_id;
+}
+
+int64_t ChatContext::nextMediaRuntimeId() const
+{
+  // media and messages are always appended with increasing runtime IDs
+  return mMediaList.empty() ? Media::RT_START_ID : mMediaList.back().getRuntimeId() + 1;
+}
+
+int64_t ChatContext::nextMessageRuntimeId() const
+{
+  return mMessageList.empty() ? Message::RT_START_ID : mMessageList.back().getRuntimeId() + 1;
+}
+
+void ChatContext::setChatName(const std::string &name)
+{
+  mChat->setName(name);
+}
+
+void ChatContext::setUserName(int64_t user_runtime_id, const std::string &name)
+{
+  mUserList.at(mUserIndexByRuntimeId.at(user_runtime_id)).setName(name);
+}
+
+void ChatContext::setMediaType(int64_t media_runtime_id, MediaType type, const std::string &mime_type)
+{
+  Media &media_obj = mMediaList.at(mMediaIndexByRuntimeId.at(media_runtime_id));
+  media_obj.mType = type;
+  media_obj.mMimeType = mime_type;
+  media_obj.mChanged = true;
+}
+
+void ChatContext::setMessageText(size_t message_index, const std::string &text)
+{
+  mMessageList.at(message_index).mText = text;
+  mMessageList[message_index].mFingerprint = Message::NO_FINGERPRINT;
+  stageMessage(message_index);
+}
+
+void ChatContext::setMessageTimestamp(size_t message_index, int64_t timestamp)
+{
+  mMessageList.at(message_index).mTimestamp = timestamp;
+  mMessageList[message_index].mFingerprint = Message::NO_FINGERPRINT;
+  stageMessage(message_index);
+
+  // the index maps time ranges by the message order
+  mMessageIndex.reset();
+}
+
+void ChatContext::stageMessage(size_t message_index)
+{
+  // new messages are staged when they're added
+  if (mMessageList[message_index].getDatabaseId() != Message::DB_NO_ID)
+  {
+    mStagedMessages.push_back(message_index);
+  }
+}
+
+bool ChatContext::hasChanges() const
+{
+  if (!mChat || mChat->getDatabaseId() == Chat::DB_NO_ID || mChat->mChanged)
+  {
+    return true;
+  }
+
+  if (!mStagedMessages.empty() || mMessagesUntracked)
+  {
+    return true;
+  }
+
+  // few users and media compared to the messages -> check all
+  for (const auto &user : mUserList)
+  {
+    if (user.getDatabaseId() == User::DB_NO_ID || user.mChanged)
+      return true;
+  }
+  for (const auto &media_obj : mMediaList)
+  {
+    if (media_obj.getDatabaseId() == Media::DB_NO_ID || media_obj.mChanged)
+      return true;
+  }
+
+  return false;
+}
+
+bool ChatContext::persistChat(ChatRepository &chat_repo)
 {
   if (mChat->getDatabaseId() == Chat::DB_NO_ID)
   {
@@ -114,18 +237,36 @@ void ChatContext::persistChat(ChatRepository &chat_repo)
     chat_row.source = static_cast<int64_t>(mChat->getSource());
 
     int64_t new_id = chat_repo.insert(chat_row);
+    if (new_id == Chat::DB_NO_ID)
+    {
+      return false;
+    }
     mChat->setDatabaseId(new_id);
   }
-  else
+  else if (mChat->mChanged)
   {
-    // TODO: implement UPDATE
+    ChatRow chat_row {};
+
+    chat_row.chat_id = mChat->getDatabaseId();
+    chat_row.name = mChat->getName();
+    chat_row.source = static_cast<int64_t>(mChat->getSource());
+
+    if (!chat_repo.update(chat_row))
+    {
+      return false;
+    }
   }
+
+  mChat->mChanged = false;
+  return true;
 }
 
-void ChatContext::persistUsers(UserRepository &user_repo)
+bool ChatContext::persistUsers(UserRepository &user_repo)
 {
-  for (auto &user : mUserList)
+  for (size_t user_index = 0; user_index < mUserList.size(); user_index++)
   {
+    User &user = mUserList[user_index];
+
     // never persist any runtime system users as they're yet in the database
     if (!user.isSystem())
     {
@@ -136,15 +277,16 @@ void ChatContext::persistUsers(UserRepository &user_repo)
           // Use a Lambda to find if the user_id is in the database_id mapping
           [&](const auto& pair){ return pair.first == user.getRuntimeId(); }
       );
-      if (it != mRuntimeToDatabaseUserMapping.end())
+      if (user.getDatabaseId() == User::DB_NO_ID && it != mRuntimeToDatabaseUserMapping.end())
       {
           int64_t maping_user_id = it->second;
           //cout << "found for user: " << user.getName() << endl;
 
           UserRow loaded_user_row = user_repo.getByUserId(maping_user_id);
           // TODO: copy here all other settings from the database back into the runtime User
-          user.setName(loaded_user_row.name);
+          user.mName = loaded_user_row.name;
           user.setDatabaseId(loaded_user_row.user_id);
+          mUserIndexByDatabaseId.emplace(user.getDatabaseId(), user_index);
       }
 
       // if not import or update a new user
@@ -156,28 +298,65 @@ void ChatContext::persistUsers(UserRepository &user_repo)
         user_row.name = user.getName();
 
         int64_t new_id = user_repo.insert(user_row);
+        if (new_id == User::DB_NO_ID)
+        {
+          return false;
+        }
         user.setDatabaseId(new_id);
+        mUserIndexByDatabaseId.emplace(new_id, user_index);
       }
-      else
+      else if (user.mChanged)
       {
-        // TODO: implement UPDATE
+        UserRow user_row {};
+
+        user_row.user_id = user.getDatabaseId();
+        user_row.name = user.getName();
+
+        // e.g. a concurrent deleteChat() removed the user
+        if (!user_repo.update(user_row))
+        {
+          return false;
+        }
       }
     }
 
-    else // User::isSystem()
+    else if (user.getDatabaseId() == User::DB_NO_ID) // User::isSystem()
     {
       // for system users patch the real database user ID back
       user.setDatabaseId(user_repo.getSystemUserId());
+      mUserIndexByDatabaseId.emplace(user.getDatabaseId(), user_index);
     }
+
+    user.mChanged = false;
   }
+
+  return true;
 }
 
-void ChatContext::persistMedia(MediaRepository &media_repo)
+bool ChatContext::persistMedia(MediaRepository &media_repo, size_t &out_deduplicated)
 {
-  for (auto &media_obj : mMediaList)
+  out_deduplicated = 0;
+
+  for (size_t media_index = 0; media_index < mMediaList.size(); media_index++)
   {
+    Media &media_obj = mMediaList[media_index];
+
     if (media_obj.getDatabaseId() == Media::DB_NO_ID)
     {
+      // the same content is yet stored -> reference it and skip the copy
+      if (!media_obj.getContentHash().empty())
+      {
+        std::optional<MediaRow> existing_row = media_repo.getByContentHash(media_obj.getContentHash());
+        if (existing_row)
+        {
+          media_obj.setDatabaseId(existing_row->media_id);
+          mMediaIndexByDatabaseId.emplace(existing_row->media_id, media_index);
+          media_obj.mChanged = false;
+          out_deduplicated++;
+          continue;
+        }
+      }
+
       // write the Media object to DB
       MediaRow media_row;
 
@@ -185,29 +364,94 @@ void ChatContext::persistMedia(MediaRepository &media_repo)
       media_row.media_size = media_obj.getMediaSize();
       media_row.mime_type = media_obj.getMimeType();
       media_row.type = static_cast<int64_t>(media_obj.getType());
+      media_row.content_hash = media_obj.getContentHash();
       int64_t new_id = media_repo.insert(media_row);
+      if (new_id == Media::DB_NO_ID)
+      {
+        // no file action: its destination would be the name of another media
+        return false;
+      }
       // after inserting update the Message object with the new database id
       media_obj.setDatabaseId(new_id);
+      mMediaIndexByDatabaseId.emplace(new_id, media_index);
 
       MediaRepository::MediaAction media_action {};
-      media_action.type = MediaRepository::MediaAction::Type::Copy;
+      media_action.type = media_repo.getIngestMode() == MediaIngestMode::Reference ?
+          MediaRepository::MediaAction::Type::Reference : MediaRepository::MediaAction::Type::Copy;
       // use the old filename as long as it's available
       media_action.src = media_obj.getImportName();
-      media_action.dst = to_string(media_obj.getDatabaseId()) + "." + media_obj.getMediaExtension();
+      media_action.dst = media_repo.getRelativeMediaPath(media_obj.getDatabaseId(), media_obj.getMediaExtension());
+      media_action.media_id = media_obj.getDatabaseId();
 
       media_repo.enqueueAction(media_action);
     }
-    else
+    else if (media_obj.mChanged)
     {
-      // TODO: implement UPDATE
+      MediaRow media_row;
+
+      media_row.media_id = media_obj.getDatabaseId();
+      media_row.media_size = media_obj.getMediaSize();
+      media_row.mime_type = media_obj.getMimeType();
+      media_row.type = static_cast<int64_t>(media_obj.getType());
+
+      if (!media_repo.update(media_row))
+      {
+        return false;
+      }
     }
+
+    media_obj.mChanged = false;
   }
+
+  return true;
 }
 
-void ChatContext::persistMessages(MessageRepository &message_repo)
+size_t ChatContext::persistMessages(MessageRepository &message_repo)
 {
-  for (auto &message : mMessageList)
+  return persistMessageBatch(message_repo, std::numeric_limits<size_t>::max()).existing;
+}
+
+ChatContext::MessageBatch ChatContext::persistMessageBatch(MessageRepository &message_repo, size_t max_messages)
+{
+  MessageBatch batch;
+
+  if (mPersistQueue.empty())
   {
+    mPersistQueue = std::move(mStagedMessages);
+    mStagedMessages.clear();
+    mPersistPos = 0;
+
+    if (mMessagesUntracked)
+    {
+      for (size_t message_index = 0; message_index < mMessageList.size(); message_index++)
+      {
+        if (mMessageList[message_index].getDatabaseId() == Message::DB_NO_ID)
+        {
+          mPersistQueue.push_back(message_index);
+        }
+      }
+      mMessagesUntracked = false;
+    }
+
+    // new messages are inserted in list order; a message might be staged more than once
+    std::sort(mPersistQueue.begin(), mPersistQueue.end());
+    mPersistQueue.erase(std::unique(mPersistQueue.begin(), mPersistQueue.end()), mPersistQueue.end());
+  }
+
+  mBatchBegin = mPersistPos;
+  mBatchInserted.clear();
+
+  for (; mPersistPos < mPersistQueue.size() && batch.messages < max_messages; mPersistPos++)
+  {
+    size_t message_index = mPersistQueue[mPersistPos];
+    if (message_index >= mMessageList.size())
+    {
+      // the list was shortened by the mutable access
+      mPersistPos = mPersistQueue.size();
+      break;
+    }
+    Message &message = mMessageList[message_index];
+
     if (message.getDatabaseId() == Message::DB_NO_ID)
     {
       // pre-step: update the Message object with database values from Chat and User DB IDs
@@ -231,26 +475,209 @@ void ChatContext::persistMessages(MessageRepository &message_repo)
       message_row.timestamp = message.getTimestamp();
       message_row.text = message.getText();
       message_row.media_id = message.getMediaDatabaseId();
+      message_row.fingerprint = message.getFingerprint();
       int64_t new_id = message_repo.insert(message_row);
 
+      if (new_id < 0 && message.getFingerprint() != Message::NO_FINGERPRINT)
+      {
+        // the same imported message is yet stored (e.g. by a concurrent import) -> use that one
+        new_id = message_repo.getIdByFingerprint(mChat->getDatabaseId(), message.getFingerprint());
+        batch.existing++;
+      }
+      else if (new_id >= 0)
+      {
+        mBatchInserted.push_back(message_index);
+        if (batch.first_inserted_id == Message::DB_NO_ID)
+        {
+          batch.first_inserted_id = new_id;
+        }
+      }
+
+      if (new_id < 0)
+      {
+        batch.failed = true;
+        break;
+      }
+
       // after inserting update the Message object with the new database id
       message.setDatabaseId(new_id);
+      if (mPersistState)
+      {
+        mPersistState->assigned_messages.push_back(message_index);
+      }
     }
     else
     {
-      // TODO: implement UPDATE
+      MessageRow message_row {};
+
+      message_row.message_id = message.getDatabaseId();
+      message_row.chat_id = message.getChatDatabaseId();
+      message_row.sender_id = message.getSenderDatabaseId();
+      message_row.timestamp = message.getTimestamp();
+      message_row.text = message.getText();
+      message_row.media_id = message.getMediaDatabaseId();
+      message_row.fingerprint = message.getFingerprint();
+
+      // the row may be deleted in the meantime
+      if (!message_repo.update(message_row))
+      {
+        batch.failed = true;
+        break;
+      }
     }
+
+    batch.messages++;
+    batch.bytes += message.getText().size();
+  }
+
+  if (!batch.failed && mPersistPos >= mPersistQueue.size())
+  {
+    mPersistQueue.clear();
+    mPersistPos = 0;
+    batch.done = true;
   }
+
+  return batch;
+}
+
+void ChatContext::rollbackMessageBatch()
+{
+  for (size_t message_index : mBatchInserted)
+  {
+    mMessageList[message_index].setDatabaseId(Message::DB_NO_ID);
+  }
+  mBatchInserted.clear();
+
+  if (mBatchBegin < mPersistQueue.size())
+  {
+    mStagedMessages.insert(mStagedMessages.end(), mPersistQueue.begin() + mBatchBegin, mPersistQueue.end());
+  }
+  mPersistQueue.clear();
+  mPersistPos = 0;
+  mBatchBegin = 0;
+}
+
+void ChatContext::beginPersist()
+{
+  mPersistState = std::make_unique<PersistState>();
+  savePersistState();
+}
+
+void ChatContext::commitPersist()
+{
+  if (mPersistState)
+  {
+    savePersistState();
+  }
+}
+
+void ChatContext::endPersist()
+{
+  mPersistState.reset();
+}
+
+void ChatContext::savePersistState()
+{
+  PersistState &state = *mPersistState;
+
+  state.chat_id = mChat->getDatabaseId();
+  state.chat_changed = mChat->mChanged;
+
+  state.users.clear();
+  for (const auto &user : mUserList)
+  {
+    state.users.emplace_back(user.getDatabaseId(), user.mChanged);
+  }
+  state.media.clear();
+  for (const auto &media_obj : mMediaList)
+  {
+    state.media.emplace_back(media_obj.getDatabaseId(), media_obj.mChanged);
+  }
+  state.user_index_by_database_id = mUserIndexByDatabaseId;
+  state.media_index_by_database_id = mMediaIndexByDatabaseId;
+
+  // the messages that aren't persisted yet: the staged ones and the rest of a save in batches
+  state.staged_messages = mStagedMessages;
+  if (mPersistPos < mPersistQueue.size())
+  {
+    state.staged_messages.insert(state.staged_messages.end(), mPersistQueue.begin() + mPersistPos, mPersistQueue.end());
+  }
+  state.messages_untracked = mMessagesUntracked;
+  state.assigned_messages.clear();
+}
+
+void ChatContext::rollbackPersist()
+{
+  if (!mPersistState)
+  {
+    return;
+  }
+  PersistState &state = *mPersistState;
+
+  mChat->setDatabaseId(state.chat_id);
+  mChat->mChanged = state.chat_changed;
+
+  // the lists aren't changed while a save runs
+  for (size_t user_index = 0; user_index < state.users.size() && user_index < mUserList.size(); user_index++)
+  {
+    mUserList[user_index].setDatabaseId(state.users[user_index].first);
+    mUserList[user_index].mChanged = state.users[user_index].second;
+  }
+  for (size_t media_index = 0; media_index < state.media.size() && media_index < mMediaList.size(); media_index++)
+  {
+    mMediaList[media_index].setDatabaseId(state.media[media_index].first);
+    mMediaList[media_index].mChanged = state.media[media_index].second;
+  }
+  mUserIndexByDatabaseId = std::move(state.user_index_by_database_id);
+  mMediaIndexByDatabaseId = std::move(state.media_index_by_database_id);
+
+  for (size_t message_index : state.assigned_messages)
+  {
+    if (message_index < mMessageList.size())
+    {
+      mMessageList[message_index].setDatabaseId(Message::DB_NO_ID);
+    }
+  }
+
+  mStagedMessages = std::move(state.staged_messages);
+  mMessagesUntracked = state.messages_untracked;
+  mPersistQueue.clear();
+  mPersistPos = 0;
+  mBatchBegin = 0;
+  mBatchInserted.clear();
+
+  mPersistState.reset();
 }
 
 void ChatContext::addMessage(Message message)
 {
   mMessageList.emplace_back(std::move(message));
+
+  if (mMessageList.back().getDatabaseId() == Message::DB_NO_ID)
+  {
+    mStagedMessages.push_back(mMessageList.size() - 1);
+  }
+
+  if (mMessageIndex)
+  {
+    mMessageIndex->add(mMessageList.size() - 1, mMessageList.back());
+  }
 }
 
 void ChatContext::setMessageList(std::vector<Message> messages)
 {
   mMessageList = std::move(messages);
+  mMessageIndex.reset();
+
+  mStagedMessages.clear();
+  mMessagesUntracked = false;
+  for (size_t message_index = 0; message_index < mMessageList.size(); message_index++)
+  {
+    if (mMessageList[message_index].getDatabaseId() == Message::DB_NO_ID)
+    {
+      mStagedMessages.push_back(message_index);
+    }
+  }
 }
 
 const std::vector<Message>& ChatContext::getMessageList() const
@@ -260,9 +687,27 @@ const std::vector<Message>& ChatContext::getMessageList() const
 
 std::vector<Message>& ChatContext::getMessageList()
 {
+  mMessageIndex.reset();
+  mMessagesUntracked = true;
   return mMessageList;
 }
 
+std::vector<size_t> ChatContext::findMessages(const MessageFilter &filter) const
+{
+  ensureMessageIndex();
+
+  return mMessageIndex->find(filter, mMessageList);
+}
+
+void ChatContext::ensureMessageIndex() const
+{
+  if (!mMessageIndex)
+  {
+    mMessageIndex = std::make_unique<MessageIndex>();
+    mMessageIndex->build(mMessageList);
+  }
+}
+
 /**
  *  Sets the media list. If a temporary vector is passed, it will be moved into mMediaList.
  *  After a move, the input vector is valid but its content is unspecified.
@@ -289,8 +734,65 @@ std::vector<Media> ChatContext::getMediaList() const
   return mMediaList;
 }
 
+std::vector<Media>& ChatContext::getMediaList()
+{
+  return mMediaList;
+}
+
 void ChatContext::addRuntimeToDatabaseUserMapping(int64_t runtime_id, int64_t database_id)
 {
   mRuntimeToDatabaseUserMapping.emplace_back(runtime_id, database_id);
 }
 
+std::unique_ptr<ChatContext> ChatContext::clone() const
+{
+  auto ctx = std::make_unique<ChatContext>();
+
+  if (mChat)
+  {
+    ctx->setChat(std::make_unique<Chat>(*mChat));
+  }
+  ctx->setUserList(mUserList);
+  ctx->setMediaList(mMediaList);
+  ctx->setMessageList(mMessageList);
+  ctx->mStagedMessages = mStagedMessages;
+  ctx->mMessagesUntracked = mMessagesUntracked;
+  ctx->mRuntimeToDatabaseUserMapping = mRuntimeToDatabaseUserMapping;
+
+  return ctx;
+}
+
+size_t ChatContext::getMemoryUsage() const
+{
+  size_t bytes = sizeof(ChatContext);
+
+  if (mChat)
+  {
+    bytes += sizeof(Chat) + mChat->getName().capacity();
+  }
+
+  for (const auto &user : mUserList)
+  {
+    bytes += sizeof(User) + user.getName().capacity();
+  }
+
+  for (const auto &message : mMessageList)
+  {
+    bytes += sizeof(Message) + message.getText().capacity();
+  }
+
+  bytes += mMediaList.size() * (sizeof(Media) + 32 /* mime type and import name */);
+
+  // rough hash map costs: bucket pointer + node with key/value
+  size_t index_entries = mUserIndexByRuntimeId.size() + mUserIndexByDatabaseId.size() + mMediaIndexByRuntimeId.size()
+      + mMediaIndexByDatabaseId.size();
+  bytes += index_entries * (sizeof(void*) * 2 + sizeof(int64_t) + sizeof(size_t));
+
+  if (mMessageIndex)
+  {
+    bytes += mMessageIndex->getMemoryUsage();
+  }
+
+  return bytes;
+}
+
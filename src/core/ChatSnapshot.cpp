@@ -0,0 +1,81 @@
+/*
+ * ChatSnapshot.cpp
+ *
+ *      Author: Andreas Volz
+ */
+
+// project public API
+#include "chatstorage/ChatSnapshot.h"
+
+// system
+#include <stdexcept>
+
+ChatSnapshot::ChatSnapshot(std::unique_ptr<ChatContext> ctx) :
+    mContext(std::move(ctx))
+{
+}
+
+ChatSnapshotPtr ChatSnapshot::create(std::unique_ptr<ChatContext> ctx)
+{
+  if (!ctx)
+  {
+    throw std::invalid_argument("ChatSnapshot needs a ChatContext");
+  }
+
+  // build all lazy state now, afterwards the context is only read
+  ctx->ensureMessageIndex();
+
+  // the constructor is private, so std::make_shared isn't possible
+  return ChatSnapshotPtr(new ChatSnapshot(std::move(ctx)));
+}
+
+const Chat* ChatSnapshot::getChat() const
+{
+  return mContext->getChat();
+}
+
+const std::vector<User>& ChatSnapshot::getUserList() const
+{
+  return mContext->getUserList();
+}
+
+const std::vector<Message>& ChatSnapshot::getMessageList() const
+{
+  return mContext->getMessageList();
+}
+
+const std::vector<Media>& ChatSnapshot::getMediaList() const
+{
+  // direct member access as ChatContext::getMediaList() returns a copy
+  return mContext->mMediaList;
+}
+
+const User& ChatSnapshot::getUserBySenderRuntimeId(int64_t sender_runtime_id) const
+{
+  return mContext->getUserBySenderRuntimeId(sender_runtime_id);
+}
+
+const User& ChatSnapshot::getUserBySenderDatabaseId(int64_t sender_database_id) const
+{
+  return mContext->getUserBySenderDatabaseId(sender_database_id);
+}
+
+const Media& ChatSnapshot::getMediaByMediaRuntimeId(int64_t media_runtime_id) const
+{
+  return mContext->getMediaByMediaRuntimeId(media_runtime_id);
+}
+
+const Media& ChatSnapshot::getMediaByMediaDatabaseId(int64_t media_database_id) const
+{
+  return mContext->getMediaByMediaDatabaseId(media_database_id);
+}
+
+std::vector<size_t> ChatSnapshot::findMessages(const MessageFilter &filter) const
+{
+  return mContext->findMessages(filter);
+}
+
+const ChatContext& ChatSnapshot::getContext() const
+{
+  return *mContext;
+}
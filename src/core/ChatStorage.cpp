@@ -14,90 +14,1036 @@
 #include "database/ChatRepository.h"
 #include "database/MediaRepository.h"
 #include "database/PersistenceManager.h"
+#include "database/ChatSnapshotFile.h"
+#include "database/StorageMetaRepository.h"
+#include "database/MediaJournalRepository.h"
+#include "database/MediaGarbageCollector.h"
+#include "database/ImportFileRepository.h"
+#include "database/ImportStateRepository.h"
+#include "database/SaveProgressRepository.h"
+#include "database/DatabaseSession.h"
+#include "database/ConnectionPool.h"
 #include "importer/ImportManager.h"
+#include "importer/TailImporter.h"
+#include "core/ChatCache.h"
+#include "core/SaveQueue.h"
+#include "common/MappedFile.h"
+#include "common/HashUtil.h"
+#include "common/TailReader.h"
 
 // system
+#include <algorithm>
+#include <chrono>
+#include <ctime>
 #include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_set>
 
 using namespace std;
 
 struct ChatStorage::Impl
 {
-  std::unique_ptr<SQLiteConnection> sql;
-  std::unique_ptr<UserRepository> user_repo;
-  std::unique_ptr<MessageRepository> message_repo;
-  std::unique_ptr<ChatRepository> chat_repo;
-  std::unique_ptr<MediaRepository> media_repo;
-  std::unique_ptr<PersistenceManager> persistence;
+  // the first member -> destroyed last, the sessions and the save queue may still run tasks on it
+  std::shared_ptr<Executor> executor;
+
+  // the writer session is only used with write_mutex held
+  std::mutex write_mutex;
+  std::unique_ptr<DatabaseSession> writer;
+  std::unique_ptr<ConnectionPool> readers; // nullptr -> reads through the writer session
+  std::unique_ptr<ChatCache> cache;
+  std::mutex chat_entry_mutex;
+  std::filesystem::path db_path;
+  std::filesystem::path media_path;
+  MediaIngestConfig media_ingest_config;
+  int busy_timeout_ms = SQLiteConnection::DEFAULT_BUSY_TIMEOUT_MS;
+  std::filesystem::path snapshot_dir;
+  bool verify_snapshot_checksum = false;
+  FollowConfig follow_config;
+
+  // the last member -> destroyed first, so the pending saves are finished while everything else is still alive
+  std::unique_ptr<SaveQueue> save_queue;
+
+  std::filesystem::path getSnapshotPath(int64_t chat_id) const
+  {
+    if (snapshot_dir.empty())
+    {
+      throw std::runtime_error("ChatStorage: no snapshot directory for an in-memory database configured"); // TODO: custom exception
+    }
+    return snapshot_dir / ("chat_" + std::to_string(chat_id) + ".snap");
+  }
+
+  ConnectionPool::Lease acquireReader()
+  {
+    if (readers)
+    {
+      return readers->acquire();
+    }
+    return ConnectionPool::Lease(*writer, std::unique_lock<std::mutex>(write_mutex));
+  }
+
+  std::vector<SaveReport> saveGroup(std::vector<SaveQueue::Request> &requests)
+  {
+    std::vector<PersistenceManager::SaveItem> items;
+    items.reserve(requests.size());
+    for (auto &request : requests)
+    {
+      items.push_back(PersistenceManager::SaveItem { request.ctx.get(), request.import_media_path });
+    }
+
+    std::vector<SaveReport> reports;
+    {
+      std::lock_guard<std::mutex> lock(write_mutex);
+      reports = writer->persistence.save(items);
+    }
+
+    for (auto &request : requests)
+    {
+      if (request.ctx->getChat())
+      {
+        cache->invalidate(request.ctx->getChat()->getDatabaseId());
+      }
+    }
+
+    return reports;
+  }
+
+  /**
+   * The chat an import merges into: chat_id or the chat with the name and source of the import. Called with
+   * write_mutex held.
+   *
+   * @return false if chat_id doesn't exist
+   */
+  bool findImportChat(int64_t chat_id, const ImportConfig &import_config, std::optional<ChatRow> &out_chat_row)
+  {
+    if (chat_id == Chat::DB_NO_ID)
+    {
+      out_chat_row = writer->chat_repo.getByName(import_config.chatName,
+          static_cast<int64_t>(import_config.chatSource));
+      return true;
+    }
+
+    try
+    {
+      out_chat_row = writer->chat_repo.getByChatId(chat_id);
+    }
+    catch (const std::runtime_error&)
+    {
+      cerr << "Chat not found: " << chat_id << endl;
+      return false;
+    }
+    return true;
+  }
+
+  /**
+   * Reads the fingerprints of the messages of the chat and maps the senders of the import to the users of the chat
+   * (explicit mappings of the caller come first). Called with write_mutex held.
+   */
+  void prepareMerge(const ChatRow &chat_row, std::unordered_set<int64_t> &out_known_fingerprints,
+      ImportConfig &in_out_import_config)
+  {
+    if (writer->persistence.backfillFingerprints(chat_row.chat_id) > 0)
+    {
+      // the loaded contexts have no fingerprints
+      cache->invalidate(chat_row.chat_id);
+    }
+
+    // only the (chat_id, fingerprint) index is read
+    for (int64_t fingerprint : writer->message_repo.getFingerprintsByChatId(chat_row.chat_id))
+    {
+      out_known_fingerprints.insert(fingerprint);
+    }
+
+    std::vector<int64_t> sender_ids = writer->message_repo.getDistinctSenderIdsByChatId(chat_row.chat_id);
+    for (const UserRow &user_row : writer->user_repo.getByUserIds(sender_ids))
+    {
+      if (!user_row.is_system)
+      {
+        in_out_import_config.userImportMapping.emplace_back(user_row.name, static_cast<int>(user_row.user_id));
+      }
+    }
+  }
+
+  /**
+   * Stores where the next import of the file continues. Called with write_mutex held.
+   */
+  void storeResumePoint(const std::filesystem::path &file, int64_t chat_id,
+      const ImportManager::ResumePoint &resume_point)
+  {
+    ImportStateRow import_state_row;
+    if (resume_point.valid && ImportManager::hashPrefix(file, resume_point.offset, ImportManager::RESUME_PREFIX_LINES,
+        import_state_row.prefix_length, import_state_row.prefix_hash))
+    {
+      import_state_row.chat_id = chat_id;
+      import_state_row.byte_offset = resume_point.offset;
+      import_state_row.last_timestamp = resume_point.last_timestamp;
+      writer->import_state_repo.set(import_state_row);
+    }
+  }
+
+  /**
+   * @return true if the file still has the same lines in front of the resume point of the import state
+   */
+  static bool canResume(const std::filesystem::path &file, uintmax_t file_size, const ImportStateRow &import_state)
+  {
+    return import_state.byte_offset > 0 && import_state.byte_offset <= static_cast<int64_t>(file_size)
+        && ImportManager::verifyPrefix(file, import_state.byte_offset, import_state.prefix_length,
+            import_state.prefix_hash);
+  }
+
+  /**
+   * Commits of other connections aren't seen by save() -> compare the generations of all cached chats. The
+   * generations are read in one query without holding the cache lock.
+   */
+  void checkDataVersion(DatabaseSession &session)
+  {
+    if (session.checkDataVersion())
+    {
+      session.media_repo.reloadLayout();
+      std::vector<int64_t> cached_chat_ids = cache->getChatIds();
+      if (!cached_chat_ids.empty())
+      {
+        cache->revalidate(session.chat_repo.getGenerations(cached_chat_ids));
+      }
+    }
+  }
 };
 
-ChatStorage::ChatStorage(const std::filesystem::path &db_path, const std::filesystem::path &media_perisistence_path) :
+ChatStorage::ChatStorage(const std::filesystem::path &db_path, const std::filesystem::path &media_perisistence_path,
+    const ChatStorageConfig &config) :
     mImpl(std::make_unique<Impl>())
 {
-  mImpl->sql = std::make_unique<SQLiteConnection>(db_path);
+  mImpl->executor = config.executor;
+  if (!mImpl->executor)
+  {
+    mImpl->executor = std::make_shared<Executor>(config.executorThreads, config.pinExecutorThreads);
+  }
+
+  auto sql = std::make_unique<SQLiteConnection>(db_path, SQLiteConnection::Mode::ReadWrite, config.busyTimeoutMs);
+  mImpl->db_path = db_path;
+  mImpl->media_path = media_perisistence_path;
+  mImpl->media_ingest_config = config.mediaIngest;
+  mImpl->busy_timeout_ms = config.busyTimeoutMs;
 
-  mImpl->sql->begin();
-  UserRepository::createTable(*mImpl->sql);
-  MessageRepository::createTable(*mImpl->sql);
-  ChatRepository::createTable(*mImpl->sql);
-  MediaRepository::createTable(*mImpl->sql);
-  mImpl->sql->commit();
+  sql->begin();
+  UserRepository::createTable(*sql);
+  MessageRepository::createTable(*sql);
+  ChatRepository::createTable(*sql);
+  MediaRepository::createTable(*sql);
+  MediaJournalRepository::createTable(*sql);
+  StorageMetaRepository::createTable(*sql);
+  ImportFileRepository::createTable(*sql);
+  ImportStateRepository::createTable(*sql);
+  SaveProgressRepository::createTable(*sql);
+  sql->commit();
 
-  mImpl->user_repo = std::make_unique<UserRepository>(*mImpl->sql);
-  mImpl->user_repo->createSystemUser();
-  mImpl->message_repo = std::make_unique<MessageRepository>(*mImpl->sql);
-  mImpl->chat_repo = std::make_unique<ChatRepository>(*mImpl->sql);
-  mImpl->media_repo = std::make_unique<MediaRepository>(*mImpl->sql, media_perisistence_path);
+  mImpl->writer = std::make_unique<DatabaseSession>(std::move(sql), media_perisistence_path, config.mediaIngest,
+      config.mediaLayout, mImpl->executor.get());
+  mImpl->writer->user_repo.createSystemUser();
+  mImpl->writer->persistence.setChunkedSaveConfig(config.chunkedSave);
 
-  mImpl->persistence = std::make_unique<PersistenceManager>(*mImpl->sql, *mImpl->user_repo, *mImpl->message_repo,
-      *mImpl->chat_repo, *mImpl->media_repo);
+  if (!db_path.empty() && db_path != ":memory:")
+  {
+    size_t reader_connections = config.readerConnections;
+    if (reader_connections == 0)
+    {
+      reader_connections = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    mImpl->readers = std::make_unique<ConnectionPool>(reader_connections,
+        [db_path, media_perisistence_path, config, executor = mImpl->executor.get()]()
+        {
+          auto reader_sql = std::make_unique<SQLiteConnection>(db_path, SQLiteConnection::Mode::ReadOnly,
+              config.busyTimeoutMs);
+          return std::make_unique<DatabaseSession>(std::move(reader_sql), media_perisistence_path, config.mediaIngest,
+              config.mediaLayout, executor);
+        });
+  }
+
+  mImpl->cache = std::make_unique<ChatCache>(config.cacheBudgetBytes);
+
+  mImpl->snapshot_dir = config.snapshotDirectory;
+  if (mImpl->snapshot_dir.empty() && !db_path.empty() && db_path != ":memory:")
+  {
+    mImpl->snapshot_dir = db_path;
+    mImpl->snapshot_dir += ".snapshots";
+  }
+  mImpl->verify_snapshot_checksum = config.verifySnapshotChecksum;
+  mImpl->follow_config = config.follow;
+
+  Impl *impl = mImpl.get();
+  mImpl->save_queue = std::make_unique<SaveQueue>(config.asyncSave, [impl](std::vector<SaveQueue::Request> &requests)
+  {
+    return impl->saveGroup(requests);
+  });
 
   createChatEntries();
+
+  // finish the media file operations of a save that was interrupted
+  resumeMediaJournal();
 }
 
 ChatStorage::~ChatStorage() = default;
 
 std::filesystem::path ChatStorage::getMediaPersistencePath()
 {
-  return mImpl->media_repo->getMediaPersistencePath();
+  // immutable after the construction
+  return mImpl->writer->media_repo.getMediaPersistencePath();
+}
+
+std::filesystem::path ChatStorage::resolveMediaPath(const Media &media)
+{
+  return resolveMediaPath(media.getDatabaseId());
+}
+
+std::filesystem::path ChatStorage::resolveMediaPath(int64_t media_database_id)
+{
+  ConnectionPool::Lease session = mImpl->acquireReader();
+  mImpl->checkDataVersion(*session);
+
+  try
+  {
+    MediaRow media_row = session->media_repo.getByMediaId(media_database_id);
+    return session->media_repo.resolveMediaPath(media_row);
+  }
+  catch (const std::runtime_error&)
+  {
+    return {};
+  }
+}
+
+MediaHandlePtr ChatStorage::openMedia(int64_t media_database_id)
+{
+  ConnectionPool::Lease session = mImpl->acquireReader();
+  mImpl->checkDataVersion(*session);
+
+  // a compaction may move a packed media between reading the index and opening the segment -> read again
+  for (int attempt = 0; attempt < 2; attempt++)
+  {
+    MediaRow media_row;
+    try
+    {
+      media_row = session->media_repo.getByMediaId(media_database_id);
+    }
+    catch (const std::runtime_error&)
+    {
+      return nullptr;
+    }
+
+    auto file = std::make_unique<MappedFile>();
+    bool opened = false;
+    if (media_row.storage == MediaRow::STORAGE_PACK)
+    {
+      fs::path segment_path = session->media_repo.getPackStore().getSegmentPath(media_row.pack_id);
+      opened = file->open(segment_path, media_row.pack_offset, media_row.pack_length)
+          && file->size() == static_cast<size_t>(media_row.pack_length);
+    }
+    else
+    {
+      fs::path media_path = session->media_repo.resolveMediaPath(media_row);
+      if (media_path.empty())
+      {
+        // a referenced source that was changed or removed after the import
+        return nullptr;
+      }
+      opened = file->open(media_path)
+          && (media_row.storage != MediaRow::STORAGE_REFERENCE || file->size() == static_cast<size_t>(media_row.source_size));
+    }
+
+    if (opened)
+    {
+      // the constructor is private, so std::make_unique isn't possible
+      return MediaHandlePtr(new MediaHandle(media_database_id, static_cast<MediaType>(media_row.type),
+          media_row.mime_type, std::move(file)));
+    }
+  }
+
+  return nullptr;
+}
+
+MediaGcStats ChatStorage::collectMediaGarbage(const MediaGcConfig &config)
+{
+  if (mImpl->media_path.empty())
+  {
+    return {};
+  }
+
+  // the scan and the rate limited deletes take long; a file that is copied by a save in the meantime has its row
+  // yet committed, so the collector doesn't need the write_mutex
+  ConnectionPool::Lease session = mImpl->acquireReader();
+  MediaGarbageCollector garbage_collector(session->media_repo, mImpl->media_ingest_config.workers);
+  return garbage_collector.run(config);
+}
+
+MediaIngestStats ChatStorage::resumeMediaJournal()
+{
+  std::vector<MediaIngestFailure> failures;
+  MediaIngestStats stats;
+  {
+    std::lock_guard<std::mutex> lock(mImpl->write_mutex);
+    stats = mImpl->writer->media_repo.resumeJournal(failures);
+  }
+
+  for (const auto &failure : failures)
+  {
+    cerr << "Resumed media action failed: " << failure.source << ": " << failure.error << endl;
+  }
+
+  return stats;
+}
+
+MediaLayout ChatStorage::getMediaLayout() const
+{
+  std::lock_guard<std::mutex> lock(mImpl->write_mutex);
+  return mImpl->writer->media_repo.getLayout();
+}
+
+MediaLayoutMigrationStats ChatStorage::migrateMediaLayout(MediaLayout target_layout)
+{
+  // switch first: all media saved from now on are written in the new layout
+  {
+    std::lock_guard<std::mutex> lock(mImpl->write_mutex);
+    mImpl->writer->media_repo.switchLayout(target_layout);
+  }
+
+  // the files of the old layout are still found by resolveMediaPath() -> the saves aren't blocked while they're moved
+  ConnectionPool::Lease session = mImpl->acquireReader();
+  return session->media_repo.moveFilesToLayout(target_layout);
+}
+
+MediaPackCompactionStats ChatStorage::compactMediaPacks(double min_garbage_ratio)
+{
+  std::lock_guard<std::mutex> lock(mImpl->write_mutex);
+  return mImpl->writer->media_repo.compactPacks(min_garbage_ratio);
+}
+
+std::future<MediaPackCompactionStats> ChatStorage::compactMediaPacksAsync(double min_garbage_ratio)
+{
+  if (mImpl->db_path.empty() || mImpl->db_path == ":memory:")
+  {
+    throw std::runtime_error("ChatStorage: background compaction needs a database file"); // TODO: custom exception
+  }
+
+  // only copies are captured, the task doesn't depend on the lifetime of this object
+  return std::async(std::launch::async,
+      [db_path = mImpl->db_path, media_path = mImpl->media_path, config = mImpl->media_ingest_config,
+          busy_timeout_ms = mImpl->busy_timeout_ms, executor = mImpl->executor, min_garbage_ratio]()
+      {
+        SQLiteConnection sql(db_path, SQLiteConnection::Mode::ReadWrite, busy_timeout_ms);
+        MediaRepository media_repo(sql, media_path, config);
+        media_repo.setExecutor(executor.get());
+        return media_repo.compactPacks(min_garbage_ratio);
+      });
 }
 
 void ChatStorage::createChatEntries()
 {
-  mChatEntryList.clear();
-  size_t chat_index = 0;
-  for (const auto &chat : listChats())
+  // only called from the constructor or with the write_mutex held
+  std::vector<ChatEntry> chat_entry_list;
+  for (const auto &chat : mImpl->writer->persistence.listChats())
   {
     ChatEntry chat_entry = {};
     chat_entry.database_id = chat.getDatabaseId();
     chat_entry.name = chat.getName();
-    mChatEntryList.emplace_back(chat_entry);
-    chat_index++;
+    chat_entry_list.emplace_back(chat_entry);
   }
+
+  std::lock_guard<std::mutex> lock(mImpl->chat_entry_mutex);
+  mChatEntryList = std::move(chat_entry_list);
 }
 
 std::vector<ChatEntry> ChatStorage::getChatEntryList()
 {
+  std::lock_guard<std::mutex> lock(mImpl->chat_entry_mutex);
   return mChatEntryList;
 }
 
-std::vector<Chat> ChatStorage::listChats()
+std::unique_ptr<ChatContext> ChatStorage::loadByChatEntry(ChatEntry chat_entry)
 {
-  return mImpl->persistence->listChats();
+  ConnectionPool::Lease session = mImpl->acquireReader();
+  ReadTransaction read_transaction(session->sql);
+  return session->persistence.loadByChatId(chat_entry.database_id);
 }
 
-std::unique_ptr<ChatContext> ChatStorage::loadByChatEntry(ChatEntry chat_entry)
+std::unique_ptr<ChatContext> ChatStorage::loadByChatId(int64_t chat_id)
 {
-  return mImpl->persistence->loadByChatId(chat_entry.database_id);
+  if (!mImpl->cache->isEnabled())
+  {
+    ConnectionPool::Lease session = mImpl->acquireReader();
+    ReadTransaction read_transaction(session->sql);
+    return session->persistence.loadByChatId(chat_id);
+  }
+
+  return loadSnapshotByChatId(chat_id)->getContext().clone();
 }
 
-std::unique_ptr<ChatContext> ChatStorage::loadByChatId(int64_t chat_id)
+ChatSnapshotPtr ChatStorage::loadSnapshotByChatId(int64_t chat_id)
+{
+  ConnectionPool::Lease session = mImpl->acquireReader();
+  mImpl->checkDataVersion(*session);
+
+  ChatSnapshotPtr snapshot = mImpl->cache->get(chat_id);
+  if (!snapshot)
+  {
+    uint64_t epoch = mImpl->cache->getEpoch();
+
+    // the generation and the chat are read from the same database snapshot
+    ReadTransaction read_transaction(session->sql);
+    int64_t generation = session->chat_repo.getGeneration(chat_id);
+    snapshot = ChatSnapshot::create(session->persistence.loadByChatId(chat_id));
+    mImpl->cache->put(chat_id, generation, snapshot, epoch);
+  }
+
+  return snapshot;
+}
+
+size_t ChatStorage::refresh(ChatContext &ctx)
+{
+  ConnectionPool::Lease session = mImpl->acquireReader();
+  ReadTransaction read_transaction(session->sql);
+  return session->persistence.refresh(ctx);
+}
+
+MappedChatPtr ChatStorage::openMappedChat(int64_t chat_id)
+{
+  int64_t generation = -1;
+  {
+    ConnectionPool::Lease session = mImpl->acquireReader();
+    generation = session->chat_repo.getGeneration(chat_id);
+  }
+  if (generation < 0)
+  {
+    return nullptr;
+  }
+
+  std::filesystem::path snapshot_path = mImpl->getSnapshotPath(chat_id);
+
+  MappedChatPtr mapped_chat = ChatSnapshotFile::open(snapshot_path, mImpl->verify_snapshot_checksum);
+  if (mapped_chat && mapped_chat->getChatDatabaseId() == chat_id && mapped_chat->getGeneration() == generation)
+  {
+    return mapped_chat;
+  }
+
+  // missing, invalid or outdated -> write a new one (an already mapped old file stays valid after the rename)
+  mapped_chat.reset();
+  if (!writeMappedSnapshot(chat_id))
+  {
+    return nullptr;
+  }
+
+  return ChatSnapshotFile::open(snapshot_path, mImpl->verify_snapshot_checksum);
+}
+
+bool ChatStorage::writeMappedSnapshot(int64_t chat_id)
+{
+  // read the generation before the chat to never label newer data with an older generation
+  int64_t generation = -1;
+  {
+    ConnectionPool::Lease session = mImpl->acquireReader();
+    generation = session->chat_repo.getGeneration(chat_id);
+  }
+  if (generation < 0)
+  {
+    return false;
+  }
+
+  ChatSnapshotPtr snapshot = loadSnapshotByChatId(chat_id);
+  return ChatSnapshotFile::write(snapshot->getContext(), generation, mImpl->getSnapshotPath(chat_id));
+}
+
+ChatCacheStats ChatStorage::getCacheStats() const
 {
-  return mImpl->persistence->loadByChatId(chat_id);
+  return mImpl->cache->getStats();
 }
 
-void ChatStorage::save(ChatContext& ctx, const std::filesystem::path& import_media_path)
+Executor& ChatStorage::getExecutor()
 {
-  mImpl->persistence->save(ctx, import_media_path);
+  return *mImpl->executor;
 }
 
+void ChatStorage::setCacheBudget(size_t budget_bytes)
+{
+  mImpl->cache->setBudget(budget_bytes);
+}
+
+MediaDedupStats ChatStorage::deduplicateMedia()
+{
+  std::lock_guard<std::mutex> lock(mImpl->write_mutex);
+  MediaDedupStats stats = mImpl->writer->persistence.deduplicateMedia();
+
+  if (stats.duplicates > 0)
+  {
+    // loaded chats might reference a removed media_id
+    mImpl->cache->clear();
+  }
+
+  return stats;
+}
+
+ChatDeleteStats ChatStorage::deleteChat(int64_t chat_id)
+{
+  ChatDeleteStats stats;
+
+  // the write lock is only held for one batch, so saves continue between the batches
+  bool more_batches = true;
+  while (more_batches)
+  {
+    std::lock_guard<std::mutex> lock(mImpl->write_mutex);
+    more_batches = mImpl->writer->persistence.deleteChatBatch(chat_id, stats);
+
+    // a load between two batches shouldn't be served the complete chat from the cache
+    mImpl->cache->invalidate(chat_id);
+
+    if (stats.deleted)
+    {
+      if (!mImpl->snapshot_dir.empty())
+      {
+        std::error_code ec;
+        fs::remove(mImpl->getSnapshotPath(chat_id), ec);
+      }
+
+      createChatEntries();
+    }
+  }
+
+  if (!stats.deleted)
+  {
+    return stats;
+  }
+
+  int64_t step_pages = 0;
+  do
+  {
+    std::lock_guard<std::mutex> lock(mImpl->write_mutex);
+    step_pages = mImpl->writer->persistence.vacuumIncrementalStep(PersistenceManager::VACUUM_STEP_PAGES);
+    stats.pages_freed += step_pages;
+  } while (step_pages > 0);
+
+  return stats;
+}
+
+std::vector<InterruptedSave> ChatStorage::getInterruptedSaves()
+{
+  std::lock_guard<std::mutex> lock(mImpl->write_mutex);
+
+  std::vector<InterruptedSave> saves;
+  for (const SaveProgressRow &progress_row : mImpl->writer->save_progress_repo.getAll())
+  {
+    InterruptedSave save;
+    save.chat_id = progress_row.chat_id;
+    save.new_chat = progress_row.new_chat;
+    save.first_message_id = progress_row.first_message_id;
+    save.messages_saved = progress_row.messages_saved;
+    save.started_at = progress_row.started_at;
+    saves.push_back(save);
+  }
+
+  return saves;
+}
+
+ChatDeleteStats ChatStorage::discardInterruptedSave(int64_t chat_id)
+{
+  std::lock_guard<std::mutex> lock(mImpl->write_mutex);
+  ChatDeleteStats stats = mImpl->writer->persistence.discardInterruptedSave(chat_id);
+
+  mImpl->cache->invalidate(chat_id);
+
+  if (stats.deleted)
+  {
+    if (!mImpl->snapshot_dir.empty())
+    {
+      std::error_code ec;
+      fs::remove(mImpl->getSnapshotPath(chat_id), ec);
+    }
+
+    createChatEntries();
+  }
+
+  return stats;
+}
+
+SaveReport ChatStorage::save(ChatContext& ctx, const std::filesystem::path& import_media_path)
+{
+  std::lock_guard<std::mutex> lock(mImpl->write_mutex);
+  SaveReport report = mImpl->writer->persistence.save(ctx, import_media_path);
+
+  if (ctx.getChat())
+  {
+    mImpl->cache->invalidate(ctx.getChat()->getDatabaseId());
+  }
+
+  return report;
+}
+
+SaveAllReport ChatStorage::saveAll(const std::vector<ChatContext*> &contexts,
+    const std::filesystem::path& import_media_path)
+{
+  std::vector<PersistenceManager::SaveItem> items;
+  items.reserve(contexts.size());
+  for (ChatContext *ctx : contexts)
+  {
+    items.push_back(PersistenceManager::SaveItem { ctx, import_media_path });
+  }
+
+  SaveAllReport report;
+  {
+    std::lock_guard<std::mutex> lock(mImpl->write_mutex);
+    report = mImpl->writer->persistence.saveAll(items);
+  }
+
+  for (ChatContext *ctx : contexts)
+  {
+    if (ctx->getChat())
+    {
+      mImpl->cache->invalidate(ctx->getChat()->getDatabaseId());
+    }
+  }
+
+  return report;
+}
+
+std::future<SaveReport> ChatStorage::saveAsync(std::unique_ptr<ChatContext> ctx, const std::filesystem::path& import_media_path)
+{
+  return mImpl->save_queue->push(std::move(ctx), import_media_path);
+}
+
+ImportResult ChatStorage::importFile(const std::filesystem::path &file, const ImportConfig &import_config, int64_t chat_id)
+{
+  ImportResult result;
+
+  std::error_code ec;
+  uintmax_t file_size = fs::file_size(file, ec);
+  uint64_t file_hash = 0;
+  if (ec || !HashUtil::xxh64File(file, file_hash))
+  {
+    cerr << "Error to read the file: " << file << endl;
+    return result;
+  }
+  std::string file_hash_hex = HashUtil::toHex(file_hash);
+
+  ImportConfig merge_import_config = import_config;
+  if (!merge_import_config.executor)
+  {
+    merge_import_config.executor = mImpl->executor;
+  }
+  std::optional<ChatRow> chat_row;
+  std::optional<ImportStateRow> import_state;
+  std::unordered_set<int64_t> known_fingerprints;
+  {
+    std::lock_guard<std::mutex> lock(mImpl->write_mutex);
+    DatabaseSession &session = *mImpl->writer;
+
+    if (!mImpl->findImportChat(chat_id, import_config, chat_row))
+    {
+      return result;
+    }
+
+    if (chat_row)
+    {
+      result.chat_id = chat_row->chat_id;
+
+      if (session.import_file_repo.contains(chat_row->chat_id, file_hash_hex, static_cast<int64_t>(file_size)))
+      {
+        result.committed = true;
+        result.skipped = true;
+        return result;
+      }
+
+      import_state = session.import_state_repo.getByChatId(chat_row->chat_id);
+      mImpl->prepareMerge(*chat_row, known_fingerprints, merge_import_config);
+    }
+  }
+
+  ImportManager::MergeState merge_state;
+  merge_state.known_fingerprints = chat_row ? &known_fingerprints : nullptr;
+
+  // the file still has the lines in front of the last imported messages -> only parse from there on
+  if (import_state && Impl::canResume(file, file_size, *import_state))
+  {
+    merge_state.start_offset = import_state->byte_offset;
+    result.resumed = true;
+    result.resume_offset = import_state->byte_offset;
+  }
+
+  // parsing and probing the media doesn't block other writers
+  auto ctx = std::make_unique<ChatContext>();
+  bool import_ok = ImportManager::importFromFile(file, merge_import_config, *ctx, result.import, &merge_state);
+
+  // the tail has to continue with the last imported messages and must not go back in time, otherwise the occurrence
+  // numbers of the fingerprints would differ from a complete parse
+  if (result.resumed && (!import_ok || merge_state.first_timestamp != import_state->last_timestamp
+      || merge_state.min_timestamp < import_state->last_timestamp))
+  {
+    ctx = std::make_unique<ChatContext>();
+    result.import = ImportReport {};
+    result.resumed = false;
+    result.resume_offset = 0;
+    merge_state = ImportManager::MergeState {};
+    merge_state.known_fingerprints = &known_fingerprints;
+    import_ok = ImportManager::importFromFile(file, merge_import_config, *ctx, result.import, &merge_state);
+  }
+
+  if (!import_ok)
+  {
+    return result;
+  }
+
+  if (chat_row)
+  {
+    ctx->setChat(std::make_unique<Chat>(Chat::RT_START_ID, chat_row->chat_id, chat_row->name,
+        static_cast<ChatSource>(chat_row->source)));
+  }
+
+  fs::path import_media_path = import_config.mediaDirectory.empty() ? file.parent_path() : import_config.mediaDirectory;
+  result.save = save(*ctx, import_media_path);
+  if (!result.save.committed)
+  {
+    return result;
+  }
+
+  result.committed = true;
+  result.chat_id = ctx->getChat()->getDatabaseId();
+  result.messages_existing = result.import.messages_known + result.save.messages_existing;
+  result.messages_new = result.import.messages_parsed - result.messages_existing;
+
+  {
+    std::lock_guard<std::mutex> lock(mImpl->write_mutex);
+
+    // not in the save transaction: a lost entry only costs parsing the complete file again
+    ImportFileRow import_file_row;
+    import_file_row.chat_id = result.chat_id;
+    import_file_row.file_hash = file_hash_hex;
+    import_file_row.file_size = static_cast<int64_t>(file_size);
+    import_file_row.imported_at = static_cast<int64_t>(std::time(nullptr));
+    import_file_row.messages = static_cast<int64_t>(result.messages_new);
+    mImpl->writer->import_file_repo.insert(import_file_row);
+
+    mImpl->storeResumePoint(file, result.chat_id, merge_state.resume_point);
+
+    if (!chat_row)
+    {
+      createChatEntries();
+    }
+  }
+
+  return result;
+}
+
+FollowStats ChatStorage::followFile(const std::filesystem::path &file, const ImportConfig &import_config,
+    const std::atomic<bool> &stop, int64_t chat_id, const std::function<void(const FollowStats&)> &on_commit)
+{
+  FollowStats stats;
+  const FollowConfig &follow_config = mImpl->follow_config;
+
+  // only a regular file could be read again, a pipe is read once from its start
+  std::error_code ec;
+  bool regular_file = file != "-" && fs::is_regular_file(file, ec);
+
+  ImportConfig merge_import_config = import_config;
+  if (!merge_import_config.executor)
+  {
+    merge_import_config.executor = mImpl->executor;
+  }
+  if (merge_import_config.mediaDirectory.empty() && file != "-")
+  {
+    merge_import_config.mediaDirectory = file.parent_path().empty() ? fs::path(".") : file.parent_path();
+  }
+
+  std::optional<ChatRow> chat_row;
+  std::optional<ImportStateRow> import_state;
+  std::unordered_set<int64_t> known_fingerprints;
+  {
+    std::lock_guard<std::mutex> lock(mImpl->write_mutex);
+
+    if (!mImpl->findImportChat(chat_id, import_config, chat_row))
+    {
+      return stats;
+    }
+
+    if (chat_row)
+    {
+      stats.chat_id = chat_row->chat_id;
+      if (regular_file)
+      {
+        import_state = mImpl->writer->import_state_repo.getByChatId(chat_row->chat_id);
+      }
+      mImpl->prepareMerge(*chat_row, known_fingerprints, merge_import_config);
+    }
+  }
+
+  int64_t start_offset = 0;
+  if (import_state && Impl::canResume(file, fs::file_size(file, ec), *import_state))
+  {
+    start_offset = import_state->byte_offset;
+    stats.resumed = true;
+    stats.resume_offset = start_offset;
+  }
+
+  TailReader reader;
+  if (!reader.open(file, start_offset))
+  {
+    cerr << "Error to open the file: " << file << endl;
+    return stats;
+  }
+
+  auto tail_importer = std::make_unique<TailImporter>(merge_import_config, &known_fingerprints, start_offset);
+
+  auto restart = [&]()
+  {
+    stats.restarts++;
+    stats.resumed = false;
+    tail_importer = std::make_unique<TailImporter>(merge_import_config, &known_fingerprints, 0);
+    return reader.open(file, 0);
+  };
+
+  auto commit = [&]()
+  {
+    auto ctx = std::make_unique<ChatContext>();
+    ImportReport batch_report;
+    bool import_ok = tail_importer->takeBatch(*ctx, batch_report);
+    stats.missing_media.insert(stats.missing_media.end(), batch_report.missing_media.begin(),
+        batch_report.missing_media.end());
+    if (!import_ok)
+    {
+      return false;
+    }
+
+    if (chat_row)
+    {
+      ctx->setChat(std::make_unique<Chat>(Chat::RT_START_ID, chat_row->chat_id, chat_row->name,
+          static_cast<ChatSource>(chat_row->source)));
+    }
+
+    SaveReport save_report = save(*ctx, merge_import_config.mediaDirectory);
+    stats.media_failures.insert(stats.media_failures.end(), save_report.media_failures.begin(),
+        save_report.media_failures.end());
+    if (!save_report.committed)
+    {
+      return false;
+    }
+
+    size_t messages_existing = batch_report.messages_known + save_report.messages_existing;
+    stats.batches++;
+    stats.messages_existing += messages_existing;
+    stats.messages_new += batch_report.messages_parsed - messages_existing;
+
+    // the next batches continue the chat of the first one
+    for (const Message &message : ctx->getMessageList())
+    {
+      known_fingerprints.insert(message.getFingerprint());
+    }
+    for (const User &user : ctx->getUserList())
+    {
+      if (!user.isSystem())
+      {
+        tail_importer->mapUser(user.getName(), user.getDatabaseId());
+      }
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mImpl->write_mutex);
+
+      if (!chat_row)
+      {
+        const Chat &chat = *ctx->getChat();
+        chat_row = ChatRow { chat.getDatabaseId(), 0, chat.getName(), static_cast<int64_t>(chat.getSource()) };
+        stats.chat_id = chat_row->chat_id;
+        createChatEntries();
+      }
+
+      // not in the save transaction: a lost resume point only costs parsing more of the file again
+      if (regular_file)
+      {
+        mImpl->storeResumePoint(file, stats.chat_id, tail_importer->getMergeState().resume_point);
+      }
+    }
+
+    if (on_commit)
+    {
+      on_commit(stats);
+    }
+    return true;
+  };
+
+  std::string data;
+  bool end_of_input = false;
+  while (!end_of_input && !stop)
+  {
+    auto latency = std::chrono::milliseconds(follow_config.maxLatencyMs);
+    int timeout_ms = static_cast<int>(follow_config.idleWakeMs);
+    if (tail_importer->pendingMessages() > 0)
+    {
+      auto waited = std::chrono::steady_clock::now() - tail_importer->pendingSince();
+      auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(latency - waited).count();
+      timeout_ms = static_cast<int>(std::max<int64_t>(0, std::min<int64_t>(remaining, timeout_ms)));
+    }
+
+    data.clear();
+    switch (reader.read(data, timeout_ms))
+    {
+      case TailReader::Status::Data:
+        stats.bytes_read += static_cast<int64_t>(data.size());
+        if (!tail_importer->feed(data.data(), data.size()))
+        {
+          return stats;
+        }
+        break;
+
+      case TailReader::Status::End:
+        end_of_input = true;
+        if (!tail_importer->finish())
+        {
+          return stats;
+        }
+        break;
+
+      case TailReader::Status::Truncated:
+        // the complete messages of the former content are stored, the new content is a new export
+        if ((tail_importer->pendingMessages() > 0 && !commit()) || !restart())
+        {
+          return stats;
+        }
+        continue;
+
+      case TailReader::Status::Error:
+        cerr << "Error to read the file: " << file << endl;
+        return stats;
+
+      case TailReader::Status::Timeout:
+      default:
+        break;
+    }
+
+    // like importFile(): the tail has to continue with the last imported messages and must not go back in time
+    const ImportManager::MergeState &merge_state = tail_importer->getMergeState();
+    if (stats.resumed && merge_state.first_timestamp && (merge_state.first_timestamp != import_state->last_timestamp
+        || merge_state.min_timestamp < import_state->last_timestamp))
+    {
+      if (!restart())
+      {
+        return stats;
+      }
+      continue;
+    }
+
+    size_t pending_messages = tail_importer->pendingMessages();
+    if (pending_messages >= follow_config.maxBatchMessages || (pending_messages > 0
+        && std::chrono::steady_clock::now() - tail_importer->pendingSince() >= latency))
+    {
+      if (!commit())
+      {
+        return stats;
+      }
+    }
+  }
+
+  if (tail_importer->pendingMessages() > 0 && !commit())
+  {
+    return stats;
+  }
+
+  stats.ok = true;
+  return stats;
+}
@@ -10,26 +10,28 @@
 // project internal
 #include "importer/ImportManager.h"
 
-// system
-#include <iostream>
-#include <fstream>
-
 using namespace std;
 
 bool ChatStorageImporter::importFromStream(std::istream& in_stream, const ImportConfig &import_config, ChatContext& out_ctx)
 {
-  return ImportManager::importFromStream(in_stream, import_config, out_ctx);
+  ImportReport import_report;
+  return importFromStream(in_stream, import_config, out_ctx, import_report);
 }
 
-bool ChatStorageImporter::importFromFile(const std::string& filename, const ImportConfig &import_config, ChatContext& out_ctx)
+bool ChatStorageImporter::importFromStream(std::istream& in_stream, const ImportConfig &import_config, ChatContext& out_ctx,
+    ImportReport &out_report)
 {
-  std::ifstream import_stream(filename);
+  return ImportManager::importFromStream(in_stream, import_config, out_ctx, out_report);
+}
 
-  if (!import_stream)
-  {
-    std::cerr << "Error to open the file: " << filename << endl;
-    return false;
-  }
+bool ChatStorageImporter::importFromFile(const std::string& filename, const ImportConfig &import_config, ChatContext& out_ctx)
+{
+  ImportReport import_report;
+  return importFromFile(filename, import_config, out_ctx, import_report);
+}
 
-  return importFromStream(import_stream, import_config, out_ctx);
+bool ChatStorageImporter::importFromFile(const std::string& filename, const ImportConfig &import_config, ChatContext& out_ctx,
+    ImportReport &out_report)
+{
+  return ImportManager::importFromFile(filename, import_config, out_ctx, out_report);
 }
@@ -0,0 +1,352 @@
+/*
+ * Executor.cpp
+ *
+ *      Author: Andreas Volz
+ */
+
+// project public API
+#include "chatstorage/Executor.h"
+
+// system
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+#include <vector>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace
+{
+// the executor and deque index of a worker thread; nullptr in other threads
+thread_local const void *current_executor = nullptr;
+thread_local size_t current_worker = 0;
+}
+
+struct Executor::Impl
+{
+  struct Worker
+  {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+    std::thread thread;
+  };
+
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::atomic<size_t> queued { 0 };
+  std::atomic<size_t> next_worker { 0 };
+  bool pin_threads = false;
+
+  // idle workers and the groups waited for in a worker sleep on wake, any of them can take a new task. A thread
+  // outside the executor only waits for the tasks of its group -> it sleeps on foreign_wake, so it never consumes the
+  // wakeup a worker needs.
+  std::mutex wake_mutex;
+  std::condition_variable wake;
+  std::condition_variable foreign_wake;
+  bool stop = false;
+};
+
+Executor::Executor(unsigned threads, bool pin_threads) :
+    mImpl(std::make_unique<Impl>())
+{
+  if (threads == 0)
+  {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  mImpl->pin_threads = pin_threads;
+
+  // all deques have to exist before the first worker steals
+  for (unsigned i = 0; i < threads; i++)
+  {
+    mImpl->workers.push_back(std::make_unique<Impl::Worker>());
+  }
+
+  for (unsigned i = 0; i < threads; i++)
+  {
+    mImpl->workers[i]->thread = std::thread([this, i]()
+    {
+      current_executor = this;
+      current_worker = i;
+
+#ifdef __linux__
+      if (mImpl->pin_threads)
+      {
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        CPU_SET(i % std::max(1u, std::thread::hardware_concurrency()), &cpu_set);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+      }
+#endif
+
+      while (true)
+      {
+        if (runQueuedTask())
+        {
+          continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mImpl->wake_mutex);
+        mImpl->wake.wait(lock, [this]()
+        {
+          return mImpl->stop || mImpl->queued > 0;
+        });
+
+        if (mImpl->stop && mImpl->queued == 0)
+        {
+          return;
+        }
+      }
+    });
+  }
+}
+
+Executor::~Executor()
+{
+  {
+    std::lock_guard<std::mutex> lock(mImpl->wake_mutex);
+    mImpl->stop = true;
+  }
+  mImpl->wake.notify_all();
+
+  for (auto &worker : mImpl->workers)
+  {
+    worker->thread.join();
+  }
+}
+
+unsigned Executor::getThreadCount() const
+{
+  return static_cast<unsigned>(mImpl->workers.size());
+}
+
+void Executor::submit(Task task)
+{
+  size_t index;
+  if (current_executor == this)
+  {
+    index = current_worker;
+  }
+  else
+  {
+    index = mImpl->next_worker++ % mImpl->workers.size();
+  }
+
+  {
+    Impl::Worker &worker = *mImpl->workers[index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    worker.tasks.push_back(std::move(task));
+  }
+
+  // the lock orders the increment before the check of a thread that is about to sleep
+  {
+    std::lock_guard<std::mutex> lock(mImpl->wake_mutex);
+    mImpl->queued++;
+  }
+  mImpl->wake.notify_one();
+  mImpl->foreign_wake.notify_all();
+}
+
+bool Executor::runQueuedTask(const TaskGroup *only_group)
+{
+  if (mImpl->queued == 0)
+  {
+    return false;
+  }
+
+  Task task;
+  bool found = false;
+  size_t worker_count = mImpl->workers.size();
+  size_t start = 0;
+
+  if (only_group)
+  {
+    for (size_t i = 0; !found && i < worker_count; i++)
+    {
+      Impl::Worker &worker = *mImpl->workers[i];
+      std::lock_guard<std::mutex> lock(worker.mutex);
+      auto it = std::find_if(worker.tasks.begin(), worker.tasks.end(), [only_group](const Task &queued_task)
+      {
+        return queued_task.group == only_group;
+      });
+      if (it != worker.tasks.end())
+      {
+        task = std::move(*it);
+        worker.tasks.erase(it);
+        task.group->mQueued--;
+        found = true;
+      }
+    }
+  }
+
+  // LIFO from the own deque: the newest task works on the data the worker just touched
+  else if (current_executor == this)
+  {
+    start = current_worker;
+    Impl::Worker &worker = *mImpl->workers[start];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (!worker.tasks.empty())
+    {
+      task = std::move(worker.tasks.back());
+      worker.tasks.pop_back();
+      task.group->mQueued--;
+      found = true;
+    }
+  }
+
+  // FIFO when stealing: the oldest task of another worker is likely the biggest one
+  for (size_t i = 1; !found && i <= worker_count; i++)
+  {
+    Impl::Worker &worker = *mImpl->workers[(start + i) % worker_count];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (!worker.tasks.empty())
+    {
+      task = std::move(worker.tasks.front());
+      worker.tasks.pop_front();
+      task.group->mQueued--;
+      found = true;
+    }
+  }
+
+  if (!found)
+  {
+    return false;
+  }
+
+  mImpl->queued--;
+  runTask(task);
+  return true;
+}
+
+void Executor::notifyAll()
+{
+  {
+    std::lock_guard<std::mutex> lock(mImpl->wake_mutex);
+  }
+  mImpl->wake.notify_all();
+  mImpl->foreign_wake.notify_all();
+}
+
+void Executor::runTask(Task &task)
+{
+  std::exception_ptr error;
+  if (!task.group->isCancelled())
+  {
+    try
+    {
+      task.func();
+    }
+    catch (...)
+    {
+      error = std::current_exception();
+    }
+  }
+
+  // the group may be destroyed as soon as its last task is finished
+  task.func = nullptr;
+  task.group->finishTask(error);
+}
+
+Executor::TaskGroup::TaskGroup(Executor &executor) :
+    mExecutor(executor)
+{
+}
+
+Executor::TaskGroup::~TaskGroup()
+{
+  try
+  {
+    wait();
+  }
+  catch (...)
+  {
+  }
+}
+
+void Executor::TaskGroup::run(std::function<void()> task)
+{
+  mPending++;
+  mQueued++;
+  mExecutor.submit(Task { std::move(task), this });
+}
+
+void Executor::TaskGroup::wait()
+{
+  Impl &impl = *mExecutor.mImpl;
+
+  // another thread may hold locks (e.g. the write_mutex of a storage) -> it only runs the tasks of this group, an
+  // unrelated long task would keep it from continuing
+  const TaskGroup *only_group = current_executor == &mExecutor ? nullptr : this;
+
+  while (mPending > 0)
+  {
+    // help instead of blocking, otherwise a wait() in a task could block all workers
+    if (mExecutor.runQueuedTask(only_group))
+    {
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(impl.wake_mutex);
+    if (only_group)
+    {
+      impl.foreign_wake.wait(lock, [this]()
+      {
+        return mPending == 0 || mQueued > 0;
+      });
+    }
+    else
+    {
+      impl.wake.wait(lock, [this, &impl]()
+      {
+        return mPending == 0 || impl.queued > 0;
+      });
+    }
+  }
+
+  // the wakeup of a new task may have reached this worker instead of an idle one
+  if (!only_group && impl.queued > 0)
+  {
+    impl.wake.notify_one();
+  }
+
+  std::exception_ptr error;
+  {
+    std::lock_guard<std::mutex> lock(mErrorMutex);
+    std::swap(error, mError);
+  }
+
+  if (error)
+  {
+    std::rethrow_exception(error);
+  }
+}
+
+void Executor::TaskGroup::cancel()
+{
+  mCancelled = true;
+}
+
+bool Executor::TaskGroup::isCancelled() const
+{
+  return mCancelled;
+}
+
+void Executor::TaskGroup::finishTask(std::exception_ptr error)
+{
+  if (error)
+  {
+    std::lock_guard<std::mutex> lock(mErrorMutex);
+    if (!mError)
+    {
+      mError = error;
+    }
+    mCancelled = true;
+  }
+
+  Executor &executor = mExecutor;
+  if (--mPending == 0)
+  {
+    executor.notifyAll();
+  }
+}
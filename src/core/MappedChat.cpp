@@ -0,0 +1,250 @@
+/*
+ * MappedChat.cpp
+ *
+ *      Author: Andreas Volz
+ */
+
+// project public API
+#include "chatstorage/MappedChat.h"
+
+// project private
+#include "database/ChatSnapshotFile.h"
+#include "common/HashUtil.h"
+#include "common/MappedFile.h"
+
+// system
+#include <stdexcept>
+
+using namespace std;
+
+namespace
+{
+
+  const ChatSnapshotFile::Header& header(const void *header)
+  {
+    return *static_cast<const ChatSnapshotFile::Header*>(header);
+  }
+
+} // namespace
+
+MappedChat::MappedChat(std::unique_ptr<MappedFile> file) :
+    mFile(std::move(file))
+{
+}
+
+MappedChat::~MappedChat() = default;
+
+int64_t MappedChat::getChatDatabaseId() const
+{
+  return header(mHeader).chat_id;
+}
+
+int64_t MappedChat::getGeneration() const
+{
+  return header(mHeader).generation;
+}
+
+std::string_view MappedChat::getName() const
+{
+  return textAt(header(mHeader).chat_name_offset, header(mHeader).chat_name_length);
+}
+
+ChatSource MappedChat::getSource() const
+{
+  return static_cast<ChatSource>(header(mHeader).chat_source);
+}
+
+size_t MappedChat::getUserCount() const
+{
+  return header(mHeader).user_count;
+}
+
+int64_t MappedChat::getUserDatabaseId(size_t user_runtime_id) const
+{
+  if (user_runtime_id >= getUserCount())
+  {
+    throw std::out_of_range("MappedChat: user_runtime_id out of range");
+  }
+  return reinterpret_cast<const ChatSnapshotFile::UserRecord*>(mUsers)[user_runtime_id].database_id;
+}
+
+std::string_view MappedChat::getUserName(size_t user_runtime_id) const
+{
+  if (user_runtime_id >= getUserCount())
+  {
+    throw std::out_of_range("MappedChat: user_runtime_id out of range");
+  }
+  const auto &record = reinterpret_cast<const ChatSnapshotFile::UserRecord*>(mUsers)[user_runtime_id];
+  return textAt(record.name_offset, record.name_length);
+}
+
+bool MappedChat::isSystemUser(size_t user_runtime_id) const
+{
+  if (user_runtime_id >= getUserCount())
+  {
+    throw std::out_of_range("MappedChat: user_runtime_id out of range");
+  }
+  return reinterpret_cast<const ChatSnapshotFile::UserRecord*>(mUsers)[user_runtime_id].is_system != 0;
+}
+
+size_t MappedChat::getMediaCount() const
+{
+  return header(mHeader).media_count;
+}
+
+int64_t MappedChat::getMediaDatabaseId(size_t media_runtime_id) const
+{
+  if (media_runtime_id >= getMediaCount())
+  {
+    throw std::out_of_range("MappedChat: media_runtime_id out of range");
+  }
+  return reinterpret_cast<const ChatSnapshotFile::MediaRecord*>(mMedia)[media_runtime_id].database_id;
+}
+
+MediaType MappedChat::getMediaType(size_t media_runtime_id) const
+{
+  if (media_runtime_id >= getMediaCount())
+  {
+    throw std::out_of_range("MappedChat: media_runtime_id out of range");
+  }
+  return static_cast<MediaType>(reinterpret_cast<const ChatSnapshotFile::MediaRecord*>(mMedia)[media_runtime_id].type);
+}
+
+int64_t MappedChat::getMediaSize(size_t media_runtime_id) const
+{
+  if (media_runtime_id >= getMediaCount())
+  {
+    throw std::out_of_range("MappedChat: media_runtime_id out of range");
+  }
+  return reinterpret_cast<const ChatSnapshotFile::MediaRecord*>(mMedia)[media_runtime_id].media_size;
+}
+
+std::string_view MappedChat::getMediaMimeType(size_t media_runtime_id) const
+{
+  if (media_runtime_id >= getMediaCount())
+  {
+    throw std::out_of_range("MappedChat: media_runtime_id out of range");
+  }
+  const auto &record = reinterpret_cast<const ChatSnapshotFile::MediaRecord*>(mMedia)[media_runtime_id];
+  return textAt(record.mime_type_offset, record.mime_type_length);
+}
+
+size_t MappedChat::getMessageCount() const
+{
+  return header(mHeader).message_count;
+}
+
+int64_t MappedChat::getMessageDatabaseId(size_t message_runtime_id) const
+{
+  if (message_runtime_id >= getMessageCount())
+  {
+    throw std::out_of_range("MappedChat: message_runtime_id out of range");
+  }
+  return mMessageIds[message_runtime_id];
+}
+
+int64_t MappedChat::getMessageTimestamp(size_t message_runtime_id) const
+{
+  if (message_runtime_id >= getMessageCount())
+  {
+    throw std::out_of_range("MappedChat: message_runtime_id out of range");
+  }
+  return mMessageTimestamps[message_runtime_id];
+}
+
+int64_t MappedChat::getMessageSenderRuntimeId(size_t message_runtime_id) const
+{
+  if (message_runtime_id >= getMessageCount())
+  {
+    throw std::out_of_range("MappedChat: message_runtime_id out of range");
+  }
+  return mMessageSenders[message_runtime_id];
+}
+
+int64_t MappedChat::getMessageMediaRuntimeId(size_t message_runtime_id) const
+{
+  if (message_runtime_id >= getMessageCount())
+  {
+    throw std::out_of_range("MappedChat: message_runtime_id out of range");
+  }
+  int32_t media_runtime_id = mMessageMedia[message_runtime_id];
+  return media_runtime_id < 0 ? Message::MEDIA_NO_ID : media_runtime_id;
+}
+
+std::string_view MappedChat::getMessageText(size_t message_runtime_id) const
+{
+  if (message_runtime_id >= getMessageCount())
+  {
+    throw std::out_of_range("MappedChat: message_runtime_id out of range");
+  }
+  uint64_t begin = mMessageTextOffsets[message_runtime_id];
+  uint64_t end = mMessageTextOffsets[message_runtime_id + 1];
+  if (end < begin)
+  {
+    return {};
+  }
+  return textAt(begin, end - begin);
+}
+
+bool MappedChat::verifyChecksum() const
+{
+  const ChatSnapshotFile::Header &h = header(mHeader);
+  uint64_t checksum = HashUtil::xxh64(mFile->data() + h.header_size, h.file_size - h.header_size);
+  return checksum == h.payload_checksum;
+}
+
+std::unique_ptr<ChatContext> MappedChat::toChatContext() const
+{
+  auto ctx = std::make_unique<ChatContext>();
+
+  ctx->setChat(std::make_unique<Chat>(Chat::RT_START_ID, getChatDatabaseId(), std::string(getName()), getSource()));
+
+  std::vector<User> users;
+  users.reserve(getUserCount());
+  for (size_t i = 0; i < getUserCount(); i++)
+  {
+    users.emplace_back(i, getUserDatabaseId(i), std::string(getUserName(i)), isSystemUser(i));
+  }
+
+  std::vector<Media> media_list;
+  media_list.reserve(getMediaCount());
+  for (size_t i = 0; i < getMediaCount(); i++)
+  {
+    media_list.emplace_back(i, getMediaDatabaseId(i), getMediaType(i), getMediaSize(i),
+        std::string(getMediaMimeType(i)));
+  }
+
+  std::vector<Message> messages;
+  messages.reserve(getMessageCount());
+  for (size_t i = 0; i < getMessageCount(); i++)
+  {
+    int64_t sender_runtime_id = getMessageSenderRuntimeId(i);
+    int64_t sender_database_id =
+        (sender_runtime_id >= 0 && static_cast<size_t>(sender_runtime_id) < users.size()) ?
+            users[sender_runtime_id].getDatabaseId() : User::DB_NO_ID;
+
+    int64_t media_runtime_id = getMessageMediaRuntimeId(i);
+    int64_t media_database_id =
+        (media_runtime_id != Message::MEDIA_NO_ID && static_cast<size_t>(media_runtime_id) < media_list.size()) ?
+            media_list[media_runtime_id].getDatabaseId() : Media::DB_NO_ID;
+
+    messages.emplace_back(i, getMessageDatabaseId(i), Chat::RT_START_ID, getChatDatabaseId(), sender_runtime_id,
+        sender_database_id, media_runtime_id, media_database_id, getMessageTimestamp(i),
+        std::string(getMessageText(i)));
+  }
+
+  ctx->setUserList(std::move(users));
+  ctx->setMediaList(std::move(media_list));
+  ctx->setMessageList(std::move(messages));
+
+  return ctx;
+}
+
+std::string_view MappedChat::textAt(uint64_t offset, uint64_t length) const
+{
+  if (offset > mTextSize || length > mTextSize - offset)
+  {
+    return {};
+  }
+  return std::string_view(mText + offset, length);
+}
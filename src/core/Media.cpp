@@ -24,10 +24,15 @@ void Media::setDatabaseId(int64_t database_id)
 
 std::string Media::getMediaExtension() const
 {
-  std::size_t pos = mMimeType.find('/');
-  if (pos != std::string::npos || pos + 1 >= mMimeType.size())
+  return getExtensionFromMimeType(mMimeType);
+}
+
+std::string Media::getExtensionFromMimeType(const std::string &mime_type)
+{
+  std::size_t pos = mime_type.find('/');
+  if (pos != std::string::npos || pos + 1 >= mime_type.size())
   {
-    return mMimeType.substr(pos + 1);
+    return mime_type.substr(pos + 1);
   }
   return "";
 }
@@ -59,3 +64,17 @@ std::string Media::getImportName() const
   }
   return "";
 }
+
+void Media::setContentHash(const std::string &content_hash)
+{
+  mContentHash = content_hash;
+}
+
+std::string Media::getContentHash() const
+{
+  if (mContentHash)
+  {
+    return mContentHash.value();
+  }
+  return "";
+}
@@ -0,0 +1,62 @@
+/*
+ * MediaHandle.cpp
+ *
+ *      Author: Andreas Volz
+ */
+
+// project public API
+#include "chatstorage/MediaHandle.h"
+
+// project private
+#include "common/MappedFile.h"
+
+MediaHandle::MediaHandle(int64_t media_id, MediaType type, const std::string &mime_type,
+    std::unique_ptr<MappedFile> file) :
+    mMediaId(media_id),
+    mType(type),
+    mMimeType(mime_type),
+    mFile(std::move(file))
+{
+}
+
+MediaHandle::~MediaHandle() = default;
+
+int64_t MediaHandle::getMediaDatabaseId() const
+{
+  return mMediaId;
+}
+
+MediaType MediaHandle::getType() const
+{
+  return mType;
+}
+
+const std::string& MediaHandle::getMimeType() const
+{
+  return mMimeType;
+}
+
+size_t MediaHandle::size() const
+{
+  return mFile->size();
+}
+
+const uint8_t* MediaHandle::data() const
+{
+  return mFile->data();
+}
+
+int MediaHandle::getFd() const
+{
+  return mFile->fd();
+}
+
+int64_t MediaHandle::getOffset() const
+{
+  return static_cast<int64_t>(mFile->offset());
+}
+
+int64_t MediaHandle::getLength() const
+{
+  return static_cast<int64_t>(mFile->size());
+}
@@ -67,11 +67,21 @@ int64_t Message::getTimestamp() const
   return mTimestamp;
 }
 
-std::string Message::getText() const
+const std::string& Message::getText() const
 {
   return mText;
 }
 
+int64_t Message::getFingerprint() const
+{
+  return mFingerprint;
+}
+
+void Message::setFingerprint(int64_t fingerprint)
+{
+  mFingerprint = fingerprint;
+}
+
 
 void Message::setMediaDatabaseId(int64_t media_id)
 {
@@ -0,0 +1,34 @@
+/*
+ * MessageFingerprinter.cpp
+ *
+ *      Author: Andreas Volz
+ */
+
+// project public API
+#include "chatstorage/Message.h"
+
+// project
+#include "MessageFingerprinter.h"
+#include "common/HashUtil.h"
+
+int64_t MessageFingerprinter::next(int64_t timestamp, const std::string &sender_name, bool is_system,
+    const std::string &text)
+{
+  const std::string &sender = is_system ? std::string() : sender_name;
+
+  HashUtil::XXH64 content_hash;
+  content_hash.update(&timestamp, sizeof(timestamp));
+  // the terminating '\0' separates sender and text ("ab" + "c" != "a" + "bc")
+  content_hash.update(sender.c_str(), sender.size() + 1);
+  content_hash.update(text.data(), text.size());
+  uint64_t content = content_hash.digest();
+
+  uint32_t occurrence = mOccurrences[content]++;
+
+  HashUtil::XXH64 fingerprint_hash;
+  fingerprint_hash.update(&content, sizeof(content));
+  fingerprint_hash.update(&occurrence, sizeof(occurrence));
+  int64_t fingerprint = static_cast<int64_t>(fingerprint_hash.digest());
+
+  return fingerprint == Message::NO_FINGERPRINT ? 1 : fingerprint;
+}
@@ -0,0 +1,40 @@
+/*
+ * MessageFingerprinter.h
+ *
+ *      Author: Andreas Volz
+ */
+
+#ifndef MESSAGEFINGERPRINTER_H_
+#define MESSAGEFINGERPRINTER_H_
+
+// system
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+/**
+ * Computes the stable identity of the messages of a chat export, so a re-export of the same chat is recognized.
+ *
+ * The fingerprint is the hash of timestamp, sender alias and text. The same message could be sent twice within
+ * the resolution of a timestamp (e.g. "ok"), so the occurrence number of equal messages is part of the hash. This
+ * works as long as the messages are fed in chat order and each export contains the complete history.
+ */
+class MessageFingerprinter
+{
+public:
+  MessageFingerprinter() = default;
+  ~MessageFingerprinter() = default;
+
+  /**
+   * @param is_system the name of a system sender is ignored, the system user in the database doesn't have the name
+   *        of the export
+   *
+   * @return the fingerprint of the next message in chat order; never Message::NO_FINGERPRINT
+   */
+  int64_t next(int64_t timestamp, const std::string &sender_name, bool is_system, const std::string &text);
+
+private:
+  std::unordered_map<uint64_t, uint32_t> mOccurrences;
+};
+
+#endif /* MESSAGEFINGERPRINTER_H_ */
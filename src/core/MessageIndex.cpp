@@ -0,0 +1,169 @@
+/*
+ * MessageIndex.cpp
+ *
+ *      Author: Andreas Volz
+ */
+
+// project
+#include "MessageIndex.h"
+
+// system
+#include <algorithm>
+
+void MessageIndex::build(const std::vector<Message> &messages)
+{
+  mSenderPostings.clear();
+  mMediaPostings.clear();
+  mTimestampsSorted = true;
+  mLastTimestamp = 0;
+  mCount = 0;
+
+  for (size_t ordinal = 0; ordinal < messages.size(); ordinal++)
+  {
+    add(ordinal, messages[ordinal]);
+  }
+}
+
+void MessageIndex::add(size_t ordinal, const Message &message)
+{
+  mSenderPostings[message.getSenderRuntimeId()].append(static_cast<uint32_t>(ordinal));
+
+  if (message.getMediaRuntimeId() != Message::MEDIA_NO_ID)
+  {
+    mMediaPostings.append(static_cast<uint32_t>(ordinal));
+  }
+
+  if (mCount > 0 && message.getTimestamp() < mLastTimestamp)
+  {
+    mTimestampsSorted = false;
+  }
+  mLastTimestamp = message.getTimestamp();
+  mCount++;
+}
+
+std::vector<size_t> MessageIndex::find(const MessageFilter &filter, const std::vector<Message> &messages) const
+{
+  std::vector<size_t> result;
+
+  // step 1: reduce the time range to an ordinal range [lo, hi)
+  size_t lo = 0;
+  size_t hi = mCount;
+  bool check_time = false;
+
+  if (filter.from_timestamp || filter.to_timestamp)
+  {
+    if (mTimestampsSorted)
+    {
+      auto ts_less = [](const Message &message, int64_t timestamp) { return message.getTimestamp() < timestamp; };
+      auto first = messages.begin();
+      auto last = messages.begin() + mCount;
+      if (filter.from_timestamp)
+      {
+        lo = std::lower_bound(first, last, *filter.from_timestamp, ts_less) - first;
+      }
+      if (filter.to_timestamp)
+      {
+        hi = std::lower_bound(first + lo, last, *filter.to_timestamp, ts_less) - first;
+      }
+    }
+    else
+    {
+      // unordered timestamps can't be mapped to a range -> check each candidate
+      check_time = true;
+    }
+  }
+
+  if (lo >= hi)
+  {
+    return result;
+  }
+
+  // step 2: collect the posting lists that have to be intersected
+  std::vector<PostingList::Cursor> cursors;
+
+  if (filter.sender_runtime_id)
+  {
+    auto posting_it = mSenderPostings.find(*filter.sender_runtime_id);
+    if (posting_it == mSenderPostings.end())
+    {
+      return result;
+    }
+    cursors.push_back(posting_it->second.cursor());
+  }
+
+  if (filter.has_media)
+  {
+    cursors.push_back(mMediaPostings.cursor());
+  }
+
+  auto accept = [&](size_t ordinal)
+  {
+    if (check_time)
+    {
+      int64_t timestamp = messages[ordinal].getTimestamp();
+      if ((filter.from_timestamp && timestamp < *filter.from_timestamp) ||
+          (filter.to_timestamp && timestamp >= *filter.to_timestamp))
+      {
+        return;
+      }
+    }
+    result.push_back(ordinal);
+  };
+
+  if (cursors.empty())
+  {
+    for (size_t ordinal = lo; ordinal < hi; ordinal++)
+    {
+      accept(ordinal);
+    }
+    return result;
+  }
+
+  // step 3: leapfrog intersection - every cursor seeks to the highest current candidate
+  for (auto &cursor : cursors)
+  {
+    cursor.seek(static_cast<uint32_t>(lo));
+  }
+
+  while (true)
+  {
+    uint32_t candidate = 0;
+    for (const auto &cursor : cursors)
+    {
+      if (!cursor.valid())
+        return result;
+      candidate = std::max(candidate, cursor.value());
+    }
+
+    if (candidate >= hi)
+      return result;
+
+    bool all_equal = true;
+    for (auto &cursor : cursors)
+    {
+      cursor.seek(candidate);
+      if (!cursor.valid())
+        return result;
+      if (cursor.value() != candidate)
+        all_equal = false;
+    }
+
+    if (all_equal)
+    {
+      accept(candidate);
+      cursors.front().next();
+    }
+  }
+
+  return result;
+}
+
+size_t MessageIndex::getMemoryUsage() const
+{
+  size_t bytes = sizeof(MessageIndex) + mMediaPostings.getMemoryUsage();
+  for (const auto &sender_posting : mSenderPostings)
+  {
+    bytes += sizeof(sender_posting) + sender_posting.second.getMemoryUsage();
+  }
+  return bytes;
+}
@@ -0,0 +1,52 @@
+/*
+ * MessageIndex.h
+ *
+ *      Author: Andreas Volz
+ */
+
+#ifndef MESSAGEINDEX_H_
+#define MESSAGEINDEX_H_
+
+// project public API
+#include "chatstorage/ChatContext.h"
+
+// project private
+#include "core/PostingList.h"
+
+// system
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Secondary index over the message list of a ChatContext.
+ *
+ * The index keeps one PostingList of message ordinals (= index in the message list) per sender runtime ID and one
+ * for all messages with an attached Media. A time range is resolved to an ordinal range by binary search as long as
+ * the messages are appended in chronological order.
+ */
+class MessageIndex
+{
+public:
+  MessageIndex() = default;
+  ~MessageIndex() = default;
+
+  void build(const std::vector<Message> &messages);
+
+  /**
+   * Incremental update for a message that is appended at the end of the message list.
+   */
+  void add(size_t ordinal, const Message &message);
+
+  std::vector<size_t> find(const MessageFilter &filter, const std::vector<Message> &messages) const;
+
+  size_t getMemoryUsage() const;
+
+private:
+  std::unordered_map<int64_t, PostingList> mSenderPostings;
+  PostingList mMediaPostings;
+  bool mTimestampsSorted = true;
+  int64_t mLastTimestamp = 0;
+  size_t mCount = 0;
+};
+
+#endif /* MESSAGEINDEX_H_ */
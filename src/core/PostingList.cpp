@@ -0,0 +1,163 @@
+/*
+ * PostingList.cpp
+ *
+ *      Author: Andreas Volz
+ */
+
+// project
+#include "PostingList.h"
+
+// system
+#include <algorithm>
+#include <stdexcept>
+
+PostingList::Cursor::Cursor(const PostingList &list) :
+    mList(&list)
+{
+  if (!mList->mSkips.empty())
+  {
+    mValue = mList->mSkips.front().ordinal;
+    mPos = mList->mSkips.front().byte_offset;
+    mValid = true;
+  }
+}
+
+bool PostingList::Cursor::valid() const
+{
+  return mValid;
+}
+
+uint32_t PostingList::Cursor::value() const
+{
+  return mValue;
+}
+
+void PostingList::Cursor::next()
+{
+  if (!mValid)
+    return;
+
+  mIndex++;
+  if (mIndex >= mList->mCount)
+  {
+    mValid = false;
+    return;
+  }
+
+  if (mIndex % SKIP_INTERVAL == 0)
+  {
+    // the first entry of each block is stored absolute in the skip table
+    const SkipEntry &skip = mList->mSkips[mIndex / SKIP_INTERVAL];
+    mValue = skip.ordinal;
+    mPos = skip.byte_offset;
+  }
+  else
+  {
+    mValue += readDelta(mList->mBytes, mPos);
+  }
+}
+
+void PostingList::Cursor::seek(uint32_t target)
+{
+  if (!mValid || mValue >= target)
+    return;
+
+  // jump over complete blocks with the skip table before decoding
+  const std::vector<SkipEntry> &skips = mList->mSkips;
+  size_t block = mIndex / SKIP_INTERVAL;
+  auto skip_it = std::upper_bound(skips.begin() + block + 1, skips.end(), target,
+      [](uint32_t value, const SkipEntry &entry) { return value < entry.ordinal; });
+  size_t target_block = static_cast<size_t>(skip_it - skips.begin()) - 1;
+
+  if (target_block > block)
+  {
+    mIndex = target_block * SKIP_INTERVAL;
+    mValue = skips[target_block].ordinal;
+    mPos = skips[target_block].byte_offset;
+  }
+
+  while (mValid && mValue < target)
+  {
+    next();
+  }
+}
+
+void PostingList::append(uint32_t ordinal)
+{
+  if (mCount > 0 && ordinal <= mLast)
+  {
+    throw std::invalid_argument("PostingList ordinals must be strictly increasing");
+  }
+
+  if (mCount % SKIP_INTERVAL == 0)
+  {
+    mSkips.push_back(SkipEntry { ordinal, static_cast<uint32_t>(mBytes.size()) });
+  }
+  else
+  {
+    uint32_t delta = ordinal - mLast;
+    while (delta >= 0x80)
+    {
+      mBytes.push_back(static_cast<uint8_t>(delta | 0x80));
+      delta >>= 7;
+    }
+    mBytes.push_back(static_cast<uint8_t>(delta));
+  }
+
+  mLast = ordinal;
+  mCount++;
+}
+
+void PostingList::clear()
+{
+  mBytes.clear();
+  mSkips.clear();
+  mCount = 0;
+  mLast = 0;
+}
+
+size_t PostingList::size() const
+{
+  return mCount;
+}
+
+bool PostingList::empty() const
+{
+  return mCount == 0;
+}
+
+PostingList::Cursor PostingList::cursor() const
+{
+  return Cursor(*this);
+}
+
+std::vector<uint32_t> PostingList::decode() const
+{
+  std::vector<uint32_t> ordinals;
+  ordinals.reserve(mCount);
+  for (Cursor c = cursor(); c.valid(); c.next())
+  {
+    ordinals.push_back(c.value());
+  }
+  return ordinals;
+}
+
+size_t PostingList::getMemoryUsage() const
+{
+  return sizeof(PostingList) + mBytes.capacity() + mSkips.capacity() * sizeof(SkipEntry);
+}
+
+uint32_t PostingList::readDelta(const std::vector<uint8_t> &bytes, size_t &in_out_pos)
+{
+  uint32_t delta = 0;
+  int shift = 0;
+  uint8_t byte = 0;
+  do
+  {
+    byte = bytes[in_out_pos++];
+    delta |= static_cast<uint32_t>(byte & 0x7F) << shift;
+    shift += 7;
+  } while (byte & 0x80);
+
+  return delta;
+}
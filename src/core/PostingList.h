@@ -0,0 +1,85 @@
+/*
+ * PostingList.h
+ *
+ *      Author: Andreas Volz
+ */
+
+#ifndef POSTINGLIST_H_
+#define POSTINGLIST_H_
+
+// system
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * A compact, append-only list of strictly increasing message ordinals.
+ *
+ * The ordinals are stored as variable length (LEB128) deltas. Every SKIP_INTERVAL entries a skip entry is
+ * recorded, so a Cursor is able to seek() forward without decoding the complete list.
+ */
+class PostingList
+{
+public:
+  PostingList() = default;
+  ~PostingList() = default;
+
+  class Cursor
+  {
+  public:
+    Cursor(const PostingList &list);
+
+    bool valid() const;
+
+    uint32_t value() const;
+
+    void next();
+
+    /**
+     * Moves the cursor to the first ordinal >= target. A cursor never moves backwards.
+     */
+    void seek(uint32_t target);
+
+  private:
+    const PostingList *mList;
+    size_t mPos = 0;    // byte position of the next encoded delta
+    size_t mIndex = 0;  // index of the current value
+    uint32_t mValue = 0;
+    bool mValid = false;
+  };
+
+  /**
+   * @param ordinal must be greater than the last appended ordinal
+   */
+  void append(uint32_t ordinal);
+
+  void clear();
+
+  size_t size() const;
+
+  bool empty() const;
+
+  Cursor cursor() const;
+
+  std::vector<uint32_t> decode() const;
+
+  size_t getMemoryUsage() const;
+
+  static constexpr size_t SKIP_INTERVAL = 64;
+
+private:
+  struct SkipEntry
+  {
+    uint32_t ordinal;     // value of the entry at index (n * SKIP_INTERVAL)
+    uint32_t byte_offset; // position of the delta that follows this entry
+  };
+
+  static uint32_t readDelta(const std::vector<uint8_t> &bytes, size_t &in_out_pos);
+
+  std::vector<uint8_t> mBytes;
+  std::vector<SkipEntry> mSkips;
+  size_t mCount = 0;
+  uint32_t mLast = 0;
+};
+
+#endif /* POSTINGLIST_H_ */
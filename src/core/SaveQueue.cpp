@@ -0,0 +1,118 @@
+/*
+ * SaveQueue.cpp
+ *
+ *      Author: Andreas Volz
+ */
+
+// project
+#include "SaveQueue.h"
+
+// system
+#include <algorithm>
+#include <chrono>
+
+SaveQueue::SaveQueue(const AsyncSaveConfig &config, GroupWriter group_writer) :
+    mConfig(config),
+    mGroupWriter(std::move(group_writer))
+{
+  mConfig.maxGroupSize = std::max<size_t>(mConfig.maxGroupSize, 1);
+  mConfig.maxQueuedSaves = std::max<size_t>(mConfig.maxQueuedSaves, 1);
+}
+
+SaveQueue::~SaveQueue()
+{
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mStop = true;
+  }
+  mQueued.notify_one();
+
+  if (mThread.joinable())
+  {
+    mThread.join();
+  }
+}
+
+std::future<SaveReport> SaveQueue::push(std::unique_ptr<ChatContext> ctx, const std::filesystem::path &import_media_path)
+{
+  Request request;
+  request.ctx = std::move(ctx);
+  request.import_media_path = import_media_path;
+  std::future<SaveReport> future = request.promise.get_future();
+
+  {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mDequeued.wait(lock, [this]()
+    {
+      return mRequests.size() < mConfig.maxQueuedSaves;
+    });
+
+    mRequests.push_back(std::move(request));
+
+    if (!mThread.joinable())
+    {
+      mThread = std::thread(&SaveQueue::run, this);
+    }
+  }
+  mQueued.notify_one();
+
+  return future;
+}
+
+void SaveQueue::run()
+{
+  std::unique_lock<std::mutex> lock(mMutex);
+
+  while (true)
+  {
+    mQueued.wait(lock, [this]()
+    {
+      return mStop || !mRequests.empty();
+    });
+
+    if (mRequests.empty())
+    {
+      // stopped and nothing left to save
+      return;
+    }
+
+    // give the producers a short time to fill the group (not on shutdown, then everything is already queued)
+    if (!mStop && mConfig.maxLatencyMs > 0 && mRequests.size() < mConfig.maxGroupSize)
+    {
+      mQueued.wait_for(lock, std::chrono::milliseconds(mConfig.maxLatencyMs), [this]()
+      {
+        return mStop || mRequests.size() >= mConfig.maxGroupSize;
+      });
+    }
+
+    size_t group_size = std::min(mRequests.size(), mConfig.maxGroupSize);
+    std::vector<Request> group;
+    group.reserve(group_size);
+    for (size_t i = 0; i < group_size; i++)
+    {
+      group.push_back(std::move(mRequests.front()));
+      mRequests.pop_front();
+    }
+
+    lock.unlock();
+    mDequeued.notify_all();
+
+    try
+    {
+      std::vector<SaveReport> reports = mGroupWriter(group);
+      for (size_t i = 0; i < group.size(); i++)
+      {
+        group[i].promise.set_value(i < reports.size() ? std::move(reports[i]) : SaveReport());
+      }
+    }
+    catch (...)
+    {
+      for (auto &request : group)
+      {
+        request.promise.set_exception(std::current_exception());
+      }
+    }
+
+    lock.lock();
+  }
+}
@@ -0,0 +1,74 @@
+/*
+ * SaveQueue.h
+ *
+ *      Author: Andreas Volz
+ */
+
+#ifndef SAVEQUEUE_H_
+#define SAVEQUEUE_H_
+
+// project public API
+#include "chatstorage/ChatStorage.h"
+
+// system
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * The queue of ChatStorage::saveAsync() with its writer thread.
+ *
+ * The thread takes all waiting saves (up to AsyncSaveConfig::maxGroupSize) as one group and passes them to the
+ * GroupWriter that saves them in one transaction. If the group isn't full the thread waits up to maxLatencyMs for
+ * more saves first. The thread is started with the first push().
+ */
+class SaveQueue
+{
+public:
+  struct Request
+  {
+    std::unique_ptr<ChatContext> ctx;
+    std::filesystem::path import_media_path;
+    std::promise<SaveReport> promise;
+  };
+
+  /**
+   * Saves all requests of a group and returns one report per request.
+   */
+  using GroupWriter = std::function<std::vector<SaveReport>(std::vector<Request> &requests)>;
+
+  SaveQueue(const AsyncSaveConfig &config, GroupWriter group_writer);
+
+  /**
+   * Finishes all queued saves before it returns.
+   */
+  ~SaveQueue();
+
+  SaveQueue(const SaveQueue&) = delete;
+  SaveQueue& operator=(const SaveQueue&) = delete;
+
+  /**
+   * Blocks while the queue is full (AsyncSaveConfig::maxQueuedSaves).
+   */
+  std::future<SaveReport> push(std::unique_ptr<ChatContext> ctx, const std::filesystem::path &import_media_path);
+
+private:
+  void run();
+
+  AsyncSaveConfig mConfig;
+  GroupWriter mGroupWriter;
+
+  std::mutex mMutex;
+  std::condition_variable mQueued;   // a new request or stop
+  std::condition_variable mDequeued; // space in a full queue
+  std::deque<Request> mRequests;
+  bool mStop = false;
+  std::thread mThread;
+};
+
+#endif /* SAVEQUEUE_H_ */
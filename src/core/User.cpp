@@ -25,6 +25,7 @@ void User::setDatabaseId(int64_t database_id)
 void User::setName(const std::string name)
 {
   mName = name;
+  mChanged = true;
 }
 
 const std::string &User::getName() const
@@ -19,12 +19,30 @@ int64_t ChatRepository::insert(const ChatRow &chat_row)
   mInsertStmt.bind(":name",       chat_row.name);
   mInsertStmt.bind(":source",     chat_row.source);
 
-  mInsertStmt.step();
+  bool success = mInsertStmt.step() == SQLiteConnection::Result::Done;
   mInsertStmt.reset();
 
+  // lastInsertRowID() would be the ID of an older row
+  if (!success)
+  {
+    return -1;
+  }
+
   return mSQLCon.lastInsertRowID();
 }
 
+bool ChatRepository::update(const ChatRow &chat_row)
+{
+  mUpdateStmt.bind(":chat_id", chat_row.chat_id);
+  mUpdateStmt.bind(":name",    chat_row.name);
+  mUpdateStmt.bind(":source",  chat_row.source);
+
+  bool success = mUpdateStmt.step() == SQLiteConnection::Result::Done;
+  mUpdateStmt.reset();
+
+  return success && mSQLCon.changes() > 0;
+}
+
 ChatRow ChatRepository::getByChatId(int64_t chat_id)
 {
   mSelectByIdStmt.reset();
@@ -37,6 +55,10 @@ ChatRow ChatRepository::getByChatId(int64_t chat_id)
     chat_row.account_id = mSelectByIdStmt.getInt64(0);
     chat_row.name       = mSelectByIdStmt.getText(1);
     chat_row.source     = mSelectByIdStmt.getInt64(2);
+    chat_row.generation = mSelectByIdStmt.getInt64(3);
+
+    // end the implicit read transaction, otherwise later reads see an old database state
+    mSelectByIdStmt.reset();
 
     return chat_row;
   }
@@ -44,6 +66,27 @@ ChatRow ChatRepository::getByChatId(int64_t chat_id)
   throw std::runtime_error("Chat not found"); // TODO: custom exception
 }
 
+std::optional<ChatRow> ChatRepository::getByName(const std::string &name, int64_t source)
+{
+  mSelectByNameStmt.reset();
+  mSelectByNameStmt.bind(":name",   name);
+  mSelectByNameStmt.bind(":source", source);
+
+  std::optional<ChatRow> chat_row;
+  if (mSelectByNameStmt.step() == SQLiteConnection::Result::Row)
+  {
+    chat_row = ChatRow {};
+    chat_row->chat_id    = mSelectByNameStmt.getInt64(0);
+    chat_row->account_id = mSelectByNameStmt.getInt64(1);
+    chat_row->name       = name;
+    chat_row->source     = source;
+    chat_row->generation = mSelectByNameStmt.getInt64(2);
+  }
+  mSelectByNameStmt.reset();
+
+  return chat_row;
+}
+
 std::vector<ChatRow> ChatRepository::listChats()
 {
   mSelectListChatsStmt.reset();
@@ -57,12 +100,75 @@ std::vector<ChatRow> ChatRepository::listChats()
     chat_row.account_id = mSelectListChatsStmt.getInt64(1);
     chat_row.name       = mSelectListChatsStmt.getText(2);
     chat_row.source     = mSelectListChatsStmt.getInt64(3);
+    chat_row.generation = mSelectListChatsStmt.getInt64(4);
     chat_rows.emplace_back(std::move(chat_row));
   }
 
   return chat_rows;
 }
 
+int64_t ChatRepository::getGeneration(int64_t chat_id)
+{
+  mSelectGenerationStmt.reset();
+  mSelectGenerationStmt.bind(":chat_id", chat_id);
+
+  int64_t generation = -1;
+  if (mSelectGenerationStmt.step() == SQLiteConnection::Result::Row)
+  {
+    generation = mSelectGenerationStmt.getInt64(0);
+  }
+  mSelectGenerationStmt.reset();
+
+  return generation;
+}
+
+std::unordered_map<int64_t, int64_t> ChatRepository::getGenerations(const std::vector<int64_t> &chat_ids)
+{
+  std::unordered_map<int64_t, int64_t> generations;
+  if (chat_ids.empty())
+  {
+    // return empty map to prevent sql execution with empty list
+    return generations;
+  }
+
+  for (int64_t chat_id : chat_ids)
+  {
+    generations[chat_id] = -1;
+  }
+
+  std::string generations_sql = "SELECT chat_id, generation FROM chats WHERE chat_id IN ("
+      + SQLiteConnection::makePlaceholders(chat_ids.size()) + ")";
+  Statement generations_stmt(mSQLCon, generations_sql);
+
+  generations_stmt.reset();
+  generations_stmt.bindInt64Container(1, chat_ids);
+
+  while (generations_stmt.step() == SQLiteConnection::Result::Row)
+  {
+    generations[generations_stmt.getInt64(0)] = generations_stmt.getInt64(1);
+  }
+
+  return generations;
+}
+
+void ChatRepository::bumpGeneration(int64_t chat_id)
+{
+  mBumpGenerationStmt.bind(":chat_id", chat_id);
+
+  mBumpGenerationStmt.step();
+  mBumpGenerationStmt.reset();
+}
+
+bool ChatRepository::remove(int64_t chat_id)
+{
+  mDeleteStmt.bind(":chat_id", chat_id);
+
+  bool success = mDeleteStmt.step() == SQLiteConnection::Result::Done;
+  mDeleteStmt.reset();
+
+  return success;
+}
+
 bool ChatRepository::createTable(SQLiteConnection &sql_con)
 {
   std::string chats_table_sql =
@@ -70,9 +176,15 @@ bool ChatRepository::createTable(SQLiteConnection &sql_con)
       "chat_id INTEGER PRIMARY KEY AUTOINCREMENT, "
       "account_id INTEGER NOT NULL, "
       "name TEXT, "
-      "source INTEGER"
+      "source INTEGER, "
+      "generation INTEGER NOT NULL DEFAULT 0"
       ");";
 
-  return sql_con.exec(chats_table_sql);
+  bool success = sql_con.exec(chats_table_sql);
+
+  // upgrade of databases created before the column was introduced
+  success &= sql_con.addColumnIfMissing("chats", "generation", "INTEGER NOT NULL DEFAULT 0");
+
+  return success;
 }
 // @formatter:on
@@ -13,6 +13,8 @@
 #include "database/ChatRow.h"
 
 // system
+#include <optional>
+#include <unordered_map>
 #include <vector>
 
 class ChatRepository
@@ -24,14 +26,33 @@ public:
       mInsertStmt(mSQLCon,
           "INSERT INTO chats (account_id, name, source) "
           "VALUES (:account_id, :name, :source);"),
-      mUpdateStmt(mSQLCon, "UPDATE..."),
+      mUpdateStmt(mSQLCon,
+          "UPDATE chats SET name = :name, source = :source "
+          "WHERE chat_id=:chat_id"),
       mSelectByIdStmt(mSQLCon,
-          "SELECT account_id, name, source "
+          "SELECT account_id, name, source, generation "
           "FROM chats "
           "WHERE chat_id=:chat_id"),
+      mSelectByNameStmt(mSQLCon,
+          "SELECT chat_id, account_id, generation "
+          "FROM chats "
+          "WHERE name = :name AND source = :source "
+          "ORDER BY chat_id "
+          "LIMIT 1"),
       mSelectListChatsStmt(mSQLCon,
-          "SELECT chat_id, account_id, name, source "
-          "FROM chats")
+          "SELECT chat_id, account_id, name, source, generation "
+          "FROM chats"),
+      mSelectGenerationStmt(mSQLCon,
+          "SELECT generation "
+          "FROM chats "
+          "WHERE chat_id=:chat_id"),
+      mBumpGenerationStmt(mSQLCon,
+          "UPDATE chats "
+          "SET generation = generation + 1 "
+          "WHERE chat_id=:chat_id"),
+      mDeleteStmt(mSQLCon,
+          "DELETE FROM chats "
+          "WHERE chat_id=:chat_id")
 // @formatter:on
   {
   }
@@ -40,10 +61,41 @@ public:
 
   int64_t insert(const ChatRow &chat_row);
 
+  /**
+   * Writes name and source of an existing chat.
+   *
+   * @return false if no chat was changed
+   */
+  bool update(const ChatRow &chat_row);
+
   ChatRow getByChatId(int64_t chat_id);
 
+  /**
+   * @return the oldest chat with this name and source
+   */
+  std::optional<ChatRow> getByName(const std::string &name, int64_t source);
+
   std::vector<ChatRow> listChats();
 
+  /**
+   * The generation is a per chat change counter. It's increased with each save() of the chat and used to
+   * invalidate cached copies of the chat.
+   *
+   * @return the generation or -1 if the chat doesn't exist
+   */
+  int64_t getGeneration(int64_t chat_id);
+
+  /**
+   * Reads the generations of many chats in one query.
+   *
+   * @return the generation of each requested chat, -1 for a chat that doesn't exist
+   */
+  std::unordered_map<int64_t, int64_t> getGenerations(const std::vector<int64_t> &chat_ids);
+
+  void bumpGeneration(int64_t chat_id);
+
+  bool remove(int64_t chat_id);
+
   static bool createTable(SQLiteConnection &sql_con);
 
 private:
@@ -51,7 +103,11 @@ private:
   Statement mInsertStmt;
   Statement mUpdateStmt;
   Statement mSelectByIdStmt;
+  Statement mSelectByNameStmt;
   Statement mSelectListChatsStmt;
+  Statement mSelectGenerationStmt;
+  Statement mBumpGenerationStmt;
+  Statement mDeleteStmt;
 };
 
 #endif /* CHATREPOSITORY_H_ */
@@ -17,6 +17,7 @@ struct ChatRow
   int64_t account_id = 0;
   std::string name;
   int64_t source = 0;
+  int64_t generation = 0;
 };
 
 #endif /* CHATROW_H_ */
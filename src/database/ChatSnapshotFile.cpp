@@ -0,0 +1,347 @@
+/*
+ * ChatSnapshotFile.cpp
+ *
+ *      Author: Andreas Volz
+ */
+
+// project
+#include "ChatSnapshotFile.h"
+
+// project private
+#include "common/HashUtil.h"
+#include "common/MappedFile.h"
+
+// system
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <thread>
+#include <unordered_map>
+#include <type_traits>
+
+using namespace std;
+
+static_assert(std::is_trivially_copyable<ChatSnapshotFile::Header>::value, "Header must be trivially copyable");
+static_assert(sizeof(ChatSnapshotFile::Header) % 8 == 0, "Header must be 8 byte aligned");
+static_assert(sizeof(ChatSnapshotFile::UserRecord) % 8 == 0, "UserRecord must be 8 byte aligned");
+static_assert(sizeof(ChatSnapshotFile::MediaRecord) % 8 == 0, "MediaRecord must be 8 byte aligned");
+
+namespace
+{
+
+  uint64_t align8(uint64_t value)
+  {
+    return (value + 7) & ~static_cast<uint64_t>(7);
+  }
+
+  /**
+   * Writes sections into the stream and hashes everything behind the header.
+   */
+  class PayloadWriter
+  {
+  public:
+    PayloadWriter(std::ofstream &out) :
+        mOut(out)
+    {
+    }
+
+    void write(const void *data, size_t length)
+    {
+      mOut.write(static_cast<const char*>(data), length);
+      mHash.update(data, length);
+      mPosition += length;
+    }
+
+    template<typename T>
+    void writeArray(const std::vector<T> &values)
+    {
+      write(values.data(), values.size() * sizeof(T));
+    }
+
+    void pad()
+    {
+      static const uint8_t zeros[8] = {};
+      write(zeros, align8(mPosition) - mPosition);
+    }
+
+    uint64_t position() const
+    {
+      return mPosition;
+    }
+
+    uint64_t digest() const
+    {
+      return mHash.digest();
+    }
+
+  private:
+    std::ofstream &mOut;
+    HashUtil::XXH64 mHash;
+    uint64_t mPosition = sizeof(ChatSnapshotFile::Header);
+  };
+
+  bool inRange(uint64_t offset, uint64_t length, uint64_t size)
+  {
+    return offset <= size && length <= size - offset;
+  }
+
+} // namespace
+
+uint64_t ChatSnapshotFile::headerChecksum(const Header &header)
+{
+  return HashUtil::xxh64(&header, offsetof(Header, header_checksum));
+}
+
+bool ChatSnapshotFile::write(const ChatContext &ctx, int64_t generation, const fs::path &path)
+{
+  const Chat *chat = ctx.getChat();
+  if (!chat)
+  {
+    return false;
+  }
+
+  const std::vector<User> &users = ctx.getUserList();
+  const std::vector<Message> &messages = ctx.getMessageList();
+  std::vector<Media> media_list = ctx.getMediaList();
+
+  // the runtime IDs in the file are the positions in the tables
+  std::unordered_map<int64_t, int32_t> user_index;
+  for (size_t i = 0; i < users.size(); i++)
+  {
+    user_index[users[i].getRuntimeId()] = static_cast<int32_t>(i);
+  }
+  std::unordered_map<int64_t, int32_t> media_index;
+  for (size_t i = 0; i < media_list.size(); i++)
+  {
+    media_index[media_list[i].getRuntimeId()] = static_cast<int32_t>(i);
+  }
+
+  Header header = {};
+  memcpy(header.magic, MAGIC, sizeof(header.magic));
+  header.version = VERSION;
+  header.endian_check = ENDIAN_CHECK;
+  header.header_size = sizeof(Header);
+  header.chat_id = chat->getDatabaseId();
+  header.generation = generation;
+  header.chat_source = static_cast<int64_t>(chat->getSource());
+  header.user_count = users.size();
+  header.media_count = media_list.size();
+  header.message_count = messages.size();
+
+  // text blob: message texts first to have contiguous offsets, then all other strings
+  std::vector<uint64_t> text_offsets;
+  text_offsets.reserve(messages.size() + 1);
+  uint64_t text_size = 0;
+  for (const auto &message : messages)
+  {
+    text_offsets.push_back(text_size);
+    text_size += message.getText().size();
+  }
+  text_offsets.push_back(text_size);
+
+  header.chat_name_offset = text_size;
+  header.chat_name_length = chat->getName().size();
+  text_size += chat->getName().size();
+
+  std::vector<UserRecord> user_records;
+  user_records.reserve(users.size());
+  for (const auto &user : users)
+  {
+    UserRecord record = {};
+    record.database_id = user.getDatabaseId();
+    record.name_offset = text_size;
+    record.name_length = static_cast<uint32_t>(user.getName().size());
+    record.is_system = user.isSystem() ? 1 : 0;
+    text_size += record.name_length;
+    user_records.push_back(record);
+  }
+
+  std::vector<MediaRecord> media_records;
+  std::vector<std::string> mime_types;
+  media_records.reserve(media_list.size());
+  for (const auto &media_obj : media_list)
+  {
+    MediaRecord record = {};
+    record.database_id = media_obj.getDatabaseId();
+    record.type = static_cast<int64_t>(media_obj.getType());
+    record.media_size = media_obj.getMediaSize();
+    mime_types.push_back(media_obj.getMimeType());
+    record.mime_type_offset = text_size;
+    record.mime_type_length = mime_types.back().size();
+    text_size += record.mime_type_length;
+    media_records.push_back(record);
+  }
+
+  // column data
+  std::vector<int64_t> message_ids;
+  std::vector<int64_t> message_timestamps;
+  std::vector<int32_t> message_senders;
+  std::vector<int32_t> message_media;
+  message_ids.reserve(messages.size());
+  message_timestamps.reserve(messages.size());
+  message_senders.reserve(messages.size());
+  message_media.reserve(messages.size());
+  for (const auto &message : messages)
+  {
+    message_ids.push_back(message.getDatabaseId());
+    message_timestamps.push_back(message.getTimestamp());
+
+    auto user_it = user_index.find(message.getSenderRuntimeId());
+    message_senders.push_back(user_it != user_index.end() ? user_it->second : -1);
+
+    auto media_it = media_index.find(message.getMediaRuntimeId());
+    message_media.push_back(
+        (message.getMediaRuntimeId() != Message::MEDIA_NO_ID && media_it != media_index.end()) ? media_it->second : -1);
+  }
+
+  // a temporary file and rename() ensures that readers see either the old or the new snapshot; the name is unique
+  // per thread as two threads might write the snapshot of the same chat at the same time
+  fs::path tmp_path = path;
+  tmp_path += ".tmp" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+
+  std::error_code ec;
+  fs::create_directories(path.parent_path(), ec);
+
+  std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+  if (!out)
+  {
+    cerr << "Cannot write snapshot file: " << tmp_path << endl;
+    return false;
+  }
+
+  // the header is written at the end when all offsets and the checksum are known
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+  PayloadWriter payload(out);
+
+  header.users_offset = payload.position();
+  payload.writeArray(user_records);
+
+  header.media_offset = payload.position();
+  payload.writeArray(media_records);
+
+  header.message_ids_offset = payload.position();
+  payload.writeArray(message_ids);
+
+  header.message_timestamps_offset = payload.position();
+  payload.writeArray(message_timestamps);
+
+  header.message_senders_offset = payload.position();
+  payload.writeArray(message_senders);
+  payload.pad();
+
+  header.message_media_offset = payload.position();
+  payload.writeArray(message_media);
+  payload.pad();
+
+  header.message_text_offsets_offset = payload.position();
+  payload.writeArray(text_offsets);
+
+  header.text_offset = payload.position();
+  header.text_size = text_size;
+  for (const auto &message : messages)
+  {
+    payload.write(message.getText().data(), message.getText().size());
+  }
+  payload.write(chat->getName().data(), chat->getName().size());
+  for (const auto &user : users)
+  {
+    payload.write(user.getName().data(), user.getName().size());
+  }
+  for (const auto &mime_type : mime_types)
+  {
+    payload.write(mime_type.data(), mime_type.size());
+  }
+  payload.pad();
+
+  header.file_size = payload.position();
+  header.payload_checksum = payload.digest();
+  header.header_checksum = headerChecksum(header);
+
+  out.seekp(0);
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  out.close();
+
+  if (!out)
+  {
+    cerr << "Cannot write snapshot file: " << tmp_path << endl;
+    fs::remove(tmp_path, ec);
+    return false;
+  }
+
+  fs::rename(tmp_path, path, ec);
+  if (ec)
+  {
+    cerr << "Cannot rename snapshot file: " << tmp_path << " (" << ec.message() << ")" << endl;
+    fs::remove(tmp_path, ec);
+    return false;
+  }
+
+  return true;
+}
+
+MappedChatPtr ChatSnapshotFile::open(const fs::path &path, bool verify_checksum)
+{
+  auto file = std::make_unique<MappedFile>();
+  if (!file->open(path))
+  {
+    return nullptr;
+  }
+
+  const uint64_t size = file->size();
+  if (size < sizeof(Header))
+  {
+    return nullptr;
+  }
+
+  const Header *header = reinterpret_cast<const Header*>(file->data());
+
+  if (memcmp(header->magic, MAGIC, sizeof(header->magic)) != 0 || header->version != VERSION
+      || header->endian_check != ENDIAN_CHECK || header->header_size != sizeof(Header) || header->file_size != size
+      || header->header_checksum != headerChecksum(*header))
+  {
+    cerr << "Invalid snapshot file: " << path << endl;
+    return nullptr;
+  }
+
+  // all sections must be inside the file, so the accessors only need to check the indices
+  const uint64_t n = header->message_count;
+  if (n >= UINT32_MAX || header->user_count >= UINT32_MAX || header->media_count >= UINT32_MAX
+      || !inRange(header->users_offset, header->user_count * sizeof(UserRecord), size)
+      || !inRange(header->media_offset, header->media_count * sizeof(MediaRecord), size)
+      || !inRange(header->message_ids_offset, n * sizeof(int64_t), size)
+      || !inRange(header->message_timestamps_offset, n * sizeof(int64_t), size)
+      || !inRange(header->message_senders_offset, n * sizeof(int32_t), size)
+      || !inRange(header->message_media_offset, n * sizeof(int32_t), size)
+      || !inRange(header->message_text_offsets_offset, (n + 1) * sizeof(uint64_t), size)
+      || !inRange(header->text_offset, header->text_size, size))
+  {
+    cerr << "Corrupt snapshot file: " << path << endl;
+    return nullptr;
+  }
+
+  const uint8_t *base = file->data();
+
+  // the constructor is private, so std::make_shared isn't possible
+  std::shared_ptr<MappedChat> mapped_chat(new MappedChat(std::move(file)));
+  mapped_chat->mHeader = header;
+  mapped_chat->mUsers = base + header->users_offset;
+  mapped_chat->mMedia = base + header->media_offset;
+  mapped_chat->mMessageIds = reinterpret_cast<const int64_t*>(base + header->message_ids_offset);
+  mapped_chat->mMessageTimestamps = reinterpret_cast<const int64_t*>(base + header->message_timestamps_offset);
+  mapped_chat->mMessageSenders = reinterpret_cast<const int32_t*>(base + header->message_senders_offset);
+  mapped_chat->mMessageMedia = reinterpret_cast<const int32_t*>(base + header->message_media_offset);
+  mapped_chat->mMessageTextOffsets = reinterpret_cast<const uint64_t*>(base + header->message_text_offsets_offset);
+  mapped_chat->mText = reinterpret_cast<const char*>(base + header->text_offset);
+  mapped_chat->mTextSize = header->text_size;
+
+  if (verify_checksum && !mapped_chat->verifyChecksum())
+  {
+    cerr << "Checksum mismatch in snapshot file: " << path << endl;
+    return nullptr;
+  }
+
+  return mapped_chat;
+}
@@ -0,0 +1,104 @@
+/*
+ * ChatSnapshotFile.h
+ *
+ *      Author: Andreas Volz
+ */
+
+#ifndef CHATSNAPSHOTFILE_H_
+#define CHATSNAPSHOTFILE_H_
+
+// project public API
+#include "chatstorage/ChatContext.h"
+#include "chatstorage/MappedChat.h"
+
+// project private
+#include "common/platform.h"
+
+// system
+#include <cstdint>
+
+/**
+ * Reader and writer of the binary chat snapshot format.
+ *
+ * File layout (native little endian, each section 8 byte aligned):
+ *
+ *   Header
+ *   UserRecord[user_count]
+ *   MediaRecord[media_count]
+ *   int64_t  message_database_id[message_count]
+ *   int64_t  message_timestamp[message_count]
+ *   int32_t  message_sender_runtime_id[message_count]
+ *   int32_t  message_media_runtime_id[message_count]    (-1: no media)
+ *   uint64_t message_text_offset[message_count + 1]     (text of message i is [offset[i], offset[i+1]) )
+ *   char     text[text_size]                            (message texts, then names and mime types)
+ *
+ * The header is protected by its own checksum, the rest by the payload checksum (both XXH64).
+ */
+class ChatSnapshotFile
+{
+public:
+  static constexpr char MAGIC[8] = { 'C', 'H', 'A', 'T', 'S', 'N', 'A', 'P' };
+  static constexpr uint32_t VERSION = 1;
+  static constexpr uint32_t ENDIAN_CHECK = 0x01020304;
+
+  struct Header
+  {
+    char magic[8];
+    uint32_t version;
+    uint32_t endian_check;
+    uint64_t header_size;
+    uint64_t file_size;
+    int64_t chat_id;
+    int64_t generation;
+    int64_t chat_source;
+    uint64_t chat_name_offset;
+    uint64_t chat_name_length;
+    uint64_t user_count;
+    uint64_t users_offset;
+    uint64_t media_count;
+    uint64_t media_offset;
+    uint64_t message_count;
+    uint64_t message_ids_offset;
+    uint64_t message_timestamps_offset;
+    uint64_t message_senders_offset;
+    uint64_t message_media_offset;
+    uint64_t message_text_offsets_offset;
+    uint64_t text_offset;
+    uint64_t text_size;
+    uint64_t payload_checksum;
+    uint64_t header_checksum; // must be the last member
+  };
+
+  struct UserRecord
+  {
+    int64_t database_id;
+    uint64_t name_offset;
+    uint32_t name_length;
+    uint32_t is_system;
+  };
+
+  struct MediaRecord
+  {
+    int64_t database_id;
+    int64_t type;
+    int64_t media_size;
+    uint64_t mime_type_offset;
+    uint64_t mime_type_length;
+  };
+
+  /**
+   * Writes the snapshot into a temporary file and renames it at the end, so readers never see a partial file.
+   */
+  static bool write(const ChatContext &ctx, int64_t generation, const fs::path &path);
+
+  /**
+   * Maps the file and validates the header.
+   *
+   * @return nullptr if the file doesn't exist or isn't a valid snapshot
+   */
+  static MappedChatPtr open(const fs::path &path, bool verify_checksum = false);
+
+  static uint64_t headerChecksum(const Header &header);
+};
+
+#endif /* CHATSNAPSHOTFILE_H_ */
@@ -0,0 +1,106 @@
+/*
+ * ConnectionPool.cpp
+ *
+ *      Author: Andreas Volz
+ */
+
+// project
+#include "ConnectionPool.h"
+
+// system
+#include <algorithm>
+
+ConnectionPool::Lease::Lease(ConnectionPool &pool, DatabaseSession &session) :
+    mPool(&pool),
+    mSession(&session)
+{
+}
+
+ConnectionPool::Lease::Lease(DatabaseSession &session, std::unique_lock<std::mutex> session_lock) :
+    mSession(&session),
+    mSessionLock(std::move(session_lock))
+{
+}
+
+ConnectionPool::Lease::Lease(Lease &&other) noexcept :
+    mPool(other.mPool),
+    mSession(other.mSession),
+    mSessionLock(std::move(other.mSessionLock))
+{
+  other.mPool = nullptr;
+  other.mSession = nullptr;
+}
+
+ConnectionPool::Lease::~Lease()
+{
+  if (mPool && mSession)
+  {
+    mPool->release(*mSession);
+  }
+}
+
+ConnectionPool::ConnectionPool(size_t max_size, SessionFactory factory) :
+    mFactory(std::move(factory)),
+    mMaxSize(std::max<size_t>(max_size, 1))
+{
+}
+
+ConnectionPool::Lease ConnectionPool::acquire()
+{
+  std::unique_lock<std::mutex> lock(mMutex);
+
+  while (mIdleSessions.empty())
+  {
+    if (mSessions.size() + mOpening < mMaxSize)
+    {
+      // opening a connection prepares all statements -> don't block the other threads meanwhile
+      mOpening++;
+      lock.unlock();
+
+      std::unique_ptr<DatabaseSession> session;
+      try
+      {
+        session = mFactory();
+      }
+      catch (...)
+      {
+        lock.lock();
+        mOpening--;
+        mReleased.notify_one();
+        throw;
+      }
+
+      lock.lock();
+      mOpening--;
+      DatabaseSession &new_session = *session;
+      mSessions.push_back(std::move(session));
+      return Lease(*this, new_session);
+    }
+
+    mReleased.wait(lock);
+  }
+
+  DatabaseSession *session = mIdleSessions.back();
+  mIdleSessions.pop_back();
+  return Lease(*this, *session);
+}
+
+size_t ConnectionPool::getMaxSize() const
+{
+  return mMaxSize;
+}
+
+size_t ConnectionPool::getSize() const
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mSessions.size();
+}
+
+void ConnectionPool::release(DatabaseSession &session)
+{
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mIdleSessions.push_back(&session);
+  }
+  mReleased.notify_one();
+}
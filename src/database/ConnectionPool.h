@@ -0,0 +1,93 @@
+/*
+ * ConnectionPool.h
+ *
+ *      Author: Andreas Volz
+ */
+
+#ifndef CONNECTIONPOOL_H_
+#define CONNECTIONPOOL_H_
+
+// project
+#include "database/DatabaseSession.h"
+
+// system
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * A pool of read-only DatabaseSessions for one database file. With WAL the readers neither block each other nor the
+ * writer, so each thread that holds a Lease reads in parallel to all others.
+ *
+ * The sessions are opened on demand up to the maximum size and stay open until the pool is destroyed. If all are in
+ * use acquire() waits for the next released one.
+ */
+class ConnectionPool
+{
+public:
+  using SessionFactory = std::function<std::unique_ptr<DatabaseSession>()>;
+
+  /**
+   * Exclusive use of one session. The session goes back into the pool with the destruction of the Lease.
+   */
+  class Lease
+  {
+  public:
+    /**
+     * A lease of a session outside of any pool that is protected by the given lock (e.g. the writer session).
+     */
+    Lease(DatabaseSession &session, std::unique_lock<std::mutex> session_lock);
+    Lease(Lease &&other) noexcept;
+    ~Lease();
+
+    Lease(const Lease&) = delete;
+    Lease& operator=(const Lease&) = delete;
+    Lease& operator=(Lease&&) = delete;
+
+    DatabaseSession* operator->() const
+    {
+      return mSession;
+    }
+
+    DatabaseSession& operator*() const
+    {
+      return *mSession;
+    }
+
+  private:
+    friend ConnectionPool;
+    Lease(ConnectionPool &pool, DatabaseSession &session);
+
+    ConnectionPool *mPool = nullptr;
+    DatabaseSession *mSession = nullptr;
+    std::unique_lock<std::mutex> mSessionLock;
+  };
+
+  ConnectionPool(size_t max_size, SessionFactory factory);
+  ~ConnectionPool() = default;
+
+  Lease acquire();
+
+  size_t getMaxSize() const;
+
+  /**
+   * Number of sessions that were opened so far.
+   */
+  size_t getSize() const;
+
+private:
+  void release(DatabaseSession &session);
+
+  SessionFactory mFactory;
+  size_t mMaxSize;
+
+  mutable std::mutex mMutex;
+  std::condition_variable mReleased;
+  std::vector<std::unique_ptr<DatabaseSession>> mSessions;
+  std::vector<DatabaseSession*> mIdleSessions;
+  size_t mOpening = 0; // sessions that are opened outside of the lock
+};
+
+#endif /* CONNECTIONPOOL_H_ */
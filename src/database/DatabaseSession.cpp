@@ -0,0 +1,44 @@
+/*
+ * DatabaseSession.cpp
+ *
+ *      Author: Andreas Volz
+ */
+
+// project
+#include "DatabaseSession.h"
+
+DatabaseSession::DatabaseSession(std::unique_ptr<SQLiteConnection> sql_con, const fs::path &media_persistence_path,
+    const MediaIngestConfig &ingest_config, MediaLayout default_layout, Executor *executor) :
+// @formatter:off
+    mSQLConPtr(std::move(sql_con)),
+    sql(*mSQLConPtr),
+    user_repo(sql),
+    message_repo(sql),
+    chat_repo(sql),
+    meta_repo(sql),
+    media_repo(sql, media_persistence_path, ingest_config),
+    import_file_repo(sql),
+    import_state_repo(sql),
+    save_progress_repo(sql),
+    persistence(sql, user_repo, message_repo, chat_repo, media_repo, import_file_repo, import_state_repo,
+        save_progress_repo)
+// @formatter:on
+{
+  media_repo.setExecutor(executor);
+
+  // a read-only session finds the layout that the read-write session stored on its first open
+  media_repo.initLayout(meta_repo, default_layout);
+  mDataVersion = sql.dataVersion();
+}
+
+bool DatabaseSession::checkDataVersion()
+{
+  int64_t data_version = sql.dataVersion();
+  if (data_version == mDataVersion)
+  {
+    return false;
+  }
+
+  mDataVersion = data_version;
+  return true;
+}
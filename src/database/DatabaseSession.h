@@ -0,0 +1,72 @@
+/*
+ * DatabaseSession.h
+ *
+ *      Author: Andreas Volz
+ */
+
+#ifndef DATABASESESSION_H_
+#define DATABASESESSION_H_
+
+// project public API
+#include "chatstorage/MediaIngest.h"
+#include "chatstorage/Executor.h"
+
+// project
+#include "database/SQLiteConnection.h"
+#include "database/UserRepository.h"
+#include "database/MessageRepository.h"
+#include "database/ChatRepository.h"
+#include "database/MediaRepository.h"
+#include "database/StorageMetaRepository.h"
+#include "database/ImportFileRepository.h"
+#include "database/ImportStateRepository.h"
+#include "database/SaveProgressRepository.h"
+#include "database/PersistenceManager.h"
+#include "common/platform.h"
+
+// system
+#include <memory>
+
+/**
+ * One database connection with its own repositories and prepared statements. The statements keep state between
+ * the calls, so a session must only be used by one thread at a time.
+ */
+class DatabaseSession
+{
+public:
+  /**
+   * @param sql_con an open connection to a database with all tables
+   * @param executor thread pool of the parallel media file operations
+   */
+  DatabaseSession(std::unique_ptr<SQLiteConnection> sql_con, const fs::path &media_persistence_path,
+      const MediaIngestConfig &ingest_config, MediaLayout default_layout, Executor *executor = nullptr);
+  ~DatabaseSession() = default;
+
+  DatabaseSession(const DatabaseSession&) = delete;
+  DatabaseSession& operator=(const DatabaseSession&) = delete;
+
+  /**
+   * Checks 'PRAGMA data_version' of the connection.
+   *
+   * @return true if another connection committed since the last call
+   */
+  bool checkDataVersion();
+
+private:
+  std::unique_ptr<SQLiteConnection> mSQLConPtr;
+  int64_t mDataVersion = -1;
+
+public:
+  SQLiteConnection &sql;
+  UserRepository user_repo;
+  MessageRepository message_repo;
+  ChatRepository chat_repo;
+  StorageMetaRepository meta_repo;
+  MediaRepository media_repo;
+  ImportFileRepository import_file_repo;
+  ImportStateRepository import_state_repo;
+  SaveProgressRepository save_progress_repo;
+  PersistenceManager persistence;
+};
+
+#endif /* DATABASESESSION_H_ */
@@ -0,0 +1,64 @@
+/*
+ * ImportFileRepository.cpp
+ *
+ *      Author: Andreas Volz
+ */
+
+// @formatter:off
+// this file is better to understand without the Eclipse auto formatter
+
+// project
+#include "ImportFileRepository.h"
+
+bool ImportFileRepository::insert(const ImportFileRow &import_file_row)
+{
+  mUpsertStmt.bind(":chat_id",     import_file_row.chat_id);
+  mUpsertStmt.bind(":file_hash",   import_file_row.file_hash);
+  mUpsertStmt.bind(":file_size",   import_file_row.file_size);
+  mUpsertStmt.bind(":imported_at", import_file_row.imported_at);
+  mUpsertStmt.bind(":messages",    import_file_row.messages);
+
+  bool success = mUpsertStmt.step() == SQLiteConnection::Result::Done;
+  mUpsertStmt.reset();
+
+  return success;
+}
+
+bool ImportFileRepository::contains(int64_t chat_id, const std::string &file_hash, int64_t file_size)
+{
+  mSelectStmt.reset();
+  mSelectStmt.bind(":chat_id",   chat_id);
+  mSelectStmt.bind(":file_hash", file_hash);
+  mSelectStmt.bind(":file_size", file_size);
+
+  bool found = mSelectStmt.step() == SQLiteConnection::Result::Row;
+  mSelectStmt.reset();
+
+  return found;
+}
+
+bool ImportFileRepository::removeByChatId(int64_t chat_id)
+{
+  mDeleteByChatIdStmt.bind(":chat_id", chat_id);
+
+  bool success = mDeleteByChatIdStmt.step() == SQLiteConnection::Result::Done;
+  mDeleteByChatIdStmt.reset();
+
+  return success;
+}
+
+bool ImportFileRepository::createTable(SQLiteConnection &sql_con)
+{
+  std::string import_files_table_sql =
+      "CREATE TABLE IF NOT EXISTS import_files ("
+      "chat_id INTEGER NOT NULL, "
+      "file_hash TEXT NOT NULL, "
+      "file_size INTEGER NOT NULL, "
+      "imported_at INTEGER NOT NULL, "
+      "messages INTEGER NOT NULL, "
+      "PRIMARY KEY (chat_id, file_hash, file_size)"
+      ");";
+
+  return sql_con.exec(import_files_table_sql);
+}
+// @formatter:on
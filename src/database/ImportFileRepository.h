@@ -0,0 +1,60 @@
+/*
+ * ImportFileRepository.h
+ *
+ *      Author: Andreas Volz
+ */
+
+#ifndef IMPORTFILEREPOSITORY_H_
+#define IMPORTFILEREPOSITORY_H_
+
+// project
+#include "database/SQLiteConnection.h"
+#include "database/Statement.h"
+#include "database/ImportFileRow.h"
+
+// system
+#include <string>
+
+/**
+ * Registry of the export files that were imported into a chat. A byte-identical file is recognized by its content
+ * hash and size before it's parsed.
+ */
+class ImportFileRepository
+{
+public:
+  ImportFileRepository(SQLiteConnection &sql_con) :
+// @formatter:off
+      mSQLCon(sql_con),
+      mUpsertStmt(mSQLCon,
+          "INSERT INTO import_files (chat_id, file_hash, file_size, imported_at, messages) "
+          "VALUES (:chat_id, :file_hash, :file_size, :imported_at, :messages) "
+          "ON CONFLICT (chat_id, file_hash, file_size) DO UPDATE SET imported_at = excluded.imported_at;"),
+      mSelectStmt(mSQLCon,
+          "SELECT 1 "
+          "FROM import_files "
+          "WHERE chat_id = :chat_id AND file_hash = :file_hash AND file_size = :file_size"),
+      mDeleteByChatIdStmt(mSQLCon,
+          "DELETE FROM import_files "
+          "WHERE chat_id = :chat_id")
+// @formatter:on
+  {
+  }
+
+  ~ImportFileRepository() = default;
+
+  bool insert(const ImportFileRow &import_file_row);
+
+  bool contains(int64_t chat_id, const std::string &file_hash, int64_t file_size);
+
+  bool removeByChatId(int64_t chat_id);
+
+  static bool createTable(SQLiteConnection &sql_con);
+
+private:
+  SQLiteConnection &mSQLCon;
+  Statement mUpsertStmt;
+  Statement mSelectStmt;
+  Statement mDeleteByChatIdStmt;
+};
+
+#endif /* IMPORTFILEREPOSITORY_H_ */
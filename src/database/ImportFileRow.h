@@ -0,0 +1,23 @@
+/*
+ * ImportFileRow.h
+ *
+ *      Author: Andreas Volz
+ */
+
+#ifndef IMPORTFILEROW_H_
+#define IMPORTFILEROW_H_
+
+// system
+#include <cstdint>
+#include <string>
+
+struct ImportFileRow
+{
+  int64_t chat_id = 0;
+  std::string file_hash;
+  int64_t file_size = 0;
+  int64_t imported_at = 0;  // unix seconds
+  int64_t messages = 0;     // new messages of this import
+};
+
+#endif /* IMPORTFILEROW_H_ */
@@ -0,0 +1,70 @@
+/*
+ * ImportStateRepository.cpp
+ *
+ *      Author: Andreas Volz
+ */
+
+// @formatter:off
+// this file is better to understand without the Eclipse auto formatter
+
+// project
+#include "ImportStateRepository.h"
+
+bool ImportStateRepository::set(const ImportStateRow &import_state_row)
+{
+  mUpsertStmt.bind(":chat_id",        import_state_row.chat_id);
+  mUpsertStmt.bind(":byte_offset",    import_state_row.byte_offset);
+  mUpsertStmt.bind(":last_timestamp", import_state_row.last_timestamp);
+  mUpsertStmt.bind(":prefix_length",  import_state_row.prefix_length);
+  mUpsertStmt.bind(":prefix_hash",    import_state_row.prefix_hash);
+
+  bool success = mUpsertStmt.step() == SQLiteConnection::Result::Done;
+  mUpsertStmt.reset();
+
+  return success;
+}
+
+std::optional<ImportStateRow> ImportStateRepository::getByChatId(int64_t chat_id)
+{
+  mSelectStmt.reset();
+  mSelectStmt.bind(":chat_id", chat_id);
+
+  std::optional<ImportStateRow> import_state_row;
+  if (mSelectStmt.step() == SQLiteConnection::Result::Row)
+  {
+    import_state_row = ImportStateRow {};
+    import_state_row->chat_id        = chat_id;
+    import_state_row->byte_offset    = mSelectStmt.getInt64(0);
+    import_state_row->last_timestamp = mSelectStmt.getInt64(1);
+    import_state_row->prefix_length  = mSelectStmt.getInt64(2);
+    import_state_row->prefix_hash    = mSelectStmt.getText(3);
+  }
+  mSelectStmt.reset();
+
+  return import_state_row;
+}
+
+bool ImportStateRepository::remove(int64_t chat_id)
+{
+  mDeleteStmt.bind(":chat_id", chat_id);
+
+  bool success = mDeleteStmt.step() == SQLiteConnection::Result::Done;
+  mDeleteStmt.reset();
+
+  return success;
+}
+
+bool ImportStateRepository::createTable(SQLiteConnection &sql_con)
+{
+  std::string import_state_table_sql =
+      "CREATE TABLE IF NOT EXISTS import_state ("
+      "chat_id INTEGER PRIMARY KEY, "
+      "byte_offset INTEGER NOT NULL, "
+      "last_timestamp INTEGER NOT NULL, "
+      "prefix_length INTEGER NOT NULL, "
+      "prefix_hash TEXT NOT NULL"
+      ");";
+
+  return sql_con.exec(import_state_table_sql);
+}
+// @formatter:on
@@ -0,0 +1,62 @@
+/*
+ * ImportStateRepository.h
+ *
+ *      Author: Andreas Volz
+ */
+
+#ifndef IMPORTSTATEREPOSITORY_H_
+#define IMPORTSTATEREPOSITORY_H_
+
+// project
+#include "database/SQLiteConnection.h"
+#include "database/Statement.h"
+#include "database/ImportStateRow.h"
+
+// system
+#include <optional>
+
+/**
+ * The position in the export file up to which a chat was imported, so the import of the grown export continues
+ * there (see ChatStorage::importFile()).
+ */
+class ImportStateRepository
+{
+public:
+  ImportStateRepository(SQLiteConnection &sql_con) :
+// @formatter:off
+      mSQLCon(sql_con),
+      mUpsertStmt(mSQLCon,
+          "INSERT INTO import_state (chat_id, byte_offset, last_timestamp, prefix_length, prefix_hash) "
+          "VALUES (:chat_id, :byte_offset, :last_timestamp, :prefix_length, :prefix_hash) "
+          "ON CONFLICT (chat_id) DO UPDATE SET byte_offset = excluded.byte_offset, "
+          "last_timestamp = excluded.last_timestamp, prefix_length = excluded.prefix_length, "
+          "prefix_hash = excluded.prefix_hash;"),
+      mSelectStmt(mSQLCon,
+          "SELECT byte_offset, last_timestamp, prefix_length, prefix_hash "
+          "FROM import_state "
+          "WHERE chat_id = :chat_id"),
+      mDeleteStmt(mSQLCon,
+          "DELETE FROM import_state "
+          "WHERE chat_id = :chat_id")
+// @formatter:on
+  {
+  }
+
+  ~ImportStateRepository() = default;
+
+  bool set(const ImportStateRow &import_state_row);
+
+  std::optional<ImportStateRow> getByChatId(int64_t chat_id);
+
+  bool remove(int64_t chat_id);
+
+  static bool createTable(SQLiteConnection &sql_con);
+
+private:
+  SQLiteConnection &mSQLCon;
+  Statement mUpsertStmt;
+  Statement mSelectStmt;
+  Statement mDeleteStmt;
+};
+
+#endif /* IMPORTSTATEREPOSITORY_H_ */
@@ -0,0 +1,23 @@
+/*
+ * ImportStateRow.h
+ *
+ *      Author: Andreas Volz
+ */
+
+#ifndef IMPORTSTATEROW_H_
+#define IMPORTSTATEROW_H_
+
+// system
+#include <cstdint>
+#include <string>
+
+struct ImportStateRow
+{
+  int64_t chat_id = 0;
+  int64_t byte_offset = 0;     // first line of the messages with the last timestamp
+  int64_t last_timestamp = 0;
+  int64_t prefix_length = 0;   // the lines in front of byte_offset that prefix_hash covers
+  std::string prefix_hash;
+};
+
+#endif /* IMPORTSTATEROW_H_ */
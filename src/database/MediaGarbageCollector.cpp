@@ -0,0 +1,313 @@
+/*
+ * MediaGarbageCollector.cpp
+ *
+ *      Author: Andreas Volz
+ */
+
+// project
+#include "MediaGarbageCollector.h"
+#include "common/ParallelFor.h"
+
+// system
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <limits>
+#include <thread>
+#include <unordered_map>
+
+MediaGcStats MediaGarbageCollector::run(const MediaGcConfig &config)
+{
+  MediaGcStats stats;
+  auto start_time = std::chrono::steady_clock::now();
+
+  // the directory first: a file that is copied after this scan has its row yet committed
+  std::vector<FileEntry> entries = scanMediaDirectory();
+  stats.files_scanned = entries.size();
+
+  // temporary files have the ID -1 and are sorted in front
+  std::sort(entries.begin(), entries.end(), [](const FileEntry &a, const FileEntry &b)
+  {
+    return a.media_id < b.media_id;
+  });
+
+  const auto grace_period = std::chrono::seconds(config.gracePeriodSeconds);
+  const auto now = fs::file_time_type::clock::now();
+  auto delete_start = std::chrono::steady_clock::now();
+
+  auto handle_orphan = [&](const FileEntry &entry, bool check_row)
+  {
+    fs::path path = getPath(entry);
+
+    std::error_code ec;
+    uintmax_t size = fs::file_size(path, ec);
+    if (ec)
+    {
+      // removed in the meantime
+      return;
+    }
+
+    stats.orphan_files++;
+    stats.orphan_bytes += size;
+    if (stats.orphan_paths.size() < config.maxReportedEntries)
+    {
+      stats.orphan_paths.push_back(path);
+    }
+
+    fs::file_time_type mtime = fs::last_write_time(path, ec);
+    if (ec || now - mtime < grace_period)
+    {
+      stats.recent_files++;
+      return;
+    }
+
+    // a save may have inserted the row after the table window was read
+    if (config.dryRun || (check_row && mMediaRepo.exists(entry.media_id)))
+    {
+      return;
+    }
+
+    if (config.maxDeletesPerSecond > 0.0)
+    {
+      auto due_time = delete_start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<double>(stats.deleted_files / config.maxDeletesPerSecond));
+      std::this_thread::sleep_until(due_time);
+    }
+
+    if (fs::remove(path, ec))
+    {
+      stats.deleted_files++;
+      stats.bytes_freed += size;
+    }
+  };
+
+  // merge join of the sorted files with the media table in media_id order
+  size_t file_pos = 0;
+  int64_t after_media_id = 0;
+  size_t window_size = std::max<size_t>(config.windowSize, 1);
+  while (true)
+  {
+    std::vector<MediaRow> media_rows = mMediaRepo.getAll(after_media_id, window_size);
+
+    for (const auto &media_row : media_rows)
+    {
+      stats.rows_scanned++;
+
+      while (file_pos < entries.size() && entries[file_pos].media_id < media_row.media_id)
+      {
+        handle_orphan(entries[file_pos++], true);
+      }
+
+      bool has_file = false;
+      while (file_pos < entries.size() && entries[file_pos].media_id == media_row.media_id)
+      {
+        if (media_row.storage == MediaRow::STORAGE_FILE)
+        {
+          has_file = true;
+        }
+        else
+        {
+          // packed or referenced media don't use a file, it's left over from an earlier attempt
+          handle_orphan(entries[file_pos], false);
+        }
+        file_pos++;
+      }
+
+      if (media_row.storage == MediaRow::STORAGE_FILE && !has_file)
+      {
+        stats.missing_files++;
+        if (stats.missing_media_ids.size() < config.maxReportedEntries)
+        {
+          stats.missing_media_ids.push_back(media_row.media_id);
+        }
+      }
+    }
+
+    if (media_rows.size() < window_size)
+    {
+      break;
+    }
+    after_media_id = media_rows.back().media_id;
+  }
+
+  while (file_pos < entries.size())
+  {
+    handle_orphan(entries[file_pos++], true);
+  }
+
+  stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+
+  return stats;
+}
+
+std::vector<MediaGarbageCollector::FileEntry> MediaGarbageCollector::scanMediaDirectory()
+{
+  // the result of one directory tree with its own extension and temporary name tables
+  struct DirScan
+  {
+    std::vector<fs::path> dirs;
+    std::vector<FileEntry> entries;
+    std::vector<std::string> extensions;
+    std::vector<std::string> temp_names;
+    std::unordered_map<std::string, uint32_t> extension_index;
+
+    void addFile(const std::string &name, uint32_t dir_index)
+    {
+      int64_t media_id = 0;
+      std::string extension;
+      bool temporary = false;
+      if (!parseFileName(name, media_id, extension, temporary))
+      {
+        return;
+      }
+
+      if (temporary)
+      {
+        entries.push_back(FileEntry { -1, dir_index, static_cast<uint32_t>(temp_names.size()) });
+        temp_names.push_back(name);
+        return;
+      }
+
+      auto result = extension_index.emplace(extension, static_cast<uint32_t>(extensions.size()));
+      if (result.second)
+      {
+        extensions.push_back(extension);
+      }
+      entries.push_back(FileEntry { media_id, dir_index, result.first->second });
+    }
+  };
+
+  fs::path root = mMediaRepo.getMediaPersistencePath();
+
+  // the top level contains the files of the flat layout and the fan-out directories of the sharded one
+  DirScan root_scan;
+  root_scan.dirs.push_back(root);
+  std::vector<fs::path> level1_dirs;
+  std::error_code ec;
+  for (fs::directory_iterator it(root, ec), end; !ec && it != end; it.increment(ec))
+  {
+    std::string name = it->path().filename().string();
+    std::error_code type_ec;
+    if (it->is_regular_file(type_ec))
+    {
+      root_scan.addFile(name, 0);
+    }
+    else if (it->is_directory(type_ec) && isShardDirectory(name))
+    {
+      level1_dirs.push_back(it->path());
+    }
+  }
+
+  // each worker lists one top level directory with its 256 sub directories
+  std::vector<DirScan> scans(level1_dirs.size());
+  parallelFor(mMediaRepo.getExecutor(), level1_dirs.size(), mWorkers, [&](size_t index)
+  {
+    DirScan &scan = scans[index];
+    std::error_code scan_ec;
+    for (fs::directory_iterator level1_it(level1_dirs[index], scan_ec), end; !scan_ec && level1_it != end;
+        level1_it.increment(scan_ec))
+    {
+      std::error_code type_ec;
+      if (!level1_it->is_directory(type_ec) || !isShardDirectory(level1_it->path().filename().string()))
+      {
+        continue;
+      }
+
+      uint32_t dir_index = static_cast<uint32_t>(scan.dirs.size());
+      scan.dirs.push_back(level1_it->path());
+
+      std::error_code file_ec;
+      for (fs::directory_iterator file_it(level1_it->path(), file_ec), file_end; !file_ec && file_it != file_end;
+          file_it.increment(file_ec))
+      {
+        if (file_it->is_regular_file(type_ec))
+        {
+          scan.addFile(file_it->path().filename().string(), dir_index);
+        }
+      }
+    }
+  });
+
+  // merge the local tables into the global ones
+  mDirs.clear();
+  mExtensions.clear();
+  mTempNames.clear();
+  std::unordered_map<std::string, uint32_t> extension_index;
+  std::vector<FileEntry> entries;
+
+  auto merge = [&](DirScan &scan)
+  {
+    uint32_t dir_offset = static_cast<uint32_t>(mDirs.size());
+    uint32_t temp_offset = static_cast<uint32_t>(mTempNames.size());
+    mDirs.insert(mDirs.end(), scan.dirs.begin(), scan.dirs.end());
+    mTempNames.insert(mTempNames.end(), scan.temp_names.begin(), scan.temp_names.end());
+
+    std::vector<uint32_t> extension_map(scan.extensions.size());
+    for (size_t i = 0; i < scan.extensions.size(); i++)
+    {
+      auto result = extension_index.emplace(scan.extensions[i], static_cast<uint32_t>(mExtensions.size()));
+      if (result.second)
+      {
+        mExtensions.push_back(scan.extensions[i]);
+      }
+      extension_map[i] = result.first->second;
+    }
+
+    for (FileEntry entry : scan.entries)
+    {
+      entry.dir_index += dir_offset;
+      entry.name_index = entry.media_id < 0 ? entry.name_index + temp_offset : extension_map[entry.name_index];
+      entries.push_back(entry);
+    }
+
+    scan = DirScan();
+  };
+
+  merge(root_scan);
+  for (auto &scan : scans)
+  {
+    merge(scan);
+  }
+
+  return entries;
+}
+
+fs::path MediaGarbageCollector::getPath(const FileEntry &entry) const
+{
+  if (entry.media_id < 0)
+  {
+    return mDirs[entry.dir_index] / mTempNames[entry.name_index];
+  }
+
+  return mDirs[entry.dir_index] / (std::to_string(entry.media_id) + "." + mExtensions[entry.name_index]);
+}
+
+bool MediaGarbageCollector::isShardDirectory(const std::string &name)
+{
+  return name.size() == 2 && isxdigit(static_cast<unsigned char>(name[0])) && isxdigit(static_cast<unsigned char>(name[1]));
+}
+
+bool MediaGarbageCollector::parseFileName(const std::string &name, int64_t &out_media_id, std::string &out_extension,
+    bool &out_temporary)
+{
+  size_t dot = name.find('.');
+  if (dot == 0 || dot == std::string::npos || name.find_first_not_of("0123456789") != dot)
+  {
+    return false;
+  }
+
+  // a longer number isn't a media ID and would overflow std::stoll()
+  if (dot > static_cast<size_t>(std::numeric_limits<int64_t>::digits10))
+  {
+    return false;
+  }
+
+  out_media_id = std::stoll(name.substr(0, dot));
+  out_extension = name.substr(dot + 1);
+
+  const std::string TMP_SUFFIX = ".tmp";
+  out_temporary = out_extension.size() > TMP_SUFFIX.size()
+      && out_extension.compare(out_extension.size() - TMP_SUFFIX.size(), TMP_SUFFIX.size(), TMP_SUFFIX) == 0;
+
+  return true;
+}
@@ -0,0 +1,78 @@
+/*
+ * MediaGarbageCollector.h
+ *
+ *      Author: Andreas Volz
+ */
+
+#ifndef MEDIAGARBAGECOLLECTOR_H_
+#define MEDIAGARBAGECOLLECTOR_H_
+
+// project public API
+#include "chatstorage/MediaIngest.h"
+
+// project
+#include "database/MediaRepository.h"
+#include "common/platform.h"
+
+// system
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Finds media files without media row (failed copies, aborted imports, removed chats) and media rows without file.
+ *
+ * The media directory is scanned first, one worker per top level directory. Each file is reduced to its media ID,
+ * directory and extension and the result is sorted by ID. Then the media table is read in ID order in windows of
+ * MediaGcConfig::windowSize rows and both sorted sequences are compared with a merge join. The memory is a few
+ * bytes per file and independent of the size of the media table.
+ *
+ * As the directory is scanned before the table, each file of a committed media row is found. An orphan is deleted
+ * only if it's older than the grace period and its ID is still not in the table.
+ */
+class MediaGarbageCollector
+{
+public:
+  MediaGarbageCollector(MediaRepository &media_repo, unsigned workers) :
+      mMediaRepo(media_repo),
+      mWorkers(workers)
+  {
+  }
+
+  ~MediaGarbageCollector() = default;
+
+  MediaGcStats run(const MediaGcConfig &config);
+
+private:
+  struct FileEntry
+  {
+    int64_t media_id;     // -1 for temporary files
+    uint32_t dir_index;   // index into mDirs
+    uint32_t name_index;  // index into mExtensions or for temporary files into mTempNames
+  };
+
+  /**
+   * Scans the top level files and the "xx/yy" fan-out directories of the sharded layout, so files of both layouts
+   * are found during a layout migration. Other directories (e.g. the pack segments) are ignored.
+   */
+  std::vector<FileEntry> scanMediaDirectory();
+
+  fs::path getPath(const FileEntry &entry) const;
+
+  static bool isShardDirectory(const std::string &name);
+
+  /**
+   * Splits "<media_id>.<ext>" and "<media_id>.<ext>.tmp" file names.
+   *
+   * @return false if it's not a media file
+   */
+  static bool parseFileName(const std::string &name, int64_t &out_media_id, std::string &out_extension, bool &out_temporary);
+
+  MediaRepository &mMediaRepo;
+  unsigned mWorkers;
+  std::vector<fs::path> mDirs;
+  std::vector<std::string> mExtensions;
+  std::vector<std::string> mTempNames;
+};
+
+#endif /* MEDIAGARBAGECOLLECTOR_H_ */
@@ -0,0 +1,133 @@
+/*
+ * MediaJournalRepository.cpp
+ *
+ *      Author: Andreas Volz
+ */
+
+// project
+#include "MediaJournalRepository.h"
+
+// system
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+
+MediaJournalRepository::~MediaJournalRepository()
+{
+  unlock();
+}
+
+int64_t MediaJournalRepository::insert(const Entry &entry)
+{
+  mInsertStmt.bind(":media_id", entry.media_id);
+  mInsertStmt.bind(":type",     entry.type);
+  mInsertStmt.bind(":src",      entry.src);
+  mInsertStmt.bind(":dst",      entry.dst);
+
+  mInsertStmt.step();
+  mInsertStmt.reset();
+
+  return mSQLCon.lastInsertRowID();
+}
+
+bool MediaJournalRepository::remove(int64_t journal_id)
+{
+  mDeleteStmt.bind(":journal_id", journal_id);
+
+  bool success = mDeleteStmt.step() == SQLiteConnection::Result::Done;
+  mDeleteStmt.reset();
+
+  return success;
+}
+
+std::vector<MediaJournalRepository::Entry> MediaJournalRepository::getAll()
+{
+  std::vector<Entry> entries;
+
+// @formatter:off
+  Statement journal_stmt(mSQLCon,
+      "SELECT journal_id, media_id, type, src, dst "
+      "FROM media_journal "
+      "ORDER BY journal_id");
+// @formatter:on
+
+  while (journal_stmt.step() == SQLiteConnection::Result::Row)
+  {
+    Entry entry;
+
+    entry.journal_id = journal_stmt.getInt64(0);
+    entry.media_id   = journal_stmt.getInt64(1);
+    entry.type       = journal_stmt.getInt64(2);
+    journal_stmt.getColumn(3, entry.src);
+    journal_stmt.getColumn(4, entry.dst);
+
+    entries.push_back(std::move(entry));
+  }
+
+  return entries;
+}
+
+#ifndef _WIN32
+
+bool MediaJournalRepository::lock(bool exclusive)
+{
+  unlock();
+
+  std::error_code ec;
+  fs::create_directories(mLockFile.parent_path(), ec);
+
+  mLockFd = ::open(mLockFile.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (mLockFd < 0)
+  {
+    return false;
+  }
+
+  if (flock(mLockFd, exclusive ? LOCK_EX | LOCK_NB : LOCK_SH) != 0)
+  {
+    unlock();
+    return false;
+  }
+
+  return true;
+}
+
+void MediaJournalRepository::unlock()
+{
+  if (mLockFd >= 0)
+  {
+    // closing the descriptor releases the lock
+    ::close(mLockFd);
+    mLockFd = -1;
+  }
+}
+
+#else
+
+bool MediaJournalRepository::lock(bool exclusive)
+{
+  return false;
+}
+
+void MediaJournalRepository::unlock()
+{
+}
+
+#endif
+
+// @formatter:off
+bool MediaJournalRepository::createTable(SQLiteConnection &sql_con)
+{
+  std::string media_journal_table_sql =
+      "CREATE TABLE IF NOT EXISTS media_journal ("
+      "journal_id INTEGER PRIMARY KEY AUTOINCREMENT, "
+      "media_id INTEGER, "
+      "type INTEGER NOT NULL, "
+      "src TEXT, "
+      "dst TEXT"
+      ");";
+
+  return sql_con.exec(media_journal_table_sql);
+}
+// @formatter:on
@@ -0,0 +1,82 @@
+/*
+ * MediaJournalRepository.h
+ *
+ *      Author: Andreas Volz
+ */
+
+#ifndef MEDIAJOURNALREPOSITORY_H_
+#define MEDIAJOURNALREPOSITORY_H_
+
+// project
+#include "database/SQLiteConnection.h"
+#include "database/Statement.h"
+#include "common/platform.h"
+
+// system
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * The media file operations of a save() are executed after the commit. To survive a crash in between they are
+ * written to the media_journal table in the same transaction as the media rows and removed after they are done.
+ * Whatever is left in the journal is resumed by the next open of the storage.
+ */
+class MediaJournalRepository
+{
+public:
+  struct Entry
+  {
+    int64_t journal_id = 0;
+    int64_t media_id = -1;
+    int64_t type = 0;
+    std::string src; // absolute
+    std::string dst; // relative to the media persistence path
+  };
+
+  /**
+   * @param lock_file Every process that executes journaled actions holds a shared lock on this file, the resume
+   *        needs the exclusive lock. So the actions of a running save are never resumed by a second process.
+   */
+  MediaJournalRepository(SQLiteConnection &sql_con, const fs::path &lock_file) :
+// @formatter:off
+      mSQLCon(sql_con),
+      mInsertStmt(mSQLCon,
+          "INSERT INTO media_journal (media_id, type, src, dst) "
+          "VALUES (:media_id, :type, :src, :dst);"),
+      mDeleteStmt(mSQLCon,
+          "DELETE FROM media_journal "
+          "WHERE journal_id = :journal_id"),
+      mLockFile(lock_file)
+// @formatter:on
+  {
+  }
+
+  ~MediaJournalRepository();
+
+  int64_t insert(const Entry &entry);
+
+  bool remove(int64_t journal_id);
+
+  std::vector<Entry> getAll();
+
+  /**
+   * @param exclusive false: blocks until no resume is running; true: fails at once if any process holds the lock
+   *
+   * @return false if the lock isn't available (or not supported on this platform)
+   */
+  bool lock(bool exclusive);
+
+  void unlock();
+
+  static bool createTable(SQLiteConnection &sql_con);
+
+private:
+  SQLiteConnection &mSQLCon;
+  Statement mInsertStmt;
+  Statement mDeleteStmt;
+  fs::path mLockFile;
+  int mLockFd = -1;
+};
+
+#endif /* MEDIAJOURNALREPOSITORY_H_ */
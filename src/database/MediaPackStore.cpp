@@ -0,0 +1,243 @@
+/*
+ * MediaPackStore.cpp
+ *
+ *      Author: Andreas Volz
+ */
+
+// project
+#include "MediaPackStore.h"
+
+// system
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <iostream>
+#include <limits>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace
+{
+
+  const std::string PACK_PREFIX = "pack-";
+  const std::string PACK_SUFFIX = ".pack";
+
+  bool parsePackId(const std::string &file_name, int64_t &out_pack_id)
+  {
+    if (file_name.size() <= PACK_PREFIX.size() + PACK_SUFFIX.size() || file_name.compare(0, PACK_PREFIX.size(), PACK_PREFIX) != 0
+        || file_name.compare(file_name.size() - PACK_SUFFIX.size(), PACK_SUFFIX.size(), PACK_SUFFIX) != 0)
+    {
+      return false;
+    }
+
+    std::string number = file_name.substr(PACK_PREFIX.size(), file_name.size() - PACK_PREFIX.size() - PACK_SUFFIX.size());
+    if (number.find_first_not_of("0123456789") != std::string::npos
+        || number.size() > static_cast<size_t>(std::numeric_limits<int64_t>::digits10))
+    {
+      return false;
+    }
+
+    out_pack_id = std::stoll(number);
+    return true;
+  }
+
+} // namespace
+
+MediaPackStore::MediaPackStore(const fs::path &pack_dir, uint64_t segment_size) :
+    mPackDir(pack_dir),
+    mSegmentSize(segment_size)
+{
+}
+
+bool MediaPackStore::isSupported()
+{
+#ifdef _WIN32
+  return false;
+#else
+  return true;
+#endif
+}
+
+fs::path MediaPackStore::getSegmentPath(int64_t pack_id) const
+{
+  char file_name[32];
+  snprintf(file_name, sizeof(file_name), "%s%08lld%s", PACK_PREFIX.c_str(), static_cast<long long>(pack_id),
+      PACK_SUFFIX.c_str());
+  return mPackDir / file_name;
+}
+
+std::vector<MediaPackStore::Segment> MediaPackStore::listSegments() const
+{
+  std::vector<Segment> segments;
+
+  std::error_code ec;
+  for (fs::directory_iterator it(mPackDir, ec), end; !ec && it != end; it.increment(ec))
+  {
+    Segment segment;
+    if (it->is_regular_file(ec) && parsePackId(it->path().filename().string(), segment.pack_id))
+    {
+      segment.size = it->file_size(ec);
+      segment.modified = it->last_write_time(ec);
+      segments.push_back(segment);
+    }
+  }
+
+  std::sort(segments.begin(), segments.end(), [](const Segment &a, const Segment &b)
+  {
+    return a.pack_id < b.pack_id;
+  });
+
+  return segments;
+}
+
+bool MediaPackStore::removeSegment(int64_t pack_id)
+{
+  std::error_code ec;
+  return fs::remove(getSegmentPath(pack_id), ec);
+}
+
+#ifndef _WIN32
+
+bool MediaPackStore::append(const std::vector<std::vector<uint8_t>> &blobs, std::vector<Location> &out_locations)
+{
+  out_locations.clear();
+
+  if (blobs.empty())
+  {
+    return true;
+  }
+
+  std::error_code ec;
+  fs::create_directories(mPackDir, ec);
+
+  std::vector<Segment> segments = listSegments();
+  int64_t pack_id = segments.empty() ? 1 : segments.back().pack_id;
+  if (!segments.empty() && segments.back().size >= mSegmentSize)
+  {
+    pack_id++;
+  }
+
+  while (true)
+  {
+    int fd = ::open(getSegmentPath(pack_id).c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+      cerr << "Cannot open pack segment: " << getSegmentPath(pack_id) << endl;
+      return false;
+    }
+
+    // the lock serializes the appends of all processes and threads
+    if (flock(fd, LOCK_EX) != 0)
+    {
+      ::close(fd);
+      return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+      ::close(fd);
+      return false;
+    }
+
+    // another writer filled the segment in the meantime
+    if (static_cast<uint64_t>(st.st_size) >= mSegmentSize)
+    {
+      ::close(fd);
+      pack_id++;
+      continue;
+    }
+
+    std::vector<uint8_t> buffer;
+    size_t total_size = 0;
+    for (const auto &blob : blobs)
+    {
+      total_size += blob.size();
+    }
+    buffer.reserve(total_size);
+
+    int64_t offset = st.st_size;
+    for (const auto &blob : blobs)
+    {
+      Location location;
+      location.pack_id = pack_id;
+      location.offset = offset + buffer.size();
+      location.length = blob.size();
+      out_locations.push_back(location);
+      buffer.insert(buffer.end(), blob.begin(), blob.end());
+    }
+
+    size_t written = 0;
+    while (written < buffer.size())
+    {
+      ssize_t rc = pwrite(fd, buffer.data() + written, buffer.size() - written, offset + written);
+      if (rc < 0)
+      {
+        if (errno == EINTR)
+          continue;
+        break;
+      }
+      written += rc;
+    }
+
+    // the index is committed after this, so the data must be on disk first
+    bool success = written == buffer.size() && fdatasync(fd) == 0;
+    if (!success)
+    {
+      // don't leave a partial entry behind for the next writer
+      if (ftruncate(fd, offset) != 0)
+      {
+        cerr << "Cannot truncate pack segment: " << getSegmentPath(pack_id) << endl;
+      }
+      out_locations.clear();
+    }
+
+    ::close(fd); // releases the lock
+    return success;
+  }
+}
+
+bool MediaPackStore::read(const Location &location, std::vector<uint8_t> &out_data) const
+{
+  int fd = ::open(getSegmentPath(location.pack_id).c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+  {
+    return false;
+  }
+
+  out_data.resize(location.length);
+  size_t done = 0;
+  while (done < out_data.size())
+  {
+    ssize_t rc = pread(fd, out_data.data() + done, out_data.size() - done, location.offset + done);
+    if (rc < 0 && errno == EINTR)
+      continue;
+    if (rc <= 0)
+      break;
+    done += rc;
+  }
+
+  ::close(fd);
+  return done == out_data.size();
+}
+
+#else
+
+bool MediaPackStore::append(const std::vector<std::vector<uint8_t>> &blobs, std::vector<Location> &out_locations)
+{
+  out_locations.clear();
+  return blobs.empty();
+}
+
+bool MediaPackStore::read(const Location &location, std::vector<uint8_t> &out_data) const
+{
+  return false;
+}
+
+#endif
@@ -0,0 +1,75 @@
+/*
+ * MediaPackStore.h
+ *
+ *      Author: Andreas Volz
+ */
+
+#ifndef MEDIAPACKSTORE_H_
+#define MEDIAPACKSTORE_H_
+
+// project
+#include "common/platform.h"
+
+// system
+#include <cstdint>
+#include <vector>
+
+/**
+ * Append-only pack segments for small media files.
+ *
+ * A segment is a plain concatenation of media contents, the (pack_id, offset, length) index is stored in the media
+ * table. Appends are serialized with a file lock, so several processes could write into the same store. Space of
+ * deleted media is only reclaimed by compaction, which copies the live entries into the active segment.
+ */
+class MediaPackStore
+{
+public:
+  struct Location
+  {
+    int64_t pack_id = 0;
+    int64_t offset = 0;
+    int64_t length = 0;
+  };
+
+  struct Segment
+  {
+    int64_t pack_id = 0;
+    uint64_t size = 0;
+    fs::file_time_type modified;
+  };
+
+  MediaPackStore(const fs::path &pack_dir, uint64_t segment_size);
+  ~MediaPackStore() = default;
+
+  /**
+   * Pack files need pread/pwrite and file locks, which are only implemented for POSIX.
+   */
+  static bool isSupported();
+
+  /**
+   * Appends all blobs with one write into the active segment. A new segment is started if the active one is full.
+   *
+   * @return false if nothing was written
+   */
+  bool append(const std::vector<std::vector<uint8_t>> &blobs, std::vector<Location> &out_locations);
+
+  /**
+   * Reads one entry with pread().
+   */
+  bool read(const Location &location, std::vector<uint8_t> &out_data) const;
+
+  fs::path getSegmentPath(int64_t pack_id) const;
+
+  /**
+   * All segments in pack_id order. The last one is the active segment.
+   */
+  std::vector<Segment> listSegments() const;
+
+  bool removeSegment(int64_t pack_id);
+
+private:
+  fs::path mPackDir;
+  uint64_t mSegmentSize;
+};
+
+#endif /* MEDIAPACKSTORE_H_ */
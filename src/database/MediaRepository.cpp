@@ -6,7 +6,20 @@
 
 // project
 #include "MediaRepository.h"
+#include "chatstorage/Media.h"
 #include "common/StringUtil.h"
+#include "common/FileCopy.h"
+#include "common/ParallelFor.h"
+#include "common/HashUtil.h"
+
+// system
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <cstdio>
+#include <set>
+#include <thread>
 
 int64_t MediaRepository::insert(const MediaRow &media_row)
 {
@@ -14,13 +27,41 @@ int64_t MediaRepository::insert(const MediaRow &media_row)
   mInsertStmt.bind(":type",       media_row.type);
   mInsertStmt.bind(":media_size", media_row.media_size);
   mInsertStmt.bind(":mime_type",  media_row.mime_type);
+  if (media_row.content_hash.empty())
+  {
+    // NULL as the unique index allows any number of NULL values
+    mInsertStmt.bindNull(":content_hash");
+  }
+  else
+  {
+    mInsertStmt.bind(":content_hash", media_row.content_hash);
+  }
 
-  mInsertStmt.step();
+  bool success = mInsertStmt.step() == SQLiteConnection::Result::Done;
   mInsertStmt.reset();
 
+  // lastInsertRowID() would be the ID of an older row
+  if (!success)
+  {
+    return -1;
+  }
+
   return mSQLCon.lastInsertRowID();
 }
 
+bool MediaRepository::update(const MediaRow &media_row)
+{
+  mUpdateStmt.bind(":media_id",   media_row.media_id);
+  mUpdateStmt.bind(":type",       media_row.type);
+  mUpdateStmt.bind(":media_size", media_row.media_size);
+  mUpdateStmt.bind(":mime_type",  media_row.mime_type);
+
+  bool success = mUpdateStmt.step() == SQLiteConnection::Result::Done;
+  mUpdateStmt.reset();
+
+  return success && mSQLCon.changes() > 0;
+}
+
 fs::path MediaRepository::getMediaPersistencePath()
 {
   return mMediaPersistencePath;
@@ -35,12 +76,21 @@ MediaRow MediaRepository::getByMediaId(int64_t media_id)
   {
     MediaRow media_row {};
 
-    media_row.media_id  = media_id;
+    media_row.media_id    = media_id;
     media_row.account_id  = mSelectByIdStmt.getInt64(0);
     media_row.type        = mSelectByIdStmt.getInt64(1);
-    media_row.media_id  = mSelectByIdStmt.getInt64(2);
-    media_row.media_size  = mSelectByIdStmt.getInt64(3);
-    media_row.mime_type   = mSelectByIdStmt.getText(4);
+    media_row.media_size  = mSelectByIdStmt.getInt64(2);
+    mSelectByIdStmt.getColumn(3, media_row.mime_type);
+    media_row.storage     = mSelectByIdStmt.getInt64(4);
+    mSelectByIdStmt.getColumn(5, media_row.pack_id);
+    mSelectByIdStmt.getColumn(6, media_row.pack_offset);
+    mSelectByIdStmt.getColumn(7, media_row.pack_length);
+    mSelectByIdStmt.getColumn(8, media_row.source_path);
+    mSelectByIdStmt.getColumn(9, media_row.source_mtime);
+    mSelectByIdStmt.getColumn(10, media_row.source_size);
+
+    // end the implicit read transaction, otherwise later reads see an old database state
+    mSelectByIdStmt.reset();
 
     return media_row;
   }
@@ -85,46 +135,1034 @@ std::vector<MediaRow> MediaRepository::getByMediaIds(std::vector<int64_t> media_
   return media_rows;
 }
 
+std::optional<MediaRow> MediaRepository::getByContentHash(const std::string &content_hash)
+{
+  mSelectByContentHashStmt.reset();
+  mSelectByContentHashStmt.bind(":content_hash", content_hash);
+
+  if (mSelectByContentHashStmt.step() == SQLiteConnection::Result::Row)
+  {
+    MediaRow media_row {};
+
+    media_row.media_id     = mSelectByContentHashStmt.getInt64(0);
+    media_row.account_id   = mSelectByContentHashStmt.getInt64(1);
+    media_row.type         = mSelectByContentHashStmt.getInt64(2);
+    media_row.media_size   = mSelectByContentHashStmt.getInt64(3);
+    mSelectByContentHashStmt.getColumn(4, media_row.mime_type);
+    media_row.content_hash = content_hash;
+
+    mSelectByContentHashStmt.reset();
+
+    return media_row;
+  }
+
+  mSelectByContentHashStmt.reset();
+
+  return std::nullopt;
+}
+
+std::vector<MediaRow> MediaRepository::getWithoutContentHash()
+{
+  std::vector<MediaRow> media_rows;
+
+// @formatter:off
+  Statement media_stmt(mSQLCon,
+      "SELECT media_id, account_id, type, media_size, mime_type "
+      "FROM media "
+      "WHERE content_hash IS NULL AND storage = 0 "
+      "ORDER BY media_id");
+// @formatter:on
+
+  while (media_stmt.step() == SQLiteConnection::Result::Row)
+  {
+    MediaRow media_row {};
+
+    media_row.media_id   = media_stmt.getInt64(0);
+    media_row.account_id = media_stmt.getInt64(1);
+    media_row.type       = media_stmt.getInt64(2);
+    media_row.media_size = media_stmt.getInt64(3);
+    media_stmt.getColumn(4, media_row.mime_type);
+
+    media_rows.push_back(std::move(media_row));
+  }
+
+  return media_rows;
+}
+
+bool MediaRepository::setContentHash(int64_t media_id, const std::string &content_hash)
+{
+  mUpdateContentHashStmt.bind(":content_hash", content_hash);
+  mUpdateContentHashStmt.bind(":media_id", media_id);
+
+  bool success = mUpdateContentHashStmt.step() == SQLiteConnection::Result::Done;
+  mUpdateContentHashStmt.reset();
+
+  return success;
+}
+
+bool MediaRepository::remove(int64_t media_id)
+{
+  mDeleteStmt.bind(":media_id", media_id);
+
+  bool success = mDeleteStmt.step() == SQLiteConnection::Result::Done;
+  mDeleteStmt.reset();
+
+  return success;
+}
+
+std::vector<MediaRow> MediaRepository::getAll(int64_t after_media_id, size_t limit)
+{
+  std::vector<MediaRow> media_rows;
+
+// @formatter:off
+  Statement media_stmt(mSQLCon,
+      "SELECT media_id, account_id, type, media_size, mime_type, storage "
+      "FROM media "
+      "WHERE media_id > :media_id "
+      "ORDER BY media_id "
+      "LIMIT :limit");
+// @formatter:on
+  media_stmt.bind(":media_id", after_media_id);
+  // a negative LIMIT is no limit in SQLite
+  media_stmt.bind(":limit", limit > 0 ? static_cast<int64_t>(limit) : int64_t(-1));
+
+  while (media_stmt.step() == SQLiteConnection::Result::Row)
+  {
+    MediaRow media_row {};
+
+    media_row.media_id   = media_stmt.getInt64(0);
+    media_row.account_id = media_stmt.getInt64(1);
+    media_row.type       = media_stmt.getInt64(2);
+    media_row.media_size = media_stmt.getInt64(3);
+    media_stmt.getColumn(4, media_row.mime_type);
+    media_row.storage    = media_stmt.getInt64(5);
+
+    media_rows.push_back(std::move(media_row));
+  }
+
+  return media_rows;
+}
+
+bool MediaRepository::exists(int64_t media_id)
+{
+  mExistsStmt.reset();
+  mExistsStmt.bind(":media_id", media_id);
+
+  bool found = mExistsStmt.step() == SQLiteConnection::Result::Row;
+  mExistsStmt.reset();
+
+  return found;
+}
+
+int64_t MediaRepository::removeUnreferenced(const std::vector<int64_t> &media_ids)
+{
+  if (media_ids.empty())
+  {
+    return 0;
+  }
+
+  const std::string unreferenced_condition =
+      "WHERE media_id IN (" + SQLiteConnection::makePlaceholders(media_ids.size()) + ") "
+      "AND NOT EXISTS (SELECT 1 FROM messages WHERE messages.media_id = media.media_id)";
+
+  // the file deletes are queued before the rows are gone
+  Statement select_stmt(mSQLCon, "SELECT media_id, mime_type, storage FROM media " + unreferenced_condition);
+  select_stmt.bindInt64Container(1, media_ids);
+  while (select_stmt.step() == SQLiteConnection::Result::Row)
+  {
+    int64_t media_id = select_stmt.getInt64(0);
+    std::string mime_type;
+    select_stmt.getColumn(1, mime_type);
+
+    if (select_stmt.getInt64(2) == MediaRow::STORAGE_FILE)
+    {
+      MediaAction media_action {};
+      media_action.type = MediaAction::Type::Delete;
+      media_action.src = resolveMediaPath(media_id, Media::getExtensionFromMimeType(mime_type));
+      media_action.media_id = media_id;
+      enqueueAction(media_action);
+    }
+  }
+  select_stmt.reset();
+
+  Statement delete_stmt(mSQLCon, "DELETE FROM media " + unreferenced_condition);
+  delete_stmt.bindInt64Container(1, media_ids);
+
+  bool success = delete_stmt.step() == SQLiteConnection::Result::Done;
+
+  return success ? mSQLCon.changes() : 0;
+}
+
+void MediaRepository::initLayout(StorageMetaRepository &meta_repo, MediaLayout default_layout)
+{
+  mMetaRepo = &meta_repo;
+
+  std::optional<std::string> layout_value = mMetaRepo->get("media_layout");
+  if (layout_value)
+  {
+    std::optional<MediaLayout> layout = parseLayout(*layout_value);
+    if (!layout)
+    {
+      throw std::runtime_error("Unknown media layout: " + *layout_value); // TODO: custom exception
+    }
+    mLayout = *layout;
+    return;
+  }
+
+  // existing media were stored flat before the layout was introduced
+  Statement count_stmt(mSQLCon, "SELECT EXISTS (SELECT 1 FROM media)");
+  bool has_media = count_stmt.step() == SQLiteConnection::Result::Row && count_stmt.getInt64(0) != 0;
+  count_stmt.reset();
+
+  mLayout = has_media ? MediaLayout::Flat : default_layout;
+  mMetaRepo->set("media_layout", toString(mLayout));
+}
+
+void MediaRepository::reloadLayout()
+{
+  if (!mMetaRepo)
+    return;
+
+  std::optional<std::string> layout_value = mMetaRepo->get("media_layout");
+  if (layout_value)
+  {
+    std::optional<MediaLayout> layout = parseLayout(*layout_value);
+    if (layout)
+    {
+      mLayout = *layout;
+    }
+  }
+}
+
+MediaLayout MediaRepository::getLayout() const
+{
+  return mLayout;
+}
+
+fs::path MediaRepository::getRelativeMediaPath(int64_t media_id, const std::string &extension) const
+{
+  return getRelativeMediaPath(media_id, extension, mLayout);
+}
+
+fs::path MediaRepository::getRelativeMediaPath(int64_t media_id, const std::string &extension, MediaLayout layout)
+{
+  fs::path file_name = std::to_string(media_id) + "." + extension;
+
+  if (layout == MediaLayout::Sharded)
+  {
+    // the lowest bytes of the increasing IDs spread the files evenly over 256 * 256 directories
+    char level1[3];
+    char level2[3];
+    snprintf(level1, sizeof(level1), "%02x", static_cast<unsigned>(media_id & 0xFF));
+    snprintf(level2, sizeof(level2), "%02x", static_cast<unsigned>((media_id >> 8) & 0xFF));
+    return fs::path(level1) / level2 / file_name;
+  }
+
+  return file_name;
+}
+
+fs::path MediaRepository::resolveMediaPath(int64_t media_id, const std::string &extension) const
+{
+  fs::path media_file = mMediaPersistencePath / getRelativeMediaPath(media_id, extension, mLayout);
+
+  std::error_code ec;
+  if (!fs::exists(media_file, ec))
+  {
+    MediaLayout other_layout = mLayout == MediaLayout::Flat ? MediaLayout::Sharded : MediaLayout::Flat;
+    fs::path other_media_file = mMediaPersistencePath / getRelativeMediaPath(media_id, extension, other_layout);
+    if (fs::exists(other_media_file, ec))
+    {
+      return other_media_file;
+    }
+  }
+
+  return media_file;
+}
+
+fs::path MediaRepository::resolveMediaPath(const MediaRow &media_row) const
+{
+  switch (media_row.storage)
+  {
+    case MediaRow::STORAGE_FILE:
+      return resolveMediaPath(media_row.media_id, Media::getExtensionFromMimeType(media_row.mime_type));
+    case MediaRow::STORAGE_REFERENCE:
+      return verifyReference(media_row) ? fs::path(media_row.source_path) : fs::path();
+    default:
+      return {};
+  }
+}
+
+bool MediaRepository::verifyReference(const MediaRow &media_row)
+{
+  int64_t mtime = 0;
+  int64_t size = 0;
+  if (!getFileStamp(media_row.source_path, mtime, size))
+  {
+    return false;
+  }
+
+  return mtime == media_row.source_mtime && size == media_row.source_size;
+}
+
+bool MediaRepository::getFileStamp(const fs::path &file, int64_t &out_mtime, int64_t &out_size)
+{
+  std::error_code ec;
+  uintmax_t size = fs::file_size(file, ec);
+  if (ec)
+  {
+    return false;
+  }
+
+  fs::file_time_type mtime = fs::last_write_time(file, ec);
+  if (ec)
+  {
+    return false;
+  }
+
+  out_size = static_cast<int64_t>(size);
+  out_mtime = std::chrono::duration_cast<std::chrono::nanoseconds>(mtime.time_since_epoch()).count();
+  return true;
+}
+
+MediaIngestMode MediaRepository::getIngestMode() const
+{
+  return mIngestConfig.mode;
+}
+
+void MediaRepository::setExecutor(Executor *executor)
+{
+  mExecutor = executor;
+}
+
+Executor* MediaRepository::getExecutor() const
+{
+  return mExecutor;
+}
+
+void MediaRepository::switchLayout(MediaLayout target_layout)
+{
+  if (!mMetaRepo)
+  {
+    throw std::runtime_error("MediaRepository: layout isn't initialized"); // TODO: custom exception
+  }
+
+  mSQLCon.begin();
+  mMetaRepo->set("media_layout", toString(target_layout));
+  if (!mSQLCon.commit())
+  {
+    mSQLCon.rollback();
+    throw std::runtime_error("MediaRepository: cannot switch the media layout"); // TODO: custom exception
+  }
+  mLayout = target_layout;
+}
+
+MediaLayoutMigrationStats MediaRepository::moveFilesToLayout(MediaLayout target_layout)
+{
+  MediaLayoutMigrationStats stats;
+
+  auto start_time = std::chrono::steady_clock::now();
+
+  MediaLayout source_layout = target_layout == MediaLayout::Flat ? MediaLayout::Sharded : MediaLayout::Flat;
+
+  std::vector<MediaRow> media_rows = getAll();
+
+  // packed and referenced media have no own file
+  media_rows.erase(std::remove_if(media_rows.begin(), media_rows.end(), [](const MediaRow &media_row)
+  {
+    return media_row.storage != MediaRow::STORAGE_FILE;
+  }), media_rows.end());
+  stats.files = media_rows.size();
+
+  std::vector<fs::path> src_files(media_rows.size());
+  std::vector<fs::path> dst_files(media_rows.size());
+  std::set<fs::path> dst_dirs;
+  for (size_t i = 0; i < media_rows.size(); i++)
+  {
+    std::string extension = Media::getExtensionFromMimeType(media_rows[i].mime_type);
+    src_files[i] = mMediaPersistencePath / getRelativeMediaPath(media_rows[i].media_id, extension, source_layout);
+    dst_files[i] = mMediaPersistencePath / getRelativeMediaPath(media_rows[i].media_id, extension, target_layout);
+    dst_dirs.insert(dst_files[i].parent_path());
+  }
+
+  for (const auto &dir : dst_dirs)
+  {
+    std::error_code ec;
+    fs::create_directories(dir, ec);
+  }
+
+  // 0: already in target layout, 1: moved, 2: missing, 3: failed
+  std::vector<uint8_t> results(media_rows.size(), 0);
+
+  parallelFor(mExecutor, media_rows.size(), mIngestConfig.workers, [&](size_t index)
+  {
+    std::error_code ec;
+    if (fs::exists(dst_files[index], ec))
+    {
+      return;
+    }
+
+    if (!fs::exists(src_files[index], ec))
+    {
+      results[index] = 2;
+      return;
+    }
+
+    FileCopy::Method method;
+    results[index] = FileCopy::moveFile(src_files[index], dst_files[index], method, ec) ? 1 : 3;
+  });
+
+  if (source_layout == MediaLayout::Sharded)
+  {
+    // remove the empty fan-out directories, fs::remove() fails for not empty ones
+    std::set<fs::path> src_dirs;
+    for (const auto &src_file : src_files)
+    {
+      src_dirs.insert(src_file.parent_path());
+    }
+    for (const auto &dir : src_dirs)
+    {
+      std::error_code ec;
+      if (fs::remove(dir, ec))
+      {
+        fs::remove(dir.parent_path(), ec);
+      }
+    }
+  }
+
+  for (uint8_t result : results)
+  {
+    switch (result)
+    {
+      case 1:
+        stats.moved++;
+        break;
+      case 2:
+        stats.missing++;
+        break;
+      case 3:
+        stats.failed++;
+        break;
+      default:
+        break;
+    }
+  }
+
+  stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+
+  return stats;
+}
+
+std::string MediaRepository::toString(MediaLayout layout)
+{
+  return layout == MediaLayout::Sharded ? "sharded" : "flat";
+}
+
+std::optional<MediaLayout> MediaRepository::parseLayout(const std::string &layout)
+{
+  if (layout == "flat")
+    return MediaLayout::Flat;
+  if (layout == "sharded")
+    return MediaLayout::Sharded;
+  return std::nullopt;
+}
+
+std::string MediaRepository::computeContentHash(const fs::path &file)
+{
+  uint64_t hash = 0;
+  if (!HashUtil::xxh64File(file, hash))
+  {
+    return "";
+  }
+
+  std::error_code ec;
+  uintmax_t size = fs::file_size(file, ec);
+  if (ec)
+  {
+    return "";
+  }
+
+  return HashUtil::toHex(hash) + "-" + std::to_string(size);
+}
+
+std::vector<std::string> MediaRepository::computeContentHashes(const fs::path &base_path,
+    const std::vector<fs::path> &files)
+{
+  std::vector<std::string> hashes(files.size());
+
+  parallelFor(mExecutor, files.size(), mIngestConfig.workers, [&](size_t index)
+  {
+    hashes[index] = computeContentHash(base_path / files[index]);
+  });
+
+  return hashes;
+}
+
 void MediaRepository::enqueueAction(const MediaRepository::MediaAction& action)
 {
   mActions.push_back(action);
 }
 
-void MediaRepository::executeActions(fs::path mMediaImportPath)
+void MediaRepository::acquireJournal()
+{
+  // without lock support a resume could run in parallel, but the actions are idempotent
+  if (!mMediaPersistencePath.empty())
+  {
+    mJournal.lock(false);
+  }
+}
+
+void MediaRepository::journalActions(const fs::path &media_import_path)
+{
+  for (auto &a : mActions)
+  {
+    if (a.journal_id >= 0)
+    {
+      continue;
+    }
+
+    std::error_code ec;
+    a.src = fs::absolute(media_import_path / a.src, ec).lexically_normal();
+
+    MediaJournalRepository::Entry entry;
+    entry.media_id = a.media_id;
+    entry.type = static_cast<int64_t>(a.type);
+    entry.src = a.src.string();
+    entry.dst = a.dst.string();
+    a.journal_id = mJournal.insert(entry);
+  }
+}
+
+MediaIngestStats MediaRepository::resumeJournal(std::vector<MediaIngestFailure> &out_failures)
+{
+  // a storage opened without media path (e.g. read only tools) can't execute the actions
+  if (mMediaPersistencePath.empty() || !mJournal.lock(true))
+  {
+    return {};
+  }
+
+  std::vector<MediaJournalRepository::Entry> entries = mJournal.getAll();
+  if (entries.empty())
+  {
+    mJournal.unlock();
+    return {};
+  }
+
+  mActions.clear();
+  for (const auto &entry : entries)
+  {
+    MediaAction a;
+    a.type = static_cast<MediaAction::Type>(entry.type);
+    a.src = entry.src;
+    a.dst = entry.dst;
+    a.media_id = entry.media_id;
+    a.journal_id = entry.journal_id;
+    mActions.push_back(std::move(a));
+  }
+
+  // the sources are absolute
+  return executeActions(fs::path(), out_failures);
+}
+
+void MediaRepository::removeFromJournal(const std::vector<MediaAction> &actions)
 {
+  bool journaled = std::any_of(actions.begin(), actions.end(), [](const MediaAction &a) { return a.journal_id >= 0; });
+  if (!journaled)
+  {
+    return;
+  }
+
+  mSQLCon.begin();
+  for (const auto &a : actions)
+  {
+    if (a.journal_id >= 0)
+    {
+      mJournal.remove(a.journal_id);
+    }
+  }
+
+  if (!mSQLCon.commit())
+  {
+    // the actions are repeated by the next resume
+    mSQLCon.rollback();
+  }
+}
+
+MediaIngestStats MediaRepository::executeActions(const fs::path &media_import_path,
+    std::vector<MediaIngestFailure> &out_failures)
+{
+  struct ActionResult
+  {
+    bool success = false;
+    FileCopy::Method method = FileCopy::Method::None;
+    unsigned attempts = 0;
+    std::error_code ec;
+    uint64_t bytes = 0;
+  };
+
+  MediaIngestStats stats;
+  stats.actions = mActions.size();
+
+  if (mActions.empty())
+  {
+    mJournal.unlock();
+    return stats;
+  }
+
+  auto start_time = std::chrono::steady_clock::now();
+
+  referenceMedia(media_import_path, stats, out_failures);
+  packSmallMedia(media_import_path, stats);
+
+  // create the target directories once before the workers start
+  std::set<fs::path> dst_dirs;
   for (const auto &a : mActions)
   {
-    fs::path abs_src(mMediaImportPath / a.src);
+    if (a.type != MediaAction::Type::Delete)
+    {
+      dst_dirs.insert((mMediaPersistencePath / a.dst).parent_path());
+    }
+  }
+  for (const auto &dir : dst_dirs)
+  {
+    std::error_code ec;
+    fs::create_directories(dir, ec);
+  }
+
+  std::vector<ActionResult> results(mActions.size());
+
+  parallelFor(mExecutor, mActions.size(), mIngestConfig.workers, [&](size_t index)
+  {
+    const MediaAction &a = mActions[index];
+    ActionResult &result = results[index];
+
+    fs::path abs_src(media_import_path / a.src);
     fs::path abs_dst(mMediaPersistencePath / a.dst);
 
-    try
+    for (unsigned attempt = 0; attempt <= mIngestConfig.retries && !result.success; attempt++)
     {
+      if (attempt > 0)
+      {
+        if (result.ec == std::errc::no_such_file_or_directory)
+          break;
+
+        // transient errors (e.g. network file systems) have a chance after a short pause
+        std::this_thread::sleep_for(std::chrono::milliseconds(10 * attempt));
+      }
+      result.attempts++;
+
       switch (a.type)
       {
         case MediaAction::Type::Copy:
-          // TODO: create media folder recursive
-          std::filesystem::copy_file(abs_src, abs_dst, std::filesystem::copy_options::overwrite_existing);
+          result.success = FileCopy::copyFile(abs_src, abs_dst, mIngestConfig.allowHardlink, result.method, result.ec);
           break;
         case MediaAction::Type::Move:
-          std::filesystem::rename(abs_src, abs_dst);
+          result.success = FileCopy::moveFile(abs_src, abs_dst, result.method, result.ec);
           break;
         case MediaAction::Type::Delete:
-          // TODO: document that only the src is removed
-          std::filesystem::remove(abs_src);
+          // only the src is removed
+          result.success = fs::remove(abs_src, result.ec) || !result.ec;
+          break;
+        case MediaAction::Type::Reference:
+          // handled by referenceMedia()
           break;
       }
     }
-    catch(std::filesystem::__cxx11::filesystem_error &fs_ex)
+
+    if (result.success && a.type != MediaAction::Type::Delete)
+    {
+      std::error_code size_ec;
+      uintmax_t size = fs::file_size(abs_dst, size_ec);
+      result.bytes = size_ec ? 0 : size;
+    }
+  });
+
+  for (size_t i = 0; i < mActions.size(); i++)
+  {
+    const ActionResult &result = results[i];
+    stats.retries += result.attempts > 0 ? result.attempts - 1 : 0;
+
+    if (!result.success)
+    {
+      stats.failed++;
+
+      MediaIngestFailure failure;
+      failure.source = media_import_path / mActions[i].src;
+      failure.destination = mActions[i].type == MediaAction::Type::Delete ? fs::path() : mMediaPersistencePath / mActions[i].dst;
+      failure.error = result.ec.message();
+      failure.attempts = result.attempts;
+      out_failures.push_back(std::move(failure));
+      continue;
+    }
+
+    stats.succeeded++;
+    stats.bytes += result.bytes;
+
+    switch (result.method)
     {
-      std::cerr << "throw a std::filesystem::__cxx11::filesystem_error" << std::endl;
+      case FileCopy::Method::Reflink:
+        stats.reflinked++;
+        break;
+      case FileCopy::Method::Hardlink:
+        stats.hardlinked++;
+        break;
+      case FileCopy::Method::Rename:
+        stats.renamed++;
+        break;
+      case FileCopy::Method::CopyFileRange:
+        stats.kernel_copied++;
+        break;
+      case FileCopy::Method::Copy:
+        stats.copied++;
+        break;
+      default:
+        stats.deleted++;
+        break;
     }
   }
+
+  // a missing source won't appear by retrying, so only transient errors stay in the journal
+  std::vector<MediaAction> finished_actions;
+  for (size_t i = 0; i < mActions.size(); i++)
+  {
+    if (results[i].success || results[i].ec == std::errc::no_such_file_or_directory)
+    {
+      finished_actions.push_back(mActions[i]);
+    }
+  }
+  removeFromJournal(finished_actions);
+
+  stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+
   mActions.clear();
+  mJournal.unlock();
+
+  return stats;
+}
+
+void MediaRepository::packSmallMedia(const fs::path &media_import_path, MediaIngestStats &stats)
+{
+  if (!mIngestConfig.pack.enabled || !MediaPackStore::isSupported())
+  {
+    return;
+  }
+
+  std::vector<MediaAction> file_actions;
+  std::vector<MediaAction> pack_actions;
+  for (const auto &a : mActions)
+  {
+    std::error_code ec;
+    uintmax_t size = a.type == MediaAction::Type::Copy && a.media_id >= 0 ? fs::file_size(media_import_path / a.src, ec) : 0;
+
+    if (a.type == MediaAction::Type::Copy && a.media_id >= 0 && !ec && size <= mIngestConfig.pack.maxMediaSize)
+    {
+      pack_actions.push_back(a);
+    }
+    else
+    {
+      file_actions.push_back(a);
+    }
+  }
+
+  // bounded memory: the files of a chunk are read in parallel and appended with one write
+  const size_t CHUNK_SIZE = 256;
+  for (size_t chunk_start = 0; chunk_start < pack_actions.size(); chunk_start += CHUNK_SIZE)
+  {
+    size_t chunk_end = std::min(chunk_start + CHUNK_SIZE, pack_actions.size());
+
+    std::vector<std::vector<uint8_t>> blobs(chunk_end - chunk_start);
+    std::vector<uint8_t> read_ok(blobs.size(), 0);
+    parallelFor(mExecutor, blobs.size(), mIngestConfig.workers, [&](size_t index)
+    {
+      std::ifstream in(media_import_path / pack_actions[chunk_start + index].src, std::ios::binary);
+      if (in)
+      {
+        blobs[index].assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        read_ok[index] = !in.bad();
+      }
+    });
+
+    std::vector<MediaAction> chunk_actions;
+    std::vector<std::vector<uint8_t>> chunk_blobs;
+    for (size_t i = 0; i < blobs.size(); i++)
+    {
+      if (read_ok[i])
+      {
+        chunk_actions.push_back(pack_actions[chunk_start + i]);
+        chunk_blobs.push_back(std::move(blobs[i]));
+      }
+      else
+      {
+        // the regular copy reports the error
+        file_actions.push_back(pack_actions[chunk_start + i]);
+      }
+    }
+
+    std::vector<MediaPackStore::Location> locations;
+    if (!mPackStore.append(chunk_blobs, locations))
+    {
+      file_actions.insert(file_actions.end(), chunk_actions.begin(), chunk_actions.end());
+      continue;
+    }
+
+    mSQLCon.begin();
+    for (size_t i = 0; i < chunk_actions.size(); i++)
+    {
+      mUpdatePackLocationStmt.bind(":pack_id",     locations[i].pack_id);
+      mUpdatePackLocationStmt.bind(":pack_offset", locations[i].offset);
+      mUpdatePackLocationStmt.bind(":pack_length", locations[i].length);
+      mUpdatePackLocationStmt.bind(":media_id",    chunk_actions[i].media_id);
+      mUpdatePackLocationStmt.step();
+      mUpdatePackLocationStmt.reset();
+
+      // done in the same transaction as the index update
+      if (chunk_actions[i].journal_id >= 0)
+      {
+        mJournal.remove(chunk_actions[i].journal_id);
+      }
+    }
+
+    if (mSQLCon.commit())
+    {
+      stats.packed += chunk_actions.size();
+      stats.succeeded += chunk_actions.size();
+      for (const auto &location : locations)
+      {
+        stats.bytes += location.length;
+      }
+    }
+    else
+    {
+      // the appended data is garbage now, compaction reclaims it
+      mSQLCon.rollback();
+      file_actions.insert(file_actions.end(), chunk_actions.begin(), chunk_actions.end());
+    }
+  }
+
+  mActions = std::move(file_actions);
+}
+
+void MediaRepository::referenceMedia(const fs::path &media_import_path, MediaIngestStats &stats,
+    std::vector<MediaIngestFailure> &out_failures)
+{
+  std::vector<MediaAction> file_actions;
+  std::vector<MediaAction> reference_actions;
+  for (const auto &a : mActions)
+  {
+    if (a.type == MediaAction::Type::Reference)
+    {
+      reference_actions.push_back(a);
+    }
+    else
+    {
+      file_actions.push_back(a);
+    }
+  }
+
+  if (reference_actions.empty())
+  {
+    return;
+  }
+
+  std::vector<MediaRow> rows(reference_actions.size());
+  std::vector<uint8_t> stamp_ok(reference_actions.size(), 0);
+  parallelFor(mExecutor, reference_actions.size(), mIngestConfig.workers, [&](size_t index)
+  {
+    std::error_code ec;
+    fs::path source = fs::absolute(media_import_path / reference_actions[index].src, ec).lexically_normal();
+    rows[index].media_id = reference_actions[index].media_id;
+    rows[index].source_path = source.string();
+    stamp_ok[index] = getFileStamp(source, rows[index].source_mtime, rows[index].source_size);
+  });
+
+  mSQLCon.begin();
+  size_t referenced = 0;
+  uint64_t bytes = 0;
+  for (size_t i = 0; i < rows.size(); i++)
+  {
+    if (reference_actions[i].journal_id >= 0)
+    {
+      mJournal.remove(reference_actions[i].journal_id);
+    }
+
+    if (!stamp_ok[i])
+    {
+      MediaIngestFailure failure;
+      failure.source = rows[i].source_path;
+      failure.error = "source file not readable";
+      failure.attempts = 1;
+      out_failures.push_back(std::move(failure));
+      stats.failed++;
+      continue;
+    }
+
+    mUpdateReferenceStmt.bind(":source_path",  rows[i].source_path);
+    mUpdateReferenceStmt.bind(":source_mtime", rows[i].source_mtime);
+    mUpdateReferenceStmt.bind(":source_size",  rows[i].source_size);
+    mUpdateReferenceStmt.bind(":media_id",     rows[i].media_id);
+    mUpdateReferenceStmt.step();
+    mUpdateReferenceStmt.reset();
+    referenced++;
+    bytes += rows[i].source_size;
+  }
+
+  if (mSQLCon.commit())
+  {
+    stats.referenced += referenced;
+    stats.succeeded += referenced;
+    stats.bytes += bytes;
+  }
+  else
+  {
+    mSQLCon.rollback();
+    for (size_t i = 0; i < rows.size(); i++)
+    {
+      if (stamp_ok[i])
+      {
+        MediaIngestFailure failure;
+        failure.source = rows[i].source_path;
+        failure.error = "cannot record the reference";
+        failure.attempts = 1;
+        out_failures.push_back(std::move(failure));
+        stats.failed++;
+      }
+    }
+  }
+
+  mActions = std::move(file_actions);
+}
+
+MediaPackCompactionStats MediaRepository::compactPacks(double min_garbage_ratio)
+{
+  MediaPackCompactionStats stats;
+
+  std::vector<MediaPackStore::Segment> segments = mPackStore.listSegments();
+  if (segments.size() <= 1)
+  {
+    return stats;
+  }
+
+  // the active segment is still appended to
+  segments.pop_back();
+  stats.segments = segments.size();
+
+// @formatter:off
+  Statement live_stmt(mSQLCon,
+      "SELECT media_id, pack_offset, pack_length "
+      "FROM media "
+      "WHERE storage = 1 AND pack_id = :pack_id "
+      "ORDER BY pack_offset");
+// @formatter:on
+
+  // a writer that appended shortly before the segment got full may not yet have committed its index
+  const auto grace_time = std::chrono::minutes(1);
+  const auto now = fs::file_time_type::clock::now();
+
+  for (const auto &segment : segments)
+  {
+    if (now - segment.modified < grace_time)
+    {
+      continue;
+    }
+
+    std::vector<MediaRow> live_rows;
+    uint64_t live_bytes = 0;
+
+    live_stmt.reset();
+    live_stmt.bind(":pack_id", segment.pack_id);
+    while (live_stmt.step() == SQLiteConnection::Result::Row)
+    {
+      MediaRow media_row {};
+      media_row.media_id    = live_stmt.getInt64(0);
+      media_row.pack_id     = segment.pack_id;
+      media_row.pack_offset = live_stmt.getInt64(1);
+      media_row.pack_length = live_stmt.getInt64(2);
+      live_bytes += media_row.pack_length;
+      live_rows.push_back(std::move(media_row));
+    }
+    live_stmt.reset();
+
+    uint64_t garbage_bytes = segment.size > live_bytes ? segment.size - live_bytes : 0;
+    if (!live_rows.empty() && (segment.size == 0 || static_cast<double>(garbage_bytes) / segment.size < min_garbage_ratio))
+    {
+      continue;
+    }
+
+    if (!live_rows.empty())
+    {
+      std::vector<std::vector<uint8_t>> blobs(live_rows.size());
+      bool read_ok = true;
+      for (size_t i = 0; i < live_rows.size() && read_ok; i++)
+      {
+        MediaPackStore::Location location { segment.pack_id, live_rows[i].pack_offset, live_rows[i].pack_length };
+        read_ok = mPackStore.read(location, blobs[i]);
+      }
+
+      std::vector<MediaPackStore::Location> locations;
+      if (!read_ok || !mPackStore.append(blobs, locations))
+      {
+        std::cerr << "Cannot compact pack segment: " << mPackStore.getSegmentPath(segment.pack_id) << std::endl;
+        continue;
+      }
+
+      // only entries that weren't changed in the meantime are moved
+      mSQLCon.begin();
+      for (size_t i = 0; i < live_rows.size(); i++)
+      {
+        mMovePackLocationStmt.bind(":pack_id",         locations[i].pack_id);
+        mMovePackLocationStmt.bind(":pack_offset",     locations[i].offset);
+        mMovePackLocationStmt.bind(":media_id",        live_rows[i].media_id);
+        mMovePackLocationStmt.bind(":old_pack_id",     live_rows[i].pack_id);
+        mMovePackLocationStmt.bind(":old_pack_offset", live_rows[i].pack_offset);
+        mMovePackLocationStmt.step();
+        mMovePackLocationStmt.reset();
+      }
+      if (!mSQLCon.commit())
+      {
+        mSQLCon.rollback();
+        continue;
+      }
+
+      stats.compacted++;
+      stats.bytes_moved += live_bytes;
+    }
+
+    // readers that mapped the old segment keep their mapping after the unlink
+    if (mPackStore.removeSegment(segment.pack_id))
+    {
+      stats.removed++;
+      stats.bytes_freed += garbage_bytes;
+    }
+  }
+
+  return stats;
+}
+
+const MediaPackStore& MediaRepository::getPackStore() const
+{
+  return mPackStore;
 }
 
 void MediaRepository::clearActions()
 {
   mActions.clear();
+  mJournal.unlock();
+}
+
+std::vector<MediaRepository::MediaAction> MediaRepository::takeActions()
+{
+  std::vector<MediaAction> actions = std::move(mActions);
+  mActions.clear();
+  return actions;
+}
+
+void MediaRepository::setActions(std::vector<MediaAction> actions)
+{
+  mActions = std::move(actions);
+}
+
+size_t MediaRepository::getActionCount() const
+{
+  return mActions.size();
 }
 
 bool MediaRepository::createTable(SQLiteConnection &sql_con)
@@ -135,8 +1173,33 @@ bool MediaRepository::createTable(SQLiteConnection &sql_con)
       "account_id INTEGER NOT NULL, "
       "type INTEGER, "
       "media_size INTEGER NOT NULL,"
-      "mime_type TEXT"
+      "mime_type TEXT, "
+      "content_hash TEXT, "
+      "storage INTEGER NOT NULL DEFAULT 0, "
+      "pack_id INTEGER, "
+      "pack_offset INTEGER, "
+      "pack_length INTEGER, "
+      "source_path TEXT, "
+      "source_mtime INTEGER, "
+      "source_size INTEGER"
       ");";
 
-  return sql_con.exec(messages_table_sql);
+  bool success = sql_con.exec(messages_table_sql);
+
+  // upgrade of databases created before content hashing (existing rows stay NULL until deduplicateMedia())
+  success &= sql_con.addColumnIfMissing("media", "content_hash", "TEXT");
+  success &= sql_con.addColumnIfMissing("media", "storage", "INTEGER NOT NULL DEFAULT 0");
+  success &= sql_con.addColumnIfMissing("media", "pack_id", "INTEGER");
+  success &= sql_con.addColumnIfMissing("media", "pack_offset", "INTEGER");
+  success &= sql_con.addColumnIfMissing("media", "pack_length", "INTEGER");
+  success &= sql_con.addColumnIfMissing("media", "source_path", "TEXT");
+  success &= sql_con.addColumnIfMissing("media", "source_mtime", "INTEGER");
+  success &= sql_con.addColumnIfMissing("media", "source_size", "INTEGER");
+
+  // each content is stored only once
+  success &= sql_con.exec(
+      "CREATE UNIQUE INDEX IF NOT EXISTS media_content_hash_idx "
+      "ON media (content_hash);");
+
+  return success;
 }
@@ -7,27 +7,67 @@
 #ifndef MEDIAREPOSITORY_H_
 #define MEDIAREPOSITORY_H_
 
+// project public API
+#include "chatstorage/MediaIngest.h"
+#include "chatstorage/Executor.h"
+
 // project
 #include "database/SQLiteConnection.h"
 #include "database/Statement.h"
 #include "database/MediaRow.h"
+#include "database/StorageMetaRepository.h"
+#include "database/MediaPackStore.h"
+#include "database/MediaJournalRepository.h"
 #include "common/platform.h"
 
+// system
+#include <optional>
+
 class MediaRepository
 {
 public:
-  MediaRepository(SQLiteConnection &sql_con, const fs::path &media_persistence_path) :
+  MediaRepository(SQLiteConnection &sql_con, const fs::path &media_persistence_path,
+      const MediaIngestConfig &ingest_config = {}) :
 // @formatter:off
       mSQLCon(sql_con),
       mInsertStmt(mSQLCon,
-          "INSERT INTO media (account_id, type, media_size, mime_type) "
-          "VALUES (:account_id, :type, :media_size, :mime_type);"),
-      mUpdateStmt(mSQLCon, "UPDATE..."),
+          "INSERT INTO media (account_id, type, media_size, mime_type, content_hash) "
+          "VALUES (:account_id, :type, :media_size, :mime_type, :content_hash);"),
+      mUpdateStmt(mSQLCon,
+          "UPDATE media SET type = :type, media_size = :media_size, mime_type = :mime_type "
+          "WHERE media_id = :media_id"),
       mSelectByIdStmt(mSQLCon,
-          "SELECT account_id, type, media_size, mime_type "
+          "SELECT account_id, type, media_size, mime_type, storage, pack_id, pack_offset, pack_length, "
+          "source_path, source_mtime, source_size "
+          "FROM media "
+          "WHERE media_id = :media_id"),
+      mSelectByContentHashStmt(mSQLCon,
+          "SELECT media_id, account_id, type, media_size, mime_type "
+          "FROM media "
+          "WHERE content_hash = :content_hash"),
+      mUpdateContentHashStmt(mSQLCon,
+          "UPDATE media SET content_hash = :content_hash "
+          "WHERE media_id = :media_id"),
+      mDeleteStmt(mSQLCon,
+          "DELETE FROM media "
+          "WHERE media_id = :media_id"),
+      mExistsStmt(mSQLCon,
+          "SELECT 1 "
           "FROM media "
           "WHERE media_id = :media_id"),
-      mMediaPersistencePath(media_persistence_path)
+      mUpdatePackLocationStmt(mSQLCon,
+          "UPDATE media SET storage = 1, pack_id = :pack_id, pack_offset = :pack_offset, pack_length = :pack_length "
+          "WHERE media_id = :media_id"),
+      mMovePackLocationStmt(mSQLCon,
+          "UPDATE media SET pack_id = :pack_id, pack_offset = :pack_offset "
+          "WHERE media_id = :media_id AND storage = 1 AND pack_id = :old_pack_id AND pack_offset = :old_pack_offset"),
+      mUpdateReferenceStmt(mSQLCon,
+          "UPDATE media SET storage = 2, source_path = :source_path, source_mtime = :source_mtime, source_size = :source_size "
+          "WHERE media_id = :media_id"),
+      mMediaPersistencePath(media_persistence_path),
+      mIngestConfig(ingest_config),
+      mPackStore(media_persistence_path / "packs", ingest_config.pack.segmentSize),
+      mJournal(sql_con, media_persistence_path / ".journal.lock")
 // @formatter:on
   {
   }
@@ -38,35 +78,226 @@ public:
   {
     enum class Type
     {
-      Copy, Delete, Move
+      Copy, Delete, Move, Reference
     };
     Type type = Type::Copy;
     std::filesystem::path src;
     std::filesystem::path dst;
+    int64_t media_id = -1; // needed to store small media in a pack segment
+    int64_t journal_id = -1;
   };
 
   int64_t insert(const MediaRow &media_row);
 
+  /**
+   * Writes the type, size and MIME type of an existing media. The content and the storage location aren't changed.
+   *
+   * @return false if no media was changed
+   */
+  bool update(const MediaRow &media_row);
+
   fs::path getMediaPersistencePath();
 
   MediaRow getByMediaId(int64_t media_id);
 
   std::vector<MediaRow> getByMediaIds(std::vector<int64_t> media_ids);
 
+  std::optional<MediaRow> getByContentHash(const std::string &content_hash);
+
+  /**
+   * All media rows that were stored before content hashing was introduced.
+   */
+  std::vector<MediaRow> getWithoutContentHash();
+
+  bool setContentHash(int64_t media_id, const std::string &content_hash);
+
+  bool remove(int64_t media_id);
+
+  /**
+   * All media rows with a media_id greater than after_media_id in media_id order.
+   *
+   * @param limit maximum number of rows, 0 for all
+   */
+  std::vector<MediaRow> getAll(int64_t after_media_id = 0, size_t limit = 0);
+
+  bool exists(int64_t media_id);
+
+  /**
+   * Deletes the media rows of the list that are no longer referenced by any message and enqueues the deletion of
+   * their files. Packed media become garbage for compactPacks(), referenced source files are never touched.
+   *
+   * @return the number of deleted rows
+   */
+  int64_t removeUnreferenced(const std::vector<int64_t> &media_ids);
+
+  /**
+   * Reads the media layout of the storage. A new storage gets the default_layout, a storage from before the layout
+   * was recorded is flat.
+   */
+  void initLayout(StorageMetaRepository &meta_repo, MediaLayout default_layout);
+
+  /**
+   * Re-reads the layout, another process may have migrated the storage. Call inside a transaction.
+   */
+  void reloadLayout();
+
+  MediaLayout getLayout() const;
+
+  /**
+   * The path of a media file relative to the media persistence path in the current layout.
+   */
+  fs::path getRelativeMediaPath(int64_t media_id, const std::string &extension) const;
+
+  static fs::path getRelativeMediaPath(int64_t media_id, const std::string &extension, MediaLayout layout);
+
+  /**
+   * The absolute path of a media file. During a layout migration a file may still be in the old layout, so if the
+   * file doesn't exist in the current layout the other one is checked.
+   */
+  fs::path resolveMediaPath(int64_t media_id, const std::string &extension) const;
+
+  /**
+   * The absolute path of the content of a media row: the stored file or the referenced source file. A referenced
+   * source is only returned if its size and mtime still match the stamps recorded at import.
+   *
+   * @return empty path for packed media or a changed reference
+   */
+  fs::path resolveMediaPath(const MediaRow &media_row) const;
+
+  /**
+   * @return true if the referenced source file still has the size and mtime recorded at import
+   */
+  static bool verifyReference(const MediaRow &media_row);
+
+  /**
+   * Reads the stamps which are used to detect a changed source file.
+   */
+  static bool getFileStamp(const fs::path &file, int64_t &out_mtime, int64_t &out_size);
+
+  MediaIngestMode getIngestMode() const;
+
+  /**
+   * Thread pool of the parallel file operations; without one each operation starts its own threads.
+   */
+  void setExecutor(Executor *executor);
+
+  Executor* getExecutor() const;
+
+  /**
+   * Switches the storage to the new layout, new media are written in it from the commit on. Needs a read-write
+   * connection.
+   */
+  void switchLayout(MediaLayout target_layout);
+
+  /**
+   * Moves all files of the other layout into target_layout in parallel. Only the media table is read, so it doesn't
+   * need the write connection. The readers find not yet moved files with resolveMediaPath(). An interrupted
+   * migration is continued by calling it again.
+   */
+  MediaLayoutMigrationStats moveFilesToLayout(MediaLayout target_layout);
+
+  /**
+   * Rewrites all pack segments (except the active one) with at least min_garbage_ratio of deleted entries. The live
+   * entries are appended to the active segment, then the index is updated and the old segment is removed.
+   */
+  MediaPackCompactionStats compactPacks(double min_garbage_ratio);
+
+  const MediaPackStore& getPackStore() const;
+
+  static std::string toString(MediaLayout layout);
+
+  static std::optional<MediaLayout> parseLayout(const std::string &layout);
+
+  /**
+   * The content hash is the XXH64 of the file content as hex string combined with the file size ("<hash>-<size>").
+   * The size makes a collision of two different files practically impossible.
+   *
+   * @return empty string if the file couldn't be read
+   */
+  static std::string computeContentHash(const fs::path &file);
+
+  /**
+   * Computes the content hash of many files in parallel.
+   */
+  std::vector<std::string> computeContentHashes(const fs::path &base_path, const std::vector<fs::path> &files);
+
   void enqueueAction(const MediaRepository::MediaAction &action);
 
-  void executeActions(fs::path mMediaImportPath);
+  /**
+   * Takes the shared journal lock, so no other process resumes the actions of this save. Call before the write
+   * transaction is started, the lock is released by executeActions() or clearActions().
+   */
+  void acquireJournal();
+
+  /**
+   * Writes all enqueued actions to the journal. Call inside the write transaction that inserts the media rows.
+   *
+   * @param media_import_path base path of the action sources, the journal stores absolute paths
+   */
+  void journalActions(const fs::path &media_import_path);
+
+  /**
+   * Executes all enqueued actions in parallel (see MediaIngestConfig) and clears the queue. Finished actions are
+   * removed from the journal, actions with a transient error stay in it for the next resume.
+   *
+   * @param media_import_path base path of the action sources
+   * @param out_failures all actions that failed after the retries
+   */
+  MediaIngestStats executeActions(const fs::path &media_import_path, std::vector<MediaIngestFailure> &out_failures);
+
+  /**
+   * Executes the actions that are left in the journal by an interrupted save. Does nothing while another process
+   * executes journaled actions. All actions are idempotent, so an action that was done before the interruption
+   * is just repeated.
+   */
+  MediaIngestStats resumeJournal(std::vector<MediaIngestFailure> &out_failures);
 
   void clearActions();
 
+  /**
+   * Moves all enqueued actions out of the queue, e.g. to execute the actions of each save of a group commit
+   * separately with setActions() and executeActions().
+   */
+  std::vector<MediaAction> takeActions();
+
+  void setActions(std::vector<MediaAction> actions);
+
+  size_t getActionCount() const;
+
   static bool createTable(SQLiteConnection &sql_con);
 
 private:
+  /**
+   * Appends the small media files of the Copy actions to the pack store and removes them from the action list.
+   */
+  void packSmallMedia(const fs::path &media_import_path, MediaIngestStats &stats);
+
+  void removeFromJournal(const std::vector<MediaAction> &actions);
+
+  /**
+   * Records the absolute source path and stamps of the Reference actions and removes them from the action list.
+   */
+  void referenceMedia(const fs::path &media_import_path, MediaIngestStats &stats,
+      std::vector<MediaIngestFailure> &out_failures);
+
   SQLiteConnection &mSQLCon;
   Statement mInsertStmt;
   Statement mUpdateStmt;
   Statement mSelectByIdStmt;
+  Statement mSelectByContentHashStmt;
+  Statement mUpdateContentHashStmt;
+  Statement mDeleteStmt;
+  Statement mExistsStmt;
+  Statement mUpdatePackLocationStmt;
+  Statement mMovePackLocationStmt;
+  Statement mUpdateReferenceStmt;
   fs::path mMediaPersistencePath;
+  MediaIngestConfig mIngestConfig;
+  Executor *mExecutor = nullptr;
+  StorageMetaRepository *mMetaRepo = nullptr;
+  MediaLayout mLayout = MediaLayout::Flat;
+  MediaPackStore mPackStore;
+  MediaJournalRepository mJournal;
   std::vector<MediaAction> mActions;
 };
 
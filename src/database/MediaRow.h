@@ -18,6 +18,22 @@ struct MediaRow
   int64_t type = 0;
   int64_t media_size = 0;
   std::string mime_type;
+  std::string content_hash; // empty: not yet hashed
+
+  // location of media in a pack segment (storage == STORAGE_PACK)
+  int64_t storage = STORAGE_FILE;
+  int64_t pack_id = 0;
+  int64_t pack_offset = 0;
+  int64_t pack_length = 0;
+
+  // referenced source file (storage == STORAGE_REFERENCE) and its stamps to detect changes
+  std::string source_path;
+  int64_t source_mtime = 0;
+  int64_t source_size = 0;
+
+  static constexpr int64_t STORAGE_FILE = 0;
+  static constexpr int64_t STORAGE_PACK = 1;
+  static constexpr int64_t STORAGE_REFERENCE = 2;
 };
 
 #endif /* MEDIAROW_H_ */
@@ -22,13 +22,49 @@ int64_t MessageRepository::insert(const MessageRow &message_row)
   mInsertStmt.bind(":media_id",   message_row.media_id);
   mInsertStmt.bind(":timestamp",  message_row.timestamp);
   mInsertStmt.bind(":text",       message_row.text);
+  if (message_row.fingerprint != 0)
+  {
+    mInsertStmt.bind(":fingerprint", message_row.fingerprint);
+  }
+  else
+  {
+    mInsertStmt.bindNull(":fingerprint");
+  }
 
-  mInsertStmt.step();
+  bool success = mInsertStmt.step() == SQLiteConnection::Result::Done;
   mInsertStmt.reset();
 
+  // OR IGNORE -> no row and no error for a message that is yet stored
+  if (!success || mSQLCon.changes() == 0)
+  {
+    return -1;
+  }
+
   return mSQLCon.lastInsertRowID();
 }
 
+bool MessageRepository::update(const MessageRow &message_row)
+{
+  mUpdateStmt.bind(":message_id", message_row.message_id);
+  mUpdateStmt.bind(":sender_id",  message_row.sender_id);
+  mUpdateStmt.bind(":media_id",   message_row.media_id);
+  mUpdateStmt.bind(":timestamp",  message_row.timestamp);
+  mUpdateStmt.bind(":text",       message_row.text);
+  if (message_row.fingerprint != 0)
+  {
+    mUpdateStmt.bind(":fingerprint", message_row.fingerprint);
+  }
+  else
+  {
+    mUpdateStmt.bindNull(":fingerprint");
+  }
+
+  bool success = mUpdateStmt.step() == SQLiteConnection::Result::Done;
+  mUpdateStmt.reset();
+
+  return success && mSQLCon.changes() > 0;
+}
+
 MessageRow MessageRepository::getByMessageId(int64_t message_id)
 {
   mSelectByIdStmt.reset();
@@ -46,6 +82,9 @@ MessageRow MessageRepository::getByMessageId(int64_t message_id)
     message_row.timestamp   = mSelectByIdStmt.getInt64(4);
     message_row.text        = mSelectByIdStmt.getText(5);
 
+    // end the implicit read transaction, otherwise later reads see an old database state
+    mSelectByIdStmt.reset();
+
     return message_row;
   }
 
@@ -100,6 +139,10 @@ std::vector<MessageRow> MessageRepository::getByChatId(int64_t chat_id)
     message_row.media_id = mSelectByChatIdStmt.getInt64(3);
     message_row.timestamp = mSelectByChatIdStmt.getInt64(4);
     message_row.text = mSelectByChatIdStmt.getText(5);
+    if (!mSelectByChatIdStmt.getColumn(6, message_row.fingerprint))
+    {
+      message_row.fingerprint = 0;
+    }
 
     messages.push_back(std::move(message_row));
   }
@@ -107,6 +150,231 @@ std::vector<MessageRow> MessageRepository::getByChatId(int64_t chat_id)
   return messages;
 }
 
+std::vector<MessageRow> MessageRepository::getByChatIdAfterMessageId(int64_t chat_id, int64_t after_message_id)
+{
+  std::vector<MessageRow> messages;
+  mSelectByChatIdAfterIdStmt.reset();
+
+  mSelectByChatIdAfterIdStmt.bind(":chat_id",    chat_id);
+  mSelectByChatIdAfterIdStmt.bind(":message_id", after_message_id);
+
+  while (mSelectByChatIdAfterIdStmt.step() == SQLiteConnection::Result::Row)
+  {
+    MessageRow message_row {};
+
+    message_row.chat_id    = chat_id;
+    message_row.message_id = mSelectByChatIdAfterIdStmt.getInt64(0);
+    message_row.account_id = mSelectByChatIdAfterIdStmt.getInt64(1);
+    message_row.sender_id  = mSelectByChatIdAfterIdStmt.getInt64(2);
+    message_row.media_id   = mSelectByChatIdAfterIdStmt.getInt64(3);
+    message_row.timestamp  = mSelectByChatIdAfterIdStmt.getInt64(4);
+    message_row.text       = mSelectByChatIdAfterIdStmt.getText(5);
+    if (!mSelectByChatIdAfterIdStmt.getColumn(6, message_row.fingerprint))
+    {
+      message_row.fingerprint = 0;
+    }
+
+    messages.push_back(std::move(message_row));
+  }
+
+  return messages;
+}
+
+std::vector<int64_t> MessageRepository::getDistinctChatIdsByMediaId(int64_t media_id)
+{
+  std::vector<int64_t> distinct_chat_ids;
+  mSelectDistinctChatIdByMediaIdStmt.reset();
+
+  mSelectDistinctChatIdByMediaIdStmt.bind(":media_id", media_id);
+
+  while (mSelectDistinctChatIdByMediaIdStmt.step() == SQLiteConnection::Result::Row)
+  {
+    distinct_chat_ids.push_back(mSelectDistinctChatIdByMediaIdStmt.getInt64(0));
+  }
+  mSelectDistinctChatIdByMediaIdStmt.reset();
+
+  return distinct_chat_ids;
+}
+
+bool MessageRepository::replaceMediaId(int64_t old_media_id, int64_t new_media_id)
+{
+  mReplaceMediaIdStmt.bind(":old_media_id", old_media_id);
+  mReplaceMediaIdStmt.bind(":new_media_id", new_media_id);
+
+  bool success = mReplaceMediaIdStmt.step() == SQLiteConnection::Result::Done;
+  mReplaceMediaIdStmt.reset();
+
+  return success;
+}
+
+int64_t MessageRepository::getDeleteBatchEnd(int64_t chat_id, size_t batch_size)
+{
+  mSelectDeleteBatchEndStmt.reset();
+  mSelectDeleteBatchEndStmt.bind(":chat_id", chat_id);
+  mSelectDeleteBatchEndStmt.bind(":limit",   static_cast<int64_t>(batch_size));
+
+  int64_t max_message_id = -1;
+  if (mSelectDeleteBatchEndStmt.step() == SQLiteConnection::Result::Row)
+  {
+    // MAX() of no rows is NULL
+    if (!mSelectDeleteBatchEndStmt.getColumn(0, max_message_id))
+    {
+      max_message_id = -1;
+    }
+  }
+  mSelectDeleteBatchEndStmt.reset();
+
+  return max_message_id;
+}
+
+std::vector<int64_t> MessageRepository::getDistinctMediaIdsByChatId(int64_t chat_id, int64_t max_message_id)
+{
+  std::vector<int64_t> distinct_media_ids;
+  mSelectBatchMediaIdStmt.reset();
+
+  mSelectBatchMediaIdStmt.bind(":chat_id",    chat_id);
+  mSelectBatchMediaIdStmt.bind(":message_id", max_message_id);
+
+  while (mSelectBatchMediaIdStmt.step() == SQLiteConnection::Result::Row)
+  {
+    distinct_media_ids.push_back(mSelectBatchMediaIdStmt.getInt64(0));
+  }
+  mSelectBatchMediaIdStmt.reset();
+
+  return distinct_media_ids;
+}
+
+std::vector<int64_t> MessageRepository::getDistinctSenderIdsByChatId(int64_t chat_id, int64_t max_message_id)
+{
+  std::vector<int64_t> distinct_sender_ids;
+  mSelectBatchSenderIdStmt.reset();
+
+  mSelectBatchSenderIdStmt.bind(":chat_id",    chat_id);
+  mSelectBatchSenderIdStmt.bind(":message_id", max_message_id);
+
+  while (mSelectBatchSenderIdStmt.step() == SQLiteConnection::Result::Row)
+  {
+    distinct_sender_ids.push_back(mSelectBatchSenderIdStmt.getInt64(0));
+  }
+  mSelectBatchSenderIdStmt.reset();
+
+  return distinct_sender_ids;
+}
+
+int64_t MessageRepository::removeByChatId(int64_t chat_id, int64_t max_message_id)
+{
+  mDeleteByChatIdStmt.bind(":chat_id",    chat_id);
+  mDeleteByChatIdStmt.bind(":message_id", max_message_id);
+
+  bool success = mDeleteByChatIdStmt.step() == SQLiteConnection::Result::Done;
+  mDeleteByChatIdStmt.reset();
+
+  return success ? mSQLCon.changes() : 0;
+}
+
+std::vector<int64_t> MessageRepository::getDistinctMediaIdsFromMessageId(int64_t chat_id, int64_t min_message_id)
+{
+  std::vector<int64_t> distinct_media_ids;
+  mSelectTailMediaIdStmt.reset();
+
+  mSelectTailMediaIdStmt.bind(":chat_id",    chat_id);
+  mSelectTailMediaIdStmt.bind(":message_id", min_message_id);
+
+  while (mSelectTailMediaIdStmt.step() == SQLiteConnection::Result::Row)
+  {
+    distinct_media_ids.push_back(mSelectTailMediaIdStmt.getInt64(0));
+  }
+  mSelectTailMediaIdStmt.reset();
+
+  return distinct_media_ids;
+}
+
+std::vector<int64_t> MessageRepository::getDistinctSenderIdsFromMessageId(int64_t chat_id, int64_t min_message_id)
+{
+  std::vector<int64_t> distinct_sender_ids;
+  mSelectTailSenderIdStmt.reset();
+
+  mSelectTailSenderIdStmt.bind(":chat_id",    chat_id);
+  mSelectTailSenderIdStmt.bind(":message_id", min_message_id);
+
+  while (mSelectTailSenderIdStmt.step() == SQLiteConnection::Result::Row)
+  {
+    distinct_sender_ids.push_back(mSelectTailSenderIdStmt.getInt64(0));
+  }
+  mSelectTailSenderIdStmt.reset();
+
+  return distinct_sender_ids;
+}
+
+int64_t MessageRepository::removeFromMessageId(int64_t chat_id, int64_t min_message_id)
+{
+  mDeleteTailStmt.bind(":chat_id",    chat_id);
+  mDeleteTailStmt.bind(":message_id", min_message_id);
+
+  bool success = mDeleteTailStmt.step() == SQLiteConnection::Result::Done;
+  mDeleteTailStmt.reset();
+
+  return success ? mSQLCon.changes() : 0;
+}
+
+int64_t MessageRepository::getIdByFingerprint(int64_t chat_id, int64_t fingerprint)
+{
+  mSelectIdByFingerprintStmt.reset();
+  mSelectIdByFingerprintStmt.bind(":chat_id",     chat_id);
+  mSelectIdByFingerprintStmt.bind(":fingerprint", fingerprint);
+
+  int64_t message_id = -1;
+  if (mSelectIdByFingerprintStmt.step() == SQLiteConnection::Result::Row)
+  {
+    message_id = mSelectIdByFingerprintStmt.getInt64(0);
+  }
+  mSelectIdByFingerprintStmt.reset();
+
+  return message_id;
+}
+
+std::vector<int64_t> MessageRepository::getFingerprintsByChatId(int64_t chat_id)
+{
+  std::vector<int64_t> fingerprints;
+  mSelectFingerprintsStmt.reset();
+
+  mSelectFingerprintsStmt.bind(":chat_id", chat_id);
+
+  while (mSelectFingerprintsStmt.step() == SQLiteConnection::Result::Row)
+  {
+    fingerprints.push_back(mSelectFingerprintsStmt.getInt64(0));
+  }
+  mSelectFingerprintsStmt.reset();
+
+  return fingerprints;
+}
+
+bool MessageRepository::hasMessagesWithoutFingerprint(int64_t chat_id)
+{
+  mSelectWithoutFingerprintStmt.reset();
+  mSelectWithoutFingerprintStmt.bind(":chat_id", chat_id);
+
+  bool found = false;
+  if (mSelectWithoutFingerprintStmt.step() == SQLiteConnection::Result::Row)
+  {
+    found = mSelectWithoutFingerprintStmt.getInt64(0) != 0;
+  }
+  mSelectWithoutFingerprintStmt.reset();
+
+  return found;
+}
+
+bool MessageRepository::setFingerprint(int64_t message_id, int64_t fingerprint)
+{
+  mSetFingerprintStmt.bind(":message_id",  message_id);
+  mSetFingerprintStmt.bind(":fingerprint", fingerprint);
+
+  bool success = mSetFingerprintStmt.step() == SQLiteConnection::Result::Done;
+  mSetFingerprintStmt.reset();
+
+  return success;
+}
+
 bool MessageRepository::createTable(SQLiteConnection &sql_con)
 {
   std::string messages_table_sql =
@@ -117,9 +385,37 @@ bool MessageRepository::createTable(SQLiteConnection &sql_con)
       "sender_id INTEGER, "
       "media_id INTEGER, "
       "timestamp INTEGER, "
-      "text TEXT"
+      "text TEXT, "
+      "fingerprint INTEGER"
       ");";
 
-  return sql_con.exec(messages_table_sql);
+  // all loads are by chat in message_id order
+  std::string messages_chat_index_sql =
+      "CREATE INDEX IF NOT EXISTS messages_chat_id_idx "
+      "ON messages (chat_id, message_id);";
+
+  // reverse lookup of the messages that reference a media (media deduplication)
+  std::string messages_media_index_sql =
+      "CREATE INDEX IF NOT EXISTS messages_media_id_idx "
+      "ON messages (media_id);";
+
+  // is a user still referenced after a chat was deleted
+  std::string messages_sender_index_sql =
+      "CREATE INDEX IF NOT EXISTS messages_sender_id_idx "
+      "ON messages (sender_id);";
+
+  // identity of the imported messages: a re-import of the same chat only inserts the new ones (NULL is never equal)
+  std::string messages_fingerprint_index_sql =
+      "CREATE UNIQUE INDEX IF NOT EXISTS messages_fingerprint_idx "
+      "ON messages (chat_id, fingerprint);";
+
+  bool success = sql_con.exec(messages_table_sql);
+  success &= sql_con.addColumnIfMissing("messages", "fingerprint", "INTEGER");
+  success &= sql_con.exec(messages_chat_index_sql);
+  success &= sql_con.exec(messages_fingerprint_index_sql);
+  success &= sql_con.exec(messages_media_index_sql);
+  success &= sql_con.exec(messages_sender_index_sql);
+
+  return success;
 }
 // @formatter:on
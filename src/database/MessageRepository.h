@@ -23,16 +23,24 @@ public:
 // @formatter:off
       mSQLCon(sql_con),
       mInsertStmt(mSQLCon,
-          "INSERT INTO messages (account_id, chat_id, sender_id, media_id, timestamp, text) "
-          "VALUES (:account_id, :chat_id, :sender_id, :media_id, :timestamp, :text);"),
-      mUpdateStmt(mSQLCon, "UPDATE..."),
+          "INSERT OR IGNORE INTO messages (account_id, chat_id, sender_id, media_id, timestamp, text, fingerprint) "
+          "VALUES (:account_id, :chat_id, :sender_id, :media_id, :timestamp, :text, :fingerprint);"),
+      mUpdateStmt(mSQLCon,
+          "UPDATE messages SET sender_id = :sender_id, media_id = :media_id, timestamp = :timestamp, text = :text, "
+          "fingerprint = :fingerprint "
+          "WHERE message_id=:message_id"),
       mSelectByIdStmt(mSQLCon,
           "SELECT account_id, chat_id, sender_id, media_id, timestamp, text "
           "FROM messages "
           "WHERE message_id = :message_id"),
       mSelectByChatIdStmt(mSQLCon,
-          "SELECT message_id, account_id, sender_id, media_id, timestamp, text FROM messages "
-          "WHERE chat_id = :chat_id"),
+          "SELECT message_id, account_id, sender_id, media_id, timestamp, text, fingerprint FROM messages "
+          "WHERE chat_id = :chat_id "
+          "ORDER BY message_id"),
+      mSelectByChatIdAfterIdStmt(mSQLCon,
+          "SELECT message_id, account_id, sender_id, media_id, timestamp, text, fingerprint FROM messages "
+          "WHERE chat_id = :chat_id AND message_id > :message_id "
+          "ORDER BY message_id"),
       mSelectByDistinctSenderIdStmt(mSQLCon,
           "SELECT DISTINCT sender_id "
           "FROM messages "
@@ -40,13 +48,68 @@ public:
       mSelectByDistinctMediaIdStmt(mSQLCon,
           "SELECT DISTINCT media_id "
           "FROM messages "
-          "WHERE chat_id = :chat_id;")
+          "WHERE chat_id = :chat_id;"),
+      mSelectDistinctChatIdByMediaIdStmt(mSQLCon,
+          "SELECT DISTINCT chat_id "
+          "FROM messages "
+          "WHERE media_id = :media_id;"),
+      mReplaceMediaIdStmt(mSQLCon,
+          "UPDATE messages SET media_id = :new_media_id "
+          "WHERE media_id = :old_media_id;"),
+      mSelectDeleteBatchEndStmt(mSQLCon,
+          "SELECT MAX(message_id) "
+          "FROM (SELECT message_id FROM messages WHERE chat_id = :chat_id ORDER BY message_id LIMIT :limit)"),
+      mSelectBatchMediaIdStmt(mSQLCon,
+          "SELECT DISTINCT media_id "
+          "FROM messages "
+          "WHERE chat_id = :chat_id AND message_id <= :message_id AND media_id >= 0"),
+      mSelectBatchSenderIdStmt(mSQLCon,
+          "SELECT DISTINCT sender_id "
+          "FROM messages "
+          "WHERE chat_id = :chat_id AND message_id <= :message_id"),
+      mDeleteByChatIdStmt(mSQLCon,
+          "DELETE FROM messages "
+          "WHERE chat_id = :chat_id AND message_id <= :message_id"),
+      mSelectIdByFingerprintStmt(mSQLCon,
+          "SELECT message_id "
+          "FROM messages "
+          "WHERE chat_id = :chat_id AND fingerprint = :fingerprint"),
+      mSelectFingerprintsStmt(mSQLCon,
+          "SELECT fingerprint "
+          "FROM messages "
+          "WHERE chat_id = :chat_id AND fingerprint IS NOT NULL"),
+      mSelectWithoutFingerprintStmt(mSQLCon,
+          "SELECT EXISTS (SELECT 1 FROM messages WHERE chat_id = :chat_id AND fingerprint IS NULL)"),
+      mSetFingerprintStmt(mSQLCon,
+          "UPDATE messages SET fingerprint = :fingerprint "
+          "WHERE message_id = :message_id"),
+      mSelectTailMediaIdStmt(mSQLCon,
+          "SELECT DISTINCT media_id "
+          "FROM messages "
+          "WHERE chat_id = :chat_id AND message_id >= :message_id AND media_id >= 0"),
+      mSelectTailSenderIdStmt(mSQLCon,
+          "SELECT DISTINCT sender_id "
+          "FROM messages "
+          "WHERE chat_id = :chat_id AND message_id >= :message_id"),
+      mDeleteTailStmt(mSQLCon,
+          "DELETE FROM messages "
+          "WHERE chat_id = :chat_id AND message_id >= :message_id")
 // @formatter:on
   {
   }
 
+  /**
+   * @return the new message_id or -1 if the chat yet has a message with the same fingerprint
+   */
   int64_t insert(const MessageRow &message_row);
 
+  /**
+   * Writes sender, media, timestamp and text of an existing message. The chat of a message never changes.
+   *
+   * @return false if no message was changed
+   */
+  bool update(const MessageRow &message_row);
+
   MessageRow getByMessageId(int64_t message_id);
 
   std::vector<int64_t> getDistinctSenderIdsByChatId(int64_t chat_id);
@@ -55,8 +118,67 @@ public:
 
   std::vector<MessageRow> getByChatId(int64_t chat_id);
 
-// TODO: update()
-// TODO: delete()
+  /**
+   * Returns all messages of the chat with a message_id greater than after_message_id in message_id order.
+   */
+  std::vector<MessageRow> getByChatIdAfterMessageId(int64_t chat_id, int64_t after_message_id);
+
+  std::vector<int64_t> getDistinctChatIdsByMediaId(int64_t media_id);
+
+  /**
+   * Points all messages that reference old_media_id to new_media_id.
+   */
+  bool replaceMediaId(int64_t old_media_id, int64_t new_media_id);
+
+  /**
+   * The message_id that ends the next batch of at most batch_size messages of the chat (in message_id order).
+   *
+   * @return -1 if the chat has no messages
+   */
+  int64_t getDeleteBatchEnd(int64_t chat_id, size_t batch_size);
+
+  /**
+   * The media and sender IDs of the messages of the chat up to max_message_id.
+   */
+  std::vector<int64_t> getDistinctMediaIdsByChatId(int64_t chat_id, int64_t max_message_id);
+  std::vector<int64_t> getDistinctSenderIdsByChatId(int64_t chat_id, int64_t max_message_id);
+
+  /**
+   * Deletes all messages of the chat up to max_message_id.
+   *
+   * @return the number of deleted messages
+   */
+  int64_t removeByChatId(int64_t chat_id, int64_t max_message_id);
+
+  /**
+   * The media and sender IDs of the messages of the chat from min_message_id on.
+   */
+  std::vector<int64_t> getDistinctMediaIdsFromMessageId(int64_t chat_id, int64_t min_message_id);
+  std::vector<int64_t> getDistinctSenderIdsFromMessageId(int64_t chat_id, int64_t min_message_id);
+
+  /**
+   * Deletes all messages of the chat from min_message_id on.
+   *
+   * @return the number of deleted messages
+   */
+  int64_t removeFromMessageId(int64_t chat_id, int64_t min_message_id);
+
+  /**
+   * @return the message_id of the message with this fingerprint or -1 if the chat has none
+   */
+  int64_t getIdByFingerprint(int64_t chat_id, int64_t fingerprint);
+
+  /**
+   * All fingerprints of a chat. Only the (chat_id, fingerprint) index is read, not the messages.
+   */
+  std::vector<int64_t> getFingerprintsByChatId(int64_t chat_id);
+
+  /**
+   * @return true if the chat has messages without fingerprint, e.g. imported before fingerprints existed
+   */
+  bool hasMessagesWithoutFingerprint(int64_t chat_id);
+
+  bool setFingerprint(int64_t message_id, int64_t fingerprint);
 
   static bool createTable(SQLiteConnection &sql_con);
 
@@ -68,8 +190,22 @@ private:
   Statement mUpdateStmt;
   Statement mSelectByIdStmt;
   Statement mSelectByChatIdStmt;
+  Statement mSelectByChatIdAfterIdStmt;
   Statement mSelectByDistinctSenderIdStmt;
   Statement mSelectByDistinctMediaIdStmt;
+  Statement mSelectDistinctChatIdByMediaIdStmt;
+  Statement mReplaceMediaIdStmt;
+  Statement mSelectDeleteBatchEndStmt;
+  Statement mSelectBatchMediaIdStmt;
+  Statement mSelectBatchSenderIdStmt;
+  Statement mDeleteByChatIdStmt;
+  Statement mSelectIdByFingerprintStmt;
+  Statement mSelectFingerprintsStmt;
+  Statement mSelectWithoutFingerprintStmt;
+  Statement mSetFingerprintStmt;
+  Statement mSelectTailMediaIdStmt;
+  Statement mSelectTailSenderIdStmt;
+  Statement mDeleteTailStmt;
 };
 
 #endif /* MESSAGEREPOSITORY_H_ */
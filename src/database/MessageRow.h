@@ -20,6 +20,7 @@ struct MessageRow
   int64_t media_id;
   int64_t timestamp = 0;
   std::string text;
+  int64_t fingerprint = 0; // 0 -> NULL, see Message::getFingerprint()
 };
 
 #endif /* MESSAGEROW_H_ */
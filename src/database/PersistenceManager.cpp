@@ -8,33 +8,597 @@
 #include "PersistenceManager.h"
 #include "common/StringUtil.h"
 #include "database/MediaRepository.h"
+#include "core/MessageFingerprinter.h"
 
 // system
 #include <memory>
+#include <algorithm>
+#include <ctime>
+#include <limits>
+#include <unordered_map>
 
 using namespace std;
 
-void PersistenceManager::save(ChatContext &ctx, const fs::path& import_media_path)
+SaveReport PersistenceManager::save(ChatContext &ctx, const fs::path& import_media_path)
 {
+  return save(std::vector<SaveItem> { SaveItem { &ctx, import_media_path } }).front();
+}
+
+PersistenceManager::GroupCommit PersistenceManager::commitGroup(const std::vector<SaveItem> &items)
+{
+  GroupCommit group;
+  group.committed.resize(items.size());
+  group.journaled.resize(items.size());
+  group.deduplicated.resize(items.size());
+  group.messages_existing.resize(items.size());
+  group.action_begins.resize(items.size());
+  group.action_ends.resize(items.size());
+
+  // hash the new media files before the write transaction is started (referenced files are never read)
+  if (mMediaRepo.getIngestMode() == MediaIngestMode::Copy)
+  {
+    for (const SaveItem &item : items)
+    {
+      hashNewMedia(*item.ctx, item.import_media_path);
+    }
+  }
+
+  // before the transaction, so no other process can resume the actions of this save
+  mMediaRepo.acquireJournal();
+
+  mSQLCon.begin();
+
+  // another process may have migrated the media layout since the last save
+  mMediaRepo.reloadLayout();
+
+  // mapped users and the system user are resolved once for all contexts
+  mUserRepo.setResolveCache(true);
+
+  const bool chunked = mChunkConfig.chunkMessages > 0;
+  const size_t batch_messages = chunked ? std::max<size_t>(1, mChunkConfig.savepointMessages) :
+      std::numeric_limits<size_t>::max();
+  size_t chunk_messages = 0;
+  size_t chunk_bytes = 0;
+  bool in_transaction = true;
+
+  // the items from first_uncommitted on are written in the open transaction; written = completely and without error
+  size_t first_uncommitted = 0;
+  std::vector<bool> written(items.size(), false);
+  auto finish_transaction = [&](size_t end, bool committed)
+  {
+    for (size_t i = first_uncommitted; i < std::min(end, items.size()); i++)
+    {
+      if (committed)
+      {
+        items[i].ctx->endPersist();
+        group.committed[i] = written[i];
+        group.journaled[i] = true;
+      }
+      else
+      {
+        // a rollback gives the context its changes back, so it can be saved again
+        items[i].ctx->rollbackPersist();
+      }
+    }
+    first_uncommitted = end;
+  };
+
+  for (size_t item_index = 0; item_index < items.size(); item_index++)
+  {
+    ChatContext &ctx = *items[item_index].ctx;
+    group.action_begins[item_index] = mMediaRepo.getActionCount();
+    group.action_ends[item_index] = group.action_begins[item_index];
+
+    if (!ctx.hasChanges())
+    {
+      // nothing to write -> the cached copies of the chat stay valid
+      written[item_index] = true;
+      continue;
+    }
+
+    SaveProgressRow progress_row;
+    progress_row.new_chat = ctx.getChat()->getDatabaseId() == Chat::DB_NO_ID;
+    progress_row.started_at = static_cast<int64_t>(std::time(nullptr));
+
+    // a failing context is rolled back alone, the other contexts of the group are still saved
+    mSQLCon.savepoint("save_item");
+    ctx.beginPersist();
+
+    // a chunk of the item is committed -> a failure can only roll back its last savepoint
+    bool item_split = false;
+    bool item_failed = false;
+
+    // the order is important!
+    item_failed = !ctx.persistChat(mChatRepo) || !ctx.persistUsers(mUserRepo) ||
+        !ctx.persistMedia(mMediaRepo, group.deduplicated[item_index]);
+    progress_row.chat_id = ctx.getChat()->getDatabaseId();
+
+    // the file operations run after the commit -> journal them with the rows that reference the files
+    // (the journal stores absolute sources, so the contexts of a group may have different import paths)
+    mMediaRepo.journalActions(items[item_index].import_media_path);
+    group.action_ends[item_index] = mMediaRepo.getActionCount();
+
+    while (!item_failed)
+    {
+      if (item_split)
+      {
+        mSQLCon.savepoint("message_batch");
+      }
+
+      ChatContext::MessageBatch batch = ctx.persistMessageBatch(mMessageRepo, batch_messages);
+      if (batch.failed)
+      {
+        if (item_split)
+        {
+          mSQLCon.rollbackTo("message_batch");
+          ctx.rollbackMessageBatch();
+        }
+        item_failed = true;
+        break;
+      }
+
+      if (item_split)
+      {
+        mSQLCon.release("message_batch");
+      }
+
+      group.messages_existing[item_index] += batch.existing;
+      progress_row.messages_saved += static_cast<int64_t>(batch.messages);
+      if (progress_row.first_message_id == 0 && batch.first_inserted_id != Message::DB_NO_ID)
+      {
+        progress_row.first_message_id = batch.first_inserted_id;
+      }
+
+      if (batch.done)
+      {
+        break;
+      }
+
+      chunk_messages += batch.messages;
+      chunk_bytes += batch.bytes;
+      if (chunk_messages < mChunkConfig.chunkMessages && chunk_bytes < mChunkConfig.chunkBytes)
+      {
+        continue;
+      }
+
+      // the readers see the committed part -> each chunk is a new generation of the chat
+      mChatRepo.bumpGeneration(progress_row.chat_id);
+      mSaveProgressRepo.set(progress_row);
+
+      // the commit also ends the savepoint of the item
+      if (!mSQLCon.commit())
+      {
+        mSQLCon.rollback();
+        finish_transaction(item_index + 1, false);
+        in_transaction = false;
+        break;
+      }
+      group.chunks++;
+      chunk_messages = 0;
+      chunk_bytes = 0;
+
+      finish_transaction(item_index, true);
+      ctx.commitPersist();
+      group.journaled[item_index] = true;
+      item_split = true;
+
+      // readers are never blocked by a PASSIVE checkpoint
+      if (mChunkConfig.checkpoint)
+      {
+        mSQLCon.checkpoint();
+      }
+
+      mSQLCon.begin();
+    }
+
+    if (!in_transaction)
+    {
+      // the rest of the group isn't tried after a failed commit
+      break;
+    }
+
+    if (item_failed && !item_split)
+    {
+      // below the first chunk the failed save is rolled back completely
+      mSQLCon.rollbackTo("save_item");
+      ctx.rollbackPersist();
+      group.action_ends[item_index] = group.action_begins[item_index];
+      group.deduplicated[item_index] = 0;
+      group.messages_existing[item_index] = 0;
+      cerr << "SAVE - Rollback!" << endl;
+      continue;
+    }
+
+    if (!item_split)
+    {
+      mSQLCon.release("save_item");
+    }
+
+    // each save is a new generation of the chat - this invalidates all cached copies
+    mChatRepo.bumpGeneration(progress_row.chat_id);
+
+    if (item_failed)
+    {
+      // the messages in front of the failed one are committed with the marker
+      mSaveProgressRepo.set(progress_row);
+    }
+    else
+    {
+      // a complete save of the chat also finishes an interrupted one
+      mSaveProgressRepo.remove(progress_row.chat_id);
+      written[item_index] = true;
+    }
+  }
+
+  if (in_transaction)
+  {
+    if (mSQLCon.commit())
+    {
+      group.chunks++;
+      finish_transaction(items.size(), true);
+    }
+    else
+    {
+      mSQLCon.rollback();
+      finish_transaction(items.size(), false);
+    }
+  }
+
+  mUserRepo.setResolveCache(false);
+
+  if (std::none_of(group.journaled.begin(), group.journaled.end(), [](bool journaled) { return journaled; }))
+  {
+    mMediaRepo.clearActions();
+    cerr << "SAVE - Rollback!" << endl;
+    return group;
+  }
+
+  if (mChunkConfig.checkpoint && group.chunks > 1)
+  {
+    mSQLCon.checkpoint();
+  }
+
+  // the media rows of the committed chunks are stored -> their files are needed even if a later chunk failed
+  group.actions = mMediaRepo.takeActions();
+
+  return group;
+}
+
+std::vector<SaveReport> PersistenceManager::save(const std::vector<SaveItem> &items)
+{
+  std::vector<SaveReport> reports(items.size());
+  if (items.empty())
+  {
+    return reports;
+  }
+
+  GroupCommit group = commitGroup(items);
+
+  for (size_t i = 0; i < items.size(); i++)
+  {
+    if (!group.journaled[i])
+    {
+      continue;
+    }
+
+    mMediaRepo.setActions(std::vector<MediaRepository::MediaAction>(group.actions.begin() + group.action_begins[i],
+        group.actions.begin() + group.action_ends[i]));
+
+    // executeActions() releases the journal lock after each context (the sources are already absolute)
+    mMediaRepo.acquireJournal();
+
+    reports[i].committed = group.committed[i];
+    reports[i].messages_existing = group.messages_existing[i];
+    reports[i].chunks = group.chunks;
+    reports[i].chunk_messages = mChunkConfig.chunkMessages;
+    reports[i].media = mMediaRepo.executeActions(fs::path(), reports[i].media_failures);
+    reports[i].media.deduplicated = group.deduplicated[i];
+  }
+
+  return reports;
+}
+
+SaveAllReport PersistenceManager::saveAll(const std::vector<SaveItem> &items)
+{
+  SaveAllReport report;
+  report.contexts.resize(items.size());
+  if (items.empty())
+  {
+    return report;
+  }
+
+  GroupCommit group = commitGroup(items);
+  report.chunks = group.chunks;
+
+  // one flush for all contexts: the copies run in one parallel pass and the journal is cleaned in one transaction
+  std::vector<MediaRepository::MediaAction> actions;
+  for (size_t i = 0; i < items.size(); i++)
+  {
+    SaveReport &context_report = report.contexts[i];
+    context_report.committed = group.committed[i];
+    context_report.messages_existing = group.messages_existing[i];
+    context_report.chunks = group.chunks;
+    context_report.chunk_messages = mChunkConfig.chunkMessages;
+    context_report.media.deduplicated = group.deduplicated[i];
+
+    if (group.journaled[i])
+    {
+      actions.insert(actions.end(), group.actions.begin() + group.action_begins[i],
+          group.actions.begin() + group.action_ends[i]);
+      report.media.deduplicated += group.deduplicated[i];
+    }
+  }
+
+  if (std::none_of(group.journaled.begin(), group.journaled.end(), [](bool journaled) { return journaled; }))
+  {
+    return report;
+  }
+
+  mMediaRepo.setActions(std::move(actions));
+  mMediaRepo.acquireJournal();
+
+  size_t deduplicated = report.media.deduplicated;
+  report.media = mMediaRepo.executeActions(fs::path(), report.media_failures);
+  report.media.deduplicated = deduplicated;
+
+  return report;
+}
+
+void PersistenceManager::hashNewMedia(ChatContext &ctx, const fs::path &import_media_path)
+{
+  std::vector<Media*> new_media;
+  std::vector<fs::path> import_files;
+  for (auto &media_obj : ctx.getMediaList())
+  {
+    if (media_obj.getDatabaseId() == Media::DB_NO_ID && media_obj.getContentHash().empty()
+        && !media_obj.getImportName().empty())
+    {
+      new_media.push_back(&media_obj);
+      import_files.push_back(media_obj.getImportName());
+    }
+  }
+
+  std::vector<std::string> hashes = mMediaRepo.computeContentHashes(import_media_path, import_files);
+  for (size_t i = 0; i < new_media.size(); i++)
+  {
+    // an unreadable file stays without hash, the copy reports the error later
+    if (!hashes[i].empty())
+    {
+      new_media[i]->setContentHash(hashes[i]);
+    }
+  }
+}
+
+MediaDedupStats PersistenceManager::deduplicateMedia()
+{
+  MediaDedupStats stats;
+
+  std::vector<MediaRow> media_rows = mMediaRepo.getWithoutContentHash();
+  stats.scanned = media_rows.size();
+
+  std::vector<fs::path> media_files;
+  media_files.reserve(media_rows.size());
+  for (const auto &media_row : media_rows)
+  {
+    media_files.push_back(
+        mMediaRepo.resolveMediaPath(media_row.media_id, Media::getExtensionFromMimeType(media_row.mime_type)));
+  }
+
+  // the expensive part is done outside of the transaction
+  std::vector<std::string> hashes = mMediaRepo.computeContentHashes(fs::path(), media_files);
+
+  std::vector<fs::path> obsolete_files;
+
   mSQLCon.begin();
 
-  // the order is important!
-  ctx.persistChat(mChatRepo);
-  ctx.persistUsers(mUserRepo);
-  ctx.persistMedia(mMediaRepo);
-  ctx.persistMessages(mMessageRepo);
+  // the rows are in media_id order, so the oldest media of each content is kept
+  for (size_t i = 0; i < media_rows.size(); i++)
+  {
+    const MediaRow &media_row = media_rows[i];
+
+    if (hashes[i].empty())
+    {
+      stats.missing++;
+      continue;
+    }
+
+    std::optional<MediaRow> existing_row = mMediaRepo.getByContentHash(hashes[i]);
+    if (!existing_row)
+    {
+      mMediaRepo.setContentHash(media_row.media_id, hashes[i]);
+      stats.hashed++;
+      continue;
+    }
 
-  bool commit_success = mSQLCon.commit();
+    // the chats that change their media reference are a new generation
+    for (int64_t chat_id : mMessageRepo.getDistinctChatIdsByMediaId(media_row.media_id))
+    {
+      mChatRepo.bumpGeneration(chat_id);
+    }
+
+    mMessageRepo.replaceMediaId(media_row.media_id, existing_row->media_id);
+    mMediaRepo.remove(media_row.media_id);
+    obsolete_files.push_back(media_files[i]);
+    stats.duplicates++;
+  }
 
-  if (commit_success)
+  if (!mSQLCon.commit())
   {
-    mMediaRepo.executeActions(import_media_path);
+    mSQLCon.rollback();
+    cerr << "DEDUPLICATE MEDIA - Rollback!" << endl;
+    return MediaDedupStats {};
+  }
+
+  // remove the files only after the database doesn't reference them any longer
+  for (const auto &file : obsolete_files)
+  {
+    std::error_code ec;
+    uintmax_t size = fs::file_size(file, ec);
+    if (fs::remove(file, ec))
+    {
+      stats.bytes_freed += size;
+    }
+  }
+
+  return stats;
+}
+
+ChatDeleteStats PersistenceManager::deleteChat(int64_t chat_id)
+{
+  ChatDeleteStats stats;
+
+  while (deleteChatBatch(chat_id, stats))
+  {
+  }
+
+  if (stats.deleted)
+  {
+    stats.pages_freed = vacuumIncremental(VACUUM_STEP_PAGES);
+  }
+
+  return stats;
+}
+
+bool PersistenceManager::deleteChatBatch(int64_t chat_id, ChatDeleteStats &stats)
+{
+  if (mChatRepo.getGeneration(chat_id) < 0)
+  {
+    return false;
+  }
+
+  mMediaRepo.acquireJournal();
+  mSQLCon.begin();
+
+  // each batch is a consistent state: the media and users of the deleted messages are checked in the same transaction
+  int64_t batch_end = mMessageRepo.getDeleteBatchEnd(chat_id, DELETE_BATCH_SIZE);
+  bool last_batch = batch_end < 0;
+
+  if (last_batch)
+  {
+    mChatRepo.remove(chat_id);
+    mImportFileRepo.removeByChatId(chat_id);
+    mImportStateRepo.remove(chat_id);
+    mSaveProgressRepo.remove(chat_id);
   }
   else
+  {
+    std::vector<int64_t> media_ids = mMessageRepo.getDistinctMediaIdsByChatId(chat_id, batch_end);
+    std::vector<int64_t> sender_ids = mMessageRepo.getDistinctSenderIdsByChatId(chat_id, batch_end);
+
+    stats.messages += mMessageRepo.removeByChatId(chat_id, batch_end);
+    stats.media += mMediaRepo.removeUnreferenced(media_ids);
+    stats.users += mUserRepo.removeUnreferenced(sender_ids);
+
+    // cached copies in other processes are outdated
+    mChatRepo.bumpGeneration(chat_id);
+  }
+
+  mMediaRepo.journalActions(fs::path());
+
+  if (!mSQLCon.commit())
   {
     mSQLCon.rollback();
-    cerr << "SAVE - Rollback!" << endl;
+    mMediaRepo.clearActions();
+    cerr << "DELETE CHAT - Rollback!" << endl;
+    return false;
+  }
+  stats.batches++;
+
+  MediaIngestStats media_stats = mMediaRepo.executeActions(fs::path(), stats.media_failures);
+  stats.media_files.actions += media_stats.actions;
+  stats.media_files.succeeded += media_stats.succeeded;
+  stats.media_files.failed += media_stats.failed;
+  stats.media_files.deleted += media_stats.deleted;
+  stats.media_files.seconds += media_stats.seconds;
+
+  // readers are never blocked by a PASSIVE checkpoint
+  mSQLCon.checkpoint();
+
+  stats.deleted = last_batch;
+  return !last_batch;
+}
+
+ChatDeleteStats PersistenceManager::discardInterruptedSave(int64_t chat_id)
+{
+  ChatDeleteStats stats;
+
+  std::optional<SaveProgressRow> found_row = mSaveProgressRepo.getByChatId(chat_id);
+  if (!found_row)
+  {
+    return stats;
+  }
+  const SaveProgressRow &progress_row = *found_row;
+
+  // the chat didn't exist before the save -> the whole chat is the interrupted part
+  if (progress_row.new_chat)
+  {
+    return deleteChat(chat_id);
+  }
+
+  mMediaRepo.acquireJournal();
+  mSQLCon.begin();
+
+  if (progress_row.first_message_id > 0)
+  {
+    std::vector<int64_t> media_ids = mMessageRepo.getDistinctMediaIdsFromMessageId(chat_id,
+        progress_row.first_message_id);
+    std::vector<int64_t> sender_ids = mMessageRepo.getDistinctSenderIdsFromMessageId(chat_id,
+        progress_row.first_message_id);
+
+    stats.messages = mMessageRepo.removeFromMessageId(chat_id, progress_row.first_message_id);
+    stats.media = mMediaRepo.removeUnreferenced(media_ids);
+    stats.users = mUserRepo.removeUnreferenced(sender_ids);
+
+    // cached copies in other processes are outdated
+    mChatRepo.bumpGeneration(chat_id);
+  }
+  mSaveProgressRepo.remove(chat_id);
+
+  mMediaRepo.journalActions(fs::path());
+
+  if (!mSQLCon.commit())
+  {
+    mSQLCon.rollback();
+    mMediaRepo.clearActions();
+    cerr << "DISCARD SAVE - Rollback!" << endl;
+    return stats;
   }
+  stats.batches = 1;
+
+  stats.media_files = mMediaRepo.executeActions(fs::path(), stats.media_failures);
+
+  return stats;
+}
+
+int64_t PersistenceManager::vacuumIncremental(int64_t max_pages_per_step)
+{
+  int64_t pages_freed = 0;
+  for (int64_t step_pages = vacuumIncrementalStep(max_pages_per_step); step_pages > 0;
+      step_pages = vacuumIncrementalStep(max_pages_per_step))
+  {
+    pages_freed += step_pages;
+  }
+
+  return pages_freed;
+}
+
+int64_t PersistenceManager::vacuumIncrementalStep(int64_t max_pages)
+{
+  int64_t free_pages = mSQLCon.freelistCount();
+  if (free_pages <= 0 || !mSQLCon.incrementalVacuum(max_pages))
+  {
+    return 0;
+  }
+  mSQLCon.checkpoint();
+
+  int64_t remaining_pages = mSQLCon.freelistCount();
+  if (remaining_pages < 0 || remaining_pages >= free_pages)
+  {
+    // auto_vacuum isn't INCREMENTAL for this database -> nothing is freed
+    return 0;
+  }
+
+  return free_pages - remaining_pages;
 }
 
 std::unique_ptr<ChatContext> PersistenceManager::loadByChatId(int64_t chat_id)
@@ -119,6 +683,7 @@ std::unique_ptr<ChatContext> PersistenceManager::loadByChatId(int64_t chat_id)
         message_row.text
     );
 // @formatter:on
+    message.setFingerprint(message_row.fingerprint);
 
     messages.emplace_back(std::move(message));
 
@@ -130,6 +695,142 @@ std::unique_ptr<ChatContext> PersistenceManager::loadByChatId(int64_t chat_id)
   return ctx;
 }
 
+size_t PersistenceManager::refresh(ChatContext &ctx)
+{
+  const Chat *chat = ctx.getChat();
+  if (!chat || chat->getDatabaseId() == Chat::DB_NO_ID)
+  {
+    // a never saved context has no messages in the database
+    return 0;
+  }
+
+  int64_t chat_id = chat->getDatabaseId();
+
+  vector<MessageRow> message_rows = mMessageRepo.getByChatIdAfterMessageId(chat_id, ctx.getLastMessageDatabaseId());
+  if (message_rows.empty())
+  {
+    return 0;
+  }
+
+  // -> get the new Users and Media from DB that are referenced by the new messages
+
+  vector<int64_t> new_sender_ids;
+  vector<int64_t> new_media_ids;
+  for (const MessageRow &message_row : message_rows)
+  {
+    if (!ctx.hasUserWithDatabaseId(message_row.sender_id) &&
+        std::find(new_sender_ids.begin(), new_sender_ids.end(), message_row.sender_id) == new_sender_ids.end())
+    {
+      new_sender_ids.push_back(message_row.sender_id);
+    }
+
+    if (message_row.media_id != Media::DB_NO_ID && !ctx.hasMediaWithDatabaseId(message_row.media_id))
+    {
+      new_media_ids.push_back(message_row.media_id);
+    }
+  }
+
+  // a media is referenced by several messages after a content deduplication -> it's appended once
+  std::sort(new_media_ids.begin(), new_media_ids.end());
+  new_media_ids.erase(std::unique(new_media_ids.begin(), new_media_ids.end()), new_media_ids.end());
+
+  int64_t user_runtime_id = ctx.nextUserRuntimeId();
+  for (const UserRow &user_row : mUserRepo.getByUserIds(new_sender_ids))
+  {
+    ctx.addUser(User(user_runtime_id, user_row.user_id, user_row.name, user_row.is_system));
+    user_runtime_id++;
+  }
+
+  int64_t media_runtime_id = ctx.nextMediaRuntimeId();
+  for (const MediaRow &media_row : mMediaRepo.getByMediaIds(new_media_ids))
+  {
+    ctx.addMedia(Media(media_runtime_id, media_row.media_id, static_cast<MediaType>(media_row.type), media_row.media_size,
+        media_row.mime_type));
+    media_runtime_id++;
+  }
+
+  // -> append the new Messages
+
+  int64_t message_runtime_id = ctx.nextMessageRuntimeId();
+  int64_t chat_runtime_id = chat->getRuntimeId();
+  for (MessageRow &message_row : message_rows)
+  {
+    const User &user = ctx.getUserBySenderDatabaseId(message_row.sender_id);
+
+    int64_t message_media_runtime_id = Message::MEDIA_NO_ID;
+    if (message_row.media_id != Media::DB_NO_ID)
+    {
+      message_media_runtime_id = ctx.getMediaByMediaDatabaseId(message_row.media_id).getRuntimeId();
+    }
+
+// @formatter:off
+    Message message(
+        message_runtime_id, message_row.message_id,
+        chat_runtime_id, chat_id,
+        user.getRuntimeId(), message_row.sender_id,
+        message_media_runtime_id, message_row.media_id,
+        message_row.timestamp,
+        std::move(message_row.text)
+    );
+// @formatter:on
+    message.setFingerprint(message_row.fingerprint);
+
+    ctx.addMessage(std::move(message));
+    message_runtime_id++;
+  }
+
+  return message_rows.size();
+}
+
+size_t PersistenceManager::backfillFingerprints(int64_t chat_id)
+{
+  if (!mMessageRepo.hasMessagesWithoutFingerprint(chat_id))
+  {
+    return 0;
+  }
+
+  size_t backfilled = 0;
+
+  mSQLCon.begin();
+
+  vector<MessageRow> message_rows = mMessageRepo.getByChatId(chat_id);
+
+  std::unordered_map<int64_t, const UserRow*> senders;
+  vector<UserRow> user_rows = mUserRepo.getByUserIds(mMessageRepo.getDistinctSenderIdsByChatId(chat_id));
+  for (const UserRow &user_row : user_rows)
+  {
+    senders.emplace(user_row.user_id, &user_row);
+  }
+
+  // all messages in chat order, as the occurrence numbers count the messages that have a fingerprint, too
+  MessageFingerprinter fingerprinter;
+  for (const MessageRow &message_row : message_rows)
+  {
+    auto sender_it = senders.find(message_row.sender_id);
+    if (sender_it == senders.end())
+    {
+      continue;
+    }
+    const UserRow &sender = *sender_it->second;
+    int64_t fingerprint = fingerprinter.next(message_row.timestamp, sender.name, sender.is_system, message_row.text);
+
+    // a conflict with an existing fingerprint leaves the message without one
+    if (message_row.fingerprint == 0 && mMessageRepo.setFingerprint(message_row.message_id, fingerprint))
+    {
+      backfilled++;
+    }
+  }
+
+  if (!mSQLCon.commit())
+  {
+    mSQLCon.rollback();
+    cerr << "BACKFILL FINGERPRINTS - Rollback!" << endl;
+    return 0;
+  }
+
+  return backfilled;
+}
+
 std::unique_ptr<ChatContext> PersistenceManager::loadByMessageId(int64_t message_id)
 {
   auto ctx = std::make_unique<ChatContext>();
@@ -8,7 +8,9 @@
 #define PERSISTENCEMANAGER_H_
 
 // project public API
+#include "chatstorage/ChatStorage.h"
 #include "chatstorage/ChatContext.h"
+#include "chatstorage/MediaIngest.h"
 
 // project private
 #include "database/SQLiteConnection.h"
@@ -16,18 +18,25 @@
 #include "database/MessageRepository.h"
 #include "database/MediaRepository.h"
 #include "database/ChatRepository.h"
+#include "database/ImportFileRepository.h"
+#include "database/ImportStateRepository.h"
+#include "database/SaveProgressRepository.h"
 #include "common/platform.h"
 
 class PersistenceManager
 {
 public:
   PersistenceManager(SQLiteConnection &sql_con, UserRepository &user_repo, MessageRepository &message_repo,
-      ChatRepository &chat_repo, MediaRepository &media_repo) :
+      ChatRepository &chat_repo, MediaRepository &media_repo, ImportFileRepository &import_file_repo,
+      ImportStateRepository &import_state_repo, SaveProgressRepository &save_progress_repo) :
       mSQLCon(sql_con),
       mUserRepo(user_repo),
       mMessageRepo(message_repo),
       mChatRepo(chat_repo),
-      mMediaRepo(media_repo)
+      mMediaRepo(media_repo),
+      mImportFileRepo(import_file_repo),
+      mImportStateRepo(import_state_repo),
+      mSaveProgressRepo(save_progress_repo)
   {
   }
 
@@ -35,23 +44,144 @@ public:
 
   /**
    * @param import_media_path The absolute path where the referenced source media is located. This is the copy source path..
+   *
+   * @return the commit state and the result of the media file operations
    */
-  void save(ChatContext& ctx, const fs::path& import_media_path = {});
+  SaveReport save(ChatContext& ctx, const fs::path& import_media_path = {});
+
+  struct SaveItem
+  {
+    ChatContext *ctx = nullptr;
+    fs::path import_media_path;
+  };
+
+  /**
+   * Saves several contexts in one write transaction (group commit), so all of them share one fsync. Each context is
+   * written in its own savepoint: a context that fails is rolled back alone and the others are still saved. After
+   * the commit the media file operations of each context are executed separately.
+   *
+   * With ChunkedSaveConfig::chunkMessages the messages are committed in chunks instead. A save_progress marker is
+   * committed with each chunk and removed with the last one, so a crash leaves a recognizable partial chat. A failure
+   * before the first chunk of a context is committed rolls it back completely.
+   *
+   * @return one report per item in the same order; if the commit fails no context is saved and all keep their changes
+   */
+  std::vector<SaveReport> save(const std::vector<SaveItem> &items);
+
+  /**
+   * Like save(items), but the media file operations of all contexts are executed together after the commit. This
+   * saves one journal transaction per context, so it's the better choice for many small chats.
+   *
+   * @return a report per item and the result of the media file operations of all items
+   */
+  SaveAllReport saveAll(const std::vector<SaveItem> &items);
 
   std::unique_ptr<ChatContext> loadByChatId(int64_t chat_id);
 
+  /**
+   * Migration of media stores from before content hashing: hashes all media files without a content hash and
+   * merges rows with the same content into the oldest one. The duplicate files are removed after the commit.
+   */
+  MediaDedupStats deduplicateMedia();
+
+  /**
+   * Appends all messages to the context that were added to its chat in the database after it was loaded or saved.
+   * Only the new messages and the users and media referenced by them are read.
+   *
+   * @return the number of appended messages
+   */
+  size_t refresh(ChatContext &ctx);
+
+  /**
+   * Gives the messages of a chat that were stored before fingerprints existed their fingerprint, so a merge import
+   * recognizes them. The sender is the current user name; a user that was mapped to another name on import
+   * (ImportConfig::userImportMapping) doesn't match the export then.
+   *
+   * @return the number of messages that got a fingerprint
+   */
+  size_t backfillFingerprints(int64_t chat_id);
+
   std::unique_ptr<ChatContext> loadByMessageId(int64_t message_id);
 
   std::unique_ptr<ChatContext> loadByUserId(int64_t user_id);
 
   std::vector<Chat> listChats();
 
+  /**
+   * See ChatStorage::deleteChat()
+   */
+  ChatDeleteStats deleteChat(int64_t chat_id);
+
+  /**
+   * Deletes the next batch of messages of a chat in an own transaction, the last batch removes the chat row (and sets
+   * stats.deleted). The counters of stats are summed up, so a caller can take a lock around each batch.
+   *
+   * @return true if more batches follow; false after the last batch, if the chat doesn't exist or the transaction
+   *         failed
+   */
+  bool deleteChatBatch(int64_t chat_id, ChatDeleteStats &stats);
+
+  void setChunkedSaveConfig(const ChunkedSaveConfig &chunk_config)
+  {
+    mChunkConfig = chunk_config;
+  }
+
+  /**
+   * See ChatStorage::discardInterruptedSave()
+   */
+  ChatDeleteStats discardInterruptedSave(int64_t chat_id);
+
+  /**
+   * Returns the free pages of the database file to the file system in steps of max_pages_per_step pages. A WAL
+   * checkpoint after each step keeps the WAL file small.
+   *
+   * @return the number of freed pages
+   */
+  int64_t vacuumIncremental(int64_t max_pages_per_step);
+
+  /**
+   * One step of vacuumIncremental().
+   *
+   * @return the number of freed pages; 0 if nothing is left to free
+   */
+  int64_t vacuumIncrementalStep(int64_t max_pages);
+
+  static constexpr size_t DELETE_BATCH_SIZE = 5000;
+  static constexpr int64_t VACUUM_STEP_PAGES = 1024;
+
 private:
+  /**
+   * State of the items after commitGroup()
+   */
+  struct GroupCommit
+  {
+    size_t chunks = 0;
+    std::vector<bool> committed; // the item is completely stored
+    std::vector<bool> journaled; // the media rows of the item are stored, also of a partially stored item
+    std::vector<size_t> deduplicated;
+    std::vector<size_t> messages_existing;
+    std::vector<size_t> action_begins;
+    std::vector<size_t> action_ends;
+    std::vector<MediaRepository::MediaAction> actions; // the journal lock is still held if an item is journaled
+  };
+
+  /**
+   * Writes the items in one transaction (or in chunks, see ChunkedSaveConfig) without executing the media file
+   * operations.
+   */
+  GroupCommit commitGroup(const std::vector<SaveItem> &items);
+
+  void hashNewMedia(ChatContext &ctx, const fs::path &import_media_path);
+
   SQLiteConnection &mSQLCon;
   UserRepository &mUserRepo;
   MessageRepository &mMessageRepo;
   ChatRepository &mChatRepo;
   MediaRepository &mMediaRepo;
+  ImportFileRepository &mImportFileRepo;
+  ImportStateRepository &mImportStateRepo;
+  SaveProgressRepository &mSaveProgressRepo;
+  ChunkedSaveConfig mChunkConfig;
 };
 
 #endif /* PERSISTENCEMANAGER_H_ */
@@ -16,10 +16,11 @@ using namespace std;
 
 static Logger logger("ChatStorage.SQLiteConnection");
 
-SQLiteConnection::SQLiteConnection(const fs::path &database) :
-    mDB(nullptr)
+SQLiteConnection::SQLiteConnection(const fs::path &database, Mode mode, int busy_timeout_ms) :
+    mDB(nullptr),
+    mMode(mode)
 {
-  open(database);
+  open(database, busy_timeout_ms);
 }
 
 SQLiteConnection::~SQLiteConnection()
@@ -27,9 +28,10 @@ SQLiteConnection::~SQLiteConnection()
   close();
 }
 
-bool SQLiteConnection::open(const fs::path &database)
+bool SQLiteConnection::open(const fs::path &database, int busy_timeout_ms)
 {
-  int rc = sqlite3_open(database.string().c_str(), &mDB);
+  int flags = (mMode == Mode::ReadOnly) ? SQLITE_OPEN_READONLY : (SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+  int rc = sqlite3_open_v2(database.string().c_str(), &mDB, flags, nullptr);
   if (rc != SQLITE_OK)
   {
     std::cerr << "Error (" << rc << ") - Cannot open DB: " << database << endl;
@@ -37,10 +39,23 @@ bool SQLiteConnection::open(const fs::path &database)
   }
   LOG4CXX_INFO(logger, "Successful opened SQLite database in: " + string(fs::absolute(database)));
 
+  // Wait for the locks of other connections instead of failing at once with SQLITE_BUSY.
+  setBusyTimeout(busy_timeout_ms);
+
    // IMPORTANT: SQLite disables foreign key enforcement by default.
    // This PRAGMA must be enabled for each database connection after opening it.
   exec("PRAGMA foreign_keys = ON;");
 
+  if (mMode == Mode::ReadOnly)
+  {
+    // the file mode is persistent and already set up by the read-write connection
+    return true;
+  }
+
+  // Free pages could be returned to the file system in small steps with 'PRAGMA incremental_vacuum'.
+  // Only effective for a new database before the first table is created.
+  exec("PRAGMA auto_vacuum = INCREMENTAL");
+
   // Enable Write-Ahead Logging mode for better concurrency between readers and writers.
   // Allows multiple readers while a single writer can still modify the database.
   exec("PRAGMA journal_mode = WAL");
@@ -53,6 +68,9 @@ bool SQLiteConnection::open(const fs::path &database)
 
 bool SQLiteConnection::close()
 {
+  sqlite3_finalize(mDataVersionStmt);
+  mDataVersionStmt = nullptr;
+
   int rc = sqlite3_close(mDB);
   if (rc != SQLITE_OK)
   {
@@ -78,7 +96,7 @@ bool SQLiteConnection::exec(const std::string &sql)
 
 bool SQLiteConnection::begin()
 {
-  return exec("BEGIN;");
+  return exec((mMode == Mode::ReadOnly) ? "BEGIN;" : "BEGIN IMMEDIATE;");
 }
 
 bool SQLiteConnection::commit()
@@ -91,11 +109,126 @@ bool SQLiteConnection::rollback()
   return exec("ROLLBACK;");
 }
 
+bool SQLiteConnection::savepoint(const std::string &name)
+{
+  return exec("SAVEPOINT " + name + ";");
+}
+
+bool SQLiteConnection::release(const std::string &name)
+{
+  return exec("RELEASE " + name + ";");
+}
+
+bool SQLiteConnection::rollbackTo(const std::string &name)
+{
+  // ROLLBACK TO keeps the savepoint on the stack
+  return exec("ROLLBACK TO " + name + ";") && release(name);
+}
+
 int64_t SQLiteConnection::lastInsertRowID()
 {
   return sqlite3_last_insert_rowid(mDB);
 }
 
+int64_t SQLiteConnection::changes()
+{
+  return sqlite3_changes(mDB);
+}
+
+int64_t SQLiteConnection::freelistCount()
+{
+  sqlite3_stmt *stmt = nullptr;
+  if (sqlite3_prepare_v2(mDB, "PRAGMA freelist_count;", -1, &stmt, nullptr) != SQLITE_OK)
+  {
+    return -1;
+  }
+
+  int64_t free_pages = -1;
+  if (sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    free_pages = sqlite3_column_int64(stmt, 0);
+  }
+  sqlite3_finalize(stmt);
+
+  return free_pages;
+}
+
+bool SQLiteConnection::incrementalVacuum(int64_t max_pages)
+{
+  return exec("PRAGMA incremental_vacuum(" + std::to_string(max_pages) + ");");
+}
+
+bool SQLiteConnection::checkpoint()
+{
+  int rc = sqlite3_wal_checkpoint_v2(mDB, nullptr, SQLITE_CHECKPOINT_PASSIVE, nullptr, nullptr);
+  return rc == SQLITE_OK;
+}
+
+int64_t SQLiteConnection::dataVersion()
+{
+  // prepared once as it's called for every cache lookup
+  if (!mDataVersionStmt)
+  {
+    int rc = sqlite3_prepare_v2(mDB, "PRAGMA data_version;", -1, &mDataVersionStmt, nullptr);
+    if (rc != SQLITE_OK)
+    {
+      std::cerr << "Error (" << rc << ") - Cannot prepare data_version Statement" << endl;
+      return -1;
+    }
+  }
+
+  int64_t data_version = -1;
+  if (sqlite3_step(mDataVersionStmt) == SQLITE_ROW)
+  {
+    data_version = sqlite3_column_int64(mDataVersionStmt, 0);
+  }
+  sqlite3_reset(mDataVersionStmt);
+
+  return data_version;
+}
+
+bool SQLiteConnection::hasColumn(const std::string &table, const std::string &column)
+{
+  sqlite3_stmt *stmt = nullptr;
+  std::string sql = "PRAGMA table_info(" + table + ");";
+  if (sqlite3_prepare_v2(mDB, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK)
+  {
+    return false;
+  }
+
+  bool found = false;
+  while (!found && sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    // column 1 of table_info is the column name
+    const unsigned char *name = sqlite3_column_text(stmt, 1);
+    found = name && column == reinterpret_cast<const char*>(name);
+  }
+  sqlite3_finalize(stmt);
+
+  return found;
+}
+
+bool SQLiteConnection::addColumnIfMissing(const std::string &table, const std::string &column, const std::string &definition)
+{
+  if (hasColumn(table, column))
+  {
+    return true;
+  }
+
+  LOG4CXX_INFO(logger, "Upgrade schema: add column " + table + "." + column);
+  return exec("ALTER TABLE " + table + " ADD COLUMN " + column + " " + definition + ";");
+}
+
+void SQLiteConnection::setBusyTimeout(int milliseconds)
+{
+  sqlite3_busy_timeout(mDB, milliseconds);
+}
+
+bool SQLiteConnection::isReadOnly() const
+{
+  return mMode == Mode::ReadOnly;
+}
+
 std::string SQLiteConnection::makePlaceholders(size_t n)
 {
   if (n == 0)
@@ -15,6 +15,7 @@
 
 // forward declarations
 typedef struct sqlite3 sqlite3;
+typedef struct sqlite3_stmt sqlite3_stmt;
 
 class Statement;
 
@@ -30,27 +31,123 @@ public:
     Misuse
   };
 
-  SQLiteConnection(const fs::path &database);
+  enum class Mode
+  {
+    ReadWrite,
+    ReadOnly
+  };
+
+  SQLiteConnection(const fs::path &database, Mode mode = Mode::ReadWrite, int busy_timeout_ms = DEFAULT_BUSY_TIMEOUT_MS);
   ~SQLiteConnection();
 
   bool exec(const std::string& sql);
 
+  /**
+   * A read-write connection takes the write lock at once (BEGIN IMMEDIATE). A deferred transaction that starts with
+   * a read couldn't wait for the lock later and would fail with SQLITE_BUSY if another connection committed in
+   * between. A read-only connection starts a normal transaction that keeps one database snapshot for all reads.
+   */
   bool begin();
 
   bool commit();
 
   bool rollback();
 
+  /**
+   * A named sub-transaction inside the current transaction. rollbackTo() reverts the changes since the savepoint
+   * without ending the transaction; release() keeps them.
+   */
+  bool savepoint(const std::string &name);
+
+  bool release(const std::string &name);
+
+  bool rollbackTo(const std::string &name);
+
   int64_t lastInsertRowID();
 
+  /**
+   * Number of rows changed by the last INSERT, UPDATE or DELETE.
+   */
+  int64_t changes();
+
+  /**
+   * The value of 'PRAGMA data_version'. It changes if another connection has committed changes to the database.
+   * Commits of this connection don't change it.
+   */
+  int64_t dataVersion();
+
+  /**
+   * Number of unused pages in the database file.
+   */
+  int64_t freelistCount();
+
+  /**
+   * Returns up to max_pages free pages to the file system. Only has an effect on databases with
+   * auto_vacuum = INCREMENTAL, that is the default for new databases. Older databases need a VACUUM once.
+   */
+  bool incrementalVacuum(int64_t max_pages);
+
+  /**
+   * Copies the committed WAL content into the database without waiting for readers (PASSIVE checkpoint), so a long
+   * sequence of write transactions doesn't grow the WAL file.
+   */
+  bool checkpoint();
+
+  bool hasColumn(const std::string &table, const std::string &column);
+
+  /**
+   * Schema upgrade helper for existing databases: adds the column with an 'ALTER TABLE' if it doesn't yet exist.
+   */
+  bool addColumnIfMissing(const std::string &table, const std::string &column, const std::string &definition);
+
+  /**
+   * How long a statement waits for a lock of another connection before it gives up with SQLITE_BUSY.
+   */
+  void setBusyTimeout(int milliseconds);
+
+  bool isReadOnly() const;
+
   static std::string makePlaceholders(size_t n);
 
+  static constexpr int DEFAULT_BUSY_TIMEOUT_MS = 5000;
+
 private:
   friend Statement;
   sqlite3* mDB;
+  sqlite3_stmt *mDataVersionStmt = nullptr;
+  Mode mMode;
 
-  bool open(const fs::path &database);
+  bool open(const fs::path &database, int busy_timeout_ms);
   bool close();
 };
 
+/**
+ * Keeps all reads of a scope in one transaction, so they see the same database snapshot even if another connection
+ * commits in between. The transaction is ended when the scope is left, also by an exception.
+ */
+class ReadTransaction
+{
+public:
+  ReadTransaction(SQLiteConnection &sql_con) :
+      mSQLCon(sql_con),
+      mActive(sql_con.begin())
+  {
+  }
+
+  ~ReadTransaction()
+  {
+    if (mActive)
+    {
+      mSQLCon.commit();
+    }
+  }
+
+  ReadTransaction(const ReadTransaction&) = delete;
+  ReadTransaction& operator=(const ReadTransaction&) = delete;
+
+private:
+  SQLiteConnection &mSQLCon;
+  bool mActive;
+};
+
 #endif /* SQLITECONNECTION_H_ */
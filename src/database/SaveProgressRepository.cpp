@@ -0,0 +1,95 @@
+/*
+ * SaveProgressRepository.cpp
+ *
+ *      Author: Andreas Volz
+ */
+
+// @formatter:off
+// this file is better to understand without the Eclipse auto formatter
+
+// project
+#include "SaveProgressRepository.h"
+
+bool SaveProgressRepository::set(const SaveProgressRow &save_progress_row)
+{
+  mUpsertStmt.bind(":chat_id",          save_progress_row.chat_id);
+  mUpsertStmt.bind(":new_chat",         static_cast<int64_t>(save_progress_row.new_chat));
+  mUpsertStmt.bind(":first_message_id", save_progress_row.first_message_id);
+  mUpsertStmt.bind(":messages_saved",   save_progress_row.messages_saved);
+  mUpsertStmt.bind(":started_at",       save_progress_row.started_at);
+
+  bool success = mUpsertStmt.step() == SQLiteConnection::Result::Done;
+  mUpsertStmt.reset();
+
+  return success;
+}
+
+std::optional<SaveProgressRow> SaveProgressRepository::getByChatId(int64_t chat_id)
+{
+  mSelectStmt.reset();
+  mSelectStmt.bind(":chat_id", chat_id);
+
+  std::optional<SaveProgressRow> save_progress_row;
+  if (mSelectStmt.step() == SQLiteConnection::Result::Row)
+  {
+    save_progress_row = SaveProgressRow {};
+    save_progress_row->chat_id          = chat_id;
+    save_progress_row->new_chat         = mSelectStmt.getInt64(0) != 0;
+    save_progress_row->first_message_id = mSelectStmt.getInt64(1);
+    save_progress_row->messages_saved   = mSelectStmt.getInt64(2);
+    save_progress_row->started_at       = mSelectStmt.getInt64(3);
+  }
+  mSelectStmt.reset();
+
+  return save_progress_row;
+}
+
+std::vector<SaveProgressRow> SaveProgressRepository::getAll()
+{
+  std::vector<SaveProgressRow> save_progress_rows;
+
+  Statement select_all_stmt(mSQLCon,
+      "SELECT chat_id, new_chat, first_message_id, messages_saved, started_at "
+      "FROM save_progress "
+      "ORDER BY chat_id");
+
+  while (select_all_stmt.step() == SQLiteConnection::Result::Row)
+  {
+    SaveProgressRow save_progress_row;
+
+    save_progress_row.chat_id          = select_all_stmt.getInt64(0);
+    save_progress_row.new_chat         = select_all_stmt.getInt64(1) != 0;
+    save_progress_row.first_message_id = select_all_stmt.getInt64(2);
+    save_progress_row.messages_saved   = select_all_stmt.getInt64(3);
+    save_progress_row.started_at       = select_all_stmt.getInt64(4);
+
+    save_progress_rows.push_back(save_progress_row);
+  }
+
+  return save_progress_rows;
+}
+
+bool SaveProgressRepository::remove(int64_t chat_id)
+{
+  mDeleteStmt.bind(":chat_id", chat_id);
+
+  bool success = mDeleteStmt.step() == SQLiteConnection::Result::Done;
+  mDeleteStmt.reset();
+
+  return success;
+}
+
+bool SaveProgressRepository::createTable(SQLiteConnection &sql_con)
+{
+  std::string save_progress_table_sql =
+      "CREATE TABLE IF NOT EXISTS save_progress ("
+      "chat_id INTEGER PRIMARY KEY, "
+      "new_chat INTEGER NOT NULL, "
+      "first_message_id INTEGER NOT NULL, "
+      "messages_saved INTEGER NOT NULL, "
+      "started_at INTEGER NOT NULL"
+      ");";
+
+  return sql_con.exec(save_progress_table_sql);
+}
+// @formatter:on
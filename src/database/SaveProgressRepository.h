@@ -0,0 +1,67 @@
+/*
+ * SaveProgressRepository.h
+ *
+ *      Author: Andreas Volz
+ */
+
+#ifndef SAVEPROGRESSREPOSITORY_H_
+#define SAVEPROGRESSREPOSITORY_H_
+
+// project
+#include "database/SQLiteConnection.h"
+#include "database/Statement.h"
+#include "database/SaveProgressRow.h"
+
+// system
+#include <optional>
+#include <vector>
+
+/**
+ * Progress markers of the saves that are committed in chunks. A marker is written with the first chunk and removed
+ * with the last one, so a marker that is left over belongs to an interrupted save.
+ */
+class SaveProgressRepository
+{
+public:
+  SaveProgressRepository(SQLiteConnection &sql_con) :
+// @formatter:off
+      mSQLCon(sql_con),
+      mUpsertStmt(mSQLCon,
+          "INSERT INTO save_progress (chat_id, new_chat, first_message_id, messages_saved, started_at) "
+          "VALUES (:chat_id, :new_chat, :first_message_id, :messages_saved, :started_at) "
+          "ON CONFLICT (chat_id) DO UPDATE SET messages_saved = excluded.messages_saved, "
+          "first_message_id = CASE WHEN first_message_id = 0 THEN excluded.first_message_id ELSE first_message_id END;"),
+      mSelectStmt(mSQLCon,
+          "SELECT new_chat, first_message_id, messages_saved, started_at "
+          "FROM save_progress "
+          "WHERE chat_id = :chat_id"),
+      mDeleteStmt(mSQLCon,
+          "DELETE FROM save_progress "
+          "WHERE chat_id = :chat_id")
+// @formatter:on
+  {
+  }
+
+  ~SaveProgressRepository() = default;
+
+  /**
+   * A marker that is yet there (of an earlier interrupted save) keeps its start and first message.
+   */
+  bool set(const SaveProgressRow &save_progress_row);
+
+  std::optional<SaveProgressRow> getByChatId(int64_t chat_id);
+
+  std::vector<SaveProgressRow> getAll();
+
+  bool remove(int64_t chat_id);
+
+  static bool createTable(SQLiteConnection &sql_con);
+
+private:
+  SQLiteConnection &mSQLCon;
+  Statement mUpsertStmt;
+  Statement mSelectStmt;
+  Statement mDeleteStmt;
+};
+
+#endif /* SAVEPROGRESSREPOSITORY_H_ */
@@ -0,0 +1,22 @@
+/*
+ * SaveProgressRow.h
+ *
+ *      Author: Andreas Volz
+ */
+
+#ifndef SAVEPROGRESSROW_H_
+#define SAVEPROGRESSROW_H_
+
+// system
+#include <cstdint>
+
+struct SaveProgressRow
+{
+  int64_t chat_id = 0;
+  bool new_chat = false;          // the chat was created by the save
+  int64_t first_message_id = 0;   // first message inserted by the save; 0 if none
+  int64_t messages_saved = 0;     // committed so far
+  int64_t started_at = 0;         // unix seconds
+};
+
+#endif /* SAVEPROGRESSROW_H_ */
@@ -163,6 +163,31 @@ bool Statement::bind(const std::string &parameter, int64_t number)
   return bind(parameter_index, number);
 }
 
+bool Statement::bindNull(int parameter_index)
+{
+  if (parameter_index != 0)
+  {
+    int rc = sqlite3_bind_null(mStmt, parameter_index);
+    if (rc != SQLITE_OK)
+    {
+      LOG4CXX_ERROR(logger, "SQL Error (" + to_string(rc) +  ") - Cannot bind parameter '" + to_string(parameter_index) + "' to NULL" );
+      return false;
+    }
+    return true; // this is the good path
+  }
+  else
+  {
+    LOG4CXX_ERROR(logger, "SQL Error: Unknown parameter Index for NULL");
+  }
+  return false;
+}
+
+bool Statement::bindNull(const std::string &parameter)
+{
+  int parameter_index = parameterIndex(parameter);
+  return bindNull(parameter_index);
+}
+
 bool Statement::getColumn(int col, std::string &out_text)
 {
   // TODO: wrap sqlite3_column_type
@@ -54,6 +54,9 @@ public:
 
   bool bind(int parameter_index, int64_t number);
   bool bind(const std::string &parameter, int64_t number);
+
+  bool bindNull(int parameter_index);
+  bool bindNull(const std::string &parameter);
   // TODO: all other bind()
 
   /**
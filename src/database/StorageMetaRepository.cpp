@@ -0,0 +1,59 @@
+/*
+ * StorageMetaRepository.cpp
+ *
+ *      Author: Andreas Volz
+ */
+
+// project
+#include "StorageMetaRepository.h"
+
+std::optional<std::string> StorageMetaRepository::get(const std::string &key)
+{
+  mSelectStmt.reset();
+  mSelectStmt.bind(":key", key);
+
+  std::optional<std::string> value;
+  if (mSelectStmt.step() == SQLiteConnection::Result::Row)
+  {
+    std::string text;
+    mSelectStmt.getColumn(0, text);
+    value = text;
+  }
+  mSelectStmt.reset();
+
+  return value;
+}
+
+bool StorageMetaRepository::set(const std::string &key, const std::string &value)
+{
+  mUpsertStmt.bind(":key", key);
+  mUpsertStmt.bind(":value", value);
+
+  bool success = mUpsertStmt.step() == SQLiteConnection::Result::Done;
+  mUpsertStmt.reset();
+
+  return success;
+}
+
+bool StorageMetaRepository::remove(const std::string &key)
+{
+  mDeleteStmt.bind(":key", key);
+
+  bool success = mDeleteStmt.step() == SQLiteConnection::Result::Done;
+  mDeleteStmt.reset();
+
+  return success;
+}
+
+// @formatter:off
+bool StorageMetaRepository::createTable(SQLiteConnection &sql_con)
+{
+  std::string storage_meta_table_sql =
+      "CREATE TABLE IF NOT EXISTS storage_meta ("
+      "key TEXT PRIMARY KEY, "
+      "value TEXT"
+      ");";
+
+  return sql_con.exec(storage_meta_table_sql);
+}
+// @formatter:on
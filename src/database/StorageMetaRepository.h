@@ -0,0 +1,59 @@
+/*
+ * StorageMetaRepository.h
+ *
+ *      Author: Andreas Volz
+ */
+
+#ifndef STORAGEMETAREPOSITORY_H_
+#define STORAGEMETAREPOSITORY_H_
+
+// project
+#include "database/SQLiteConnection.h"
+#include "database/Statement.h"
+
+// system
+#include <optional>
+#include <string>
+
+/**
+ * Key/value settings of a storage that have to be the same for all processes (e.g. the media layout).
+ */
+class StorageMetaRepository
+{
+public:
+  StorageMetaRepository(SQLiteConnection &sql_con) :
+// @formatter:off
+      mSQLCon(sql_con),
+      mSelectStmt(mSQLCon,
+          "SELECT value "
+          "FROM storage_meta "
+          "WHERE key = :key"),
+      mUpsertStmt(mSQLCon,
+          "INSERT INTO storage_meta (key, value) "
+          "VALUES (:key, :value) "
+          "ON CONFLICT (key) DO UPDATE SET value = excluded.value;"),
+      mDeleteStmt(mSQLCon,
+          "DELETE FROM storage_meta "
+          "WHERE key = :key")
+// @formatter:on
+  {
+  }
+
+  ~StorageMetaRepository() = default;
+
+  std::optional<std::string> get(const std::string &key);
+
+  bool set(const std::string &key, const std::string &value);
+
+  bool remove(const std::string &key);
+
+  static bool createTable(SQLiteConnection &sql_con);
+
+private:
+  SQLiteConnection &mSQLCon;
+  Statement mSelectStmt;
+  Statement mUpsertStmt;
+  Statement mDeleteStmt;
+};
+
+#endif /* STORAGEMETAREPOSITORY_H_ */
@@ -20,14 +20,46 @@ int64_t UserRepository::insert(const UserRow &user_row)
   mInsertStmt.bind(":name",       user_row.name);
   mInsertStmt.bind(":is_system",  user_row.is_system);
 
-  mInsertStmt.step();
+  bool success = mInsertStmt.step() == SQLiteConnection::Result::Done;
   mInsertStmt.reset();
 
+  // lastInsertRowID() would be the ID of an older row
+  if (!success)
+  {
+    return -1;
+  }
+
   return mSQLCon.lastInsertRowID();
 }
 
+bool UserRepository::update(const UserRow &user_row)
+{
+  mUpdateStmt.bind(":user_id", user_row.user_id);
+  mUpdateStmt.bind(":name",    user_row.name);
+
+  bool success = mUpdateStmt.step() == SQLiteConnection::Result::Done;
+  mUpdateStmt.reset();
+
+  auto cache_it = mResolveCache.find(user_row.user_id);
+  if (cache_it != mResolveCache.end())
+  {
+    cache_it->second.name = user_row.name;
+  }
+
+  return success && mSQLCon.changes() > 0;
+}
+
 UserRow UserRepository::getByUserId(int64_t user_id)
 {
+  if (mResolveCacheEnabled)
+  {
+    auto cache_it = mResolveCache.find(user_id);
+    if (cache_it != mResolveCache.end())
+    {
+      return cache_it->second;
+    }
+  }
+
   mSelectByIdStmt.reset();
   mSelectByIdStmt.bind(":user_id", user_id);
 
@@ -40,6 +72,14 @@ UserRow UserRepository::getByUserId(int64_t user_id)
     user_row.name       = mSelectByIdStmt.getText(1);
     user_row.is_system  = mSelectByIdStmt.getInt64(2);
 
+    // end the implicit read transaction, otherwise later reads see an old database state
+    mSelectByIdStmt.reset();
+
+    if (mResolveCacheEnabled)
+    {
+      mResolveCache.emplace(user_id, user_row);
+    }
+
     return user_row;
   }
   mSelectByIdStmt.reset();
@@ -99,14 +139,50 @@ std::vector<UserRow> UserRepository::listUsers()
   return user_rows;
 }
 
+int64_t UserRepository::removeUnreferenced(const std::vector<int64_t> &user_ids)
+{
+  if (user_ids.empty())
+  {
+    return 0;
+  }
+
+  std::string delete_sql =
+      "DELETE FROM users "
+      "WHERE user_id IN (" + SQLiteConnection::makePlaceholders(user_ids.size()) + ") AND is_system = 0 "
+      "AND NOT EXISTS (SELECT 1 FROM messages WHERE messages.sender_id = users.user_id)";
+  Statement delete_stmt(mSQLCon, delete_sql);
+
+  delete_stmt.bindInt64Container(1, user_ids);
+
+  bool success = delete_stmt.step() == SQLiteConnection::Result::Done;
+
+  for (int64_t user_id : user_ids)
+  {
+    mResolveCache.erase(user_id);
+  }
+
+  return success ? mSQLCon.changes() : 0;
+}
+
 int64_t UserRepository::getSystemUserId()
 {
+  if (mResolveCacheEnabled && mSystemUserId)
+  {
+    return *mSystemUserId;
+  }
+
   mSelectSystemUserStmt.reset();
   mSelectSystemUserStmt.bind(":account_id", 0); // hard coded account_id = 0 for non Cloud version
 
   if (mSelectSystemUserStmt.step() == SQLiteConnection::Result::Row)
   {
     int64_t system_id = mSelectSystemUserStmt.getInt64(0);
+    mSelectSystemUserStmt.reset();
+
+    if (mResolveCacheEnabled)
+    {
+      mSystemUserId = system_id;
+    }
 
     return system_id;
   }
@@ -115,6 +191,13 @@ int64_t UserRepository::getSystemUserId()
   throw std::runtime_error("User not found"); // TODO: custom exception
 }
 
+void UserRepository::setResolveCache(bool enabled)
+{
+  mResolveCacheEnabled = enabled;
+  mResolveCache.clear();
+  mSystemUserId.reset();
+}
+
 bool UserRepository::createTable(SQLiteConnection &sql_con)
 {
   std::string users_table_sql =
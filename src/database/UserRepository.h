@@ -13,6 +13,8 @@
 #include "database/UserRow.h"
 
 // system
+#include <optional>
+#include <unordered_map>
 #include <vector>
 
 class UserRepository
@@ -24,7 +26,9 @@ public:
       mInsertStmt(mSQLCon,
           "INSERT INTO users (account_id, name, is_system) "
           "VALUES (:account_id, :name, :is_system);"),
-      mUpdateStmt(mSQLCon, "UPDATE..."),
+      mUpdateStmt(mSQLCon,
+          "UPDATE users SET name = :name "
+          "WHERE user_id=:user_id"),
       mSelectByIdStmt(mSQLCon,
           "SELECT account_id, name, is_system "
           "FROM users "
@@ -46,6 +50,13 @@ public:
 
   int64_t insert(const UserRow &user_row);
 
+  /**
+   * Writes the name of an existing user.
+   *
+   * @return false if no user was changed
+   */
+  bool update(const UserRow &user_row);
+
   UserRow getByUserId(int64_t user_id);
 
   int64_t getSystemUserId();
@@ -54,10 +65,23 @@ public:
 
   std::vector<UserRow> getByUserIds(std::vector<int64_t> user_ids);
 
+  /**
+   * Deletes the users of the list that are no longer the sender of any message. The system user is never deleted.
+   *
+   * @return the number of deleted users
+   */
+  int64_t removeUnreferenced(const std::vector<int64_t> &user_ids);
+
+  /**
+   * While enabled getByUserId() and getSystemUserId() answer repeated lookups from memory, so the contexts of a
+   * group save that map their users to the same database users resolve each one once. Enable it only inside a write
+   * transaction: other connections can't change the users then. Disabling clears the cache.
+   */
+  void setResolveCache(bool enabled);
+
   static bool createTable(SQLiteConnection &sql_con);
 
   // TODO: update()
-  // TODO: delete()
 
 private:
   SQLiteConnection &mSQLCon;
@@ -66,6 +90,9 @@ private:
   Statement mSelectByIdStmt;
   Statement mSelectAllStmt;
   Statement mSelectSystemUserStmt;
+  bool mResolveCacheEnabled = false;
+  std::unordered_map<int64_t, UserRow> mResolveCache;
+  std::optional<int64_t> mSystemUserId;
   // TODO: more prepared statement if needed
 };
 
@@ -23,7 +23,7 @@ public:
   {
     std::string filename;
     std::string mime_type;
-    int size = 0;
+    int64_t size = 0;
     MediaType type = MediaType::None;
   };
 
@@ -31,6 +31,24 @@ public:
   virtual ~AbstractChatParser() = default;
 
   virtual bool parse(std::istream& in_stream, const std::string &chat_name, ChatImportContext& out_ctx) = 0;
+
+  /**
+   * Parses the next line of a stream that grows while it's read. The state of the former lines is kept, so the
+   * messages are the same as with parse() of the complete stream.
+   *
+   * @param line without the line break
+   * @param line_offset byte offset of the line in the stream
+   *
+   * @return false if the parser can't continue (e.g. the format of the first line isn't supported)
+   */
+  virtual bool parseLine(const std::string &line, int64_t line_offset) = 0;
+
+  /**
+   * Moves the parsed messages with the users and media they reference into out_ctx.
+   *
+   * @param keep_open keep the messages that a later line could still continue
+   */
+  virtual void takeMessages(const std::string &chat_name, bool keep_open, ChatImportContext &out_ctx) = 0;
 };
 
 #endif /* ABSTRACTCHATPARSER_H_ */
@@ -21,6 +21,8 @@
 #include <istream>
 #include <string>
 #include <memory>
+#include <algorithm>
+#include <unordered_set>
 
 using namespace std;
 
@@ -85,204 +87,276 @@ static const std::string message_payload_regex = R"(^(?:([^:]+):)?\s*(.*)$)";
 
 bool ChatFormatAStreamParser::parse(std::istream &in_stream, const std::string &chat_name, ChatImportContext &out_ctx)
 {
-  std::deque<ImportUser> import_users;
-  ImportUser *found_user = nullptr;
-  ImportUser *system_user = nullptr;
-
-  std::deque<ImportMessage> import_messages;
-  ImportMessage *found_message = nullptr;
-
-  std::deque<ImportMedia> import_media_container;
+  reset();
 
   std::string line;
-  int line_count = 0;
-  int imported_line_count = 0;
-  int user_count = 0;
+  int64_t line_offset = 0; // of the current line, for a later import that continues behind the known messages
 
   while (std::getline(in_stream, line))
   {
-    // at very first normalize all strange unicode whitespace
-    // those are very bad for structured parsing in date/time.
-    // if I later find a case where it's needed for special display that this has to get more work...
-    line = StringUtil::normalize_whitespace(line);
-
-    LOG4CXX_TRACE(logger, "parse line: " + line);
+    // the raw length before any normalization ('\r' of CRLF included)
+    int64_t next_line_offset = line_offset + static_cast<int64_t>(line.size()) + 1;
 
-    if (line_count == 0)
+    if (!parseLine(line, line_offset))
     {
-      // the first line is used to identify the date format by trying out all available ones
-      bool regex_found = identifyDateFormat(line);
-      if (!regex_found)
+      if (!mMessageDateFormat)
       {
-        LOG4CXX_ERROR(logger, "File format not supported! No matching RegEx found!");
         return false;
       }
+      // break the line parser and continue with the messages so far - and fix the parser later
+      break;
     }
 
-    // regex_datetime
-    std::smatch match;
+    line_offset = next_line_offset;
+  }
+
+  LOG4CXX_TRACE(logger, "detected chat lines: " + to_string(mLineCount));
+  LOG4CXX_TRACE(logger, "imported chat lines: " + to_string(mImportedLineCount));
+
+  takeMessages(chat_name, false, out_ctx);
+
+  return true;
+}
 
-    if (regex_search(line, match, mMessageDateFormat->full_regex))
+bool ChatFormatAStreamParser::parseLine(const std::string &raw_line, int64_t line_offset)
+{
+  // at very first normalize all strange unicode whitespace
+  // those are very bad for structured parsing in date/time.
+  // if I later find a case where it's needed for special display that this has to get more work...
+  std::string line = StringUtil::normalize_whitespace(raw_line);
+
+  LOG4CXX_TRACE(logger, "parse line: " + line);
+
+  if (mLineCount == 0)
+  {
+    // the first line is used to identify the date format by trying out all available ones
+    bool regex_found = identifyDateFormat(line);
+    if (!regex_found)
     {
-      // size=3 is a message with timestamp
-      // 0: full match
-      // 1: date+time part
-      // 2: optional name + payload
-      if (match.size() == 3)
-      {
-        const string &datetime_str = match[1];
-        const string &line_payload_user = match[2];
+      LOG4CXX_ERROR(logger, "File format not supported! No matching RegEx found!");
+      return false;
+    }
+  }
 
-        //cout << "line_payload_user:" << line_payload_user << endl;
+  // regex_datetime
+  std::smatch match;
 
-        std::smatch payload_match;
-        if (regex_search(line_payload_user, payload_match, mMessageDateFormat->payload_regex))
-        {
-          string payload;
-          string name_str;
+  if (regex_search(line, match, mMessageDateFormat->full_regex))
+  {
+    // size=3 is a message with timestamp
+    // 0: full match
+    // 1: date+time part
+    // 2: optional name + payload
+    if (match.size() == 3)
+    {
+      const string &datetime_str = match[1];
+      const string &line_payload_user = match[2];
 
-          // only payload message (most likely a system message)
-          if (payload_match.size() == 2)
-          {
-            payload = payload_match[1];
-          }
-          // user + payload message match (normal user message)
-          else if (payload_match.size() == 3)
-          {
-            name_str = payload_match[1];
-            payload = payload_match[2];
-          }
+      //cout << "line_payload_user:" << line_payload_user << endl;
 
-          std::tm tm_datetime = {};
+      std::smatch payload_match;
+      if (regex_search(line_payload_user, payload_match, mMessageDateFormat->payload_regex))
+      {
+        string payload;
+        string name_str;
 
-          LOG4CXX_TRACE(logger, "Raw DateTime: " + datetime_str);
-          std::istringstream datetime_stream(datetime_str);
+        // only payload message (most likely a system message)
+        if (payload_match.size() == 2)
+        {
+          payload = payload_match[1];
+        }
+        // user + payload message match (normal user message)
+        else if (payload_match.size() == 3)
+        {
+          name_str = payload_match[1];
+          payload = payload_match[2];
+        }
 
-          datetime_stream >> std::get_time(&tm_datetime, mMessageDateFormat->time_format.c_str());
+        std::tm tm_datetime = {};
 
-          if (datetime_stream.fail())
-          {
-            // break the line parser and continue with the next line - and fix the parser later
-            LOG4CXX_ERROR(logger, "DateTime Regex Parser Error!");
-            break;
-          }
+        LOG4CXX_TRACE(logger, "Raw DateTime: " + datetime_str);
+        std::istringstream datetime_stream(datetime_str);
+
+        datetime_stream >> std::get_time(&tm_datetime, mMessageDateFormat->time_format.c_str());
+
+        if (datetime_stream.fail())
+        {
+          // break the line parser and continue with the next line - and fix the parser later
+          LOG4CXX_ERROR(logger, "DateTime Regex Parser Error!");
+          return false;
+        }
 
-          // create the crono object
-          std::time_t message_tt = std::mktime(&tm_datetime);
-          std::chrono::system_clock::time_point message_tp = std::chrono::system_clock::from_time_t(message_tt);
+        // create the crono object
+        std::time_t message_tt = std::mktime(&tm_datetime);
+        std::chrono::system_clock::time_point message_tp = std::chrono::system_clock::from_time_t(message_tt);
 
-          // This is some bare metal debug code that I didn't like to put into trace logs
-          /*std::cout << "Year: " << tm_datetime.tm_year + 1900
-           << " Month: " << tm_datetime.tm_mon + 1
-           << " Day: " << tm_datetime.tm_mday
-           << " Hour: " << tm_datetime.tm_hour
-           << " Min: " << tm_datetime.tm_min << "\n";*/
+        // This is some bare metal debug code that I didn't like to put into trace logs
+        /*std::cout << "Year: " << tm_datetime.tm_year + 1900
+         << " Month: " << tm_datetime.tm_mon + 1
+         << " Day: " << tm_datetime.tm_mday
+         << " Hour: " << tm_datetime.tm_hour
+         << " Min: " << tm_datetime.tm_min << "\n";*/
 
-          // search if a user with this alias has yet been found
-          found_user = nullptr;
-          for (auto user_it = import_users.begin(); user_it != import_users.end(); user_it++)
+        // search if a user with this alias has yet been found
+        mFoundUser = nullptr;
+        for (auto user_it = mImportUsers.begin(); user_it != mImportUsers.end(); user_it++)
+        {
+          ImportUser &import_user = *user_it;
+          if (import_user.hasNameAlias(name_str))
           {
-            ImportUser &import_user = *user_it;
-            if (import_user.hasNameAlias(name_str))
-            {
-              // found yet existing local chat user
-              found_user = &import_user;
-              break; // TODO: for now just take the first user with fitting alias. Border cases are name changes in the same chat...
-            }
+            // found yet existing local chat user
+            mFoundUser = &import_user;
+            break; // TODO: for now just take the first user with fitting alias. Border cases are name changes in the same chat...
           }
+        }
 
-          // if existing user with same alias is not found
-          if (found_user == nullptr && !name_str.empty())
-          {
-            // create new chat local import user (start with 1)
-            int user_id = user_count + 1;
+        // if existing user with same alias is not found
+        if (mFoundUser == nullptr && !name_str.empty())
+        {
+          // create new chat local import user (start with 1)
+          int user_id = mUserCount + 1;
 
-            import_users.emplace_back(user_id);
-            ImportUser *new_user = &import_users.back();
+          mImportUsers.emplace_back(user_id);
+          ImportUser *new_user = &mImportUsers.back();
 
-            new_user->addNameAlias(name_str);
-            found_user = new_user;
-            LOG4CXX_INFO(logger, "created user first time: " + name_str + " ID: " + to_string(user_id));
-            user_count++;
-          }
+          new_user->addNameAlias(name_str);
+          mFoundUser = new_user;
+          LOG4CXX_INFO(logger, "created user first time: " + name_str + " ID: " + to_string(user_id));
+          mUserCount++;
+        }
+
+        if (mFoundUser != nullptr)
+        {
+          mImportMessages.emplace_back(mNextMessageId++, message_tp, mFoundUser->getId());
+          ImportMessage *import_message = &mImportMessages.back();
+          import_message->setSourceOffset(line_offset);
 
-          if (found_user != nullptr)
+          bool attachement_found = extractAttachement(payload);
+          if (attachement_found)
           {
-            int message_id = import_messages.size();
-            import_messages.emplace_back(message_id, message_tp, found_user->getId());
-            ImportMessage *import_message = &import_messages.back();
-
-            bool attachement_found = extractAttachement(payload);
-            if (attachement_found)
-            {
-              AttachmentInfo attachment_info = analyzeAttachement(payload);
-
-              import_message->setMediaId(import_media_container.size());
-              import_media_container.emplace_back(import_media_container.size());
-              ImportMedia *import_media = &import_media_container.back();
-              import_media->setAttachmentInfo(attachment_info);
-            }
-            else
-            {
-              import_message->addMessageLine(StringUtil::normalize_newlines(payload));
-              imported_line_count++;
-              found_message = import_message;
-            }
+            AttachmentInfo attachment_info = analyzeAttachement(payload);
+
+            import_message->setMediaId(mNextMediaId);
+            mImportMedia.emplace_back(mNextMediaId++);
+            ImportMedia *import_media = &mImportMedia.back();
+            import_media->setAttachmentInfo(attachment_info);
           }
           else
           {
-            if (!system_user)
-            {
-              import_users.emplace_back(ImportUser::SYSTEM_USER_ID);
-              system_user = &import_users.back();
-            }
-
-            // add a system message
-            int message_id = import_messages.size();
-            import_messages.emplace_back(message_id, message_tp, ImportUser::SYSTEM_USER_ID);
-            ImportMessage *import_message = &import_messages.back();
-            import_message->addMessageLine(payload);
+            import_message->addMessageLine(StringUtil::normalize_newlines(payload));
+            mImportedLineCount++;
+            mFoundMessage = import_message;
           }
-
-          LOG4CXX_TRACE(logger, "payload: " + payload);
         }
         else
         {
-          // just skip such message if found - could be fixed in the parser later
-          LOG4CXX_ERROR(logger, "Parser Error - unknown message type found!");
+          if (!mSystemUser)
+          {
+            mImportUsers.emplace_back(ImportUser::SYSTEM_USER_ID);
+            mSystemUser = &mImportUsers.back();
+          }
+
+          // add a system message
+          mImportMessages.emplace_back(mNextMessageId++, message_tp, ImportUser::SYSTEM_USER_ID);
+          ImportMessage *import_message = &mImportMessages.back();
+          import_message->setSourceOffset(line_offset);
+          import_message->addMessageLine(payload);
         }
 
+        LOG4CXX_TRACE(logger, "payload: " + payload);
       }
       else
       {
         // just skip such message if found - could be fixed in the parser later
         LOG4CXX_ERROR(logger, "Parser Error - unknown message type found!");
       }
+
+    }
+    else
+    {
+      // just skip such message if found - could be fixed in the parser later
+      LOG4CXX_ERROR(logger, "Parser Error - unknown message type found!");
     }
-    else // a message without date/time that is just a line break from the line before
+  }
+  else // a message without date/time that is just a line break from the line before
+  {
+    if (mFoundUser != nullptr)
     {
-      if (found_user != nullptr)
+      if (mFoundMessage != nullptr)
       {
-        if (found_message != nullptr)
-        {
-          found_message->addMessageLine(StringUtil::normalize_newlines(line));
-          LOG4CXX_TRACE(logger, "  to user: " + to_string(found_user->getId()));
-          LOG4CXX_TRACE(logger, "belongs to message: " + found_message->getText());
-        }
+        mFoundMessage->addMessageLine(StringUtil::normalize_newlines(line));
+        LOG4CXX_TRACE(logger, "  to user: " + to_string(mFoundUser->getId()));
+        LOG4CXX_TRACE(logger, "belongs to message: " + mFoundMessage->getText());
       }
     }
-    line_count++;
   }
+  mLineCount++;
 
-  LOG4CXX_TRACE(logger, "detected chat lines: " + to_string(line_count));
-  LOG4CXX_TRACE(logger, "imported chat lines: " + to_string(imported_line_count));
+  return true;
+}
+
+void ChatFormatAStreamParser::takeMessages(const std::string &chat_name, bool keep_open, ChatImportContext &out_ctx)
+{
+  size_t take_count = mImportMessages.size();
+  if (keep_open && take_count > 0)
+  {
+    take_count--;
+    if (mFoundMessage != nullptr)
+    {
+      // the message IDs are consecutive
+      size_t found_index = static_cast<size_t>(mFoundMessage->getId() - mImportMessages.front().getId());
+      take_count = std::min(take_count, found_index);
+    }
+  }
+
+  std::unordered_set<int> sender_ids;
+  int last_media_id = -1;
+  for (size_t i = 0; i < take_count; i++)
+  {
+    ImportMessage &import_message = mImportMessages.front();
+    if (&import_message == mFoundMessage)
+    {
+      mFoundMessage = nullptr;
+    }
+    sender_ids.insert(import_message.getSenderId());
+    last_media_id = std::max(last_media_id, static_cast<int>(import_message.getMediaId()));
+    out_ctx.messages.push_back(std::move(import_message));
+    mImportMessages.pop_front();
+  }
+
+  // the users stay for the next lines
+  for (const auto &import_user : mImportUsers)
+  {
+    if (sender_ids.count(import_user.getId()) > 0)
+    {
+      out_ctx.users.push_back(import_user);
+    }
+  }
+
+  // each attachment belongs to the message that was parsed with it
+  while (!mImportMedia.empty() && mImportMedia.front().id() <= last_media_id)
+  {
+    out_ctx.media.push_back(std::move(mImportMedia.front()));
+    mImportMedia.pop_front();
+  }
 
   out_ctx.chat = std::make_unique<ImportChat>(chat_name, ChatSource::FormatA);
-  out_ctx.users = import_users;
-  out_ctx.messages = import_messages;
-  out_ctx.media = import_media_container;
+}
 
-  return true;
+void ChatFormatAStreamParser::reset()
+{
+  mMessageDateFormat.reset();
+  mImportUsers.clear();
+  mFoundUser = nullptr;
+  mSystemUser = nullptr;
+  mImportMessages.clear();
+  mFoundMessage = nullptr;
+  mImportMedia.clear();
+  mNextMessageId = 0;
+  mNextMediaId = 0;
+  mLineCount = 0;
+  mImportedLineCount = 0;
+  mUserCount = 0;
 }
 
 bool ChatFormatAStreamParser::extractAttachement(std::string &in_out_payload)
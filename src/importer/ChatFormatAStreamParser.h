@@ -9,8 +9,13 @@
 
 // project
 #include "AbstractChatParser.h"
+#include "ImportUser.h"
+#include "ImportMessage.h"
+#include "ImportMedia.h"
 
 // system
+#include <deque>
+#include <optional>
 #include <regex>
 
 struct MessageDateTimeCore
@@ -40,7 +45,17 @@ public:
 
   bool parse(std::istream &in_stream, const std::string &chat_name, ChatImportContext &out_ctx);
 
+  bool parseLine(const std::string &line, int64_t line_offset);
+
+  /**
+   * A multi-line message is open until the next line with a timestamp. Lines without timestamp behind an attachment
+   * continue the text message in front of it, so that one is kept open as well.
+   */
+  void takeMessages(const std::string &chat_name, bool keep_open, ChatImportContext &out_ctx);
+
 private:
+  void reset();
+
   /**
    * Extract the (possible) attachment part from the payload
    *
@@ -67,6 +82,19 @@ private:
   bool identifyDateFormat(const std::string &line);
 
   std::optional<MessageDateFormat> mMessageDateFormat;
+
+  // parser state between the lines
+  std::deque<ImportUser> mImportUsers;
+  ImportUser *mFoundUser = nullptr;
+  ImportUser *mSystemUser = nullptr;
+  std::deque<ImportMessage> mImportMessages;
+  ImportMessage *mFoundMessage = nullptr;
+  std::deque<ImportMedia> mImportMedia;
+  int mNextMessageId = 0;
+  int mNextMediaId = 0;
+  int mLineCount = 0;
+  int mImportedLineCount = 0;
+  int mUserCount = 0;
 };
 
 #endif /* CHATFORMATASTREAMPARSER_H_ */
@@ -14,17 +14,24 @@
 #include "ImportManager.h"
 #include "common/Logger.h"
 #include "importer/ChatParserFactory.h"
+#include "importer/MediaProbe.h"
+#include "core/MessageFingerprinter.h"
+#include "common/HashUtil.h"
 
 // system
 #include <memory>
 #include <iostream>
+#include <fstream>
 #include <vector>
+#include <algorithm>
+#include <unordered_set>
 
 using namespace std;
 
 static Logger logger = Logger("ChatStorage.ImportManager");
 
-bool ImportManager::importFromStream(std::istream &in_stream, const ImportConfig &import_config, ChatContext &out_ctx)
+bool ImportManager::importFromStream(std::istream &in_stream, const ImportConfig &import_config, ChatContext &out_ctx,
+    ImportReport &out_report, MergeState *in_out_merge_state)
 {
   unique_ptr<AbstractChatParser> chat_parser(ChatParserFactory::create(import_config.chatSource));
   ChatImportContext ci_ctx;
@@ -36,6 +43,58 @@ bool ImportManager::importFromStream(std::istream &in_stream, const ImportConfig
     return false;
   }
 
+  // over all parsed messages, so the occurrence numbers of equal messages are the same for each re-export
+  MessageFingerprinter fingerprinter;
+  std::vector<int64_t> fingerprints = fingerprintMessages(ci_ctx, fingerprinter);
+  out_report.messages_parsed = ci_ctx.messages.size();
+
+  if (in_out_merge_state)
+  {
+    MergeState &merge_state = *in_out_merge_state;
+    updateResumePoint(ci_ctx, merge_state);
+
+    // before the media probe, so only the attachments of the new messages are read
+    if (merge_state.known_fingerprints)
+    {
+      skipKnownMessages(*merge_state.known_fingerprints, ci_ctx, fingerprints);
+      out_report.messages_known = out_report.messages_parsed - ci_ctx.messages.size();
+    }
+  }
+
+  return buildContext(import_config, ci_ctx, fingerprints, out_ctx, out_report);
+}
+
+std::vector<int64_t> ImportManager::fingerprintMessages(const ChatImportContext &ci_ctx,
+    MessageFingerprinter &fingerprinter)
+{
+  std::unordered_map<int, std::string> sender_names;
+  for (const auto &import_user : ci_ctx.users)
+  {
+    sender_names.emplace(import_user.getId(), import_user.getNameAliasString());
+  }
+
+  std::vector<int64_t> fingerprints;
+  fingerprints.reserve(ci_ctx.messages.size());
+  for (auto &import_message : ci_ctx.messages)
+  {
+    fingerprints.push_back(fingerprinter.next(toUnixSeconds(import_message), sender_names[import_message.getSenderId()],
+        import_message.getSenderId() == ImportUser::SYSTEM_USER_ID, import_message.getText()));
+  }
+
+  return fingerprints;
+}
+
+bool ImportManager::buildContext(const ImportConfig &import_config, ChatImportContext &ci_ctx,
+    const std::vector<int64_t> &fingerprints, ChatContext &out_ctx, ImportReport &out_report)
+{
+  if (import_config.probeMedia && !import_config.mediaDirectory.empty())
+  {
+    if (!probeMedia(import_config, ci_ctx, out_report))
+    {
+      return false;
+    }
+  }
+
   for (auto user_it = ci_ctx.users.begin(); user_it != ci_ctx.users.end(); user_it++)
   {
     ImportUser &import_user = *user_it;
@@ -77,11 +136,10 @@ bool ImportManager::importFromStream(std::istream &in_stream, const ImportConfig
     out_ctx.addMedia(media_obj);
   }
 
-  for (auto message_it = ci_ctx.messages.begin(); message_it != ci_ctx.messages.end(); message_it++)
+  for (size_t message_index = 0; message_index < ci_ctx.messages.size(); message_index++)
   {
-    ImportMessage &import_message = *message_it;
-    std::chrono::system_clock::time_point tp = import_message.getTimePoint();
-    int64_t timestamp = std::chrono::duration_cast<std::chrono::seconds>(tp.time_since_epoch()).count();
+    ImportMessage &import_message = ci_ctx.messages[message_index];
+    int64_t timestamp = toUnixSeconds(import_message);
 
 // @formatter:off
     Message message(
@@ -93,11 +151,232 @@ bool ImportManager::importFromStream(std::istream &in_stream, const ImportConfig
         import_message.getText()
         );
 // @formatter:on
+    message.setFingerprint(fingerprints[message_index]);
 
-    out_ctx.addMessage(message);
+    out_ctx.addMessage(std::move(message));
   }
 
   out_ctx.setChat(make_unique<Chat>(Chat::RT_START_ID, Chat::DB_NO_ID, ci_ctx.chat->getName(), ci_ctx.chat->getSource()));
 
   return true;
 }
+
+bool ImportManager::importFromFile(const std::filesystem::path &filename, const ImportConfig &import_config,
+    ChatContext &out_ctx, ImportReport &out_report, MergeState *in_out_merge_state)
+{
+  // binary: the offsets of the parser are byte offsets on all platforms
+  std::ifstream import_stream(filename, std::ios::binary);
+
+  if (!import_stream)
+  {
+    std::cerr << "Error to open the file: " << filename << endl;
+    return false;
+  }
+
+  if (in_out_merge_state && in_out_merge_state->start_offset > 0)
+  {
+    import_stream.seekg(in_out_merge_state->start_offset);
+  }
+
+  // attachments are referenced relative to the export file
+  ImportConfig file_import_config = import_config;
+  if (file_import_config.mediaDirectory.empty())
+  {
+    file_import_config.mediaDirectory = filename.parent_path();
+    if (file_import_config.mediaDirectory.empty())
+    {
+      file_import_config.mediaDirectory = ".";
+    }
+  }
+
+  return importFromStream(import_stream, file_import_config, out_ctx, out_report, in_out_merge_state);
+}
+
+bool ImportManager::hashPrefix(const std::filesystem::path &filename, int64_t offset, size_t lines,
+    int64_t &out_length, std::string &out_hash)
+{
+  constexpr int64_t MAX_PREFIX_BYTES = 64 * 1024;
+
+  int64_t window_begin = std::max<int64_t>(0, offset - MAX_PREFIX_BYTES);
+  std::string window(static_cast<size_t>(offset - window_begin), '\0');
+
+  std::ifstream file(filename, std::ios::binary);
+  file.seekg(window_begin);
+  if (!file.read(&window[0], static_cast<std::streamsize>(window.size())))
+  {
+    return false;
+  }
+
+  // the window ends with the '\n' of the line in front of offset -> go back to the start of the first line
+  size_t prefix_begin = window.size();
+  for (size_t line = 0; line < lines && prefix_begin > 0; line++)
+  {
+    size_t newline = prefix_begin >= 2 ? window.rfind('\n', prefix_begin - 2) : std::string::npos;
+    if (newline == std::string::npos)
+    {
+      prefix_begin = 0;
+      break;
+    }
+    prefix_begin = newline + 1;
+  }
+
+  out_length = static_cast<int64_t>(window.size() - prefix_begin);
+  out_hash = HashUtil::toHex(HashUtil::xxh64(window.data() + prefix_begin, window.size() - prefix_begin));
+  return true;
+}
+
+bool ImportManager::verifyPrefix(const std::filesystem::path &filename, int64_t offset, int64_t length,
+    const std::string &hash)
+{
+  if (length > offset)
+  {
+    return false;
+  }
+
+  std::string prefix(static_cast<size_t>(length), '\0');
+  std::ifstream file(filename, std::ios::binary);
+  file.seekg(offset - length);
+  if (!file.read(&prefix[0], static_cast<std::streamsize>(prefix.size())))
+  {
+    return false;
+  }
+
+  return HashUtil::toHex(HashUtil::xxh64(prefix.data(), prefix.size())) == hash;
+}
+
+void ImportManager::updateResumePoint(const ChatImportContext &ci_ctx, MergeState &in_out_merge_state)
+{
+  if (ci_ctx.messages.empty())
+  {
+    return;
+  }
+
+  in_out_merge_state.first_timestamp = toUnixSeconds(ci_ctx.messages.front());
+  int64_t min_timestamp = *in_out_merge_state.first_timestamp;
+  for (const auto &import_message : ci_ctx.messages)
+  {
+    min_timestamp = std::min(min_timestamp, toUnixSeconds(import_message));
+  }
+  in_out_merge_state.min_timestamp = min_timestamp;
+
+  // the run of messages with the last timestamp at the end of the file
+  size_t run_begin = ci_ctx.messages.size() - 1;
+  int64_t last_timestamp = toUnixSeconds(ci_ctx.messages.back());
+  while (run_begin > 0 && toUnixSeconds(ci_ctx.messages[run_begin - 1]) == last_timestamp)
+  {
+    run_begin--;
+  }
+
+  ResumePoint &resume_point = in_out_merge_state.resume_point;
+  resume_point.valid = true;
+  resume_point.offset = in_out_merge_state.start_offset + ci_ctx.messages[run_begin].getSourceOffset();
+  resume_point.last_timestamp = last_timestamp;
+}
+
+int64_t ImportManager::toUnixSeconds(const ImportMessage &import_message)
+{
+  return std::chrono::duration_cast<std::chrono::seconds>(import_message.getTimePoint().time_since_epoch()).count();
+}
+
+void ImportManager::skipKnownMessages(const std::unordered_set<int64_t> &known_fingerprints,
+    ChatImportContext &in_out_ci_ctx, std::vector<int64_t> &in_out_fingerprints)
+{
+  std::deque<ImportMessage> new_messages;
+  std::vector<int64_t> new_fingerprints;
+  std::unordered_set<int> sender_ids;
+  std::unordered_set<int> media_ids;
+
+  for (size_t i = 0; i < in_out_ci_ctx.messages.size(); i++)
+  {
+    if (known_fingerprints.count(in_out_fingerprints[i]) > 0)
+    {
+      continue;
+    }
+
+    ImportMessage &import_message = in_out_ci_ctx.messages[i];
+    sender_ids.insert(import_message.getSenderId());
+    media_ids.insert(static_cast<int>(import_message.getMediaId()));
+    new_messages.push_back(std::move(import_message));
+    new_fingerprints.push_back(in_out_fingerprints[i]);
+  }
+
+  in_out_ci_ctx.messages = std::move(new_messages);
+  in_out_fingerprints = std::move(new_fingerprints);
+
+  in_out_ci_ctx.users.erase(std::remove_if(in_out_ci_ctx.users.begin(), in_out_ci_ctx.users.end(),
+      [&](const ImportUser &import_user) { return sender_ids.count(import_user.getId()) == 0; }),
+      in_out_ci_ctx.users.end());
+  in_out_ci_ctx.media.erase(std::remove_if(in_out_ci_ctx.media.begin(), in_out_ci_ctx.media.end(),
+      [&](const ImportMedia &import_media) { return media_ids.count(import_media.id()) == 0; }),
+      in_out_ci_ctx.media.end());
+}
+
+bool ImportManager::probeMedia(const ImportConfig &import_config, ChatImportContext &in_out_ci_ctx, ImportReport &out_report)
+{
+  std::vector<std::string> filenames;
+  filenames.reserve(in_out_ci_ctx.media.size());
+  for (auto &import_media : in_out_ci_ctx.media)
+  {
+    filenames.push_back(import_media.getAttachmentInfo().filename);
+  }
+
+  std::vector<MediaProbe::Result> probe_results = MediaProbe::probe(import_config.mediaDirectory, filenames,
+      import_config.probeWorkers, import_config.executor.get());
+  out_report.media_probed += probe_results.size();
+
+  std::unordered_set<int> missing_media_ids;
+  for (size_t i = 0; i < probe_results.size(); i++)
+  {
+    ImportMedia &import_media = in_out_ci_ctx.media[i];
+    const MediaProbe::Result &probe_result = probe_results[i];
+    AbstractChatParser::AttachmentInfo attachment_info = import_media.getAttachmentInfo();
+
+    if (!probe_result.exists)
+    {
+      LOG4CXX_WARN(logger, "Missing media: " << attachment_info.filename << " (" << probe_result.error << ")");
+      out_report.missing_media.push_back(attachment_info.filename);
+      missing_media_ids.insert(import_media.id());
+      continue;
+    }
+
+    attachment_info.size = probe_result.size;
+    if (!probe_result.mime_type.empty() && probe_result.mime_type != attachment_info.mime_type)
+    {
+      LOG4CXX_DEBUG(logger, "MIME type of " << attachment_info.filename << ": " << attachment_info.mime_type << " -> "
+          << probe_result.mime_type);
+      attachment_info.mime_type = probe_result.mime_type;
+      attachment_info.type = probe_result.type;
+      out_report.media_mime_corrected++;
+    }
+    import_media.setAttachmentInfo(attachment_info);
+  }
+
+  if (missing_media_ids.empty())
+  {
+    return true;
+  }
+
+  switch (import_config.missingMedia)
+  {
+    case MissingMediaPolicy::Fail:
+      LOG4CXX_ERROR(logger, "Import aborted: " << missing_media_ids.size() << " media files are missing");
+      return false;
+
+    case MissingMediaPolicy::Drop:
+      for (auto &import_message : in_out_ci_ctx.messages)
+      {
+        if (missing_media_ids.count(static_cast<int>(import_message.getMediaId())) > 0)
+        {
+          import_message.setMediaId(-1);
+        }
+      }
+      in_out_ci_ctx.media.erase(std::remove_if(in_out_ci_ctx.media.begin(), in_out_ci_ctx.media.end(),
+          [&](const ImportMedia &import_media) { return missing_media_ids.count(import_media.id()) > 0; }),
+          in_out_ci_ctx.media.end());
+      return true;
+
+    case MissingMediaPolicy::Keep:
+    default:
+      return true;
+  }
+}
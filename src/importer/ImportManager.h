@@ -15,10 +15,14 @@
 #include "importer/ChatImportContext.h"
 
 // system
+#include <filesystem>
+#include <optional>
 #include <unordered_map>
+#include <unordered_set>
 
 // forward declarations
 class Chat;
+class MessageFingerprinter;
 
 
 
@@ -28,7 +32,99 @@ public:
   ImportManager() = default;
   ~ImportManager() = default;
 
-  static bool importFromStream(std::istream &in_stream, const ImportConfig &import_config, ChatContext &out_ctx);
+  /**
+   * Where the import of a grown export could continue: the first line of the messages with the last timestamp. The
+   * messages with the same timestamp are parsed again, so their fingerprint occurrence numbers stay the same.
+   */
+  struct ResumePoint
+  {
+    bool valid = false;
+    int64_t offset = 0;
+    int64_t last_timestamp = 0;
+  };
+
+  /**
+   * Input and output of an import into a chat that yet has messages of the file (see ChatStorage::importFile())
+   */
+  struct MergeState
+  {
+    // the messages with these fingerprints are skipped, and with them the users and media only they reference
+    const std::unordered_set<int64_t> *known_fingerprints = nullptr;
+
+    // byte offset of a message line where importFromFile() starts to parse
+    int64_t start_offset = 0;
+
+    // out: of the parsed messages (before the known messages are skipped)
+    std::optional<int64_t> first_timestamp;
+    std::optional<int64_t> min_timestamp;
+
+    // out: in absolute file offsets
+    ResumePoint resume_point;
+  };
+
+  /**
+   * Each message gets its fingerprint (see MessageFingerprinter), computed over all parsed messages.
+   */
+  static bool importFromStream(std::istream &in_stream, const ImportConfig &import_config, ChatContext &out_ctx,
+      ImportReport &out_report, MergeState *in_out_merge_state = nullptr);
+
+  /**
+   * Like importFromStream(). Attachments are resolved relative to the file if ImportConfig::mediaDirectory is empty.
+   */
+  static bool importFromFile(const std::filesystem::path &filename, const ImportConfig &import_config,
+      ChatContext &out_ctx, ImportReport &out_report, MergeState *in_out_merge_state = nullptr);
+
+  /**
+   * Hashes the last lines of the file in front of offset. A grown export continues at offset if these bytes are the
+   * same.
+   *
+   * @param out_length the number of hashed bytes in front of offset
+   *
+   * @return false if the file couldn't be read
+   */
+  static bool hashPrefix(const std::filesystem::path &filename, int64_t offset, size_t lines, int64_t &out_length,
+      std::string &out_hash);
+
+  /**
+   * @return true if the length bytes in front of offset have the hash
+   */
+  static bool verifyPrefix(const std::filesystem::path &filename, int64_t offset, int64_t length,
+      const std::string &hash);
+
+  static constexpr size_t RESUME_PREFIX_LINES = 16;
+
+  /**
+   * @param fingerprinter has seen the messages in front of ci_ctx.messages
+   */
+  static std::vector<int64_t> fingerprintMessages(const ChatImportContext &ci_ctx, MessageFingerprinter &fingerprinter);
+
+  /**
+   * Removes the known messages and all users and media that are only referenced by them.
+   *
+   * @param in_out_fingerprints the fingerprints of in_out_ci_ctx.messages; filtered the same way
+   */
+  static void skipKnownMessages(const std::unordered_set<int64_t> &known_fingerprints, ChatImportContext &in_out_ci_ctx,
+      std::vector<int64_t> &in_out_fingerprints);
+
+  /**
+   * Probes the media and fills out_ctx with the parsed chat.
+   *
+   * @return false if the import has to be aborted (see MissingMediaPolicy)
+   */
+  static bool buildContext(const ImportConfig &import_config, ChatImportContext &ci_ctx,
+      const std::vector<int64_t> &fingerprints, ChatContext &out_ctx, ImportReport &out_report);
+
+  static int64_t toUnixSeconds(const ImportMessage &import_message);
+
+private:
+  static void updateResumePoint(const ChatImportContext &ci_ctx, MergeState &in_out_merge_state);
+
+  /**
+   * Fills the size and the sniffed MIME type of all attachments and applies the MissingMediaPolicy.
+   *
+   * @return false if the import has to be aborted
+   */
+  static bool probeMedia(const ImportConfig &import_config, ChatImportContext &in_out_ci_ctx, ImportReport &out_report);
 };
 
 #endif /* IMPORTMANAGER_H_ */
@@ -45,3 +45,12 @@ int64_t ImportMessage::getMediaId()
   return mMediaId;
 }
 
+void ImportMessage::setSourceOffset(int64_t offset)
+{
+  mSourceOffset = offset;
+}
+
+int64_t ImportMessage::getSourceOffset() const
+{
+  return mSourceOffset;
+}
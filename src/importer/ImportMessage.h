@@ -37,12 +37,20 @@ public:
 
   int64_t getMediaId();
 
+  /**
+   * Byte offset of the first line of the message in the parsed stream
+   */
+  void setSourceOffset(int64_t offset);
+
+  int64_t getSourceOffset() const;
+
 private:
   int mId = 0;
   std::chrono::system_clock::time_point mTimePoint;
   std::string mMessage;
   int mSenderId = 0;
   int mMediaId = -1;
+  int64_t mSourceOffset = 0;
 };
 
 #endif /* IMPORTMESSAGE_H_ */
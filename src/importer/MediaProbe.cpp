@@ -0,0 +1,205 @@
+/*
+ * MediaProbe.cpp
+ *
+ *      Author: Andreas Volz
+ */
+
+// project
+#include "MediaProbe.h"
+#include "common/ParallelFor.h"
+
+// system
+#include <cstring>
+#include <fstream>
+#ifdef __linux__
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace MediaProbe
+{
+
+  namespace
+  {
+
+    bool startsWith(const uint8_t *header, size_t length, size_t offset, const char *magic)
+    {
+      size_t magic_length = strlen(magic);
+      return length >= offset + magic_length && memcmp(header + offset, magic, magic_length) == 0;
+    }
+
+    void applyHeader(const uint8_t *header, size_t length, Result &out_result)
+    {
+      out_result.mime_type = sniffMimeType(header, length, out_result.type);
+    }
+
+#ifdef __linux__
+    /**
+     * Opens the file and fills exists/size. Returns the open file descriptor or -1.
+     */
+    int openAndStat(const fs::path &path, Result &out_result)
+    {
+      int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+      if (fd < 0)
+      {
+        out_result.error = strerror(errno);
+        return -1;
+      }
+
+      struct stat st {};
+      if (fstat(fd, &st) != 0)
+      {
+        out_result.error = strerror(errno);
+        ::close(fd);
+        return -1;
+      }
+      if (!S_ISREG(st.st_mode))
+      {
+        out_result.error = "not a regular file";
+        ::close(fd);
+        return -1;
+      }
+
+      out_result.exists = true;
+      out_result.size = st.st_size;
+      return fd;
+    }
+#endif
+
+    Result probeFile(const fs::path &path)
+    {
+      Result result;
+      uint8_t header[HEADER_SIZE];
+
+#ifdef __linux__
+      int fd = openAndStat(path, result);
+      if (fd < 0)
+      {
+        return result;
+      }
+
+      ssize_t length = pread(fd, header, sizeof(header), 0);
+      ::close(fd);
+      if (length > 0)
+      {
+        applyHeader(header, static_cast<size_t>(length), result);
+      }
+#else
+      std::error_code ec;
+      uintmax_t size = fs::file_size(path, ec);
+      if (ec)
+      {
+        result.error = ec.message();
+        return result;
+      }
+      result.exists = true;
+      result.size = static_cast<int64_t>(size);
+
+      std::ifstream file(path, std::ios::binary);
+      file.read(reinterpret_cast<char*>(header), sizeof(header));
+      applyHeader(header, static_cast<size_t>(file.gcount()), result);
+#endif
+
+      return result;
+    }
+
+  } // namespace
+
+  std::vector<Result> probe(const fs::path &base_path, const std::vector<std::string> &filenames, unsigned workers,
+      Executor *executor)
+  {
+    std::vector<fs::path> paths;
+    paths.reserve(filenames.size());
+    for (const auto &filename : filenames)
+    {
+      fs::path path(filename);
+      paths.push_back(path.is_absolute() ? path : base_path / path);
+    }
+
+    std::vector<Result> results(paths.size());
+
+    parallelFor(executor, paths.size(), workers, [&](size_t index)
+    {
+      results[index] = probeFile(paths[index]);
+    });
+
+    return results;
+  }
+
+  std::string sniffMimeType(const uint8_t *header, size_t length, MediaType &out_type)
+  {
+    out_type = MediaType::None;
+
+    if (length >= 3 && header[0] == 0xFF && header[1] == 0xD8 && header[2] == 0xFF)
+    {
+      out_type = MediaType::Image;
+      return "image/jpeg";
+    }
+    if (startsWith(header, length, 0, "\x89PNG"))
+    {
+      out_type = MediaType::Image;
+      return "image/png";
+    }
+    if (startsWith(header, length, 0, "GIF8"))
+    {
+      out_type = MediaType::Image;
+      return "image/gif";
+    }
+    if (startsWith(header, length, 0, "RIFF"))
+    {
+      if (startsWith(header, length, 8, "WEBP"))
+      {
+        out_type = MediaType::Image;
+        return "image/webp";
+      }
+      if (startsWith(header, length, 8, "WAVE"))
+      {
+        out_type = MediaType::Audio;
+        return "audio/wav";
+      }
+    }
+    if (startsWith(header, length, 4, "ftyp"))
+    {
+      // ISO base media file: the major brand tells the container variant
+      if (startsWith(header, length, 8, "qt  "))
+      {
+        out_type = MediaType::Video;
+        return "video/quicktime";
+      }
+      if (startsWith(header, length, 8, "3gp"))
+      {
+        out_type = MediaType::Video;
+        return "video/3gpp";
+      }
+      if (startsWith(header, length, 8, "M4A "))
+      {
+        out_type = MediaType::Audio;
+        return "audio/mp4";
+      }
+      out_type = MediaType::Video;
+      return "video/mp4";
+    }
+    if (startsWith(header, length, 0, "OggS"))
+    {
+      out_type = MediaType::Audio;
+      // the first page of an Opus stream starts with the OpusHead packet (27 bytes header + 1 segment table entry)
+      return startsWith(header, length, 28, "OpusHead") ? "audio/opus" : "audio/ogg";
+    }
+    if (startsWith(header, length, 0, "ID3") || (length >= 2 && header[0] == 0xFF && (header[1] & 0xE0) == 0xE0))
+    {
+      out_type = MediaType::Audio;
+      return "audio/mpeg";
+    }
+    if (startsWith(header, length, 0, "%PDF"))
+    {
+      return "application/pdf";
+    }
+
+    return std::string();
+  }
+
+} // namespace MediaProbe
@@ -0,0 +1,64 @@
+/*
+ * MediaProbe.h
+ *
+ *      Author: Andreas Volz
+ */
+
+#ifndef MEDIAPROBE_H_
+#define MEDIAPROBE_H_
+
+// project public API
+#include "chatstorage/Media.h"
+#include "chatstorage/Executor.h"
+
+// project
+#include "common/platform.h"
+
+// system
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Collects the file metadata of all attachments of an import before anything is written to the database.
+ *
+ * Each file is stat'ed and the first HEADER_SIZE bytes are read to detect the real MIME type from its magic number.
+ * The export file names are not reliable (e.g. a WebP image named .jpg), so the sniffed type wins over the extension.
+ * The files are probed in parallel by the workers of the executor.
+ */
+namespace MediaProbe
+{
+
+  struct Result
+  {
+    bool exists = false;
+    int64_t size = 0;
+    std::string mime_type; // empty if the magic number isn't known
+    MediaType type = MediaType::None;
+    std::string error;
+  };
+
+  /**
+   * @param base_path Relative file names are resolved against this directory.
+   * @param executor thread pool of the workers; nullptr starts own threads
+   *
+   * @return One Result for each file name in the same order.
+   */
+  std::vector<Result> probe(const fs::path &base_path, const std::vector<std::string> &filenames, unsigned workers,
+      Executor *executor = nullptr);
+
+  /**
+   * Detects the MIME type from the first bytes of a file.
+   *
+   * @param out_type The MediaType that belongs to the detected MIME type.
+   *
+   * @return The MIME type or an empty string if the format isn't known.
+   */
+  std::string sniffMimeType(const uint8_t *header, size_t length, MediaType &out_type);
+
+  constexpr size_t HEADER_SIZE = 64;
+
+} // namespace MediaProbe
+
+#endif /* MEDIAPROBE_H_ */
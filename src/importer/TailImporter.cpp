@@ -0,0 +1,182 @@
+/*
+ * TailImporter.cpp
+ *
+ *      Author: Andreas Volz
+ */
+
+// project
+#include "TailImporter.h"
+#include "importer/ChatParserFactory.h"
+#include "common/Logger.h"
+
+// system
+#include <algorithm>
+
+using namespace std;
+
+static Logger logger = Logger("ChatStorage.TailImporter");
+
+TailImporter::TailImporter(const ImportConfig &import_config, const std::unordered_set<int64_t> *known_fingerprints,
+    int64_t start_offset) :
+    mImportConfig(import_config),
+    mParser(ChatParserFactory::create(import_config.chatSource)),
+    mLineOffset(start_offset)
+{
+  mMergeState.known_fingerprints = known_fingerprints;
+  mMergeState.start_offset = start_offset;
+}
+
+bool TailImporter::feed(const char *data, size_t size)
+{
+  mLineBuffer.append(data, size);
+  return parseLines(false);
+}
+
+bool TailImporter::finish()
+{
+  return parseLines(true);
+}
+
+size_t TailImporter::pendingMessages() const
+{
+  return mPending.messages.size();
+}
+
+std::chrono::steady_clock::time_point TailImporter::pendingSince() const
+{
+  return mPendingSince;
+}
+
+bool TailImporter::takeBatch(ChatContext &out_ctx, ImportReport &out_report)
+{
+  ChatImportContext ci_ctx = std::move(mPending);
+  std::vector<int64_t> fingerprints = std::move(mPendingFingerprints);
+  mPending = ChatImportContext {};
+  mPendingFingerprints.clear();
+
+  out_report.messages_parsed = mBatchMessagesParsed;
+  out_report.messages_known = mBatchMessagesKnown;
+  mBatchMessagesParsed = 0;
+  mBatchMessagesKnown = 0;
+
+  if (!ci_ctx.chat)
+  {
+    ci_ctx.chat = std::make_unique<ImportChat>(mImportConfig.chatName, mImportConfig.chatSource);
+  }
+
+  return ImportManager::buildContext(mImportConfig, ci_ctx, fingerprints, out_ctx, out_report);
+}
+
+void TailImporter::mapUser(const std::string &name, int64_t database_id)
+{
+  auto &mapping = mImportConfig.userImportMapping;
+  bool mapped = std::any_of(mapping.begin(), mapping.end(), [&](const auto &pair) { return pair.first == name; });
+  if (!mapped)
+  {
+    mapping.emplace_back(name, static_cast<int>(database_id));
+  }
+}
+
+const ImportManager::MergeState& TailImporter::getMergeState() const
+{
+  return mMergeState;
+}
+
+int64_t TailImporter::getLineOffset() const
+{
+  return mLineOffset;
+}
+
+bool TailImporter::parseLines(bool end_of_stream)
+{
+  size_t line_begin = 0;
+  size_t line_end;
+  bool parse_ok = true;
+
+  while (parse_ok && (line_end = mLineBuffer.find('\n', line_begin)) != std::string::npos)
+  {
+    parse_ok = mParser->parseLine(mLineBuffer.substr(line_begin, line_end - line_begin), mLineOffset);
+    mLineOffset += static_cast<int64_t>(line_end - line_begin) + 1;
+    line_begin = line_end + 1;
+  }
+  mLineBuffer.erase(0, line_begin);
+
+  if (parse_ok && end_of_stream && !mLineBuffer.empty())
+  {
+    parse_ok = mParser->parseLine(mLineBuffer, mLineOffset);
+    mLineOffset += static_cast<int64_t>(mLineBuffer.size());
+    mLineBuffer.clear();
+  }
+
+  if (!parse_ok)
+  {
+    LOG4CXX_ERROR(logger, "Import Parser Error at byte " << mLineOffset);
+    return false;
+  }
+
+  collectMessages(!end_of_stream);
+  return true;
+}
+
+void TailImporter::collectMessages(bool keep_open)
+{
+  ChatImportContext ci_ctx;
+  mParser->takeMessages(mImportConfig.chatName, keep_open, ci_ctx);
+  if (ci_ctx.messages.empty())
+  {
+    return;
+  }
+
+  // the resume point is behind the completed messages, known or not
+  for (const auto &import_message : ci_ctx.messages)
+  {
+    int64_t timestamp = ImportManager::toUnixSeconds(import_message);
+    if (!mMergeState.first_timestamp)
+    {
+      mMergeState.first_timestamp = timestamp;
+      mMergeState.min_timestamp = timestamp;
+    }
+    mMergeState.min_timestamp = std::min(*mMergeState.min_timestamp, timestamp);
+
+    ImportManager::ResumePoint &resume_point = mMergeState.resume_point;
+    if (!resume_point.valid || resume_point.last_timestamp != timestamp)
+    {
+      resume_point.valid = true;
+      resume_point.offset = import_message.getSourceOffset();
+      resume_point.last_timestamp = timestamp;
+    }
+  }
+
+  std::vector<int64_t> fingerprints = ImportManager::fingerprintMessages(ci_ctx, mFingerprinter);
+  mBatchMessagesParsed += ci_ctx.messages.size();
+  if (mMergeState.known_fingerprints)
+  {
+    size_t parsed_count = ci_ctx.messages.size();
+    ImportManager::skipKnownMessages(*mMergeState.known_fingerprints, ci_ctx, fingerprints);
+    mBatchMessagesKnown += parsed_count - ci_ctx.messages.size();
+  }
+
+  if (ci_ctx.messages.empty())
+  {
+    return;
+  }
+
+  if (mPending.messages.empty())
+  {
+    mPendingSince = std::chrono::steady_clock::now();
+  }
+
+  for (auto &import_user : ci_ctx.users)
+  {
+    bool pending = std::any_of(mPending.users.begin(), mPending.users.end(),
+        [&](const ImportUser &pending_user) { return pending_user.getId() == import_user.getId(); });
+    if (!pending)
+    {
+      mPending.users.push_back(std::move(import_user));
+    }
+  }
+  std::move(ci_ctx.messages.begin(), ci_ctx.messages.end(), std::back_inserter(mPending.messages));
+  std::move(ci_ctx.media.begin(), ci_ctx.media.end(), std::back_inserter(mPending.media));
+  mPendingFingerprints.insert(mPendingFingerprints.end(), fingerprints.begin(), fingerprints.end());
+  mPending.chat = std::move(ci_ctx.chat);
+}
@@ -0,0 +1,105 @@
+/*
+ * TailImporter.h
+ *
+ *      Author: Andreas Volz
+ */
+
+#ifndef TAILIMPORTER_H_
+#define TAILIMPORTER_H_
+
+// project public API
+#include "chatstorage/ChatContext.h"
+#include "chatstorage/ChatStorageImporter.h"
+
+// project
+#include "importer/AbstractChatParser.h"
+#include "importer/ChatImportContext.h"
+#include "importer/ImportManager.h"
+#include "core/MessageFingerprinter.h"
+
+// system
+#include <chrono>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * Imports a chat export that grows while it's read (a file that is appended to or a pipe). The data is fed in
+ * arbitrary pieces and the parser keeps its state between them. A message is pending as soon as the next line with a
+ * timestamp shows that it's complete; takeBatch() moves the pending messages into a ChatContext for the next save.
+ *
+ * The fingerprints are computed over all fed messages, so they are the same as with a complete import of the stream.
+ */
+class TailImporter
+{
+public:
+  /**
+   * @param known_fingerprints messages the chat yet has; they are skipped. The caller adds the fingerprints of the
+   *        saved batches, so the set has to live as long as the TailImporter.
+   * @param start_offset byte offset of the first fed byte in the stream
+   */
+  TailImporter(const ImportConfig &import_config, const std::unordered_set<int64_t> *known_fingerprints,
+      int64_t start_offset);
+  ~TailImporter() = default;
+
+  /**
+   * @return false if the data can't be parsed (e.g. the format isn't supported)
+   */
+  bool feed(const char *data, size_t size);
+
+  /**
+   * The stream ended: an incomplete last line and the last message are complete.
+   */
+  bool finish();
+
+  size_t pendingMessages() const;
+
+  /**
+   * When the oldest pending message was completed
+   */
+  std::chrono::steady_clock::time_point pendingSince() const;
+
+  /**
+   * Moves the pending messages with their users and media into out_ctx.
+   *
+   * @return false if the import has to be aborted (see MissingMediaPolicy)
+   */
+  bool takeBatch(ChatContext &out_ctx, ImportReport &out_report);
+
+  /**
+   * Later batches store the senders of this name as that user.
+   */
+  void mapUser(const std::string &name, int64_t database_id);
+
+  /**
+   * Timestamps of all completed messages and the resume point behind them, in absolute stream offsets.
+   */
+  const ImportManager::MergeState& getMergeState() const;
+
+  /**
+   * Byte offset in the stream behind the last complete line
+   */
+  int64_t getLineOffset() const;
+
+private:
+  bool parseLines(bool end_of_stream);
+
+  void collectMessages(bool keep_open);
+
+  ImportConfig mImportConfig;
+  std::unique_ptr<AbstractChatParser> mParser;
+  MessageFingerprinter mFingerprinter;
+  ImportManager::MergeState mMergeState;
+
+  std::string mLineBuffer;
+  int64_t mLineOffset = 0;
+
+  ChatImportContext mPending;
+  std::vector<int64_t> mPendingFingerprints;
+  std::chrono::steady_clock::time_point mPendingSince;
+  size_t mBatchMessagesParsed = 0;
+  size_t mBatchMessagesKnown = 0;
+};
+
+#endif /* TAILIMPORTER_H_ */
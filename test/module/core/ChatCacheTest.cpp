@@ -0,0 +1,246 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+// project
+#include "ChatCacheTest.h"
+#include "core/ChatCache.h"
+#include "database/ChatRepository.h"
+#include "database/SQLiteConnection.h"
+#include "../TestHelpers.h"
+
+// system
+#include <filesystem>
+#include <limits>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+CPPUNIT_TEST_SUITE_REGISTRATION(ChatCacheTest);
+
+void ChatCacheTest::setUp()
+{
+
+}
+
+void ChatCacheTest::tearDown()
+{
+
+}
+
+void ChatCacheTest::test_lru_eviction()
+{
+  ChatSnapshotPtr snapshot = createSnapshot(10);
+  size_t entry_bytes = getEntryBytes(snapshot);
+
+  ChatCache cache(3 * entry_bytes);
+  for (int64_t chat_id = 1; chat_id <= 3; chat_id++)
+  {
+    cache.put(chat_id, 0, snapshot, cache.getEpoch());
+  }
+  CPPUNIT_ASSERT_EQUAL(size_t(3), cache.getStats().entries);
+  CPPUNIT_ASSERT_EQUAL(3 * entry_bytes, cache.getStats().bytes);
+
+  // chat 1 is the oldest entry, after the get() chat 2 is the least recently used one
+  ASSERT_MSG(cache.get(1) == snapshot, "Cached snapshot not returned!");
+  cache.put(4, 0, snapshot, cache.getEpoch());
+
+  ChatCacheStats stats = cache.getStats();
+  CPPUNIT_ASSERT_EQUAL(size_t(3), stats.entries);
+  CPPUNIT_ASSERT_EQUAL(uint64_t(1), stats.evictions);
+  ASSERT_MSG(!cache.get(2), "Least recently used entry not evicted!");
+  ASSERT_MSG(cache.get(1) && cache.get(3) && cache.get(4), "Wrong entry evicted!");
+
+  stats = cache.getStats();
+  CPPUNIT_ASSERT_EQUAL(uint64_t(4), stats.hits);
+  CPPUNIT_ASSERT_EQUAL(uint64_t(1), stats.misses);
+  CPPUNIT_ASSERT_EQUAL(uint64_t(0), stats.invalidations);
+
+  // a put() of a cached chat replaces the entry
+  cache.put(3, 1, createSnapshot(10), cache.getEpoch());
+  CPPUNIT_ASSERT_EQUAL(size_t(3), cache.getStats().entries);
+  CPPUNIT_ASSERT_EQUAL(uint64_t(1), cache.getStats().evictions);
+  ASSERT_MSG(cache.get(3) != snapshot, "Entry not replaced!");
+}
+
+void ChatCacheTest::test_budget()
+{
+  ChatSnapshotPtr small_snapshot = createSnapshot(10);
+  ChatSnapshotPtr big_snapshot = createSnapshot(1000);
+  size_t small_bytes = getEntryBytes(small_snapshot);
+  size_t big_bytes = getEntryBytes(big_snapshot);
+  ASSERT_MSG(big_bytes > 2 * small_bytes, "Snapshot sizes don't fit the test: " << small_bytes << " " << big_bytes);
+
+  ChatCache cache(big_bytes - 1);
+  CPPUNIT_ASSERT(cache.isEnabled());
+  CPPUNIT_ASSERT_EQUAL(big_bytes - 1, cache.getStats().budget_bytes);
+
+  cache.put(1, 0, small_snapshot, cache.getEpoch());
+  cache.put(2, 0, small_snapshot, cache.getEpoch());
+
+  // a snapshot bigger than the budget is rejected without evicting the others
+  cache.put(3, 0, big_snapshot, cache.getEpoch());
+  ChatCacheStats stats = cache.getStats();
+  CPPUNIT_ASSERT_EQUAL(size_t(2), stats.entries);
+  CPPUNIT_ASSERT_EQUAL(2 * small_bytes, stats.bytes);
+  CPPUNIT_ASSERT_EQUAL(uint64_t(0), stats.evictions);
+  ASSERT_MSG(!cache.get(3), "Oversized snapshot cached!");
+
+  // a smaller budget evicts the least recently used entries
+  cache.get(1);
+  cache.setBudget(small_bytes);
+  stats = cache.getStats();
+  CPPUNIT_ASSERT_EQUAL(size_t(1), stats.entries);
+  CPPUNIT_ASSERT_EQUAL(small_bytes, stats.bytes);
+  CPPUNIT_ASSERT_EQUAL(uint64_t(1), stats.evictions);
+  ASSERT_MSG(cache.get(1) && !cache.get(2), "Wrong entry evicted by setBudget()!");
+
+  // budget 0 disables the cache
+  cache.setBudget(0);
+  CPPUNIT_ASSERT(!cache.isEnabled());
+  CPPUNIT_ASSERT_EQUAL(size_t(0), cache.getStats().entries);
+  CPPUNIT_ASSERT_EQUAL(size_t(0), cache.getStats().bytes);
+  cache.put(1, 0, small_snapshot, cache.getEpoch());
+  ASSERT_MSG(!cache.get(1), "Disabled cache stored a snapshot!");
+}
+
+void ChatCacheTest::test_epoch_race()
+{
+  ChatSnapshotPtr snapshot = createSnapshot(10);
+  ChatCache cache(numeric_limits<size_t>::max());
+
+  // the invalidation of a chat that isn't cached yet still drops a load that started before it
+  uint64_t epoch = cache.getEpoch();
+  cache.invalidate(1);
+  cache.put(1, 0, snapshot, epoch);
+  ASSERT_MSG(!cache.get(1), "Snapshot of an old epoch cached!");
+  CPPUNIT_ASSERT_EQUAL(uint64_t(0), cache.getStats().invalidations);
+
+  cache.put(1, 0, snapshot, cache.getEpoch());
+  ASSERT_MSG(cache.get(1) == snapshot, "Snapshot of the current epoch not cached!");
+
+  // the invalidation of another chat and clear() increase the epoch too
+  epoch = cache.getEpoch();
+  cache.invalidate(2);
+  cache.put(2, 0, snapshot, epoch);
+  ASSERT_MSG(!cache.get(2), "Snapshot cached after the invalidation of another chat!");
+
+  epoch = cache.getEpoch();
+  cache.clear();
+  CPPUNIT_ASSERT_EQUAL(size_t(0), cache.getStats().entries);
+  cache.put(1, 0, snapshot, epoch);
+  ASSERT_MSG(!cache.get(1), "Snapshot cached after clear()!");
+
+  cache.put(1, 0, snapshot, cache.getEpoch());
+  cache.invalidate(1);
+  ASSERT_MSG(!cache.get(1), "Invalidated entry still cached!");
+  CPPUNIT_ASSERT_EQUAL(uint64_t(1), cache.getStats().invalidations);
+}
+
+void ChatCacheTest::test_revalidate()
+{
+  fs::path base_path = fs::temp_directory_path() / "ChatCacheTest";
+  fs::remove_all(base_path);
+  fs::create_directories(base_path);
+  fs::path db_file = base_path / "chat.db";
+
+  {
+    ChatStorage storage(db_file, "");
+    vector<int64_t> chat_ids;
+    for (int i = 0; i < 3; i++)
+    {
+      unique_ptr<ChatContext> ctx = createSnapshot(10)->getContext().clone();
+      ctx->setChatName("chat " + to_string(i));
+      storage.save(*ctx);
+      chat_ids.push_back(ctx->getChat()->getDatabaseId());
+    }
+
+    SQLiteConnection sql_con(db_file);
+    ChatRepository chat_repo(sql_con);
+
+    ChatCache cache(numeric_limits<size_t>::max());
+    ChatSnapshotPtr snapshot = createSnapshot(10);
+    for (int64_t chat_id : chat_ids)
+    {
+      cache.put(chat_id, chat_repo.getGeneration(chat_id), snapshot, cache.getEpoch());
+    }
+
+    // chat 1 is changed and chat 2 deleted
+    chat_repo.bumpGeneration(chat_ids[1]);
+    CPPUNIT_ASSERT(storage.deleteChat(chat_ids[2]).deleted);
+
+    vector<int64_t> cached_chat_ids = cache.getChatIds();
+    CPPUNIT_ASSERT_EQUAL(size_t(3), cached_chat_ids.size());
+    unordered_map<int64_t, int64_t> generations = chat_repo.getGenerations(cached_chat_ids);
+    CPPUNIT_ASSERT_EQUAL(size_t(3), generations.size());
+    CPPUNIT_ASSERT_EQUAL(int64_t(-1), generations[chat_ids[2]]);
+    CPPUNIT_ASSERT(chat_repo.getGenerations({}).empty());
+
+    // an entry that was put after the generations were read isn't checked
+    const int64_t unknown_chat_id = 1000;
+    cache.put(unknown_chat_id, 0, snapshot, cache.getEpoch());
+
+    uint64_t epoch = cache.getEpoch();
+    cache.revalidate(generations);
+
+    ASSERT_MSG(cache.get(chat_ids[0]), "Unchanged chat dropped!");
+    ASSERT_MSG(!cache.get(chat_ids[1]), "Changed chat still cached!");
+    ASSERT_MSG(!cache.get(chat_ids[2]), "Deleted chat still cached!");
+    ASSERT_MSG(cache.get(unknown_chat_id), "Unchecked chat dropped!");
+    CPPUNIT_ASSERT_EQUAL(uint64_t(2), cache.getStats().invalidations);
+    ASSERT_MSG(cache.getEpoch() != epoch, "Epoch not increased by revalidate()!");
+  }
+
+  fs::remove_all(base_path);
+}
+
+void ChatCacheTest::test_external_change()
+{
+  fs::path base_path = fs::temp_directory_path() / "ChatCacheTest";
+  fs::remove_all(base_path);
+  fs::create_directories(base_path);
+  fs::path db_file = base_path / "chat.db";
+
+  {
+    ChatStorage storage(db_file, "");
+    unique_ptr<ChatContext> ctx = createSnapshot(10)->getContext().clone();
+    storage.save(*ctx);
+    int64_t chat_id = ctx->getChat()->getDatabaseId();
+
+    ChatSnapshotPtr snapshot = storage.loadSnapshotByChatId(chat_id);
+    ASSERT_MSG(storage.loadSnapshotByChatId(chat_id) == snapshot, "Snapshot not served from the cache!");
+
+    // a change of another connection isn't invalidated by save()
+    SQLiteConnection sql_con(db_file);
+    sql_con.exec("UPDATE chats SET name = 'external', generation = generation + 1 WHERE chat_id = "
+        + to_string(chat_id) + ";");
+
+    ChatSnapshotPtr changed_snapshot = storage.loadSnapshotByChatId(chat_id);
+    CPPUNIT_ASSERT_EQUAL(string("external"), changed_snapshot->getChat()->getName());
+    CPPUNIT_ASSERT_EQUAL(uint64_t(1), storage.getCacheStats().invalidations);
+  }
+
+  fs::remove_all(base_path);
+}
+
+ChatSnapshotPtr ChatCacheTest::createSnapshot(int64_t count)
+{
+  auto ctx = make_unique<ChatContext>();
+  ctx->setChat(make_unique<Chat>(Chat::RT_START_ID, Chat::DB_NO_ID, "chat", ChatSource::FormatA));
+  ctx->addUser(User(0, User::DB_NO_ID, "Anna", false));
+
+  for (int64_t i = 0; i < count; i++)
+  {
+    ctx->addMessage(Message(i, Message::DB_NO_ID, 0, Chat::DB_NO_ID, 0, User::DB_NO_ID, Message::MEDIA_NO_ID,
+        Media::DB_NO_ID, 100 + i, "text"));
+  }
+
+  return ChatSnapshot::create(std::move(ctx));
+}
+
+size_t ChatCacheTest::getEntryBytes(const ChatSnapshotPtr &snapshot)
+{
+  ChatCache cache(numeric_limits<size_t>::max());
+  cache.put(1, 0, snapshot, cache.getEpoch());
+  return cache.getStats().bytes;
+}
@@ -0,0 +1,66 @@
+#ifndef CHATCACHE_TEST_H
+#define CHATCACHE_TEST_H
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+// project
+#include "chatstorage/ChatSnapshot.h"
+
+// system
+#include <cstdint>
+
+class ChatCacheTest: public CPPUNIT_NS::TestFixture
+{
+CPPUNIT_TEST_SUITE(ChatCacheTest);
+
+  CPPUNIT_TEST(test_lru_eviction);
+  CPPUNIT_TEST(test_budget);
+  CPPUNIT_TEST(test_epoch_race);
+  CPPUNIT_TEST(test_revalidate);
+  CPPUNIT_TEST(test_external_change);
+
+  CPPUNIT_TEST_SUITE_END()
+  ;
+
+public:
+  void setUp();
+  void tearDown();
+
+protected:
+  /**
+   * A full cache evicts the least recently used entry, a get() makes an entry the most recently used one.
+   */
+  void test_lru_eviction();
+
+  /**
+   * setBudget() evicts down to the new budget, a budget of 0 disables the cache and a snapshot bigger than the
+   * budget isn't cached.
+   */
+  void test_budget();
+
+  /**
+   * A snapshot that was loaded before an invalidation isn't put into the cache.
+   */
+  void test_epoch_race();
+
+  /**
+   * revalidate() drops the entries of changed and deleted chats and keeps the entries of chats it hasn't read.
+   */
+  void test_revalidate();
+
+  /**
+   * A chat changed by another connection isn't served from the cache of a ChatStorage.
+   */
+  void test_external_change();
+
+private:
+  static ChatSnapshotPtr createSnapshot(int64_t count);
+
+  /**
+   * @return the bytes that the snapshot occupies in a cache
+   */
+  static size_t getEntryBytes(const ChatSnapshotPtr &snapshot);
+};
+
+#endif // CHATCACHE_TEST_H
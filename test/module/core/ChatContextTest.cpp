@@ -0,0 +1,350 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+// project
+#include "ChatContextTest.h"
+#include "database/ChatRepository.h"
+#include "database/SQLiteConnection.h"
+#include "../TestHelpers.h"
+
+// system
+#include <filesystem>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+CPPUNIT_TEST_SUITE_REGISTRATION(ChatContextTest);
+
+void ChatContextTest::setUp()
+{
+
+}
+
+void ChatContextTest::tearDown()
+{
+
+}
+
+void ChatContextTest::test_change_tracking()
+{
+  ChatStorage storage(":memory:", "");
+
+  unique_ptr<ChatContext> ctx = createContext(10);
+  ASSERT_MSG(ctx->hasChanges(), "A new context has no changes!");
+
+  SaveReport report = storage.save(*ctx);
+  ASSERT_MSG(report.committed, "Save of a new context failed!");
+  ASSERT_MSG(!ctx->hasChanges(), "Changes left after the save!");
+
+  ctx->setMessageText(3, "changed");
+  ASSERT_MSG(ctx->hasChanges(), "Changed message not tracked!");
+  storage.save(*ctx);
+  ASSERT_MSG(!ctx->hasChanges(), "Changes left after the second save!");
+
+  ctx->addMessage(Message(10, Message::DB_NO_ID, 0, Chat::DB_NO_ID, 1, User::DB_NO_ID, Message::MEDIA_NO_ID,
+      Media::DB_NO_ID, 1000, "appended"));
+  ASSERT_MSG(ctx->hasChanges(), "Appended message not tracked!");
+}
+
+void ChatContextTest::test_incremental_save()
+{
+  ChatStorage storage(":memory:", "");
+
+  unique_ptr<ChatContext> ctx = createContext(100);
+  storage.save(*ctx);
+  int64_t chat_id = ctx->getChat()->getDatabaseId();
+
+  unique_ptr<ChatContext> loaded_ctx = storage.loadByChatId(chat_id);
+  ASSERT_MSG(!loaded_ctx->hasChanges(), "A loaded context has changes!");
+
+  loaded_ctx->setMessageText(42, "edited");
+  loaded_ctx->setMessageTimestamp(43, 5);
+  loaded_ctx->setChatName("renamed");
+  loaded_ctx->setUserName(loaded_ctx->getUserList().front().getRuntimeId(), "Alice");
+  ASSERT_MSG(storage.save(*loaded_ctx).committed, "Save of the changes failed!");
+
+  unique_ptr<ChatContext> reloaded_ctx = storage.loadByChatId(chat_id);
+  const vector<Message> &messages = static_cast<const ChatContext&>(*reloaded_ctx).getMessageList();
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(100), messages.size());
+  CPPUNIT_ASSERT_EQUAL(string("edited"), messages[42].getText());
+  CPPUNIT_ASSERT_EQUAL(static_cast<int64_t>(5), messages[43].getTimestamp());
+  CPPUNIT_ASSERT_EQUAL(string("text 44"), messages[44].getText());
+  CPPUNIT_ASSERT_EQUAL(string("renamed"), reloaded_ctx->getChat()->getName());
+  CPPUNIT_ASSERT_EQUAL(string("Alice"), reloaded_ctx->getUserList().front().getName());
+}
+
+void ChatContextTest::test_chunked_save()
+{
+  ChatStorageConfig config;
+  config.chunkedSave.chunkMessages = 1000;
+  config.chunkedSave.savepointMessages = 100;
+  ChatStorage storage(":memory:", "", config);
+
+  unique_ptr<ChatContext> ctx = createContext(2500);
+  SaveReport report = storage.save(*ctx);
+  ASSERT_MSG(report.committed, "Chunked save failed!");
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(3), report.chunks);
+  ASSERT_MSG(storage.getInterruptedSaves().empty(), "Progress marker left after a complete save!");
+
+  unique_ptr<ChatContext> loaded_ctx = storage.loadByChatId(ctx->getChat()->getDatabaseId());
+  const vector<Message> &messages = static_cast<const ChatContext&>(*loaded_ctx).getMessageList();
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(2500), messages.size());
+  CPPUNIT_ASSERT_EQUAL(string("text 2499"), messages.back().getText());
+}
+
+void ChatContextTest::test_chunked_save_failure()
+{
+  fs::path base_path = fs::temp_directory_path() / "ChatContextTest";
+  fs::remove_all(base_path);
+  fs::create_directories(base_path);
+  fs::path db_file = base_path / "chat.db";
+
+  {
+    ChatStorageConfig config;
+    config.chunkedSave.chunkMessages = 1000;
+    config.chunkedSave.savepointMessages = 100;
+    ChatStorage storage(db_file, "", config);
+    SQLiteConnection sql_con(db_file);
+
+    sql_con.exec("CREATE TRIGGER insert_blocker BEFORE INSERT ON messages WHEN NEW.text = 'text 500' BEGIN "
+        "SELECT RAISE(ABORT, 'blocked'); END;");
+
+    // the failure is in the first chunk
+    unique_ptr<ChatContext> small_ctx = createContext(800);
+    ASSERT_MSG(!storage.save(*small_ctx).committed, "Save with a blocked message committed!");
+    ASSERT_MSG(storage.getInterruptedSaves().empty(), "Progress marker of a save that was rolled back!");
+    CPPUNIT_ASSERT_EQUAL(Chat::DB_NO_ID, small_ctx->getChat()->getDatabaseId());
+
+    // the failure is after the first chunk commit
+    sql_con.exec("DROP TRIGGER insert_blocker;");
+    sql_con.exec("CREATE TRIGGER insert_blocker BEFORE INSERT ON messages WHEN NEW.text = 'text 1500' BEGIN "
+        "SELECT RAISE(ABORT, 'blocked'); END;");
+    unique_ptr<ChatContext> big_ctx = createContext(2500);
+    ASSERT_MSG(!storage.save(*big_ctx).committed, "Save with a blocked message committed!");
+    ASSERT_MSG(big_ctx->hasChanges(), "The messages that weren't saved are lost!");
+
+    vector<InterruptedSave> interrupted_saves = storage.getInterruptedSaves();
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), interrupted_saves.size());
+    int64_t chat_id = big_ctx->getChat()->getDatabaseId();
+    CPPUNIT_ASSERT_EQUAL(chat_id, interrupted_saves.front().chat_id);
+    ASSERT_MSG(interrupted_saves.front().new_chat, "The chat of the save isn't marked as new!");
+    CPPUNIT_ASSERT_EQUAL(static_cast<int64_t>(1500), interrupted_saves.front().messages_saved);
+
+    unique_ptr<ChatContext> partial_ctx = storage.loadByChatId(chat_id);
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1500),
+        static_cast<const ChatContext&>(*partial_ctx).getMessageList().size());
+
+    ChatDeleteStats stats = storage.discardInterruptedSave(chat_id);
+    ASSERT_MSG(stats.deleted, "Partial chat not deleted!");
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1500), stats.messages);
+    ASSERT_MSG(storage.getInterruptedSaves().empty(), "Progress marker left after the discard!");
+
+    // without the blocker the rolled back save is complete
+    sql_con.exec("DROP TRIGGER insert_blocker;");
+    ASSERT_MSG(storage.save(*small_ctx).committed, "Save after the rollback failed!");
+    unique_ptr<ChatContext> loaded_ctx = storage.loadByChatId(small_ctx->getChat()->getDatabaseId());
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(800),
+        static_cast<const ChatContext&>(*loaded_ctx).getMessageList().size());
+  }
+
+  fs::remove_all(base_path);
+}
+
+void ChatContextTest::test_save_all()
+{
+  ChatStorage storage(":memory:", "");
+
+  vector<unique_ptr<ChatContext>> contexts;
+  vector<ChatContext*> context_ptrs;
+  for (int i = 0; i < 200; i++)
+  {
+    contexts.push_back(createContext(5));
+    context_ptrs.push_back(contexts.back().get());
+  }
+
+  SaveAllReport report = storage.saveAll(context_ptrs);
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(200), report.contexts.size());
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(200), report.getCommittedCount());
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), report.chunks);
+  CPPUNIT_ASSERT_EQUAL(contexts.front()->getChat()->getDatabaseId() + 199, contexts.back()->getChat()->getDatabaseId());
+
+  unique_ptr<ChatContext> loaded_ctx = storage.loadByChatId(contexts.back()->getChat()->getDatabaseId());
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(5), static_cast<const ChatContext&>(*loaded_ctx).getMessageList().size());
+  ASSERT_MSG(!contexts.front()->hasChanges(), "Changes left after saveAll()!");
+}
+
+void ChatContextTest::test_commit_failure()
+{
+  fs::path base_path = fs::temp_directory_path() / "ChatContextTest";
+  fs::remove_all(base_path);
+  fs::create_directories(base_path);
+  fs::path db_file = base_path / "chat.db";
+
+  {
+    ChatStorage storage(db_file, "");
+    SQLiteConnection sql_con(db_file);
+
+    // a deferred foreign key is checked by the COMMIT -> the save writes all rows and fails at the end
+    sql_con.exec("CREATE TABLE commit_blocker (chat_id INTEGER REFERENCES chats(chat_id) DEFERRABLE INITIALLY DEFERRED);");
+    sql_con.exec("CREATE TRIGGER commit_blocker_insert AFTER INSERT ON messages BEGIN "
+        "INSERT INTO commit_blocker VALUES (-1); END;");
+
+    unique_ptr<ChatContext> ctx = createContext(100);
+    ASSERT_MSG(!storage.save(*ctx).committed, "Save committed despite the violated foreign key!");
+    ASSERT_MSG(ctx->hasChanges(), "Changes lost by the rollback!");
+    CPPUNIT_ASSERT_EQUAL(Chat::DB_NO_ID, ctx->getChat()->getDatabaseId());
+    CPPUNIT_ASSERT_EQUAL(User::DB_NO_ID, ctx->getUserList().front().getDatabaseId());
+    CPPUNIT_ASSERT_EQUAL(Message::DB_NO_ID, ctx->getMessageList().front().getDatabaseId());
+
+    sql_con.exec("DROP TRIGGER commit_blocker_insert;");
+    ASSERT_MSG(storage.save(*ctx).committed, "Save after the rollback failed!");
+    ASSERT_MSG(!ctx->hasChanges(), "Changes left after the second save!");
+
+    unique_ptr<ChatContext> loaded_ctx = storage.loadByChatId(ctx->getChat()->getDatabaseId());
+    const vector<Message> &messages = static_cast<const ChatContext&>(*loaded_ctx).getMessageList();
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(100), messages.size());
+    CPPUNIT_ASSERT_EQUAL(string("text 99"), messages.back().getText());
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(2), loaded_ctx->getUserList().size());
+  }
+
+  fs::remove_all(base_path);
+}
+
+void ChatContextTest::test_save_async()
+{
+  fs::path base_path = fs::temp_directory_path() / "ChatContextTest";
+  fs::remove_all(base_path);
+  fs::create_directories(base_path);
+  fs::path db_file = base_path / "chat.db";
+
+  {
+    ChatStorageConfig config;
+    config.asyncSave.maxLatencyMs = 100;
+    ChatStorage storage(db_file, "", config);
+    SQLiteConnection sql_con(db_file);
+
+    sql_con.exec("CREATE TRIGGER insert_blocker BEFORE INSERT ON messages WHEN NEW.text = 'blocked' BEGIN "
+        "SELECT RAISE(ABORT, 'blocked'); END;");
+
+    vector<future<SaveReport>> reports;
+    for (int i = 0; i < 10; i++)
+    {
+      unique_ptr<ChatContext> ctx = createContext(5);
+      ctx->setChatName("chat " + to_string(i));
+      if (i == 4)
+      {
+        ctx->addMessage(Message(5, Message::DB_NO_ID, 0, Chat::DB_NO_ID, 1, User::DB_NO_ID, Message::MEDIA_NO_ID,
+            Media::DB_NO_ID, 1000, "blocked"));
+      }
+      reports.push_back(storage.saveAsync(std::move(ctx)));
+    }
+
+    for (int i = 0; i < 10; i++)
+    {
+      SaveReport report = reports[i].get();
+      ASSERT_MSG(report.committed == (i != 4), "Wrong commit state of save " + to_string(i) + "!");
+    }
+  }
+
+  {
+    // the storage reads the chat list on construction
+    ChatStorage storage(db_file, "");
+    vector<ChatEntry> chat_entries = storage.getChatEntryList();
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(9), chat_entries.size());
+    for (const auto &chat_entry : chat_entries)
+    {
+      ASSERT_MSG(chat_entry.name != "chat 4", "The failed context is stored!");
+      unique_ptr<ChatContext> loaded_ctx = storage.loadByChatEntry(chat_entry);
+      CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(5),
+          static_cast<const ChatContext&>(*loaded_ctx).getMessageList().size());
+    }
+  }
+
+  fs::remove_all(base_path);
+}
+
+void ChatContextTest::test_refresh()
+{
+  ChatStorage storage(":memory:", "");
+
+  unique_ptr<ChatContext> ctx = createContext(10);
+  storage.save(*ctx);
+  int64_t chat_id = ctx->getChat()->getDatabaseId();
+
+  unique_ptr<ChatContext> loaded_ctx = storage.loadByChatId(chat_id);
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(0), storage.refresh(*loaded_ctx));
+
+  unique_ptr<ChatContext> writer_ctx = storage.loadByChatId(chat_id);
+  for (int64_t i = 10; i < 13; i++)
+  {
+    writer_ctx->addMessage(Message(i, Message::DB_NO_ID, 0, Chat::DB_NO_ID, i % 2, User::DB_NO_ID,
+        Message::MEDIA_NO_ID, Media::DB_NO_ID, 100 + i, "text " + to_string(i)));
+  }
+  ASSERT_MSG(storage.save(*writer_ctx).committed, "Save of the new messages failed!");
+
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(3), storage.refresh(*loaded_ctx));
+  ASSERT_MSG(!loaded_ctx->hasChanges(), "Refreshed messages are pending for a save!");
+
+  const ChatContext &refreshed_ctx = *loaded_ctx;
+  const vector<Message> &messages = refreshed_ctx.getMessageList();
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(13), messages.size());
+  CPPUNIT_ASSERT_EQUAL(string("text 12"), messages.back().getText());
+  CPPUNIT_ASSERT_EQUAL(writer_ctx->getMessageList().back().getDatabaseId(), messages.back().getDatabaseId());
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(2), refreshed_ctx.getUserList().size());
+
+  // nothing new since the last refresh
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(0), storage.refresh(*loaded_ctx));
+}
+
+void ChatContextTest::test_lost_update()
+{
+  fs::path base_path = fs::temp_directory_path() / "ChatContextTest";
+  fs::remove_all(base_path);
+  fs::create_directories(base_path);
+  fs::path db_file = base_path / "chat.db";
+
+  {
+    ChatStorage storage(db_file, "");
+    SQLiteConnection sql_con(db_file);
+
+    unique_ptr<ChatContext> ctx = createContext(10);
+    storage.save(*ctx);
+    int64_t chat_id = ctx->getChat()->getDatabaseId();
+
+    unique_ptr<ChatContext> loaded_ctx = storage.loadByChatId(chat_id);
+    const User &user = loaded_ctx->getUserList().front();
+    loaded_ctx->setChatName("renamed");
+    loaded_ctx->setUserName(user.getRuntimeId(), "Alice");
+
+    // the user is removed in the meantime like by a deleteChat() of another chat
+    string user_id = to_string(user.getDatabaseId());
+    sql_con.exec("DELETE FROM messages WHERE sender_id = " + user_id + ";");
+    sql_con.exec("DELETE FROM users WHERE user_id = " + user_id + ";");
+
+    ASSERT_MSG(!storage.save(*loaded_ctx).committed, "Save of a removed user committed!");
+    ASSERT_MSG(loaded_ctx->hasChanges(), "Changes lost by the failed save!");
+
+    // the rename in front of the failed update is rolled back
+    ChatRepository chat_repo(sql_con);
+    CPPUNIT_ASSERT_EQUAL(string("chat"), chat_repo.getByChatId(chat_id).name);
+  }
+
+  fs::remove_all(base_path);
+}
+
+unique_ptr<ChatContext> ChatContextTest::createContext(int64_t count)
+{
+  auto ctx = make_unique<ChatContext>();
+  ctx->setChat(make_unique<Chat>(Chat::RT_START_ID, Chat::DB_NO_ID, "chat", ChatSource::FormatA));
+  ctx->addUser(User(0, User::DB_NO_ID, "Anna", false));
+  ctx->addUser(User(1, User::DB_NO_ID, "Tom", false));
+
+  for (int64_t i = 0; i < count; i++)
+  {
+    ctx->addMessage(Message(i, Message::DB_NO_ID, 0, Chat::DB_NO_ID, i % 2, User::DB_NO_ID, Message::MEDIA_NO_ID,
+        Media::DB_NO_ID, 100 + i, "text " + to_string(i)));
+  }
+
+  return ctx;
+}
@@ -0,0 +1,88 @@
+#ifndef CHATCONTEXT_TEST_H
+#define CHATCONTEXT_TEST_H
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+// project
+#include "chatstorage/ChatStorage.h"
+
+// system
+#include <memory>
+
+class ChatContextTest: public CPPUNIT_NS::TestFixture
+{
+CPPUNIT_TEST_SUITE(ChatContextTest);
+
+  CPPUNIT_TEST(test_change_tracking);
+  CPPUNIT_TEST(test_incremental_save);
+  CPPUNIT_TEST(test_chunked_save);
+  CPPUNIT_TEST(test_chunked_save_failure);
+  CPPUNIT_TEST(test_save_all);
+  CPPUNIT_TEST(test_save_async);
+  CPPUNIT_TEST(test_commit_failure);
+  CPPUNIT_TEST(test_refresh);
+  CPPUNIT_TEST(test_lost_update);
+
+  CPPUNIT_TEST_SUITE_END()
+  ;
+
+public:
+  void setUp();
+  void tearDown();
+
+protected:
+  /**
+   * Only new objects and changes by the setters are pending for a save.
+   */
+  void test_change_tracking();
+
+  /**
+   * Changes of a loaded chat are written by save() and seen by the next load.
+   */
+  void test_incremental_save();
+
+  /**
+   * A save with more messages than a chunk is committed in several transactions and leaves no progress marker.
+   */
+  void test_chunked_save();
+
+  /**
+   * A save that fails in its first chunk is rolled back completely. After a chunk commit the failure leaves the
+   * committed part with a progress marker, which discardInterruptedSave() removes together with the partial chat.
+   */
+  void test_chunked_save_failure();
+
+  /**
+   * Many contexts are stored in one transaction and each one gets its own chat.
+   */
+  void test_save_all();
+
+  /**
+   * The queued saves are committed in groups; a context that fails doesn't affect the others of its group.
+   */
+  void test_save_async();
+
+  /**
+   * A save whose commit fails leaves the context with all its changes, so saving it again stores the chat once.
+   */
+  void test_commit_failure();
+
+  /**
+   * A loaded context gets the messages that another context saved into its chat afterwards.
+   */
+  void test_refresh();
+
+  /**
+   * An update of a row that another writer removed fails the save, the context keeps its changes.
+   */
+  void test_lost_update();
+
+private:
+  /**
+   * A new chat with two users and count messages
+   */
+  std::unique_ptr<ChatContext> createContext(int64_t count);
+};
+
+#endif // CHATCONTEXT_TEST_H
@@ -0,0 +1,537 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+// project
+#include "ChatStorageTest.h"
+#include "database/PersistenceManager.h"
+#include "database/SQLiteConnection.h"
+#include "database/Statement.h"
+#include "../TestHelpers.h"
+
+// system
+#include <filesystem>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <future>
+#include <iterator>
+#include <map>
+#include <thread>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+CPPUNIT_TEST_SUITE_REGISTRATION(ChatStorageTest);
+
+void ChatStorageTest::setUp()
+{
+  mBasePath = fs::temp_directory_path() / "ChatStorageTest";
+  fs::remove_all(mBasePath);
+  mMediaPath = mBasePath / "media";
+  fs::create_directories(mMediaPath);
+  mDbFile = mBasePath / "chat.db";
+}
+
+void ChatStorageTest::tearDown()
+{
+  fs::remove_all(mBasePath);
+}
+
+void ChatStorageTest::test_content_dedup()
+{
+  ChatStorage storage(mDbFile, mMediaPath);
+  ImportConfig import_config;
+  import_config.chatName = "Family";
+
+  ImportResult family_result = storage.importFile(writeExport("family", { "same", "same", "other" }), import_config);
+  ASSERT_MSG(family_result.committed, "Import failed!");
+
+  unique_ptr<ChatContext> family_ctx = storage.loadByChatId(family_result.chat_id);
+  const vector<Message> &family_messages = static_cast<const ChatContext&>(*family_ctx).getMessageList();
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(3), family_messages.size());
+  CPPUNIT_ASSERT_EQUAL(family_messages[0].getMediaDatabaseId(), family_messages[1].getMediaDatabaseId());
+  ASSERT_MSG(family_messages[0].getMediaDatabaseId() != family_messages[2].getMediaDatabaseId(),
+      "Different content stored as one media!");
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(2), countMediaFiles());
+
+  import_config.chatName = "Friends";
+  ImportResult friends_result = storage.importFile(writeExport("friends", { "same" }), import_config);
+  ASSERT_MSG(friends_result.committed, "Import failed!");
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), friends_result.save.media.deduplicated);
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(2), countMediaFiles());
+
+  unique_ptr<ChatContext> friends_ctx = storage.loadByChatId(friends_result.chat_id);
+  CPPUNIT_ASSERT_EQUAL(family_messages[0].getMediaDatabaseId(),
+      static_cast<const ChatContext&>(*friends_ctx).getMessageList().front().getMediaDatabaseId());
+}
+
+void ChatStorageTest::test_deduplicate_media()
+{
+  ChatStorage storage(mDbFile, mMediaPath);
+  SQLiteConnection sql_con(mDbFile);
+  ImportConfig import_config;
+
+  // media from before content hashing
+  import_config.chatName = "Family";
+  ImportResult family_result = storage.importFile(writeExport("family", { "same" }), import_config);
+  sql_con.exec("UPDATE media SET content_hash = NULL;");
+  import_config.chatName = "Friends";
+  ImportResult friends_result = storage.importFile(writeExport("friends", { "same" }), import_config);
+  sql_con.exec("UPDATE media SET content_hash = NULL;");
+  ASSERT_MSG(family_result.committed && friends_result.committed, "Import failed!");
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(2), countMediaFiles());
+
+  MediaDedupStats stats = storage.deduplicateMedia();
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(2), stats.scanned);
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), stats.hashed);
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), stats.duplicates);
+  ASSERT_MSG(stats.bytes_freed > 0, "Duplicate file not removed!");
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), countMediaFiles());
+
+  unique_ptr<ChatContext> family_ctx = storage.loadByChatId(family_result.chat_id);
+  unique_ptr<ChatContext> friends_ctx = storage.loadByChatId(friends_result.chat_id);
+  CPPUNIT_ASSERT_EQUAL(static_cast<const ChatContext&>(*family_ctx).getMessageList().front().getMediaDatabaseId(),
+      static_cast<const ChatContext&>(*friends_ctx).getMessageList().front().getMediaDatabaseId());
+  ASSERT_MSG(!storage.resolveMediaPath(family_ctx->getMediaList().front()).empty(), "Kept media has no file!");
+
+  // all media are hashed now
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(0), storage.deduplicateMedia().scanned);
+}
+
+void ChatStorageTest::test_journal_resume()
+{
+  fs::path export_file = writeExport("family", { "content" });
+  fs::path source_file = export_file.parent_path() / "IMG-0.jpg";
+  fs::path media_file;
+  string journal_sql;
+
+  {
+    ChatStorage storage(mDbFile, mMediaPath);
+    SQLiteConnection sql_con(mDbFile);
+    ImportConfig import_config;
+
+    ImportResult result = storage.importFile(export_file, import_config);
+    ASSERT_MSG(result.committed, "Import failed!");
+    unique_ptr<ChatContext> ctx = storage.loadByChatId(result.chat_id);
+    Media media = ctx->getMediaList().front();
+    media_file = storage.resolveMediaPath(media);
+    ASSERT_MSG(fs::exists(media_file), "Media not stored!");
+
+    // a crash after the commit of the save and before its copy
+    journal_sql = "INSERT INTO media_journal (media_id, type, src, dst) VALUES ("
+        + to_string(media.getDatabaseId()) + ", 0, '" + fs::absolute(source_file).string() + "', '"
+        + fs::relative(media_file, mMediaPath).string() + "');";
+    fs::remove(media_file);
+    sql_con.exec(journal_sql);
+
+    MediaIngestStats stats = storage.resumeMediaJournal();
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), stats.actions);
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), stats.succeeded);
+    ASSERT_MSG(fs::exists(media_file), "Journaled copy not resumed!");
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(0), storage.resumeMediaJournal().actions);
+
+    fs::remove(media_file);
+    sql_con.exec(journal_sql);
+  }
+
+  ChatStorage storage(mDbFile, mMediaPath);
+  ASSERT_MSG(fs::exists(media_file), "Journaled copy not resumed on open!");
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(0), storage.resumeMediaJournal().actions);
+}
+
+void ChatStorageTest::test_delete_chat()
+{
+  ChatStorage storage(mDbFile, mMediaPath);
+  ImportConfig import_config;
+
+  import_config.chatName = "Family";
+  ImportResult family_result = storage.importFile(writeExport("family", { "same", "other" }), import_config);
+  import_config.chatName = "Friends";
+  ImportResult friends_result = storage.importFile(writeExport("friends", { "same" }), import_config);
+  ASSERT_MSG(family_result.committed && friends_result.committed, "Import failed!");
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(2), countMediaFiles());
+
+  ChatDeleteStats stats = storage.deleteChat(family_result.chat_id);
+  ASSERT_MSG(stats.deleted, "Chat not deleted!");
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(2), stats.messages);
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), stats.media);
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), stats.media_files.deleted);
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), countMediaFiles());
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), stats.users);
+
+  vector<ChatEntry> chat_entries = storage.getChatEntryList();
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), chat_entries.size());
+  CPPUNIT_ASSERT_EQUAL(friends_result.chat_id, chat_entries.front().database_id);
+
+  unique_ptr<ChatContext> friends_ctx = storage.loadByChatId(friends_result.chat_id);
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), static_cast<const ChatContext&>(*friends_ctx).getMessageList().size());
+  ASSERT_MSG(fs::exists(storage.resolveMediaPath(friends_ctx->getMediaList().front())), "Shared media removed!");
+
+  ASSERT_MSG(!storage.deleteChat(family_result.chat_id).deleted, "Missing chat deleted again!");
+}
+
+void ChatStorageTest::test_save_during_delete()
+{
+  const int64_t message_count = 20 * static_cast<int64_t>(PersistenceManager::DELETE_BATCH_SIZE);
+
+  ChatStorage storage(mDbFile, mMediaPath);
+  SQLiteConnection sql_con(mDbFile);
+
+  unique_ptr<ChatContext> big_ctx = createContext("big", message_count);
+  ASSERT_MSG(storage.save(*big_ctx).committed, "Save of the big chat failed!");
+  int64_t big_chat_id = big_ctx->getChat()->getDatabaseId();
+
+  future<ChatDeleteStats> delete_result = async(launch::async, [&storage, big_chat_id]()
+  {
+    return storage.deleteChat(big_chat_id);
+  });
+
+  // wait for the first committed batch
+  Statement count_stmt(sql_con, "SELECT COUNT(*) FROM messages WHERE chat_id = " + to_string(big_chat_id));
+  int64_t messages_left = message_count;
+  while (messages_left == message_count)
+  {
+    this_thread::sleep_for(chrono::milliseconds(1));
+    count_stmt.reset();
+    count_stmt.step();
+    messages_left = count_stmt.getInt64(0);
+  }
+
+  unique_ptr<ChatContext> small_ctx = createContext("small", 10);
+  ASSERT_MSG(storage.save(*small_ctx).committed, "Save during the delete failed!");
+
+  count_stmt.reset();
+  count_stmt.step();
+  ASSERT_MSG(count_stmt.getInt64(0) > 0, "The save waited for the complete delete!");
+
+  ChatDeleteStats stats = delete_result.get();
+  ASSERT_MSG(stats.deleted, "Chat not deleted!");
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(message_count), stats.messages);
+
+  vector<ChatEntry> chat_entries = storage.getChatEntryList();
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), chat_entries.size());
+  CPPUNIT_ASSERT_EQUAL(string("small"), chat_entries.front().name);
+}
+
+void ChatStorageTest::test_media_insert_failure()
+{
+  ChatStorage storage(mDbFile, mMediaPath);
+  SQLiteConnection sql_con(mDbFile);
+  ImportConfig import_config;
+
+  import_config.chatName = "Family";
+  ImportResult family_result = storage.importFile(writeExport("family", { "first" }), import_config);
+  ASSERT_MSG(family_result.committed, "Import failed!");
+  unique_ptr<ChatContext> family_ctx = storage.loadByChatId(family_result.chat_id);
+  fs::path media_file = storage.resolveMediaPath(family_ctx->getMediaList().front());
+
+  sql_con.exec("CREATE TRIGGER media_blocker BEFORE INSERT ON media BEGIN SELECT RAISE(ABORT, 'blocked'); END;");
+  import_config.chatName = "Friends";
+  ImportResult friends_result = storage.importFile(writeExport("friends", { "second" }), import_config);
+  ASSERT_MSG(!friends_result.committed, "Save with a blocked media committed!");
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(0), friends_result.save.media.actions);
+
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), countMediaFiles());
+  CPPUNIT_ASSERT_EQUAL(string("\xFF\xD8\xFF" "first"), readFile(media_file));
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), storage.getChatEntryList().size());
+}
+
+void ChatStorageTest::test_media_gc_flat()
+{
+  checkMediaGc(MediaLayout::Flat);
+}
+
+void ChatStorageTest::test_media_gc_sharded()
+{
+  checkMediaGc(MediaLayout::Sharded);
+}
+
+void ChatStorageTest::checkMediaGc(MediaLayout layout)
+{
+  ChatStorageConfig storage_config;
+  storage_config.mediaLayout = layout;
+  ChatStorage storage(mDbFile, mMediaPath, storage_config);
+  ImportConfig import_config;
+
+  ImportResult result = storage.importFile(writeExport("family", { "kept", "missing" }), import_config);
+  ASSERT_MSG(result.committed, "Import failed!");
+  unique_ptr<ChatContext> ctx = storage.loadByChatId(result.chat_id);
+  vector<Media> media_list = ctx->getMediaList();
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(2), media_list.size());
+  fs::path kept_file = storage.resolveMediaPath(media_list[0]);
+  fs::path missing_file = storage.resolveMediaPath(media_list[1]);
+  fs::remove(missing_file);
+
+  // the files are placed beside a stored one, so they are in a directory of the layout
+  fs::path dir = kept_file.parent_path();
+  auto write_file = [](const fs::path &path, bool old)
+  {
+    ofstream(path) << "garbage";
+    if (old)
+    {
+      fs::last_write_time(path, fs::file_time_type::clock::now() - chrono::hours(2));
+    }
+  };
+  write_file(dir / "999.jpeg", true);
+  write_file(dir / "998.jpeg", false);
+  write_file(dir / "997.jpeg.tmp", true);
+  write_file(dir / "12345678901234567890123.jpeg", true);
+  write_file(dir / "notes.txt", true);
+  write_file(dir / "12ab.jpeg", true);
+
+  MediaGcConfig gc_config;
+  MediaGcStats dry_stats = storage.collectMediaGarbage(gc_config);
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(4), dry_stats.files_scanned);
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(2), dry_stats.rows_scanned);
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(3), dry_stats.orphan_files);
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), dry_stats.recent_files);
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(0), dry_stats.deleted_files);
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), dry_stats.missing_files);
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), dry_stats.missing_media_ids.size());
+  CPPUNIT_ASSERT_EQUAL(media_list[1].getDatabaseId(), dry_stats.missing_media_ids.front());
+  ASSERT_MSG(fs::exists(dir / "999.jpeg") && fs::exists(dir / "997.jpeg.tmp"), "Dry run deleted a file!");
+
+  gc_config.dryRun = false;
+  MediaGcStats stats = storage.collectMediaGarbage(gc_config);
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(2), stats.deleted_files);
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), stats.missing_files);
+  ASSERT_MSG(!fs::exists(dir / "999.jpeg"), "Old orphan not deleted!");
+  ASSERT_MSG(!fs::exists(dir / "997.jpeg.tmp"), "Old temporary file not deleted!");
+  ASSERT_MSG(fs::exists(dir / "998.jpeg"), "Orphan inside the grace period deleted!");
+  ASSERT_MSG(fs::exists(dir / "12345678901234567890123.jpeg") && fs::exists(dir / "notes.txt")
+      && fs::exists(dir / "12ab.jpeg"), "File without media ID name deleted!");
+  ASSERT_MSG(fs::exists(kept_file), "Media file deleted!");
+
+  // the row without file stays
+  unique_ptr<ChatContext> reloaded_ctx = storage.loadByChatId(result.chat_id);
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(2), reloaded_ctx->getMediaList().size());
+}
+
+void ChatStorageTest::test_media_layout_migration()
+{
+  const size_t media_count = 6;
+  vector<string> media_contents;
+  for (size_t i = 0; i < media_count; i++)
+  {
+    media_contents.push_back("media " + to_string(i));
+  }
+
+  vector<int64_t> media_ids;
+  {
+    ChatStorageConfig storage_config;
+    storage_config.mediaLayout = MediaLayout::Flat;
+    ChatStorage storage(mDbFile, mMediaPath, storage_config);
+    ImportConfig import_config;
+
+    ImportResult result = storage.importFile(writeExport("family", media_contents), import_config);
+    ASSERT_MSG(result.committed, "Import failed!");
+    unique_ptr<ChatContext> ctx = storage.loadByChatId(result.chat_id);
+    for (const Message &message : static_cast<const ChatContext&>(*ctx).getMessageList())
+    {
+      media_ids.push_back(message.getMediaDatabaseId());
+    }
+  }
+  CPPUNIT_ASSERT_EQUAL(media_count, media_ids.size());
+
+  // the state of a migration that was interrupted after the switch and half of the files
+  {
+    SQLiteConnection sql_con(mDbFile);
+    sql_con.exec("UPDATE storage_meta SET value = 'sharded' WHERE key = 'media_layout';");
+  }
+  for (size_t i = 0; i < media_count / 2; i++)
+  {
+    char level1[3];
+    char level2[3];
+    snprintf(level1, sizeof(level1), "%02x", static_cast<unsigned>(media_ids[i] & 0xFF));
+    snprintf(level2, sizeof(level2), "%02x", static_cast<unsigned>((media_ids[i] >> 8) & 0xFF));
+    string file_name = to_string(media_ids[i]) + ".jpeg";
+    fs::create_directories(mMediaPath / level1 / level2);
+    fs::rename(mMediaPath / file_name, mMediaPath / level1 / level2 / file_name);
+  }
+
+  ChatStorage storage(mDbFile, mMediaPath);
+  CPPUNIT_ASSERT_EQUAL(static_cast<int>(MediaLayout::Sharded), static_cast<int>(storage.getMediaLayout()));
+
+  // depth 0: flat, 2: sharded, -1: not found
+  auto check_files = [&](int depth)
+  {
+    for (size_t i = 0; i < media_count; i++)
+    {
+      fs::path path = storage.resolveMediaPath(media_ids[i]);
+      ASSERT_MSG(fs::exists(path), "Media " << media_ids[i] << " not found at " << path);
+      CPPUNIT_ASSERT_EQUAL("\xFF\xD8\xFF" + media_contents[i], readFile(path));
+      fs::path relative_path = fs::relative(path, mMediaPath);
+      if (depth >= 0)
+      {
+        CPPUNIT_ASSERT_EQUAL(static_cast<ptrdiff_t>(depth + 1), distance(relative_path.begin(), relative_path.end()));
+      }
+    }
+  };
+  check_files(-1);
+
+  MediaLayoutMigrationStats sharded_stats = storage.migrateMediaLayout(MediaLayout::Sharded);
+  CPPUNIT_ASSERT_EQUAL(media_count, sharded_stats.files);
+  CPPUNIT_ASSERT_EQUAL(media_count / 2, sharded_stats.moved);
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(0), sharded_stats.missing);
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(0), sharded_stats.failed);
+  check_files(2);
+
+  MediaLayoutMigrationStats flat_stats = storage.migrateMediaLayout(MediaLayout::Flat);
+  CPPUNIT_ASSERT_EQUAL(media_count, flat_stats.moved);
+  CPPUNIT_ASSERT_EQUAL(static_cast<int>(MediaLayout::Flat), static_cast<int>(storage.getMediaLayout()));
+  check_files(0);
+
+  for (const auto &entry : fs::directory_iterator(mMediaPath))
+  {
+    ASSERT_MSG(!entry.is_directory(), "Fan-out directory left: " << entry.path());
+  }
+}
+
+void ChatStorageTest::test_media_packs()
+{
+  ChatStorageConfig storage_config;
+  storage_config.mediaIngest.pack.enabled = true;
+  storage_config.mediaIngest.pack.segmentSize = 40;
+  ChatStorage storage(mDbFile, mMediaPath, storage_config);
+  ImportConfig import_config;
+
+  // three chats with 16 bytes of media each fill the first segment, the fourth starts the second one
+  const vector<string> chat_names = { "family", "friends", "work", "sports" };
+  map<int64_t, string> media_contents;
+  vector<int64_t> chat_ids;
+  for (size_t chat_index = 0; chat_index < chat_names.size(); chat_index++)
+  {
+    vector<string> contents = { chat_names[chat_index].substr(0, 3) + "-a", chat_names[chat_index].substr(0, 3) + "-b" };
+    import_config.chatName = chat_names[chat_index];
+    ImportResult result = storage.importFile(writeExport(chat_names[chat_index], contents), import_config);
+    ASSERT_MSG(result.committed, "Import of " << chat_names[chat_index] << " failed!");
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(2), result.save.media.packed);
+    chat_ids.push_back(result.chat_id);
+
+    unique_ptr<ChatContext> ctx = storage.loadByChatId(result.chat_id);
+    const vector<Message> &messages = static_cast<const ChatContext&>(*ctx).getMessageList();
+    for (size_t i = 0; i < messages.size(); i++)
+    {
+      media_contents[messages[i].getMediaDatabaseId()] = "\xFF\xD8\xFF" + contents[i];
+      ASSERT_MSG(storage.resolveMediaPath(messages[i].getMediaDatabaseId()).empty(), "Packed media has a file!");
+    }
+  }
+
+  fs::path pack_dir = mMediaPath / "packs";
+  vector<fs::path> segment_files;
+  for (const auto &entry : fs::directory_iterator(pack_dir))
+  {
+    if (entry.is_regular_file() && entry.path().filename().string().front() != '.')
+    {
+      segment_files.push_back(entry.path());
+    }
+  }
+  sort(segment_files.begin(), segment_files.end());
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(2), segment_files.size());
+  CPPUNIT_ASSERT_EQUAL(static_cast<uintmax_t>(48), fs::file_size(segment_files[0]));
+  CPPUNIT_ASSERT_EQUAL(static_cast<uintmax_t>(16), fs::file_size(segment_files[1]));
+
+  auto check_media = [&]()
+  {
+    for (const auto &media_content : media_contents)
+    {
+      MediaHandlePtr handle = storage.openMedia(media_content.first);
+      ASSERT_MSG(handle, "Packed media " << media_content.first << " not readable!");
+      CPPUNIT_ASSERT_EQUAL(media_content.second,
+          string(reinterpret_cast<const char*>(handle->data()), handle->size()));
+    }
+  };
+  check_media();
+
+  // a third of the first segment is garbage
+  ASSERT_MSG(storage.deleteChat(chat_ids[1]).deleted, "Chat not deleted!");
+  for (auto it = media_contents.begin(); it != media_contents.end();)
+  {
+    if (it->second.find("fri") != string::npos)
+    {
+      ASSERT_MSG(!storage.openMedia(it->first), "Deleted media still readable!");
+      it = media_contents.erase(it);
+    }
+    else
+    {
+      ++it;
+    }
+  }
+
+  // the segments are recently written -> not compacted, a writer may not yet have committed its index
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(0), storage.compactMediaPacks(0.3).compacted);
+  for (const auto &segment_file : segment_files)
+  {
+    fs::last_write_time(segment_file, fs::file_time_type::clock::now() - chrono::hours(1));
+  }
+
+  // below the garbage ratio
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(0), storage.compactMediaPacks(0.5).compacted);
+
+  MediaPackCompactionStats stats = storage.compactMediaPacks(0.3);
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), stats.segments);
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), stats.compacted);
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), stats.removed);
+  CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(32), stats.bytes_moved);
+  CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(16), stats.bytes_freed);
+  ASSERT_MSG(!fs::exists(segment_files[0]), "Compacted segment not removed!");
+  CPPUNIT_ASSERT_EQUAL(static_cast<uintmax_t>(48), fs::file_size(segment_files[1]));
+  check_media();
+}
+
+fs::path ChatStorageTest::writeExport(const string &name, const vector<string> &media_contents)
+{
+  fs::path export_path = mBasePath / name;
+  fs::create_directories(export_path);
+
+  fs::path chat_file = export_path / "chat.txt";
+  ofstream chat(chat_file);
+  for (size_t i = 0; i < media_contents.size(); i++)
+  {
+    string file_name = "IMG-" + to_string(i) + ".jpg";
+    ofstream media(export_path / file_name, ios::binary);
+    media << "\xFF\xD8\xFF" << media_contents[i];
+
+    // there is an often used invisible unicode character between ':' and 'IMG'
+    chat << "27.10.23, 22:5" << i << " - Tom: \xE2\x80\x8E" << file_name << " (file attached)\n";
+  }
+
+  return chat_file;
+}
+
+unique_ptr<ChatContext> ChatStorageTest::createContext(const string &name, int64_t count)
+{
+  auto ctx = make_unique<ChatContext>();
+  ctx->setChat(make_unique<Chat>(Chat::RT_START_ID, Chat::DB_NO_ID, name, ChatSource::FormatA));
+  ctx->addUser(User(0, User::DB_NO_ID, "Anna", false));
+
+  for (int64_t i = 0; i < count; i++)
+  {
+    ctx->addMessage(Message(i, Message::DB_NO_ID, 0, Chat::DB_NO_ID, 0, User::DB_NO_ID, Message::MEDIA_NO_ID,
+        Media::DB_NO_ID, 100 + i, "text " + to_string(i)));
+  }
+
+  return ctx;
+}
+
+string ChatStorageTest::readFile(const fs::path &path)
+{
+  ifstream file(path, ios::binary);
+  return string((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+}
+
+size_t ChatStorageTest::countMediaFiles()
+{
+  size_t count = 0;
+  for (const auto &entry : fs::recursive_directory_iterator(mMediaPath))
+  {
+    // without the hidden lock and temporary files
+    if (entry.is_regular_file() && entry.path().filename().string().front() != '.')
+    {
+      count++;
+    }
+  }
+  return count;
+}
@@ -0,0 +1,117 @@
+#ifndef CHATSTORAGE_TEST_H
+#define CHATSTORAGE_TEST_H
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+// project
+#include "chatstorage/ChatStorage.h"
+
+// system
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+class ChatStorageTest: public CPPUNIT_NS::TestFixture
+{
+CPPUNIT_TEST_SUITE(ChatStorageTest);
+
+  CPPUNIT_TEST(test_content_dedup);
+  CPPUNIT_TEST(test_deduplicate_media);
+  CPPUNIT_TEST(test_journal_resume);
+  CPPUNIT_TEST(test_delete_chat);
+  CPPUNIT_TEST(test_save_during_delete);
+  CPPUNIT_TEST(test_media_insert_failure);
+  CPPUNIT_TEST(test_media_gc_flat);
+  CPPUNIT_TEST(test_media_gc_sharded);
+  CPPUNIT_TEST(test_media_layout_migration);
+  CPPUNIT_TEST(test_media_packs);
+
+  CPPUNIT_TEST_SUITE_END()
+  ;
+
+public:
+  void setUp();
+  void tearDown();
+
+protected:
+  /**
+   * Attachments with the same content share one media row and file, within a chat and across chats.
+   */
+  void test_content_dedup();
+
+  /**
+   * Media stored without content hash are hashed and the duplicates are merged into the oldest media.
+   */
+  void test_deduplicate_media();
+
+  /**
+   * The file copies that a save left in the media journal are executed by resumeMediaJournal() and by the next open.
+   */
+  void test_journal_resume();
+
+  /**
+   * A deleted chat takes its messages and the media only it references along, a media of another chat stays.
+   */
+  void test_delete_chat();
+
+  /**
+   * A save isn't blocked until a large delete is finished, the write lock is released between its batches.
+   */
+  void test_save_during_delete();
+
+  /**
+   * A media row that can't be inserted fails the save without a file operation, so no stored file is overwritten.
+   */
+  void test_media_insert_failure();
+
+  /**
+   * The media GC matches the files of a layout against the media rows: old orphans and temporary files are deleted
+   * (not in a dry run), young ones are kept, names that aren't media IDs are ignored and a row without file is only
+   * reported.
+   */
+  void test_media_gc_flat();
+  void test_media_gc_sharded();
+
+  /**
+   * An interrupted Flat -> Sharded migration with half of the files moved: all files are found and a new migration
+   * moves the rest. Migrating back to Flat moves all files and removes the fan-out directories.
+   */
+  void test_media_layout_migration();
+
+  /**
+   * Small media are appended to pack segments and read back with openMedia(); a full segment is continued in a new
+   * one. The compaction moves the live media of a segment with deleted ones into the active segment and removes it.
+   */
+  void test_media_packs();
+
+private:
+  /**
+   * Writes an export with one attachment per content into its own directory.
+   *
+   * @return the chat file
+   */
+  std::filesystem::path writeExport(const std::string &name, const std::vector<std::string> &media_contents);
+
+  void checkMediaGc(MediaLayout layout);
+
+  static std::string readFile(const std::filesystem::path &path);
+
+  /**
+   * The number of stored media files
+   */
+  size_t countMediaFiles();
+
+  /**
+   * A new chat with one user and count messages
+   */
+  std::unique_ptr<ChatContext> createContext(const std::string &name, int64_t count);
+
+  // a fresh directory for each test
+  std::filesystem::path mBasePath;
+  std::filesystem::path mDbFile;
+  std::filesystem::path mMediaPath;
+};
+
+#endif // CHATSTORAGE_TEST_H
@@ -0,0 +1,208 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+// project
+#include "ExecutorTest.h"
+#include "../TestHelpers.h"
+#include "common/ParallelFor.h"
+
+// system
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+CPPUNIT_TEST_SUITE_REGISTRATION(ExecutorTest);
+
+void ExecutorTest::setUp()
+{
+
+}
+
+void ExecutorTest::tearDown()
+{
+
+}
+
+void ExecutorTest::test_task_group()
+{
+  Executor executor(4);
+  CPPUNIT_ASSERT_EQUAL(4u, executor.getThreadCount());
+
+  atomic<int> sum { 0 };
+  Executor::TaskGroup task_group(executor);
+  for (int i = 1; i <= 1000; i++)
+  {
+    task_group.run([&sum, i]()
+    {
+      sum += i;
+    });
+  }
+  task_group.wait();
+  CPPUNIT_ASSERT_EQUAL(500500, sum.load());
+
+  vector<int> values(10000, 0);
+  parallelFor(&executor, values.size(), 8, [&values](size_t index)
+  {
+    values[index] = static_cast<int>(index);
+  });
+  for (size_t i = 0; i < values.size(); i++)
+  {
+    ASSERT_MSG(values[i] == static_cast<int>(i), "parallelFor missed an index!");
+  }
+}
+
+void ExecutorTest::test_nested_wait()
+{
+  Executor executor(2);
+
+  atomic<int> count { 0 };
+  Executor::TaskGroup outer_group(executor);
+  for (int i = 0; i < 8; i++)
+  {
+    outer_group.run([&executor, &count]()
+    {
+      Executor::TaskGroup inner_group(executor);
+      for (int j = 0; j < 8; j++)
+      {
+        inner_group.run([&count]()
+        {
+          count++;
+        });
+      }
+      inner_group.wait();
+    });
+  }
+  outer_group.wait();
+
+  CPPUNIT_ASSERT_EQUAL(64, count.load());
+}
+
+void ExecutorTest::test_exception_cancels()
+{
+  Executor executor(1);
+
+  Executor::TaskGroup task_group(executor);
+  task_group.run([]()
+  {
+    throw runtime_error("failed");
+  });
+
+  bool thrown = false;
+  try
+  {
+    task_group.wait();
+  }
+  catch (const runtime_error&)
+  {
+    thrown = true;
+  }
+  ASSERT_MSG(thrown, "The exception of a task wasn't thrown by wait()!");
+  ASSERT_MSG(task_group.isCancelled(), "The group wasn't cancelled by the exception!");
+
+  atomic<int> count { 0 };
+  for (int i = 0; i < 100; i++)
+  {
+    task_group.run([&count]()
+    {
+      count++;
+    });
+  }
+  task_group.wait();
+  CPPUNIT_ASSERT_EQUAL(0, count.load());
+}
+
+void ExecutorTest::test_foreign_wait()
+{
+  Executor executor(1);
+
+  // keeps the only worker busy
+  atomic<bool> started { false };
+  atomic<bool> release { false };
+  Executor::TaskGroup blocking_group(executor);
+  blocking_group.run([&started, &release]()
+  {
+    started = true;
+    while (!release)
+    {
+      this_thread::yield();
+    }
+  });
+  while (!started)
+  {
+    this_thread::yield();
+  }
+
+  atomic<bool> other_done { false };
+  Executor::TaskGroup other_group(executor);
+  other_group.run([&other_done]()
+  {
+    other_done = true;
+  });
+
+  atomic<bool> own_done { false };
+  Executor::TaskGroup own_group(executor);
+  own_group.run([&own_done]()
+  {
+    own_done = true;
+  });
+  own_group.wait();
+
+  ASSERT_MSG(own_done, "The task of the group isn't finished!");
+  ASSERT_MSG(!other_done, "The waiting thread ran a task of another group!");
+
+  release = true;
+  blocking_group.wait();
+  other_group.wait();
+  ASSERT_MSG(other_done, "The task of the other group isn't finished!");
+
+  // a wakeup for a task of another group has to reach an idle worker and not the sleeping foreign waiter
+  Executor pool(2);
+  atomic<bool> waiting_started { false };
+  atomic<bool> waiting_release { false };
+  Executor::TaskGroup waiting_group(pool);
+  waiting_group.run([&waiting_started, &waiting_release]()
+  {
+    waiting_started = true;
+    while (!waiting_release)
+    {
+      this_thread::yield();
+    }
+  });
+  while (!waiting_started)
+  {
+    this_thread::yield();
+  }
+  thread waiter([&waiting_group]()
+  {
+    waiting_group.wait();
+  });
+  this_thread::sleep_for(chrono::milliseconds(50));
+
+  size_t tasks_run = 0;
+  for (int i = 0; i < 20; i++)
+  {
+    // polled instead of wait(), which would run the task on this thread
+    atomic<bool> done { false };
+    Executor::TaskGroup group(pool);
+    group.run([&done]()
+    {
+      done = true;
+    });
+    auto deadline = chrono::steady_clock::now() + chrono::seconds(2);
+    while (!done && chrono::steady_clock::now() < deadline)
+    {
+      this_thread::yield();
+    }
+    tasks_run += done ? 1 : 0;
+    group.wait();
+  }
+
+  waiting_release = true;
+  waiter.join();
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(20), tasks_run);
+}
@@ -0,0 +1,45 @@
+#ifndef EXECUTOR_TEST_H
+#define EXECUTOR_TEST_H
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+// project
+#include "chatstorage/Executor.h"
+
+class ExecutorTest: public CPPUNIT_NS::TestFixture
+{
+CPPUNIT_TEST_SUITE(ExecutorTest);
+
+  CPPUNIT_TEST(test_task_group);
+  CPPUNIT_TEST(test_nested_wait);
+  CPPUNIT_TEST(test_exception_cancels);
+  CPPUNIT_TEST(test_foreign_wait);
+
+  CPPUNIT_TEST_SUITE_END()
+  ;
+
+public:
+  void setUp();
+  void tearDown();
+
+protected:
+  void test_task_group();
+
+  /**
+   * Tasks that wait for their own subtasks must not block a pool with fewer workers than waiting tasks.
+   */
+  void test_nested_wait();
+
+  /**
+   * The first exception is thrown by wait() and the tasks of the cancelled group are skipped.
+   */
+  void test_exception_cancels();
+
+  /**
+   * A thread outside of the pool only runs the tasks of the group it waits for, never the tasks of other groups.
+   */
+  void test_foreign_wait();
+};
+
+#endif // EXECUTOR_TEST_H
@@ -0,0 +1,111 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+// project
+#include "MessageIndexTest.h"
+#include "core/PostingList.h"
+#include "../TestHelpers.h"
+
+// system
+
+using namespace std;
+
+CPPUNIT_TEST_SUITE_REGISTRATION(MessageIndexTest);
+
+void MessageIndexTest::setUp()
+{
+
+}
+
+void MessageIndexTest::tearDown()
+{
+
+}
+
+void MessageIndexTest::test_posting_list_seek()
+{
+  PostingList posting_list;
+  for (uint32_t ordinal = 0; ordinal < 10000; ordinal += 7)
+  {
+    posting_list.append(ordinal);
+  }
+
+  PostingList::Cursor cursor = posting_list.cursor();
+  cursor.seek(500);
+  ASSERT_MSG(cursor.valid(), "Cursor invalid after seek!");
+  CPPUNIT_ASSERT_EQUAL(static_cast<uint32_t>(504), cursor.value());
+
+  cursor.seek(9000);
+  CPPUNIT_ASSERT_EQUAL(static_cast<uint32_t>(9002), cursor.value());
+
+  cursor.seek(20000);
+  ASSERT_MSG(!cursor.valid(), "Cursor valid behind the last entry!");
+
+  vector<uint32_t> decoded = posting_list.decode();
+  CPPUNIT_ASSERT_EQUAL(posting_list.size(), decoded.size());
+  CPPUNIT_ASSERT_EQUAL(static_cast<uint32_t>(9996), decoded.back());
+}
+
+void MessageIndexTest::test_filter_sender()
+{
+  ChatContext ctx;
+  fillContext(ctx, 1000);
+
+  MessageFilter filter;
+  filter.sender_runtime_id = 1;
+  vector<size_t> result = ctx.findMessages(filter);
+
+  ASSERT_EQUAL_MSG(result.size(), 333u, "Wrong number of messages for sender 1!");
+  for (size_t ordinal : result)
+  {
+    CPPUNIT_ASSERT_EQUAL(static_cast<int64_t>(1), ctx.getMessageList()[ordinal].getSenderRuntimeId());
+  }
+
+  filter.sender_runtime_id = 42;
+  ASSERT_MSG(ctx.findMessages(filter).empty(), "Unknown sender found messages!");
+}
+
+void MessageIndexTest::test_filter_sender_time_media()
+{
+  ChatContext ctx;
+  fillContext(ctx, 1000);
+
+  MessageFilter filter;
+  filter.sender_runtime_id = 0;
+  filter.from_timestamp = 100 + 200;
+  filter.to_timestamp = 100 + 400;
+  filter.has_media = true;
+  vector<size_t> result = ctx.findMessages(filter);
+
+  // sender 0 and media means index is a multiple of 30
+  vector<size_t> expected = {210, 240, 270, 300, 330, 360, 390};
+  ASSERT_MSG(result == expected, "Intersection of sender, time and media is wrong!");
+}
+
+void MessageIndexTest::test_incremental_add()
+{
+  ChatContext ctx;
+  fillContext(ctx, 10);
+
+  MessageFilter filter;
+  filter.sender_runtime_id = 2;
+  ASSERT_EQUAL_MSG(ctx.findMessages(filter).size(), 3u, "Wrong number of messages before add!");
+
+  ctx.addMessage(Message(10, Message::DB_NO_ID, 0, Chat::DB_NO_ID, 2, User::DB_NO_ID, Message::MEDIA_NO_ID,
+      Media::DB_NO_ID, 1000, "new"));
+
+  vector<size_t> result = ctx.findMessages(filter);
+  ASSERT_EQUAL_MSG(result.size(), 4u, "Added message not found!");
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(10), result.back());
+}
+
+void MessageIndexTest::fillContext(ChatContext &ctx, int64_t count)
+{
+  for (int64_t i = 0; i < count; i++)
+  {
+    int64_t media_runtime_id = (i % 10 == 0) ? i / 10 : Message::MEDIA_NO_ID;
+    ctx.addMessage(Message(i, Message::DB_NO_ID, 0, Chat::DB_NO_ID, i % 3, User::DB_NO_ID, media_runtime_id,
+        Media::DB_NO_ID, 100 + i, "text " + to_string(i)));
+  }
+}
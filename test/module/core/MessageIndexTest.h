@@ -0,0 +1,49 @@
+#ifndef MESSAGEINDEX_TEST_H
+#define MESSAGEINDEX_TEST_H
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+// project
+#include "chatstorage/ChatContext.h"
+
+// system
+#include <string.h>
+#include <cstdio>
+
+class MessageIndexTest: public CPPUNIT_NS::TestFixture
+{
+CPPUNIT_TEST_SUITE(MessageIndexTest);
+
+  CPPUNIT_TEST(test_posting_list_seek);
+  CPPUNIT_TEST(test_filter_sender);
+  CPPUNIT_TEST(test_filter_sender_time_media);
+  CPPUNIT_TEST(test_incremental_add);
+
+  CPPUNIT_TEST_SUITE_END()
+  ;
+
+public:
+  void setUp();
+  void tearDown();
+
+protected:
+  void test_posting_list_seek();
+
+  void test_filter_sender();
+
+  void test_filter_sender_time_media();
+
+  /**
+   * addMessage() after the first query has to update the existing index
+   */
+  void test_incremental_add();
+
+private:
+  /**
+   * Fills the context with 1000 messages: sender = index % 3, timestamp = 100 + index, every 10th has a Media
+   */
+  void fillContext(ChatContext &ctx, int64_t count);
+};
+
+#endif // MESSAGEINDEX_TEST_H
@@ -0,0 +1,202 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+// project
+#include "ChatSnapshotFileTest.h"
+#include "chatstorage/ChatStorage.h"
+#include "database/ChatSnapshotFile.h"
+#include "../TestHelpers.h"
+
+// system
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+CPPUNIT_TEST_SUITE_REGISTRATION(ChatSnapshotFileTest);
+
+void ChatSnapshotFileTest::setUp()
+{
+  mBasePath = fs::temp_directory_path() / "ChatSnapshotFileTest";
+  fs::remove_all(mBasePath);
+  fs::create_directories(mBasePath);
+}
+
+void ChatSnapshotFileTest::tearDown()
+{
+  fs::remove_all(mBasePath);
+}
+
+void ChatSnapshotFileTest::test_round_trip()
+{
+  unique_ptr<ChatContext> ctx = createContext();
+  fs::path snapshot_file = mBasePath / "42.snap";
+
+  CPPUNIT_ASSERT(ChatSnapshotFile::write(*ctx, 7, snapshot_file));
+  MappedChatPtr mapped_chat = ChatSnapshotFile::open(snapshot_file, true);
+  ASSERT_MSG(mapped_chat, "Written snapshot not opened!");
+
+  CPPUNIT_ASSERT_EQUAL(int64_t(42), mapped_chat->getChatDatabaseId());
+  CPPUNIT_ASSERT_EQUAL(int64_t(7), mapped_chat->getGeneration());
+  CPPUNIT_ASSERT_EQUAL(ctx->getChat()->getName(), string(mapped_chat->getName()));
+  CPPUNIT_ASSERT(ctx->getChat()->getSource() == mapped_chat->getSource());
+  CPPUNIT_ASSERT(mapped_chat->verifyChecksum());
+
+  const vector<User> &users = ctx->getUserList();
+  CPPUNIT_ASSERT_EQUAL(users.size(), mapped_chat->getUserCount());
+  for (size_t i = 0; i < users.size(); i++)
+  {
+    CPPUNIT_ASSERT_EQUAL(users[i].getDatabaseId(), mapped_chat->getUserDatabaseId(i));
+    CPPUNIT_ASSERT_EQUAL(users[i].getName(), string(mapped_chat->getUserName(i)));
+    CPPUNIT_ASSERT_EQUAL(users[i].isSystem(), mapped_chat->isSystemUser(i));
+  }
+
+  const vector<Media> &media_list = ctx->getMediaList();
+  CPPUNIT_ASSERT_EQUAL(media_list.size(), mapped_chat->getMediaCount());
+  for (size_t i = 0; i < media_list.size(); i++)
+  {
+    CPPUNIT_ASSERT_EQUAL(media_list[i].getDatabaseId(), mapped_chat->getMediaDatabaseId(i));
+    CPPUNIT_ASSERT(media_list[i].getType() == mapped_chat->getMediaType(i));
+    CPPUNIT_ASSERT_EQUAL(media_list[i].getMediaSize(), mapped_chat->getMediaSize(i));
+    CPPUNIT_ASSERT_EQUAL(media_list[i].getMimeType(), string(mapped_chat->getMediaMimeType(i)));
+  }
+
+  const vector<Message> &messages = ctx->getMessageList();
+  CPPUNIT_ASSERT_EQUAL(messages.size(), mapped_chat->getMessageCount());
+  for (size_t i = 0; i < messages.size(); i++)
+  {
+    CPPUNIT_ASSERT_EQUAL(messages[i].getDatabaseId(), mapped_chat->getMessageDatabaseId(i));
+    CPPUNIT_ASSERT_EQUAL(messages[i].getTimestamp(), mapped_chat->getMessageTimestamp(i));
+    CPPUNIT_ASSERT_EQUAL(messages[i].getSenderRuntimeId(), mapped_chat->getMessageSenderRuntimeId(i));
+    CPPUNIT_ASSERT_EQUAL(messages[i].getMediaRuntimeId(), mapped_chat->getMessageMediaRuntimeId(i));
+    CPPUNIT_ASSERT_EQUAL(messages[i].getText(), string(mapped_chat->getMessageText(i)));
+  }
+
+  // the decoded context has the same content
+  unique_ptr<ChatContext> decoded_ctx = mapped_chat->toChatContext();
+  CPPUNIT_ASSERT_EQUAL(messages.size(), decoded_ctx->getMessageList().size());
+  CPPUNIT_ASSERT_EQUAL(messages.back().getText(), decoded_ctx->getMessageList().back().getText());
+  CPPUNIT_ASSERT_EQUAL(users.back().getName(), decoded_ctx->getUserList().back().getName());
+  CPPUNIT_ASSERT_EQUAL(media_list.back().getMimeType(), decoded_ctx->getMediaList().back().getMimeType());
+
+  ASSERT_MSG(!ChatSnapshotFile::open(mBasePath / "missing.snap"), "Missing snapshot opened!");
+}
+
+void ChatSnapshotFileTest::test_corrupt_payload()
+{
+  unique_ptr<ChatContext> ctx = createContext();
+  fs::path snapshot_file = mBasePath / "42.snap";
+  CPPUNIT_ASSERT(ChatSnapshotFile::write(*ctx, 7, snapshot_file));
+
+  // the last byte is in the text section
+  flipByte(snapshot_file, fs::file_size(snapshot_file) - 1);
+
+  MappedChatPtr mapped_chat = ChatSnapshotFile::open(snapshot_file);
+  ASSERT_MSG(mapped_chat, "Snapshot without checksum verification not opened!");
+  ASSERT_MSG(!mapped_chat->verifyChecksum(), "Corrupt payload passed the checksum!");
+  ASSERT_MSG(!ChatSnapshotFile::open(snapshot_file, true), "Corrupt payload opened with checksum verification!");
+
+  // a header change is detected by the header checksum
+  CPPUNIT_ASSERT(ChatSnapshotFile::write(*ctx, 7, snapshot_file));
+  flipByte(snapshot_file, offsetof(ChatSnapshotFile::Header, chat_id));
+  ASSERT_MSG(!ChatSnapshotFile::open(snapshot_file), "Corrupt header opened!");
+}
+
+void ChatSnapshotFileTest::test_truncated_file()
+{
+  unique_ptr<ChatContext> ctx = createContext();
+  fs::path snapshot_file = mBasePath / "42.snap";
+  CPPUNIT_ASSERT(ChatSnapshotFile::write(*ctx, 7, snapshot_file));
+  uintmax_t file_size = fs::file_size(snapshot_file);
+
+  fs::resize_file(snapshot_file, file_size - 1);
+  ASSERT_MSG(!ChatSnapshotFile::open(snapshot_file), "Truncated payload opened!");
+
+  fs::resize_file(snapshot_file, sizeof(ChatSnapshotFile::Header) - 1);
+  ASSERT_MSG(!ChatSnapshotFile::open(snapshot_file), "Truncated header opened!");
+
+  fs::resize_file(snapshot_file, 0);
+  ASSERT_MSG(!ChatSnapshotFile::open(snapshot_file), "Empty file opened!");
+}
+
+void ChatSnapshotFileTest::test_rewrite_after_save()
+{
+  fs::path snapshot_path = mBasePath / "snapshots";
+  ChatStorageConfig config;
+  config.snapshotDirectory = snapshot_path;
+  ChatStorage storage(mBasePath / "chat.db", "", config);
+
+  auto ctx = make_unique<ChatContext>();
+  ctx->setChat(make_unique<Chat>(Chat::RT_START_ID, Chat::DB_NO_ID, "chat", ChatSource::FormatA));
+  ctx->addUser(User(0, User::DB_NO_ID, "Anna", false));
+  for (int64_t i = 0; i < 10; i++)
+  {
+    ctx->addMessage(Message(i, Message::DB_NO_ID, 0, Chat::DB_NO_ID, 0, User::DB_NO_ID, Message::MEDIA_NO_ID,
+        Media::DB_NO_ID, 100 + i, "text " + to_string(i)));
+  }
+  storage.save(*ctx);
+  int64_t chat_id = ctx->getChat()->getDatabaseId();
+
+  MappedChatPtr mapped_chat = storage.openMappedChat(chat_id);
+  ASSERT_MSG(mapped_chat, "Snapshot not written!");
+  CPPUNIT_ASSERT_EQUAL(size_t(10), mapped_chat->getMessageCount());
+  int64_t generation = mapped_chat->getGeneration();
+
+  // an unchanged chat reuses the file
+  fs::path snapshot_file;
+  for (const fs::directory_entry &entry : fs::directory_iterator(snapshot_path))
+  {
+    snapshot_file = entry.path();
+  }
+  fs::file_time_type write_time = fs::last_write_time(snapshot_file) - chrono::hours(1);
+  fs::last_write_time(snapshot_file, write_time);
+  CPPUNIT_ASSERT_EQUAL(generation, storage.openMappedChat(chat_id)->getGeneration());
+  ASSERT_MSG(fs::last_write_time(snapshot_file) == write_time, "Snapshot of an unchanged chat rewritten!");
+
+  ctx->addMessage(Message(10, Message::DB_NO_ID, 0, Chat::DB_NO_ID, 0, User::DB_NO_ID, Message::MEDIA_NO_ID,
+      Media::DB_NO_ID, 110, "appended"));
+  storage.save(*ctx);
+
+  MappedChatPtr changed_chat = storage.openMappedChat(chat_id);
+  ASSERT_MSG(changed_chat, "Snapshot not rewritten!");
+  ASSERT_MSG(changed_chat->getGeneration() > generation, "Generation not increased by the save!");
+  CPPUNIT_ASSERT_EQUAL(size_t(11), changed_chat->getMessageCount());
+  CPPUNIT_ASSERT_EQUAL(string("appended"), string(changed_chat->getMessageText(10)));
+  ASSERT_MSG(fs::last_write_time(snapshot_file) != write_time, "Snapshot file not replaced!");
+
+  // the mapping of the old file stays valid after the rename
+  CPPUNIT_ASSERT_EQUAL(size_t(10), mapped_chat->getMessageCount());
+  CPPUNIT_ASSERT_EQUAL(string("text 9"), string(mapped_chat->getMessageText(9)));
+}
+
+unique_ptr<ChatContext> ChatSnapshotFileTest::createContext()
+{
+  auto ctx = make_unique<ChatContext>();
+  ctx->setChat(make_unique<Chat>(Chat::RT_START_ID, 42, "snapshot chat", ChatSource::FormatA));
+  ctx->addUser(User(0, 10, "Anna", false));
+  ctx->addUser(User(1, 11, "System", true));
+  ctx->addMedia(Media(0, 20, MediaType::Image, 1234, "image/jpeg"));
+  ctx->addMedia(Media(1, 21, MediaType::Video, 56789, "video/mp4"));
+
+  for (int64_t i = 0; i < 100; i++)
+  {
+    int64_t media_runtime_id = (i % 10 == 0) ? (i / 10) % 2 : Message::MEDIA_NO_ID;
+    int64_t media_database_id = media_runtime_id == Message::MEDIA_NO_ID ? Media::DB_NO_ID : 20 + media_runtime_id;
+    ctx->addMessage(Message(i, 1000 + i, 0, 42, i % 2, 10 + i % 2, media_runtime_id, media_database_id, 100 + i,
+        i == 50 ? "" : "text " + to_string(i)));
+  }
+
+  return ctx;
+}
+
+void ChatSnapshotFileTest::flipByte(const fs::path &path, uintmax_t offset)
+{
+  fstream file(path, ios::in | ios::out | ios::binary);
+  file.seekg(offset);
+  char byte = static_cast<char>(file.get());
+  file.seekp(offset);
+  file.put(static_cast<char>(~byte));
+}
@@ -0,0 +1,59 @@
+#ifndef CHATSNAPSHOTFILE_TEST_H
+#define CHATSNAPSHOTFILE_TEST_H
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+// project
+#include "chatstorage/ChatContext.h"
+
+// system
+#include <filesystem>
+#include <memory>
+
+class ChatSnapshotFileTest: public CPPUNIT_NS::TestFixture
+{
+CPPUNIT_TEST_SUITE(ChatSnapshotFileTest);
+
+  CPPUNIT_TEST(test_round_trip);
+  CPPUNIT_TEST(test_corrupt_payload);
+  CPPUNIT_TEST(test_truncated_file);
+  CPPUNIT_TEST(test_rewrite_after_save);
+
+  CPPUNIT_TEST_SUITE_END()
+  ;
+
+public:
+  void setUp();
+  void tearDown();
+
+protected:
+  /**
+   * A written snapshot maps to the same chat, users, media and messages as the context it was written from.
+   */
+  void test_round_trip();
+
+  /**
+   * A changed payload byte is only detected with the checksum verification, a changed header byte always.
+   */
+  void test_corrupt_payload();
+
+  /**
+   * Files shorter than the header or than the size in the header aren't opened.
+   */
+  void test_truncated_file();
+
+  /**
+   * openMappedChat() writes a new snapshot file after a save increased the chat generation.
+   */
+  void test_rewrite_after_save();
+
+private:
+  static std::unique_ptr<ChatContext> createContext();
+
+  static void flipByte(const std::filesystem::path &path, uintmax_t offset);
+
+  std::filesystem::path mBasePath;
+};
+
+#endif // CHATSNAPSHOTFILE_TEST_H
@@ -0,0 +1,72 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+// project
+#include "MediaProbeTest.h"
+#include "importer/MediaProbe.h"
+#include "../TestHelpers.h"
+
+// system
+#include <fstream>
+
+using namespace std;
+
+CPPUNIT_TEST_SUITE_REGISTRATION(MediaProbeTest);
+
+void MediaProbeTest::setUp()
+{
+
+}
+
+void MediaProbeTest::tearDown()
+{
+
+}
+
+void MediaProbeTest::test_sniff_mime_type()
+{
+  MediaType type = MediaType::None;
+
+  const uint8_t jpeg[] = { 0xFF, 0xD8, 0xFF, 0xE0 };
+  CPPUNIT_ASSERT_EQUAL(string("image/jpeg"), MediaProbe::sniffMimeType(jpeg, sizeof(jpeg), type));
+  ASSERT_MSG(type == MediaType::Image, "JPEG isn't an image!");
+
+  const uint8_t mov[] = { 0, 0, 0, 0x14, 'f', 't', 'y', 'p', 'q', 't', ' ', ' ' };
+  CPPUNIT_ASSERT_EQUAL(string("video/quicktime"), MediaProbe::sniffMimeType(mov, sizeof(mov), type));
+  ASSERT_MSG(type == MediaType::Video, "MOV isn't a video!");
+
+  uint8_t opus[40] = { 'O', 'g', 'g', 'S' };
+  memcpy(opus + 28, "OpusHead", 8);
+  CPPUNIT_ASSERT_EQUAL(string("audio/opus"), MediaProbe::sniffMimeType(opus, sizeof(opus), type));
+  ASSERT_MSG(type == MediaType::Audio, "Opus isn't audio!");
+
+  const uint8_t text[] = { 'h', 'e', 'l', 'l', 'o' };
+  CPPUNIT_ASSERT_EQUAL(string(), MediaProbe::sniffMimeType(text, sizeof(text), type));
+  ASSERT_MSG(type == MediaType::None, "Unknown format has a type!");
+}
+
+void MediaProbeTest::test_probe_files()
+{
+  fs::path base_path = fs::temp_directory_path() / "MediaProbeTest";
+  fs::remove_all(base_path);
+  fs::create_directories(base_path);
+
+  {
+    std::ofstream webp(base_path / "IMG-1.jpg", std::ios::binary);
+    const char header[] = "RIFF\x10\x00\x00\x00WEBPVP8 ";
+    webp.write(header, sizeof(header) - 1);
+  }
+
+  vector<MediaProbe::Result> results = MediaProbe::probe(base_path, { "IMG-1.jpg", "IMG-2.jpg" }, 2);
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(2), results.size());
+
+  ASSERT_MSG(results[0].exists, "Existing file not found!");
+  CPPUNIT_ASSERT_EQUAL(static_cast<int64_t>(16), results[0].size);
+  CPPUNIT_ASSERT_EQUAL(string("image/webp"), results[0].mime_type);
+
+  ASSERT_MSG(!results[1].exists, "Missing file found!");
+  ASSERT_MSG(!results[1].error.empty(), "Missing file without error!");
+
+  fs::remove_all(base_path);
+}
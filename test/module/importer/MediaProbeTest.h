@@ -0,0 +1,34 @@
+#ifndef MEDIAPROBE_TEST_H
+#define MEDIAPROBE_TEST_H
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+// system
+#include <string.h>
+#include <cstdio>
+
+class MediaProbeTest: public CPPUNIT_NS::TestFixture
+{
+CPPUNIT_TEST_SUITE(MediaProbeTest);
+
+  CPPUNIT_TEST(test_sniff_mime_type);
+  CPPUNIT_TEST(test_probe_files);
+
+  CPPUNIT_TEST_SUITE_END()
+  ;
+
+public:
+  void setUp();
+  void tearDown();
+
+protected:
+  void test_sniff_mime_type();
+
+  /**
+   * A WebP image with .jpg extension and a missing file
+   */
+  void test_probe_files();
+};
+
+#endif // MEDIAPROBE_TEST_H
@@ -0,0 +1,159 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+// project
+#include "MergeImportTest.h"
+#include "chatstorage/ChatStorage.h"
+#include "common/platform.h"
+#include "../TestHelpers.h"
+
+// system
+#include <atomic>
+#include <fstream>
+
+using namespace std;
+
+CPPUNIT_TEST_SUITE_REGISTRATION(MergeImportTest);
+
+void MergeImportTest::setUp()
+{
+  mBasePath = fs::temp_directory_path() / "MergeImportTest";
+  fs::remove_all(mBasePath);
+  fs::create_directories(mBasePath);
+  mExportFile = mBasePath / "chat.txt";
+}
+
+void MergeImportTest::tearDown()
+{
+  fs::remove_all(mBasePath);
+}
+
+void MergeImportTest::test_reimport()
+{
+  {
+    ofstream chat(mExportFile);
+    chat << "27.10.23, 22:56 - Tom: Hello there\n"
+         << "27.10.23, 22:57 - Anna: ok\n"
+         << "27.10.23, 22:58 - Tom: bye\n";
+  }
+
+  ChatStorage storage(":memory:", "");
+  ImportConfig import_config;
+  import_config.chatName = "Family";
+
+  ImportResult first_result = storage.importFile(mExportFile, import_config);
+  ASSERT_MSG(first_result.committed, "First import failed!");
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(3), first_result.messages_new);
+  unique_ptr<ChatContext> first_ctx = storage.loadByChatId(first_result.chat_id);
+
+  ImportResult same_result = storage.importFile(mExportFile, import_config);
+  ASSERT_MSG(same_result.skipped, "Identical file parsed again!");
+  CPPUNIT_ASSERT_EQUAL(first_result.chat_id, same_result.chat_id);
+
+  {
+    ofstream chat(mExportFile, ios::app);
+    chat << "27.10.23, 22:57 - Anna: ok\n"
+         << "27.10.23, 22:59 - Anna: see you\n";
+  }
+
+  ImportResult merge_result = storage.importFile(mExportFile, import_config);
+  ASSERT_MSG(merge_result.committed && !merge_result.skipped, "Merge import failed!");
+  CPPUNIT_ASSERT_EQUAL(first_result.chat_id, merge_result.chat_id);
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(2), merge_result.messages_new);
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(3), merge_result.messages_existing);
+
+  // the refreshed messages keep their fingerprints, a later merge of the context would import them again otherwise
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(2), storage.refresh(*first_ctx));
+  for (const Message &message : first_ctx->getMessageList())
+  {
+    ASSERT_MSG(message.getFingerprint() != Message::NO_FINGERPRINT, "Message without fingerprint: " << message.getText());
+  }
+
+  unique_ptr<ChatContext> ctx = storage.loadByChatId(merge_result.chat_id);
+  const ChatContext &loaded_ctx = *ctx;
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(5), loaded_ctx.getMessageList().size());
+  ASSERT_EQUAL_MSG(loaded_ctx.getUserList().size(), 2u, "Senders of the re-export imported as new users!");
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), storage.getChatEntryList().size());
+}
+
+void MergeImportTest::test_tail_resume()
+{
+  {
+    ofstream chat(mExportFile);
+    chat << "27.10.23, 22:56 - Tom: Hello there\n"
+         << "27.10.23, 22:57 - Anna: ok\n";
+  }
+
+  ChatStorage storage(":memory:", "");
+  ImportConfig import_config;
+  import_config.chatName = "Family";
+
+  ImportResult first_result = storage.importFile(mExportFile, import_config);
+  ASSERT_MSG(first_result.committed && !first_result.resumed, "First import failed!");
+
+  {
+    // the same message again within the last minute of the first import
+    ofstream chat(mExportFile, ios::app);
+    chat << "27.10.23, 22:57 - Anna: ok\n"
+         << "27.10.23, 22:58 - Tom: bye\n";
+  }
+
+  ImportResult tail_result = storage.importFile(mExportFile, import_config);
+  ASSERT_MSG(tail_result.resumed, "Grown export parsed completely!");
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(2), tail_result.messages_new);
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(3), tail_result.import.messages_parsed);
+
+  {
+    ofstream chat(mExportFile);
+    chat << "27.10.23, 22:56 - Tom: Hello there, edited\n"
+         << "27.10.23, 22:57 - Anna: ok\n"
+         << "27.10.23, 22:57 - Anna: ok\n"
+         << "27.10.23, 22:58 - Tom: bye\n"
+         << "27.10.23, 22:59 - Anna: see you\n";
+  }
+
+  ImportResult full_result = storage.importFile(mExportFile, import_config);
+  ASSERT_MSG(!full_result.resumed, "Changed export resumed!");
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(2), full_result.messages_new);
+
+  unique_ptr<ChatContext> ctx = storage.loadByChatId(full_result.chat_id);
+  const ChatContext &loaded_ctx = *ctx;
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(6), loaded_ctx.getMessageList().size());
+}
+
+void MergeImportTest::test_follow()
+{
+  {
+    ofstream chat(mExportFile);
+    chat << "27.10.23, 22:56 - Tom: Hello there\n"
+         << "how are you?\n"
+         << "27.10.23, 22:57 - Anna: fine\n"
+         << "27.10.23, 22:58 - Tom: bye\n";
+  }
+
+  ChatStorageConfig storage_config;
+  storage_config.follow.maxLatencyMs = 0;
+  ChatStorage storage(":memory:", "", storage_config);
+  ImportConfig import_config;
+  import_config.chatName = "Family";
+
+  std::atomic<bool> stop(false);
+  FollowStats follow_stats = storage.followFile(mExportFile, import_config, stop, Chat::DB_NO_ID,
+      [&stop](const FollowStats &stats)
+      {
+        stop = stats.messages_new >= 2;
+      });
+  ASSERT_MSG(follow_stats.ok, "Follow failed!");
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(2), follow_stats.messages_new);
+
+  unique_ptr<ChatContext> ctx = storage.loadByChatId(follow_stats.chat_id);
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(2), ctx->getMessageList().size());
+  CPPUNIT_ASSERT_EQUAL(string("Hello there\nhow are you?"), ctx->getMessageList().front().getText());
+
+  // the open last message is imported behind the stored resume point
+  ImportResult merge_result = storage.importFile(mExportFile, import_config);
+  ASSERT_MSG(merge_result.resumed, "Follow didn't store the resume point!");
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), merge_result.messages_new);
+  CPPUNIT_ASSERT_EQUAL(follow_stats.chat_id, merge_result.chat_id);
+}
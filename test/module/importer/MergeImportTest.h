@@ -0,0 +1,51 @@
+#ifndef MERGEIMPORT_TEST_H
+#define MERGEIMPORT_TEST_H
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+// project
+#include "common/platform.h"
+
+// system
+#include <string.h>
+#include <cstdio>
+
+class MergeImportTest: public CPPUNIT_NS::TestFixture
+{
+CPPUNIT_TEST_SUITE(MergeImportTest);
+
+  CPPUNIT_TEST(test_reimport);
+  CPPUNIT_TEST(test_tail_resume);
+  CPPUNIT_TEST(test_follow);
+
+  CPPUNIT_TEST_SUITE_END()
+  ;
+
+public:
+  void setUp();
+  void tearDown();
+
+protected:
+  /**
+   * A byte-identical export is skipped, a longer re-export only adds its new messages (a repeated message included)
+   */
+  void test_reimport();
+
+  /**
+   * A grown export is only parsed behind the last import, a changed one completely
+   */
+  void test_tail_resume();
+
+  /**
+   * A followed file commits the complete messages; the last one could be continued and is left for the next import
+   */
+  void test_follow();
+
+private:
+  // a fresh directory for each test
+  fs::path mBasePath;
+  fs::path mExportFile;
+};
+
+#endif // MERGEIMPORT_TEST_H
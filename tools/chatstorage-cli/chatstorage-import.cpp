@@ -16,6 +16,14 @@
 #include <fstream>
 #include <memory>
 #include <map>
+#include <atomic>
+#include <csignal>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iterator>
+#include <mutex>
 
 using namespace std;
 using namespace StringUtil;
@@ -24,7 +32,7 @@ static Logger logger("ChatStorage.chatstorage-import");
 
 enum optionIndex
 {
-  UNKNOWN, HELP, VERSION, DB, BACKEND, LIST_BACKENDS, NAME, TEXT, CHAT_ID, ID, PRINT_CONTEXT, MEDIA_PATH, MAP_USER, USER_DEFAULT, INPUT_FILE
+  UNKNOWN, HELP, VERSION, DB, BACKEND, LIST_BACKENDS, NAME, TEXT, CHAT_ID, ID, PRINT_CONTEXT, MEDIA_PATH, MAP_USER, USER_DEFAULT, INPUT_FILE, MISSING_MEDIA, MEDIA_MODE, MERGE, FOLLOW, JOBS
 };
 
 fs::path option_db_path;
@@ -32,14 +40,20 @@ string option_backend;
 string option_name = "<no name>";
 string option_text;
 fs::path option_input_file;
+vector<fs::path> option_input_files;
 string option_command;
 string option_subcommand;
 fs::path option_media_path;
 int option_id = 0;
 int option_chat_id = 0;
 bool option_print_context = false;
+bool option_merge = false;
+bool option_follow = false;
+unsigned option_jobs = 0;
 vector<pair<string, int>> option_user_mapping;
 bool option_user_default_new = true;
+MissingMediaPolicy option_missing_media = MissingMediaPolicy::Keep;
+MediaIngestMode option_media_mode = MediaIngestMode::Copy;
 
 // @formatter:off
 const option::Descriptor usage[] = {
@@ -57,8 +71,14 @@ const option::Descriptor usage[] = {
     { LIST_BACKENDS, 0, "", "list-backends", option::Arg::None, "    --list-backends\t\t\tList all available import backends and exit" },
     { PRINT_CONTEXT, 0, "", "print-context", option::Arg::None, "    --print-context\t\t\tPrint the complete loaded ChatContext" },
     { MAP_USER, 0, "", "map-user", Arg::Required, "    --map-user\t\t\tMap imported user to existing user ID ('name:1' -> could be used multiple times)" },
-    { INPUT_FILE, 0, "", "input-file", Arg::Required, "    --input-file\t\t\tInput file for import parser" },
+    { INPUT_FILE, 0, "", "input-file", Arg::Required, "    --input-file\t\t\tInput file or directory of *.txt exports for import parser (could be used multiple times; several files are parsed in parallel and each one is stored as chat with the file name)" },
     { USER_DEFAULT, 0, "", "user-default", Arg::Required, "Default strategy for unmapped users (possible: auto/new; default: new)"},
+    { MISSING_MEDIA, 0, "", "missing-media", Arg::Required, "    --missing-media <policy>\t\t\tHandling of missing attachments (possible: keep/drop/fail; default: keep)" },
+    { MEDIA_MODE, 0, "", "media-mode", Arg::Required, "    --media-mode <mode>\t\t\tcopy: store the media files; reference: only record the source paths of a permanent export (default: copy)" },
+    { MERGE, 0, "", "merge", option::Arg::None, "    --merge\t\t\tMerge a re-export into the existing chat with that --name: only new messages are stored" },
+    { CHAT_ID, 0, "", "chat-id", Arg::Required, "    --chat-id <id>\t\t\tMerge into the chat with this ID (implies --merge)" },
+    { FOLLOW, 0, "", "follow", option::Arg::None, "    --follow\t\t\tKeep reading the growing --input-file (or '-' for stdin) and store new messages until interrupted (implies --merge)" },
+    { JOBS, 0, "", "jobs", Arg::Required, "    --jobs <n>\t\t\tNumber of worker threads for parsing and media copies (default: one per hardware thread)" },
     { UNKNOWN, 0, "", "", option::Arg::None,
       "\nEXAMPLES:" },
     { UNKNOWN, 0, "", "", option::Arg::None,
@@ -67,6 +87,12 @@ const option::Descriptor usage[] = {
       "\n  # DB import\nchatstorage-import --db chatstorage.db --input-file chat.txt\n" },
     { UNKNOWN, 0, "", "", option::Arg::None,
       "\n  # Search chats by name\nchatstorage-import --name 'Family' --db chatstorage.db --input-file chat.txt\n" },
+    { UNKNOWN, 0, "", "", option::Arg::None,
+      "\n  # Monthly re-export of the same chat\nchatstorage-import --merge --name 'Family' --db chatstorage.db --input-file chat.txt\n" },
+    { UNKNOWN, 0, "", "", option::Arg::None,
+      "\n  # Live import of a stream\nexport-tool | chatstorage-import --follow --name 'Family' --db chatstorage.db --input-file -\n" },
+    { UNKNOWN, 0, "", "", option::Arg::None,
+      "\n  # Nightly import of all exports of a directory\nchatstorage-import --jobs 8 --db chatstorage.db --media media --input-file exports/\n" },
     { 0, 0, 0, 0, 0, 0 } };
 // @formatter:on
 
@@ -126,6 +152,46 @@ int parse_options(int argc, const char **argv)
     }
   }
 
+  if (options[MISSING_MEDIA].count() > 0)
+  {
+    string policy = options[MISSING_MEDIA].arg;
+    if (policy == "keep")
+    {
+      option_missing_media = MissingMediaPolicy::Keep;
+    }
+    else if (policy == "drop")
+    {
+      option_missing_media = MissingMediaPolicy::Drop;
+    }
+    else if (policy == "fail")
+    {
+      option_missing_media = MissingMediaPolicy::Fail;
+    }
+    else
+    {
+      cerr << "Unknown missing media policy: " << policy << endl;
+      exit(1);
+    }
+  }
+
+  if (options[MEDIA_MODE].count() > 0)
+  {
+    string mode = options[MEDIA_MODE].arg;
+    if (mode == "copy")
+    {
+      option_media_mode = MediaIngestMode::Copy;
+    }
+    else if (mode == "reference")
+    {
+      option_media_mode = MediaIngestMode::Reference;
+    }
+    else
+    {
+      cerr << "Unknown media mode: " << mode << endl;
+      exit(1);
+    }
+  }
+
   if (options[LIST_BACKENDS])
   {
     cerr << "TODO: only one backend supported at the moment" << endl;
@@ -142,14 +208,35 @@ int parse_options(int argc, const char **argv)
     option_text = options[TEXT].arg;
   }
 
-  if (options[INPUT_FILE].count() > 0)
+  for (option::Option *opt = options[INPUT_FILE]; opt; opt = opt->next())
+  {
+    option_input_files.emplace_back(opt->arg);
+  }
+  if (!option_input_files.empty())
   {
-    option_input_file = options[INPUT_FILE].arg;
+    option_input_file = option_input_files.front();
+  }
+
+  if (options[JOBS].count() > 0)
+  {
+    option_jobs = static_cast<unsigned>(std::max(0, atoi(options[JOBS].arg)));
   }
 
   if (options[CHAT_ID].count() > 0)
   {
     option_chat_id = atoi(options[CHAT_ID].arg);
+    option_merge = true;
+  }
+
+  if (options[MERGE])
+  {
+    option_merge = true;
+  }
+
+  if (options[FOLLOW])
+  {
+    option_follow = true;
+    option_merge = true;
   }
 
   if (options[ID].count() > 0)
@@ -192,6 +279,244 @@ int parse_options(int argc, const char **argv)
   return 0;
 }
 
+static std::atomic<bool> follow_stop(false);
+
+extern "C" void stopFollow(int)
+{
+  follow_stop = true;
+}
+
+int followInput(ChatStorage &chat_storage, const ImportConfig &import_config)
+{
+  std::signal(SIGINT, stopFollow);
+  std::signal(SIGTERM, stopFollow);
+
+  FollowStats follow_stats = chat_storage.followFile(option_input_file, import_config, follow_stop,
+      option_chat_id > 0 ? option_chat_id : Chat::DB_NO_ID, [](const FollowStats &stats)
+      {
+        cout << "Chat " << stats.chat_id << ": " << stats.messages_new << " new messages, " << stats.messages_existing
+            << " yet stored (" << stats.batches << " commits, " << stats.bytes_read << " bytes read)" << endl;
+      });
+
+  for (const auto &missing : follow_stats.missing_media)
+  {
+    cerr << "Media file missing: " << missing << endl;
+  }
+  for (const auto &failure : follow_stats.media_failures)
+  {
+    cerr << "Media import failed: " << failure.source << " -> " << failure.destination << ": " << failure.error
+        << " (" << failure.attempts << " attempts)" << endl;
+  }
+
+  if (!follow_stats.ok)
+  {
+    cerr << "Import failed: " << option_input_file << endl;
+    return 1;
+  }
+
+  return follow_stats.media_failures.empty() ? 0 : 1;
+}
+
+/**
+ * A directory is replaced by its *.txt files in name order.
+ */
+vector<fs::path> expandInputFiles(const vector<fs::path> &input_paths)
+{
+  vector<fs::path> files;
+  for (const auto &input_path : input_paths)
+  {
+    std::error_code ec;
+    if (!fs::is_directory(input_path, ec))
+    {
+      files.push_back(input_path);
+      continue;
+    }
+
+    vector<fs::path> dir_files;
+    for (fs::directory_iterator it(input_path, ec), end; !ec && it != end; it.increment(ec))
+    {
+      if (it->is_regular_file(ec) && it->path().extension() == ".txt")
+      {
+        dir_files.push_back(it->path());
+      }
+    }
+    std::sort(dir_files.begin(), dir_files.end());
+    files.insert(files.end(), dir_files.begin(), dir_files.end());
+  }
+
+  return files;
+}
+
+/**
+ * Parses the files in parallel on the executor of the storage. The parsed contexts are saved by this thread in the
+ * order they are finished, so all writes go through the single writer connection. The files that are finished while
+ * a save runs are stored together by the next saveAll(). Only a few more files than workers are parsed ahead of the
+ * saves to bound the memory.
+ */
+int importFiles(ChatStorage &chat_storage, const vector<fs::path> &files, const ImportConfig &import_config)
+{
+  struct ParsedFile
+  {
+    size_t index = 0;
+    unique_ptr<ChatContext> ctx;
+    ImportReport report;
+    bool ok = false;
+  };
+
+  auto start_time = std::chrono::steady_clock::now();
+
+  Executor &executor = chat_storage.getExecutor();
+  const size_t max_in_flight = 2 * static_cast<size_t>(executor.getThreadCount());
+
+  std::mutex parsed_mutex;
+  std::condition_variable parsed_cv;
+  std::deque<ParsedFile> parsed_files;
+  size_t next_file = 0;
+  size_t in_flight = 0;
+
+  Executor::TaskGroup parse_group(executor);
+  auto parseNext = [&]()
+  {
+    size_t index = next_file++;
+    in_flight++;
+    parse_group.run([&, index]()
+    {
+      ImportConfig file_import_config = import_config;
+      file_import_config.chatName = files[index].stem().string();
+
+      ParsedFile parsed_file;
+      parsed_file.index = index;
+      parsed_file.ctx = std::make_unique<ChatContext>();
+      try
+      {
+        parsed_file.ok = ChatStorageImporter::importFromFile(files[index].string(), file_import_config,
+            *parsed_file.ctx, parsed_file.report);
+      }
+      catch (const std::exception &e)
+      {
+        // this thread waits for each file -> the failure has to be delivered
+        cerr << "Parse error: " << files[index] << ": " << e.what() << endl;
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(parsed_mutex);
+        parsed_files.push_back(std::move(parsed_file));
+      }
+      parsed_cv.notify_one();
+    });
+  };
+
+  while (next_file < files.size() && in_flight < max_in_flight)
+  {
+    parseNext();
+  }
+
+  size_t files_failed = 0;
+  bool media_failed = false;
+  size_t messages = 0;
+  uintmax_t input_bytes = 0;
+  MediaIngestStats media_stats;
+
+  while (in_flight > 0)
+  {
+    // all files that are parsed in the meantime are saved together
+    std::vector<ParsedFile> ready_files;
+    {
+      std::unique_lock<std::mutex> lock(parsed_mutex);
+      parsed_cv.wait(lock, [&parsed_files]()
+      {
+        return !parsed_files.empty();
+      });
+      std::move(parsed_files.begin(), parsed_files.end(), std::back_inserter(ready_files));
+      parsed_files.clear();
+    }
+    in_flight -= ready_files.size();
+
+    // the next files are parsed while these are saved
+    while (next_file < files.size() && in_flight < max_in_flight)
+    {
+      parseNext();
+    }
+
+    // saveAll() resolves the attachments of all contexts against one directory
+    std::map<fs::path, std::vector<ParsedFile*>> save_groups;
+    for (auto &parsed_file : ready_files)
+    {
+      const fs::path &file = files[parsed_file.index];
+      for (const auto &missing : parsed_file.report.missing_media)
+      {
+        cerr << "Media file missing: " << missing << endl;
+      }
+
+      if (!parsed_file.ok)
+      {
+        cerr << "Import failed: " << file << endl;
+        files_failed++;
+        continue;
+      }
+      save_groups[file.parent_path()].push_back(&parsed_file);
+    }
+
+    for (const auto &save_group : save_groups)
+    {
+      std::vector<ChatContext*> contexts;
+      for (ParsedFile *parsed_file : save_group.second)
+      {
+        contexts.push_back(parsed_file->ctx.get());
+      }
+
+      SaveAllReport save_report = chat_storage.saveAll(contexts, save_group.first);
+
+      for (const auto &failure : save_report.media_failures)
+      {
+        cerr << "Media import failed: " << failure.source << " -> " << failure.destination << ": " << failure.error
+            << " (" << failure.attempts << " attempts)" << endl;
+      }
+      if (!save_report.media_failures.empty())
+      {
+        media_failed = true;
+      }
+
+      // a failed context is rolled back alone, the other files of the group are stored
+      for (size_t i = 0; i < save_group.second.size(); i++)
+      {
+        ParsedFile *parsed_file = save_group.second[i];
+        const fs::path &file = files[parsed_file->index];
+        if (!save_report.contexts[i].committed)
+        {
+          cerr << "Import failed: " << file << endl;
+          files_failed++;
+          continue;
+        }
+
+        size_t file_messages = parsed_file->ctx->getMessageList().size();
+        cout << "Chat " << parsed_file->ctx->getChat()->getDatabaseId() << ": " << file_messages << " messages from "
+            << file << endl;
+
+        std::error_code ec;
+        uintmax_t file_size = fs::file_size(file, ec);
+        input_bytes += ec ? 0 : file_size;
+        messages += file_messages;
+      }
+      media_stats.actions += save_report.media.actions;
+      media_stats.succeeded += save_report.media.succeeded;
+      media_stats.bytes += save_report.media.bytes;
+      media_stats.deduplicated += save_report.media.deduplicated;
+    }
+  }
+  parse_group.wait();
+
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+  double rate_seconds = std::max(seconds, 0.001);
+  cout << "Imported " << files.size() - files_failed << "/" << files.size() << " files with " << executor.getThreadCount()
+      << " workers in " << seconds << " s: " << messages << " messages (" << static_cast<uint64_t>(messages / rate_seconds)
+      << " messages/s), " << input_bytes << " bytes (" << input_bytes / rate_seconds / (1024 * 1024) << " MiB/s), media: "
+      << media_stats.succeeded << "/" << media_stats.actions << " files, " << media_stats.bytes << " bytes, yet stored: "
+      << media_stats.deduplicated << endl;
+
+  return files_failed == 0 && !media_failed ? 0 : 1;
+}
+
 std::string unixToLocalIso(int64_t unix_seconds)
 {
   std::time_t t = static_cast<std::time_t>(unix_seconds);
@@ -292,12 +617,128 @@ int main(int argc, const char **argv)
 
   parse_options(argc, argv);
 
-  ChatStorage chat_storage(option_db_path, option_media_path);
+  // one pool for parsing, media probe and media copies -> the probe of a file runs on the same workers
+  auto executor = std::make_shared<Executor>(option_jobs);
+
+  ChatStorageConfig storage_config;
+  storage_config.mediaIngest.mode = option_media_mode;
+  storage_config.executor = executor;
+  ChatStorage chat_storage(option_db_path, option_media_path, storage_config);
+
+  ImportConfig import_config {option_name, ChatSource::FormatA, option_user_mapping };
+  import_config.missingMedia = option_missing_media;
+  import_config.executor = executor;
+
+  if (option_follow)
+  {
+    return followInput(chat_storage, import_config);
+  }
+
+  vector<fs::path> input_files = expandInputFiles(option_input_files);
+  bool several_files = input_files.size() > 1 || (!option_input_files.empty() && fs::is_directory(option_input_file));
+
+  if (option_merge && several_files)
+  {
+    // a merge reads the chat of the file first, the files are merged one after the other
+    int result = 0;
+    for (const auto &file : input_files)
+    {
+      ImportConfig file_import_config = import_config;
+      file_import_config.chatName = file.stem().string();
+      ImportResult import_result = chat_storage.importFile(file, file_import_config);
+
+      for (const auto &missing : import_result.import.missing_media)
+      {
+        cerr << "Media file missing: " << missing << endl;
+      }
+      if (!import_result.committed || !import_result.save.media_failures.empty())
+      {
+        cerr << "Import failed: " << file << endl;
+        result = 1;
+        continue;
+      }
+      cout << "Chat " << import_result.chat_id << ": " << import_result.messages_new << " new messages from " << file
+          << endl;
+    }
+    return result;
+  }
+
+  if (several_files)
+  {
+    return importFiles(chat_storage, input_files, import_config);
+  }
+
+  if (option_merge)
+  {
+    ImportResult import_result = chat_storage.importFile(option_input_file, import_config,
+        option_chat_id > 0 ? option_chat_id : Chat::DB_NO_ID);
+
+    for (const auto &missing : import_result.import.missing_media)
+    {
+      cerr << "Media file missing: " << missing << endl;
+    }
+    for (const auto &failure : import_result.save.media_failures)
+    {
+      cerr << "Media import failed: " << failure.source << " -> " << failure.destination << ": " << failure.error
+          << " (" << failure.attempts << " attempts)" << endl;
+    }
+
+    if (!import_result.committed)
+    {
+      cerr << "Import failed: " << option_input_file << endl;
+      return 1;
+    }
+
+    if (import_result.skipped)
+    {
+      cout << "Chat " << import_result.chat_id << ": file yet imported" << endl;
+    }
+    else
+    {
+      cout << "Chat " << import_result.chat_id << ": " << import_result.messages_new << " new messages, "
+          << import_result.messages_existing << " yet stored";
+      if (import_result.resumed)
+      {
+        cout << " (parsed from byte " << import_result.resume_offset << ")";
+      }
+      cout << endl;
+    }
+
+    return import_result.save.media_failures.empty() ? 0 : 1;
+  }
 
   ChatContext import_chat_context;
-  ChatStorageImporter::importFromFile(option_input_file, ImportConfig {option_name, ChatSource::FormatA, option_user_mapping }, import_chat_context);
+  ImportReport import_report;
+  bool import_ok = ChatStorageImporter::importFromFile(option_input_file, import_config, import_chat_context, import_report);
+
+  for (const auto &missing : import_report.missing_media)
+  {
+    cerr << "Media file missing: " << missing << endl;
+  }
+
+  if (!import_ok)
+  {
+    cerr << "Import failed: " << option_input_file << endl;
+    return 1;
+  }
+
+  SaveReport save_report = chat_storage.save(import_chat_context, option_input_file.parent_path());
+
+  for (const auto &failure : save_report.media_failures)
+  {
+    cerr << "Media import failed: " << failure.source << " -> " << failure.destination << ": " << failure.error
+        << " (" << failure.attempts << " attempts)" << endl;
+  }
 
-  chat_storage.save(import_chat_context, option_input_file.parent_path());
+  const MediaIngestStats &media_stats = save_report.media;
+  if (media_stats.actions > 0 || media_stats.deduplicated > 0)
+  {
+    cout << "Media: " << media_stats.succeeded << "/" << media_stats.actions << " files, " << media_stats.bytes
+        << " bytes in " << media_stats.seconds << " s (reflink: " << media_stats.reflinked << ", hardlink: "
+        << media_stats.hardlinked << ", copy_file_range: " << media_stats.kernel_copied << ", copy: "
+        << media_stats.copied << ", referenced: " << media_stats.referenced << ", yet stored: " << media_stats.deduplicated
+        << ")" << endl;
+  }
 
   if (option_print_context)
   {
@@ -306,5 +747,5 @@ int main(int argc, const char **argv)
 
   //option::printUsage(std::cout, usage);
 
-  return 0;
+  return save_report.committed && save_report.media_failures.empty() ? 0 : 1;
 }
@@ -0,0 +1,250 @@
+// project public API
+#include "chatstorage/ChatStorage.h"
+
+// project internal
+#include "common/Logger.h"
+#include "common/optparser.h"
+#include "common/FileUtil.h"
+#include "common/StringUtil.h"
+
+// system
+#include <iostream>
+#include <memory>
+
+using namespace std;
+using namespace StringUtil;
+
+static Logger logger("ChatStorage.chatstorage-media");
+
+enum optionIndex
+{
+  UNKNOWN, HELP, VERSION, DB, MEDIA, LAYOUT, DELETE, RATE, GRACE
+};
+
+fs::path option_db_path;
+fs::path option_media_path;
+string option_command;
+string option_layout = "sharded";
+bool option_delete = false;
+double option_rate = 0.0;
+int64_t option_grace = 3600;
+
+// @formatter:off
+const option::Descriptor usage[] = {
+    { UNKNOWN, 0, "", "", option::Arg::None,
+      "USAGE: chatstorage-media [OPTIONS] <command>\n\n"
+      "COMMANDS:\n"
+      "  dedup \t\t\tHash all media files from before content hashing and remove duplicates\n"
+      "  migrate-layout \t\t\tMove all media files into the layout given by --layout\n"
+      "  compact \t\t\tRewrite media pack segments with more than 50% deleted media\n"
+      "  gc \t\t\tReport media files without database entry and entries without file (--delete removes the files)\n\n"
+      "OPTIONS:" },
+    { DB, 0, "", "db", Arg::Required, "  --db <path> \t\t\tPath to database" },
+    { MEDIA, 0, "", "media", Arg::Required, "  --media <path> \t\t\tPath to media persistence directory" },
+    { LAYOUT, 0, "", "layout", Arg::Required, "  --layout <flat|sharded> \t\t\tTarget layout for migrate-layout (default: sharded)" },
+    { DELETE, 0, "", "delete", option::Arg::None, "  --delete \t\t\tgc: delete the orphaned files (default: only report)" },
+    { RATE, 0, "", "rate", Arg::Required, "  --rate <n> \t\t\tgc: delete at most n files per second (default: no limit)" },
+    { GRACE, 0, "", "grace", Arg::Required, "  --grace <seconds> \t\t\tgc: keep orphaned files younger than this (default: 3600)" },
+    { HELP, 0, "h", "help", option::Arg::None, "  --help, -h\t\t\tShow this help and exit" },
+    { VERSION, 0, "", "version", option::Arg::None, "  --version\t\t\tShow program version and exit" },
+    { UNKNOWN, 0, "", "", option::Arg::None,
+          "\nEXAMPLES:" },
+    { UNKNOWN, 0, "", "", option::Arg::None,
+      "\n  # Remove duplicate media files\nchatstorage-media --db chatstorage.db --media media dedup" },
+    { UNKNOWN, 0, "", "", option::Arg::None,
+      "\n  # Move a flat media directory into the sharded layout\nchatstorage-media --db chatstorage.db --media media --layout sharded migrate-layout" },
+    { UNKNOWN, 0, "", "", option::Arg::None,
+      "\n  # Delete orphaned media files with at most 100 deletes per second\nchatstorage-media --db chatstorage.db --media media --delete --rate 100 gc" },
+    { 0, 0, 0, 0, 0, 0 } };
+// @formatter:on
+
+int parse_options(int argc, const char **argv)
+{
+  argc -= (argc > 0);
+  argv += (argc > 0); // skip program name argv[0] if present
+  option::Stats stats(usage, argc, argv);
+  std::unique_ptr<option::Option[]> options(new option::Option[stats.options_max]), buffer(new option::Option[stats.buffer_max]);
+  option::Parser parse(usage, argc, argv, options.get(), buffer.get());
+
+  if (argc == 0)
+  {
+    option::printUsage(std::cout, usage);
+    exit(0);
+  }
+
+  if (parse.error())
+    exit(0);
+
+  if (options[HELP])
+  {
+    option::printUsage(std::cout, usage);
+    exit(0);
+  }
+
+  if (options[VERSION])
+  {
+    cout << "TODO: display version" << endl;
+    exit(0);
+  }
+
+  if (options[DB].count() > 0)
+  {
+    option_db_path = std::filesystem::path(options[DB].arg);
+  }
+
+  if (options[MEDIA].count() > 0)
+  {
+    option_media_path = std::filesystem::path(options[MEDIA].arg);
+  }
+
+  if (options[LAYOUT].count() > 0)
+  {
+    option_layout = options[LAYOUT].arg;
+  }
+
+  if (options[DELETE])
+  {
+    option_delete = true;
+  }
+
+  if (options[RATE].count() > 0)
+  {
+    option_rate = atof(options[RATE].arg);
+  }
+
+  if (options[GRACE].count() > 0)
+  {
+    option_grace = atoll(options[GRACE].arg);
+  }
+
+  // parse options
+  for (option::Option *opt = options[UNKNOWN]; opt; opt = opt->next())
+    std::cout << "Unknown option: " << opt->name << "\n";
+
+  // parse commands
+  for (int i = 0; i < parse.nonOptionsCount(); ++i)
+  {
+    switch (i)
+    {
+      case 0:
+        option_command = parse.nonOption(i);
+        break;
+      default:
+        break;
+    }
+  }
+
+  if (option_db_path.empty() || option_media_path.empty())
+  {
+    cerr << "--db and --media are required" << endl;
+    exit(1);
+  }
+
+  return 0;
+}
+
+int main(int argc, const char **argv)
+{
+#ifdef HAVE_LOG4CXX
+  const std::string LOG4CXX_PROPERTIES = "logging.prop";
+  if (fs::exists(LOG4CXX_PROPERTIES))
+  {
+    log4cxx::PropertyConfigurator::configure(LOG4CXX_PROPERTIES);
+  }
+  else
+  {
+    logger.off();
+  }
+#endif // HAVE_LOG4CXX
+
+  parse_options(argc, argv);
+
+  ChatStorage chat_storage(option_db_path, option_media_path);
+
+  if (option_command == "dedup")
+  {
+    MediaDedupStats stats = chat_storage.deduplicateMedia();
+
+    printKV("scanned:", stats.scanned);
+    printKV("unique:", stats.hashed);
+    printKV("duplicates removed:", stats.duplicates);
+    printKV("missing files:", stats.missing);
+    printKV("bytes freed:", stats.bytes_freed);
+  }
+  else if (option_command == "migrate-layout")
+  {
+    MediaLayout target_layout;
+    if (option_layout == "flat")
+    {
+      target_layout = MediaLayout::Flat;
+    }
+    else if (option_layout == "sharded")
+    {
+      target_layout = MediaLayout::Sharded;
+    }
+    else
+    {
+      cerr << "Unknown layout: '" << option_layout << "'" << endl;
+      return 1;
+    }
+
+    MediaLayoutMigrationStats stats = chat_storage.migrateMediaLayout(target_layout);
+
+    printKV("files:", stats.files);
+    printKV("moved:", stats.moved);
+    printKV("missing:", stats.missing);
+    printKV("failed:", stats.failed);
+    printKV("seconds:", stats.seconds);
+
+    if (stats.failed > 0)
+    {
+      return 1;
+    }
+  }
+  else if (option_command == "compact")
+  {
+    MediaPackCompactionStats stats = chat_storage.compactMediaPacks();
+
+    printKV("segments:", stats.segments);
+    printKV("compacted:", stats.compacted);
+    printKV("removed:", stats.removed);
+    printKV("bytes moved:", stats.bytes_moved);
+    printKV("bytes freed:", stats.bytes_freed);
+  }
+  else if (option_command == "gc")
+  {
+    MediaGcConfig gc_config;
+    gc_config.dryRun = !option_delete;
+    gc_config.maxDeletesPerSecond = option_rate;
+    gc_config.gracePeriodSeconds = option_grace;
+
+    MediaGcStats stats = chat_storage.collectMediaGarbage(gc_config);
+
+    for (const auto &path : stats.orphan_paths)
+    {
+      cout << "orphan: " << path.string() << endl;
+    }
+    for (int64_t media_id : stats.missing_media_ids)
+    {
+      cout << "missing: media_id " << media_id << endl;
+    }
+
+    printKV("files scanned:", stats.files_scanned);
+    printKV("rows scanned:", stats.rows_scanned);
+    printKV("orphaned files:", stats.orphan_files);
+    printKV("orphaned bytes:", stats.orphan_bytes);
+    printKV("in grace period:", stats.recent_files);
+    printKV("deleted files:", stats.deleted_files);
+    printKV("bytes freed:", stats.bytes_freed);
+    printKV("missing files:", stats.missing_files);
+    printKV("seconds:", stats.seconds);
+  }
+  else
+  {
+    cerr << "Unknown command: '" << option_command << "'" << endl;
+    option::printUsage(std::cerr, usage);
+    return 1;
+  }
+
+  return 0;
+}